@@ -32,6 +32,7 @@ pub fn build(b: *std.Build) void {
             "src/platform/win32/win32_ui.c",
             "src/platform/win32/win_http.c",
             "src/platform/win32/win_secret.c",
+            "src/platform/win32/win_mmap.c",
         },
         .flags = &.{"-Iinc"},
     });
@@ -44,12 +45,52 @@ pub fn build(b: *std.Build) void {
     exe.linkSystemLibrary("crypt32"); // DPAPI (CryptProtectData)
     // exe.linkSystemLibrary("kernel32"); // Not required explicitly here
 
+    // Vectorized text kernels (CRLF, JSON escaping, UTF-8 validation),
+    // shared by the app and the openai module
+    const text_kernels_mod = b.addModule("text_kernels", .{
+        .root_source_file = b.path("src/util/text_kernels.zig"),
+        .target = target,
+        .optimize = optimize,
+    });
+    exe.root_module.addImport("text_kernels", text_kernels_mod);
+
+    // Span tracing registry (Chrome trace / JSONL export), shared by the
+    // app, the openai module and the batch runner
+    const trace_mod = b.addModule("trace", .{
+        .root_source_file = b.path("src/util/trace.zig"),
+        .target = target,
+        .optimize = optimize,
+    });
+    exe.root_module.addImport("trace", trace_mod);
+
+    // Deadlines and cancellation (one process-wide watchdog), shared by the
+    // app's HTTP adapter and the openai module
+    const deadline_mod = b.addModule("deadline", .{
+        .root_source_file = b.path("src/util/deadline.zig"),
+        .target = target,
+        .optimize = optimize,
+    });
+    exe.root_module.addImport("deadline", deadline_mod);
+
+    // Event-driven HTTP/1.1 transport (epoll / io_uring, Linux), used by
+    // the openai module's evented helpers and the benchmarks
+    const event_http_mod = b.addModule("event_http", .{
+        .root_source_file = b.path("src/platform/event_http.zig"),
+        .target = target,
+        .optimize = optimize,
+    });
+    event_http_mod.addImport("trace", trace_mod);
+
     // Optional named Zig modules to make future imports cleaner
     const openai_mod = b.addModule("openai", .{
         .root_source_file = b.path("src/openai/mod.zig"),
         .target = target,
         .optimize = optimize,
     });
+    openai_mod.addImport("text_kernels", text_kernels_mod);
+    openai_mod.addImport("trace", trace_mod);
+    openai_mod.addImport("event_http", event_http_mod);
+    openai_mod.addImport("deadline", deadline_mod);
     exe.root_module.addImport("openai", openai_mod);
 
     // Build as a GUI subsystem app so no console is attached
@@ -62,4 +103,116 @@ pub fn build(b: *std.Build) void {
     const run_exe = b.addRunArtifact(exe);
     const run_step = b.step("run", "Run the application");
     run_step.dependOn(&run_exe.step);
+
+    // `zig build bench` — portable microbenchmarks (no Win32 code involved,
+    // so it runs on the host, e.g. Linux). Use -Doptimize=ReleaseFast.
+    const bench_exe = b.addExecutable(.{
+        .name = "ohmyzig-bench",
+        .root_module = b.createModule(.{
+            .root_source_file = b.path("src/bench.zig"),
+            .target = target,
+            .optimize = optimize,
+        }),
+    });
+    bench_exe.root_module.addImport("openai", openai_mod);
+    bench_exe.root_module.addImport("text_kernels", text_kernels_mod);
+    bench_exe.root_module.addImport("trace", trace_mod);
+    bench_exe.root_module.addImport("event_http", event_http_mod);
+    const run_bench = b.addRunArtifact(bench_exe);
+    if (b.args) |args| run_bench.addArgs(args);
+    const bench_step = b.step("bench", "Run microbenchmarks");
+    bench_step.dependOn(&run_bench.step);
+
+    // `zig build batch -- --in prompts.jsonl --out results.jsonl` — headless
+    // JSONL batch runner for chat completions. Portable like the benchmarks,
+    // so it builds and runs on Linux; the binary is also installed.
+    const batch_exe = b.addExecutable(.{
+        .name = "ohmyzig-batch",
+        .root_module = b.createModule(.{
+            .root_source_file = b.path("src/batch.zig"),
+            .target = target,
+            .optimize = optimize,
+        }),
+    });
+    batch_exe.root_module.addImport("openai", openai_mod);
+    batch_exe.root_module.addImport("trace", trace_mod);
+    const install_batch = b.addInstallArtifact(batch_exe, .{});
+    const run_batch = b.addRunArtifact(batch_exe);
+    if (b.args) |args| run_batch.addArgs(args);
+    const batch_step = b.step("batch", "Run the headless JSONL batch runner");
+    batch_step.dependOn(&install_batch.step);
+    batch_step.dependOn(&run_batch.step);
+
+    // `zig build mock -- --port 8080 --latency exp:20` — local mock of the
+    // OpenAI endpoints (models, chat plain/SSE, embeddings) with injected
+    // latency, 500s and 429s. Standard library only.
+    const mock_mod = b.createModule(.{
+        .root_source_file = b.path("src/mock_server.zig"),
+        .target = target,
+        .optimize = optimize,
+    });
+    const mock_exe = b.addExecutable(.{
+        .name = "ohmyzig-mock",
+        .root_module = mock_mod,
+    });
+    const install_mock = b.addInstallArtifact(mock_exe, .{});
+    const run_mock = b.addRunArtifact(mock_exe);
+    if (b.args) |args| run_mock.addArgs(args);
+    const mock_step = b.step("mock", "Run the local mock OpenAI server");
+    mock_step.dependOn(&install_mock.step);
+    mock_step.dependOn(&run_mock.step);
+
+    // `zig build loadgen -- --endpoint chat --rate 500 --duration 30` —
+    // open-loop load generator (p50/p99/p999, throughput), meant to run
+    // against the mock server.
+    const loadgen_exe = b.addExecutable(.{
+        .name = "ohmyzig-loadgen",
+        .root_module = b.createModule(.{
+            .root_source_file = b.path("src/loadgen.zig"),
+            .target = target,
+            .optimize = optimize,
+        }),
+    });
+    loadgen_exe.root_module.addImport("openai", openai_mod);
+    const install_loadgen = b.addInstallArtifact(loadgen_exe, .{});
+    const run_loadgen = b.addRunArtifact(loadgen_exe);
+    if (b.args) |args| run_loadgen.addArgs(args);
+    const loadgen_step = b.step("loadgen", "Run the load generator");
+    loadgen_step.dependOn(&install_loadgen.step);
+    loadgen_step.dependOn(&run_loadgen.step);
+
+    // `zig build test` — unit tests of the portable code (no C sources or
+    // system libraries), so they run on the host, e.g. Linux. Each root's
+    // tests sit next to the code they cover; HTTP tests start the mock
+    // server in-process (`@import("mock_server")`).
+    const test_step = b.step("test", "Run unit tests");
+    const test_roots = [_][]const u8{
+        "src/util/executor.zig",
+        "src/openai/mod.zig",
+        "src/batch.zig",
+        "src/util/text_kernels.zig",
+        "src/util/text.zig",
+        "src/util/piece_table.zig",
+        "src/util/vector_index.zig",
+        "src/util/hedge.zig",
+        "src/util/deadline.zig",
+        "src/platform/event_http.zig",
+        "src/tests.zig",
+    };
+    for (test_roots) |root| {
+        const unit_tests = b.addTest(.{
+            .root_module = b.createModule(.{
+                .root_source_file = b.path(root),
+                .target = target,
+                .optimize = optimize,
+            }),
+        });
+        unit_tests.root_module.addImport("openai", openai_mod);
+        unit_tests.root_module.addImport("text_kernels", text_kernels_mod);
+        unit_tests.root_module.addImport("trace", trace_mod);
+        unit_tests.root_module.addImport("deadline", deadline_mod);
+        unit_tests.root_module.addImport("event_http", event_http_mod);
+        unit_tests.root_module.addImport("mock_server", mock_mod);
+        test_step.dependOn(&b.addRunArtifact(unit_tests).step);
+    }
 }
@@ -5,10 +5,18 @@
 extern "C" {
 #endif
 
-// Called from the Win32 UI when the user clicks
-// the "Show OpenAI Models" button.
+// Called from the Win32 UI on startup to show the model list
+// (cached first, revalidated in the background once stale).
 void OnShowModelsRequest(void);
 
+// Called from the Win32 UI when the user clicks
+// the "Update Model List" button (conditional refresh).
+void OnUpdateModelsRequest(void);
+
+// Called on the UI thread after a worker posted PostJobsCompleted().
+// Applies results of finished background jobs.
+void OnJobsCompleted(void);
+
 #ifdef __cplusplus
 }
 #endif
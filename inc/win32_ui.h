@@ -15,13 +15,22 @@ int CreateSimpleWindow(void);
 // Shows an informational message box with the given title and body.
 void ShowInfoMessage(const char* title, const char* body);
 
-// Shows a scrollable, read-only dialog with the given title and body text.
-// Intended for long, multi-line content like model lists.
+// Shows a scrollable, read-only dialog with the given title and body text
+// (UTF-8). Intended for long, multi-line content like model lists.
 void ShowScrollableText(const char* title, const char* body);
 
-// Sets the main window's read-only text area content (multiline).
+// Sets the main window's read-only text area content (multiline, UTF-8).
 void SetMainText(const char* body);
 
+// Replaces UTF-16 code units [start, end) of the main text area with text
+// (UTF-8), leaving the rest untouched (EM_SETSEL + EM_REPLACESEL on the
+// Unicode edit control). No-op before the window exists.
+void ReplaceMainTextRange(unsigned long start, unsigned long end, const char* text);
+
+// Posts a message to the main window so the UI thread calls
+// OnJobsCompleted(). Safe to call from worker threads.
+void PostJobsCompleted(void);
+
 // Prompts the user for the OpenAI API key using a simple modal input window.
 // Writes a null-terminated string into out_buf (up to out_buf_len-1 chars).
 // out_save receives 1 if user checked "Save key (encrypted)", else 0.
@@ -1,4 +1,5 @@
 // Minimal WinINet HTTP GET helper for Windows GUI app.
+// Uses one process-lifetime session so keep-alive connections are reused.
 #ifndef WIN_HTTP_H
 #define WIN_HTTP_H
 
@@ -6,17 +7,81 @@
 extern "C" {
 #endif
 
-// Performs HTTP GET to the given URL with optional extra header string
-// (e.g., "Authorization: Bearer ...\r\n").
-// On success returns 1 and sets *out_buf/*out_len. Caller must free via http_free.
-int http_get_with_header(const char* url, const char* extra_header, char** out_buf, unsigned long* out_len);
+// Phase boundaries in ns since the request started; -1 when the phase did
+// not happen (no DNS lookup or connect on a pooled keep-alive connection).
+typedef struct HttpPhaseTimes {
+    long long resolve_start, resolve_end;
+    long long connect_start, connect_end; // TCP; TLS follows until send_start
+    long long send_start;                 // request starts going out
+    long long headers_end;                // response head received (first byte)
+} HttpPhaseTimes;
 
-// Frees buffer allocated by http_get_with_header.
-void http_free(void* p);
+// Per-request response details.
+typedef struct HttpRequestInfo {
+    int reused_connection; // 1 if a pooled keep-alive socket served the request
+    int status;            // HTTP status code (e.g. 200, 304)
+    char etag[128];        // ETag response header, "" if absent or too long
+    char last_modified[64];// Last-Modified response header, "" if absent or too long
+    int retry_after_s;     // Retry-After in seconds (429/503), -1 if absent or a date
+    long long content_length;   // Content-Length (bytes on the wire), -1 if absent
+    char content_encoding[32];  // Content-Encoding, "" for identity
+    HttpPhaseTimes times;  // where the time went (DNS, connect, TLS, wait)
+} HttpRequestInfo;
+
+// Cumulative counters since process start.
+typedef struct HttpStats {
+    unsigned long long requests;
+    unsigned long long connections_new;
+    unsigned long long connections_reused;
+} HttpStats;
+
+// Per-request WinINet timeouts in ms; 0 keeps the WinINet default.
+typedef struct HttpTimeouts {
+    unsigned long connect_ms; // TCP connect (per attempt)
+    unsigned long send_ms;    // writing the request
+    unsigned long receive_ms; // each wait for response data, head included
+} HttpTimeouts;
+
+// Open request (opaque).
+typedef struct HttpResponse HttpResponse;
+
+// Sends a GET to the given URL with optional extra header string
+// (e.g., "Authorization: Bearer ...\r\n") and waits for the response head.
+// Returns NULL on failure. out_info is optional (may be NULL); when given,
+// it must stay valid until http_close. The body is read with http_read
+// exactly as sent (still compressed if Content-Encoding is set).
+HttpResponse* http_open(const char* url, const char* extra_header, HttpRequestInfo* out_info);
+
+// http_open in two steps, so another thread can abort the request while
+// it connects or waits: http_begin parses the URL and creates the request
+// handle (timeouts may be NULL); http_send sends it and waits for the
+// response head. extra_header and out_info must stay valid until http_send
+// returns. http_send returns 0 on failure; call http_close either way.
+HttpResponse* http_begin(const char* url, const char* extra_header, HttpRequestInfo* out_info, const HttpTimeouts* timeouts);
+int http_send(HttpResponse* resp);
+
+// Aborts a request from any thread: a blocked http_send or http_read fails
+// promptly and the socket is not reused. A call that has not yet reached
+// the network fails when it returns (within the handle's timeouts), and
+// later calls fail at once. Must not overlap http_close.
+void http_abort(HttpResponse* resp);
+
+// Reads up to len body bytes into buf; *out_read == 0 means end of body.
+// Returns 0 on a transport error.
+int http_read(HttpResponse* resp, char* buf, unsigned long len, unsigned long* out_read);
+
+// Finishes the request. Read the body to EOF first so the connection can
+// be reused.
+void http_close(HttpResponse* resp);
+
+// Copies the cumulative connection counters.
+void http_get_stats(HttpStats* out);
+
+// Closes pooled connections and the shared session. Call once at exit.
+void http_shutdown(void);
 
 #ifdef __cplusplus
 }
 #endif
 
 #endif // WIN_HTTP_H
-
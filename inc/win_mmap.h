@@ -0,0 +1,22 @@
+// Read-only memory-mapped files for Windows (CreateFileMapping/MapViewOfFile).
+#ifndef WIN_MMAP_H
+#define WIN_MMAP_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Maps the whole file at path read-only. The file is opened with full
+// sharing, so other processes may replace it (by rename) while mapped.
+// On success returns 1 and sets *out_base/*out_len; an empty file maps to
+// NULL/0. Release with mmap_close().
+int mmap_open_read(const char* path, const void** out_base, unsigned long long* out_len);
+
+// Unmaps a view returned by mmap_open_read (NULL is ignored).
+void mmap_close(const void* base);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // WIN_MMAP_H
@@ -14,9 +14,14 @@ int dpapi_encrypt_and_save(const char* path, const unsigned char* data, unsigned
 // On success returns 1 and sets *out_buf/*out_len. Caller must free with secret_free().
 int dpapi_load_and_decrypt(const char* path, unsigned char** out_buf, unsigned long* out_len);
 
-// Frees buffers allocated by dpapi_load_and_decrypt.
+// Frees buffers allocated by dpapi_load_and_decrypt (zero them first).
 void secret_free(void* p);
 
+// Keeps the pages of [p, p + len) out of the page file (VirtualLock).
+// Returns 1 on success, 0 on failure (e.g. working-set quota reached).
+int secret_lock(void* p, unsigned long long len);
+void secret_unlock(void* p, unsigned long long len);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,634 @@
+//! Headless batch runner for chat completions.
+//! - Reads prompts from a JSONL file and sends them through
+//!   `openai.chatCompletion`, at most `--concurrency` at a time.
+//! - Writes one result line per prompt to the output file, in input order.
+//! - Finished results are checkpointed as they arrive, so an interrupted run
+//!   resumes without repeating any request that already succeeded. Failed
+//!   prompts (transport errors, non-2xx answers) are sent again.
+//! - Portable (no Win32 code): `zig build batch -- --in p.jsonl --out r.jsonl`.
+const std = @import("std");
+const openai = @import("openai");
+const executor = @import("util/executor.zig");
+const paths = @import("platform/paths.zig");
+const request_arena = @import("util/request_arena.zig");
+const trace = @import("trace");
+
+const usage =
+    \\usage: ohmyzig-batch --in PROMPTS.jsonl --out RESULTS.jsonl [options]
+    \\  --concurrency N   requests in flight (default 4)
+    \\  --model NAME      model for lines without one (default $OPENAI_MODEL or gpt-3.5-turbo)
+    \\  --base-url URL    API base URL (default https://api.openai.com), e.g. a local mock
+    \\  --cache DIR|-     reuse responses for identical requests ("-" = app data dir/responses)
+    \\  --cache-compress on|off  gzip new cache entries (default off)
+    \\  --trace PREFIX    record request spans; writes PREFIX.trace.json and PREFIX.jsonl
+    \\
+    \\input line:  {"prompt": "...", "id": "...", "model": "..."}   (id and model optional)
+    \\output line: {"index":N,"id":...,"ok":true,"status":200,"latency_ms":...,"response":{...}}
+    \\             {"index":N,"id":...,"ok":false,"status":500,"latency_ms":...,"error":{...}}
+    \\             {"index":N,"id":...,"ok":false,"latency_ms":...,"error":"..."}
+    \\ok is true only for a 2xx JSON answer. Rerunning with the same --out retries
+    \\the lines that are not ok and keeps the others.
+    \\The API key is read from OPENAI_API_KEY.
+    \\
+;
+
+// One line of the input file.
+const Input = struct {
+    prompt: []const u8,
+    id: ?[]const u8 = null,
+    model: ?[]const u8 = null,
+};
+
+// Only the fields needed to place a checkpointed result.
+const CheckpointEntry = struct {
+    index: usize,
+    ok: bool = false,
+};
+
+const Options = struct {
+    in_path: []const u8 = "",
+    out_path: []const u8 = "",
+    concurrency: usize = 4,
+    model: ?[]const u8 = null,
+    base_url: []const u8 = openai.Client.default_base_url,
+    cache_dir: ?[]const u8 = null,
+    cache_compress: bool = false,
+    trace_prefix: ?[]const u8 = null,
+};
+
+pub fn main() !void {
+    const allocator = std.heap.smp_allocator;
+
+    const args = try std.process.argsAlloc(allocator);
+    defer std.process.argsFree(allocator, args);
+    const options = parseArgs(args) catch {
+        std.debug.print("{s}", .{usage});
+        std.process.exit(2);
+    };
+
+    const api_key = std.process.getEnvVarOwned(allocator, "OPENAI_API_KEY") catch {
+        std.debug.print("OPENAI_API_KEY is not set\n", .{});
+        std.process.exit(2);
+    };
+    defer allocator.free(api_key);
+
+    const env_model = std.process.getEnvVarOwned(allocator, "OPENAI_MODEL") catch null;
+    defer if (env_model) |m| allocator.free(m);
+    const default_model = options.model orelse env_model orelse "gpt-3.5-turbo";
+
+    const input = try std.fs.cwd().readFileAlloc(allocator, options.in_path, std.math.maxInt(u32));
+    defer allocator.free(input);
+
+    var lines: std.ArrayListUnmanaged([]const u8) = .{};
+    defer lines.deinit(allocator);
+    var it = std.mem.tokenizeAny(u8, input, "\r\n");
+    while (it.next()) |line| {
+        if (std.mem.trim(u8, line, " \t").len == 0) continue;
+        try lines.append(allocator, line);
+    }
+
+    if (options.trace_prefix != null) trace.enable();
+    defer if (options.trace_prefix) |prefix| {
+        trace.exportFiles(allocator, prefix) catch |e| std.debug.print("trace export failed: {s}\n", .{@errorName(e)});
+        trace.reset();
+    };
+
+    var cache: ?openai.ResponseCache = null;
+    if (options.cache_dir) |dir| {
+        const path = if (std.mem.eql(u8, dir, "-"))
+            try paths.appDataFile(allocator, "responses")
+        else
+            try allocator.dupe(u8, dir);
+        defer allocator.free(path);
+        cache = try openai.ResponseCache.open(allocator, path, .{ .compress = options.cache_compress });
+    }
+    defer if (cache) |*rc| rc.close();
+
+    var client = openai.Client.init(allocator, .{
+        .max_idle_connections = @intCast(@max(options.concurrency, 1)),
+        .base_url = options.base_url,
+        .response_cache = if (cache) |*rc| rc else null,
+    });
+    defer client.deinit();
+
+    var runner = Runner{
+        .allocator = allocator,
+        .client = &client,
+        .api_key = api_key,
+        .default_model = default_model,
+        .lines = lines.items,
+        .arenas = request_arena.ArenaPool.init(allocator, .{ .max_pooled = options.concurrency }),
+    };
+    defer runner.deinit();
+    try runner.run(options);
+
+    if (cache) |*rc| {
+        const s = rc.stats();
+        std.debug.print("response cache: {d} hits, {d} misses ({d} expired), {d} entries, {d} KiB\n", .{
+            s.hits, s.misses, s.expired, s.entries, s.bytes / 1024,
+        });
+        if (s.stores > 0) std.debug.print("response cache: stored {d} KiB for {d} KiB of responses\n", .{
+            s.put_stored_bytes / 1024, s.put_raw_bytes / 1024,
+        });
+    }
+    const cs = client.stats();
+    std.debug.print("http: {d} requests, {d} compressed responses\n", .{ cs.requests, cs.compressed_responses });
+}
+
+fn parseArgs(args: []const []const u8) !Options {
+    var o = Options{};
+    var i: usize = 1;
+    while (i < args.len) : (i += 1) {
+        const arg = args[i];
+        if (i + 1 >= args.len) return error.InvalidArgs;
+        const value = args[i + 1];
+        i += 1;
+        if (std.mem.eql(u8, arg, "--in")) {
+            o.in_path = value;
+        } else if (std.mem.eql(u8, arg, "--out")) {
+            o.out_path = value;
+        } else if (std.mem.eql(u8, arg, "--concurrency")) {
+            o.concurrency = try std.fmt.parseInt(usize, value, 10);
+            if (o.concurrency == 0) return error.InvalidArgs;
+        } else if (std.mem.eql(u8, arg, "--model")) {
+            o.model = value;
+        } else if (std.mem.eql(u8, arg, "--base-url")) {
+            o.base_url = value;
+        } else if (std.mem.eql(u8, arg, "--cache")) {
+            o.cache_dir = value;
+        } else if (std.mem.eql(u8, arg, "--cache-compress")) {
+            if (std.mem.eql(u8, value, "on")) {
+                o.cache_compress = true;
+            } else if (!std.mem.eql(u8, value, "off")) {
+                return error.InvalidArgs;
+            }
+        } else if (std.mem.eql(u8, arg, "--trace")) {
+            o.trace_prefix = value;
+        } else {
+            return error.InvalidArgs;
+        }
+    }
+    if (o.in_path.len == 0 or o.out_path.len == 0) return error.InvalidArgs;
+    return o;
+}
+
+// Drives the run on the main thread: submits prompts to the executor,
+// collects completions and writes results in order.
+//
+// Files:
+//   <out>        ordered results; its complete lines are the durable prefix
+//   <out>.ckpt   every finished result in completion order (may run ahead
+//                of <out>); replayed on resume, deleted after a full run
+const Runner = struct {
+    allocator: std.mem.Allocator,
+    client: *openai.Client,
+    api_key: []const u8,
+    default_model: []const u8,
+    lines: []const []const u8,
+
+    jobs: executor.Executor = undefined,
+    // One arena per in-flight prompt (line copy, decode, response body).
+    arenas: request_arena.ArenaPool,
+    // Set by workers whenever a completion is queued.
+    wake: std.Thread.ResetEvent = .{},
+
+    // Finished result lines waiting for their turn, keyed by input index.
+    ready: std.AutoHashMapUnmanaged(usize, []u8) = .{},
+    // A result that could not be recorded; its slot would never fill.
+    fatal: ?anyerror = null,
+    out_file: std.fs.File = undefined,
+    ckpt_file: std.fs.File = undefined,
+
+    // Latencies of requests run in this session.
+    latencies_ns: std.ArrayListUnmanaged(u64) = .{},
+    failures: usize = 0,
+
+    fn deinit(self: *Runner) void {
+        var values = self.ready.valueIterator();
+        while (values.next()) |v| self.allocator.free(v.*);
+        self.ready.deinit(self.allocator);
+        self.latencies_ns.deinit(self.allocator);
+        self.arenas.deinit();
+    }
+
+    fn run(self: *Runner, options: Options) !void {
+        const ckpt_path = try std.fmt.allocPrint(self.allocator, "{s}.ckpt", .{options.out_path});
+        defer self.allocator.free(ckpt_path);
+
+        var next_write = try self.openOutput(options.out_path);
+        defer self.out_file.close();
+        try self.loadCheckpoint(ckpt_path, next_write);
+        self.ckpt_file = try openAppend(ckpt_path);
+        defer self.ckpt_file.close();
+
+        const total = self.lines.len;
+        const resumed = next_write + self.ready.count();
+        if (resumed > 0) std.debug.print("resuming: {d}/{d} already done\n", .{ resumed, total });
+
+        try self.jobs.init(self.allocator, .{
+            .threads = options.concurrency,
+            .notify = wakeMain,
+            .notify_ctx = self,
+        });
+        defer self.jobs.deinit();
+
+        // Submit ahead of the write cursor by at most `window` prompts, so
+        // a slow request at the head bounds the reorder buffer.
+        const window = options.concurrency * 4;
+        var next_submit = next_write;
+        var timer = try std.time.Timer.start();
+
+        while (true) {
+            while (next_submit < total and next_submit - next_write < window) : (next_submit += 1) {
+                if (self.ready.contains(next_submit)) continue; // from the checkpoint
+                try self.submit(next_submit);
+            }
+
+            while (self.ready.fetchRemove(next_write)) |entry| {
+                defer self.allocator.free(entry.value);
+                try self.out_file.writeAll(entry.value);
+                next_write += 1;
+            }
+            if (next_write >= total) break;
+
+            // Reset before draining: a completion posted after the drain
+            // leaves the event set, so the next wait returns immediately.
+            self.wake.wait();
+            self.wake.reset();
+            _ = self.jobs.drainCompletions();
+            // Results recorded so far stay in the checkpoint for the next run.
+            if (self.fatal) |e| return e;
+        }
+
+        try self.out_file.sync();
+        std.fs.cwd().deleteFile(ckpt_path) catch {};
+        self.report(timer.read());
+    }
+
+    // Opens (or creates) the output file for appending and returns the
+    // number of result lines kept in it: those before the first failed (or
+    // torn) line. The rest is cut off; its successful results go back to
+    // `ready`, its failed prompts are sent again.
+    fn openOutput(self: *Runner, path: []const u8) !usize {
+        self.out_file = try openAppend(path);
+        errdefer self.out_file.close();
+
+        const existing = try std.fs.cwd().readFileAlloc(self.allocator, path, std.math.maxInt(u32));
+        defer self.allocator.free(existing);
+        var keep: usize = 0;
+        var kept: usize = 0;
+        var cut = false;
+        var lines = std.mem.splitScalar(u8, existing, '\n');
+        while (lines.next()) |line| {
+            if (lines.peek() == null) break;
+            if (!cut) {
+                if (checkpointEntry(self.allocator, line)) |entry| if (entry.ok and entry.index == kept) {
+                    keep += line.len + 1;
+                    kept += 1;
+                    continue;
+                };
+                cut = true;
+            }
+            try self.restore(line, kept);
+        }
+        if (keep != existing.len) try self.out_file.setEndPos(keep);
+        try self.out_file.seekTo(keep);
+        return kept;
+    }
+
+    // Loads results finished by a previous run but not yet in the output.
+    fn loadCheckpoint(self: *Runner, path: []const u8, done: usize) !void {
+        const bytes = std.fs.cwd().readFileAlloc(self.allocator, path, std.math.maxInt(u32)) catch |e| switch (e) {
+            error.FileNotFound => return,
+            else => return e,
+        };
+        defer self.allocator.free(bytes);
+
+        // Only complete lines count; a torn tail is simply redone.
+        var lines = std.mem.splitScalar(u8, bytes, '\n');
+        while (lines.next()) |line| {
+            if (lines.peek() == null) break;
+            try self.restore(line, done);
+        }
+    }
+
+    // Queues a result line from an earlier run as finished, unless it
+    // failed, is already written (index below `done`) or already queued.
+    fn restore(self: *Runner, line: []const u8, done: usize) !void {
+        const entry = checkpointEntry(self.allocator, line) orelse return;
+        if (!entry.ok) return;
+        if (entry.index < done or entry.index >= self.lines.len or self.ready.contains(entry.index)) return;
+        const owned = try self.allocator.alloc(u8, line.len + 1);
+        errdefer self.allocator.free(owned);
+        @memcpy(owned[0..line.len], line);
+        owned[line.len] = '\n';
+        try self.ready.put(self.allocator, entry.index, owned);
+    }
+
+    fn submit(self: *Runner, index: usize) !void {
+        const job = try self.allocator.create(PromptJob);
+        job.* = .{ .runner = self, .index = index };
+        _ = self.jobs.submit(&job.job);
+    }
+
+    // Runs on the main thread for each finished job.
+    fn onResult(self: *Runner, job: *PromptJob) void {
+        const line = job.result orelse {
+            self.fatal = error.OutOfMemory;
+            return;
+        };
+        if (!job.ok) self.failures += 1;
+        self.latencies_ns.append(self.allocator, job.latency_ns) catch {};
+        self.ckpt_file.writeAll(line) catch |e| {
+            std.debug.print("checkpoint write failed: {s}\n", .{@errorName(e)});
+        };
+        self.ready.put(self.allocator, job.index, line) catch |e| {
+            self.allocator.free(line);
+            self.fatal = e;
+        };
+    }
+
+    fn report(self: *Runner, wall_ns: u64) void {
+        const n = self.latencies_ns.items.len;
+        std.debug.print("done: {d} requests this run ({d} failed) in {d:.2}s\n", .{
+            n, self.failures, @as(f64, @floatFromInt(wall_ns)) / std.time.ns_per_s,
+        });
+        if (n == 0) return;
+
+        const secs = @as(f64, @floatFromInt(@max(wall_ns, 1))) / std.time.ns_per_s;
+        std.debug.print("throughput: {d:.2} req/s\n", .{@as(f64, @floatFromInt(n)) / secs});
+
+        std.mem.sort(u64, self.latencies_ns.items, {}, std.sort.asc(u64));
+        const sorted = self.latencies_ns.items;
+        std.debug.print("latency ms: p50 {d:.1}  p90 {d:.1}  p99 {d:.1}  max {d:.1}\n", .{
+            toMs(percentile(sorted, 50)), toMs(percentile(sorted, 90)),
+            toMs(percentile(sorted, 99)), toMs(sorted[n - 1]),
+        });
+
+        if (self.arenas.flowStats("batch/prompt")) |f| {
+            const reqs: f64 = @floatFromInt(@max(f.requests, 1));
+            std.debug.print("allocations per request: {d:.1} allocs, {d:.0} B, peak {d} B\n", .{
+                @as(f64, @floatFromInt(f.allocs)) / reqs, @as(f64, @floatFromInt(f.bytes)) / reqs, f.max_peak_bytes,
+            });
+        }
+    }
+
+    fn wakeMain(ctx: ?*anyopaque) void {
+        const self: *Runner = @ptrCast(@alignCast(ctx.?));
+        self.wake.set();
+    }
+};
+
+const PromptJob = struct {
+    job: executor.Job = .{ .run = run, .complete = complete },
+    runner: *Runner,
+    index: usize,
+
+    // Filled in on the worker.
+    result: ?[]u8 = null,
+    ok: bool = false,
+    latency_ns: u64 = 0,
+
+    fn run(job: *executor.Job) void {
+        const self: *PromptJob = @fieldParentPtr("job", job);
+        const r = self.runner;
+        // The result line crosses to the main thread; everything else is
+        // request-scoped and goes away with the arena.
+        const allocator = r.allocator;
+        const ra = r.arenas.acquire("batch/prompt") catch return;
+        defer r.arenas.release(ra);
+        const scratch = ra.allocator();
+
+        // The decoder unescapes in place, so work on a copy of the line.
+        const line = scratch.dupe(u8, r.lines[self.index]) catch return;
+        const input = openai.decode.decodeLeaky(Input, scratch, line) catch |e| {
+            self.result = formatResult(allocator, self.index, null, 0, .{ .failed = e }) catch null;
+            return;
+        };
+
+        const started = std.time.Instant.now() catch null;
+        const outcome: Outcome = if (openai.chatCompletionResponse(
+            scratch,
+            r.client,
+            r.api_key,
+            input.model orelse r.default_model,
+            input.prompt,
+            .{},
+        )) |resp| .{ .response = resp } else |e| .{ .failed = e };
+        if (started) |t0| {
+            if (std.time.Instant.now()) |t1| self.latency_ns = t1.since(t0) else |_| {}
+        }
+
+        self.ok = succeeded(outcome);
+        self.result = formatResult(allocator, self.index, input.id, self.latency_ns, outcome) catch null;
+    }
+
+    fn complete(job: *executor.Job) void {
+        const self: *PromptJob = @fieldParentPtr("job", job);
+        defer self.runner.allocator.destroy(self);
+        self.runner.onResult(self);
+    }
+};
+
+const Outcome = union(enum) {
+    response: openai.ChatResponse,
+    failed: anyerror,
+};
+
+// A 2xx JSON answer; anything else is retried on the next run.
+fn succeeded(outcome: Outcome) bool {
+    return switch (outcome) {
+        .response => |r| r.status.class() == .success and isJsonBody(r.body),
+        .failed => false,
+    };
+}
+
+// Formats one output line (terminated by '\n'). Caller frees.
+fn formatResult(
+    allocator: std.mem.Allocator,
+    index: usize,
+    id: ?[]const u8,
+    latency_ns: u64,
+    outcome: Outcome,
+) ![]u8 {
+    const id_json = try std.json.stringifyAlloc(allocator, id, .{});
+    defer allocator.free(id_json);
+    const latency_ms = toMs(latency_ns);
+
+    switch (outcome) {
+        .response => |resp| {
+            const status = @intFromEnum(resp.status);
+            // Response JSON may be pretty-printed; raw newlines can only be
+            // insignificant whitespace in valid JSON, so flatten them.
+            if (isJsonBody(resp.body)) {
+                const flat = try allocator.dupe(u8, std.mem.trim(u8, resp.body, " \t\r\n"));
+                defer allocator.free(flat);
+                for (flat) |*c| {
+                    if (c.* == '\n' or c.* == '\r') c.* = ' ';
+                }
+                // A non-2xx JSON body is the API's error object.
+                const ok = succeeded(outcome);
+                return std.fmt.allocPrint(allocator, "{{\"index\":{d},\"id\":{s},\"ok\":{},\"status\":{d},\"latency_ms\":{d:.1},\"{s}\":{s}}}\n", .{
+                    index, id_json, ok, status, latency_ms, if (ok) "response" else "error", flat,
+                });
+            }
+            // Not JSON (proxy error page, ...): keep it as a string.
+            const text_json = try std.json.stringifyAlloc(allocator, resp.body, .{});
+            defer allocator.free(text_json);
+            return std.fmt.allocPrint(allocator, "{{\"index\":{d},\"id\":{s},\"ok\":false,\"status\":{d},\"latency_ms\":{d:.1},\"error\":{s}}}\n", .{
+                index, id_json, status, latency_ms, text_json,
+            });
+        },
+        .failed => |e| return std.fmt.allocPrint(allocator, "{{\"index\":{d},\"id\":{s},\"ok\":false,\"latency_ms\":{d:.1},\"error\":\"{s}\"}}\n", .{
+            index, id_json, latency_ms, @errorName(e),
+        }),
+    }
+}
+
+// Reads "index" and "ok" of a result line; null if the line is unusable.
+fn checkpointEntry(allocator: std.mem.Allocator, line: []const u8) ?CheckpointEntry {
+    // The decoder unescapes in place, so decode a copy.
+    const copy = allocator.dupe(u8, line) catch return null;
+    defer allocator.free(copy);
+    return openai.decode.decodeLeaky(CheckpointEntry, allocator, copy) catch null;
+}
+
+fn isJsonBody(body: []const u8) bool {
+    const trimmed = std.mem.trim(u8, body, " \t\r\n");
+    return trimmed.len > 0 and (trimmed[0] == '{' or trimmed[0] == '[');
+}
+
+fn openAppend(path: []const u8) !std.fs.File {
+    const file = try std.fs.cwd().createFile(path, .{ .truncate = false, .read = true });
+    errdefer file.close();
+    try file.seekFromEnd(0);
+    return file;
+}
+
+fn percentile(sorted: []const u64, p: usize) u64 {
+    const rank = (p * (sorted.len - 1) + 50) / 100;
+    return sorted[rank];
+}
+
+fn toMs(ns: u64) f64 {
+    return @as(f64, @floatFromInt(ns)) / std.time.ns_per_ms;
+}
+
+test "only a 2xx JSON answer is ok" {
+    const allocator = std.testing.allocator;
+    var body = "{\"error\":{\"message\":\"bad key\"}}".*;
+    const failed = try formatResult(allocator, 3, "a", 0, .{ .response = .{ .status = .unauthorized, .body = &body } });
+    defer allocator.free(failed);
+    try std.testing.expect(std.mem.indexOf(u8, failed, "\"ok\":false,\"status\":401") != null);
+    try std.testing.expect(std.mem.indexOf(u8, failed, "\"error\":{\"error\"") != null);
+    try std.testing.expectEqual(false, checkpointEntry(allocator, failed).?.ok);
+
+    var answer = "{\"choices\":[]}".*;
+    const ok = try formatResult(allocator, 4, null, 0, .{ .response = .{ .status = .ok, .body = &answer } });
+    defer allocator.free(ok);
+    try std.testing.expect(std.mem.indexOf(u8, ok, "\"ok\":true,\"status\":200") != null);
+    const entry = checkpointEntry(allocator, ok).?;
+    try std.testing.expect(entry.ok);
+    try std.testing.expectEqual(@as(usize, 4), entry.index);
+}
+
+// One batch run against a mock server at `port`.
+fn testRun(port: u16, out_path: []const u8, lines: []const []const u8) !void {
+    const allocator = std.testing.allocator;
+    var base_buf: [64]u8 = undefined;
+    const base = try std.fmt.bufPrint(&base_buf, "http://127.0.0.1:{d}", .{port});
+    var client = openai.Client.init(allocator, .{ .base_url = base });
+    defer client.deinit();
+    var runner = Runner{
+        .allocator = allocator,
+        .client = &client,
+        .api_key = "test-key",
+        .default_model = "mock",
+        .lines = lines,
+        .arenas = request_arena.ArenaPool.init(allocator, .{ .max_pooled = 2 }),
+    };
+    defer runner.deinit();
+    try runner.run(.{ .in_path = "-", .out_path = out_path, .concurrency = 2 });
+}
+
+// "ok" of each output line, which must be in input order.
+fn readOk(allocator: std.mem.Allocator, out_path: []const u8, out: []bool) !void {
+    const bytes = try std.fs.cwd().readFileAlloc(allocator, out_path, 1 << 20);
+    defer allocator.free(bytes);
+    var lines = std.mem.tokenizeScalar(u8, bytes, '\n');
+    var n: usize = 0;
+    while (lines.next()) |line| : (n += 1) {
+        const entry = checkpointEntry(allocator, line) orelse return error.TestUnexpectedResult;
+        try std.testing.expectEqual(n, entry.index);
+        out[n] = entry.ok;
+    }
+    try std.testing.expectEqual(out.len, n);
+}
+
+test "500 answers are failures and are sent again on resume" {
+    const mock = @import("mock_server");
+    const allocator = std.testing.allocator;
+    var tmp = std.testing.tmpDir(.{});
+    defer tmp.cleanup();
+    const dir = try tmp.dir.realpathAlloc(allocator, ".");
+    defer allocator.free(dir);
+    const out_path = try std.fs.path.join(allocator, &.{ dir, "results.jsonl" });
+    defer allocator.free(out_path);
+    const lines = [_][]const u8{
+        "{\"prompt\":\"one\"}",
+        "{\"prompt\":\"two\"}",
+        "{\"prompt\":\"three\"}",
+    };
+    var ok: [lines.len]bool = undefined;
+
+    {
+        const failing = try mock.Server.start(allocator, .{ .port = 0, .error_rate = 1 });
+        defer failing.stop();
+        try testRun(failing.port(), out_path, &lines);
+    }
+    try readOk(allocator, out_path, &ok);
+    try std.testing.expectEqualSlices(bool, &.{ false, false, false }, &ok);
+
+    const healthy = try mock.Server.start(allocator, .{ .port = 0 });
+    defer healthy.stop();
+    try testRun(healthy.port(), out_path, &lines);
+    try readOk(allocator, out_path, &ok);
+    try std.testing.expectEqualSlices(bool, &.{ true, true, true }, &ok);
+    try std.testing.expectEqual(@as(u64, 3), healthy.requests.load(.monotonic));
+}
+
+test "resume keeps successful lines after a failed one" {
+    const mock = @import("mock_server");
+    const allocator = std.testing.allocator;
+    var tmp = std.testing.tmpDir(.{});
+    defer tmp.cleanup();
+    const dir = try tmp.dir.realpathAlloc(allocator, ".");
+    defer allocator.free(dir);
+    const out_path = try std.fs.path.join(allocator, &.{ dir, "results.jsonl" });
+    defer allocator.free(out_path);
+    const lines = [_][]const u8{
+        "{\"prompt\":\"one\"}",
+        "{\"prompt\":\"two\"}",
+        "{\"prompt\":\"three\"}",
+    };
+    try tmp.dir.writeFile(.{ .sub_path = "results.jsonl", .data =
+        \\{"index":0,"id":null,"ok":true,"status":200,"latency_ms":1.0,"response":{"kept":0}}
+        \\{"index":1,"id":null,"ok":false,"status":500,"latency_ms":1.0,"error":{"error":{}}}
+        \\{"index":2,"id":null,"ok":true,"status":200,"latency_ms":1.0,"response":{"kept":2}}
+        \\
+    });
+
+    const server = try mock.Server.start(allocator, .{ .port = 0 });
+    defer server.stop();
+    try testRun(server.port(), out_path, &lines);
+
+    var ok: [lines.len]bool = undefined;
+    try readOk(allocator, out_path, &ok);
+    try std.testing.expectEqualSlices(bool, &.{ true, true, true }, &ok);
+    // Only the failed line went out again.
+    try std.testing.expectEqual(@as(u64, 1), server.requests.load(.monotonic));
+    const bytes = try tmp.dir.readFileAlloc(allocator, "results.jsonl", 1 << 20);
+    defer allocator.free(bytes);
+    try std.testing.expect(std.mem.indexOf(u8, bytes, "{\"kept\":0}") != null);
+    try std.testing.expect(std.mem.indexOf(u8, bytes, "{\"kept\":2}") != null);
+}
@@ -0,0 +1,843 @@
+//! Microbenchmarks for the hot paths (see src/bench/harness.zig).
+//! - Covers CRLF conversion, C string conversion, the model list decode
+//!   (typed decoder, the std.json.Value DOM path it replaced, and the full
+//!   decode + join + CRLF display pipeline) and chat request body building
+//!   (in memory vs streamed, checked byte-equal first), over generated
+//!   inputs of increasing size.
+//! - The text kernels (src/util/text_kernels.zig) run next to the code they
+//!   replaced (byte loop, std.json, std.unicode). Before any timing, random
+//!   inputs are fed to both and the outputs compared (`--fuzz N` cases);
+//!   a mismatch aborts the run.
+//! - `doc/*` compares a 64-byte update of the main-view piece table with
+//!   the whole-text copy SetMainText needed, at growing document sizes:
+//!   the piece table's ns/op should stay flat.
+//! - `trace/span_*` is the cost of one begin/end pair with tracing off
+//!   and on.
+//! - `vec/*` is one top-10 cosine query over deterministic fixture vectors
+//!   (seeded clusters): exact SIMD scan vs the IVF index. Before timing,
+//!   the SIMD dot product is checked against the scalar one, IVF with every
+//!   list probed against the exact scan, and IVF recall@10 is printed.
+//! - `deadline/guard` is the bookkeeping a bounded request adds (guard
+//!   start, phases, finish). Before it, requests to a local server that
+//!   stalls every response are checked to end at their first-byte deadline
+//!   and on cancel, well before the stall is over.
+//! - `credentials/*` compares a cached Authorization header with resolving
+//!   the key through the provider chain (environment miss, key file read).
+//! - Run with `zig build bench -Doptimize=ReleaseFast [-- options]`.
+const std = @import("std");
+const openai = @import("openai");
+const harness = @import("bench/harness.zig");
+const cstr = @import("util/cstr.zig");
+const text = @import("util/text.zig");
+const kernels = @import("text_kernels");
+const PieceTable = @import("util/piece_table.zig").PieceTable;
+const vector_index = @import("util/vector_index.zig");
+const credentials = @import("features/credentials.zig");
+const secrets = @import("platform/secrets.zig");
+const trace = @import("trace");
+const event_http = @import("event_http");
+const LocalServer = @import("bench/local_server.zig").LocalServer;
+const hedge = @import("util/hedge.zig");
+
+const usage =
+    \\usage: ohmyzig-bench [options]
+    \\  --filter STR       only run cases whose name contains STR
+    \\  --runs N           timed runs per case (median reported, default 5)
+    \\  --json PATH        write results as JSON
+    \\  --baseline PATH    compare against an earlier --json file
+    \\  --threshold PCT    slowdown counted as a regression (default 10)
+    \\  --fuzz N           kernel equivalence cases checked first (default 2000)
+    \\Exits with status 1 when a baseline comparison finds regressions.
+    \\
+;
+
+const text_sizes = [_]usize{ 1 << 10, 64 << 10, 1 << 20 };
+const cstr_sizes = [_]usize{ 16, 1 << 10, 64 << 10 };
+const model_counts = [_]usize{ 100, 1_000, 10_000, 100_000 };
+const prompt_sizes = [_]usize{ 100, 10 << 10, 1 << 20 };
+const vector_counts = [_]usize{ 1_000, 10_000, 100_000 };
+const vector_dims = 256;
+const http_concurrency = [_]usize{ 16, 256 };
+
+pub fn main() !void {
+    const allocator = std.heap.smp_allocator;
+
+    const args = try std.process.argsAlloc(allocator);
+    defer std.process.argsFree(allocator, args);
+    var fuzz_cases: usize = 2000;
+    const options = parseArgs(args, &fuzz_cases) catch {
+        std.debug.print("{s}", .{usage});
+        std.process.exit(2);
+    };
+
+    try fuzzKernels(allocator, fuzz_cases);
+
+    var h = try harness.Harness.init(allocator, options);
+    defer h.deinit();
+
+    for (text_sizes) |n| {
+        const input = try syntheticLines(allocator, n);
+        defer allocator.free(input);
+        try h.run("text/toCRLF", n, n, @as([]const u8, input), crlfCase);
+        try h.run("text/toCRLF_bytewise", n, n, @as([]const u8, input), crlfBytewise);
+    }
+
+    for (prompt_sizes) |n| {
+        const prompt = try syntheticPrompt(allocator, n);
+        defer allocator.free(prompt);
+        try h.run("json/escape", n, n, @as([]const u8, prompt), escapeCase);
+        try h.run("json/stringifyAlloc", n, n, @as([]const u8, prompt), stringifyCase);
+    }
+
+    for (text_sizes) |n| {
+        const input = try syntheticUtf8(allocator, n);
+        defer allocator.free(input);
+        try h.run("utf8/validate", n, n, @as([]const u8, input), utf8Case);
+        try h.run("utf8/std", n, n, @as([]const u8, input), utf8StdCase);
+    }
+
+    for (text_sizes) |n| {
+        const input = try syntheticLines(allocator, n);
+        defer allocator.free(input);
+        var doc = PieceTable.init(allocator);
+        defer doc.deinit();
+        _ = try doc.append(input);
+        try h.run("doc/append_delta", n, doc_delta.len, &doc, docAppendCase);
+        try h.run("doc/full_copy", n, n, &doc, docFullCopyCase);
+    }
+
+    try h.run("trace/span_disabled", 1, 0, {}, spanCase);
+    trace.enable();
+    try h.run("trace/span_enabled", 1, 0, {}, spanCase);
+    trace.reset();
+
+    for (vector_counts) |n| {
+        const vectors = try fixtureVectors(allocator, n, vector_dims, 0x7665637321);
+        defer allocator.free(vectors);
+        var ivf = try vector_index.Ivf.build(allocator, vectors, vector_dims, .{});
+        defer ivf.deinit();
+        var ctx = VectorCase{ .vectors = vectors, .ivf = &ivf, .query = vectors[0..vector_dims] };
+        try checkVectorSearch(&ctx, n);
+        try h.run("vec/search_flat", n, n * vector_dims * 4, &ctx, searchFlatCase);
+        try h.run("vec/search_ivf", n, n * vector_dims * 4, &ctx, searchIvfCase);
+    }
+
+    {
+        const key_path = "ohmyzig-bench.key";
+        try secrets.saveEncryptedTo(allocator, key_path, "sk-bench-0123456789abcdefghijklmnopqrstuvwxyz");
+        defer std.fs.cwd().deleteFile(key_path) catch {};
+        var provider = credentials.Provider{ .env_var = "OHMYZIG_BENCH_UNSET_KEY", .key_file = key_path };
+        defer provider.deinit();
+        try h.run("credentials/cached", 1, 0, &provider, credentialsCachedCase);
+        try h.run("credentials/resolve", 1, 0, &provider, credentialsResolveCase);
+    }
+
+    {
+        var tok = try fixtureTokenizer(allocator);
+        defer tok.deinit();
+        for (prompt_sizes) |n| {
+            const prompt = try syntheticPrompt(allocator, n);
+            defer allocator.free(prompt);
+            try checkTokenizer(allocator, &tok, prompt);
+            var ctx = TokenizerCase{ .tokenizer = &tok, .text = prompt };
+            try h.run("tokenizer/count", n, n, &ctx, tokenCountCase);
+            try h.run("tokenizer/encode", n, n, &ctx, tokenEncodeCase);
+        }
+    }
+
+    if (event_http.supported) {
+        const server = try LocalServer.start(allocator, http_fixture_body, .{});
+        defer server.stop(allocator);
+        const url = try std.fmt.allocPrint(allocator, "http://127.0.0.1:{d}/v1/models", .{server.port()});
+        defer allocator.free(url);
+        for (http_concurrency) |n| {
+            var loop = try event_http.Loop.init(allocator, .{});
+            defer loop.deinit();
+            var client = openai.Client.init(allocator, .{ .max_idle_connections = @intCast(n) });
+            defer client.deinit();
+            var ctx = HttpCase{ .url = url, .n = n, .loop = &loop, .client = &client };
+            try checkEvented(&ctx);
+            try h.run("http/evented", n, n * http_fixture_body.len, &ctx, eventedCase);
+            try h.run("http/thread_per_request", n, n * http_fixture_body.len, &ctx, threadPerRequestCase);
+        }
+    }
+
+    {
+        // Every 20th request stalls 100 ms, like a slow replica.
+        const server = try LocalServer.start(allocator, http_fixture_body, .{ .spike_every = 20, .spike_ms = 100 });
+        defer server.stop(allocator);
+        const url = try std.fmt.allocPrint(allocator, "http://127.0.0.1:{d}/v1/models", .{server.port()});
+        defer allocator.free(url);
+        var client = openai.Client.init(allocator, .{ .max_idle_connections = 8 });
+        defer client.deinit();
+        var hedger = hedge.Hedger.init(.{});
+        // Losing attempts may still be reading from the client.
+        defer hedger.drain();
+        var ctx = HedgeCase{ .url = url, .client = &client, .hedger = &hedger };
+        try checkHedging(allocator, &ctx);
+        try h.run("hedge/off", 1, http_fixture_body.len, &ctx, unhedgedCase);
+        try h.run("hedge/on", 1, http_fixture_body.len, &ctx, hedgedCase);
+    }
+
+    {
+        const server = try LocalServer.start(allocator, http_fixture_body, .{ .spike_every = 1, .spike_ms = stall_ms });
+        defer server.stop(allocator);
+        const base_url = try std.fmt.allocPrint(allocator, "http://127.0.0.1:{d}", .{server.port()});
+        defer allocator.free(base_url);
+        var client = openai.Client.init(allocator, .{ .base_url = base_url });
+        defer client.deinit();
+        try checkDeadline(&client);
+        var token: openai.deadline.CancelToken = .{};
+        try h.run("deadline/guard", 1, 0, &token, guardCase);
+    }
+
+    for (cstr_sizes) |n| {
+        const input = try allocator.alloc(u8, n);
+        defer allocator.free(input);
+        @memset(input, 'a');
+        try h.run("cstr/toCString", n, n, @as([]const u8, input), cstrCase);
+    }
+
+    for (model_counts) |n| {
+        const body = try syntheticModelList(allocator, n);
+        defer allocator.free(body);
+        // The synthetic ids contain no escapes, so the in-place decoders
+        // leave body untouched and it can be reused across iterations.
+        try h.run("models/dom", n, body.len, body, domExtract);
+        try h.run("models/extractModelIds", n, body.len, body, typedExtract);
+        try h.run("models/display_text", n, body.len, body, displayText);
+    }
+
+    for (prompt_sizes) |n| {
+        const prompt = try syntheticPrompt(allocator, n);
+        defer allocator.free(prompt);
+        try checkRequestBody(allocator, prompt);
+        try h.run("chat/buildChatBody", n, n, @as([]const u8, prompt), buildBody);
+        try h.run("chat/streamBody", n, n, @as([]const u8, prompt), streamBody);
+    }
+
+    if (try h.finish() > 0) std.process.exit(1);
+}
+
+fn parseArgs(args: []const []const u8, fuzz_cases: *usize) !harness.Options {
+    var o = harness.Options{};
+    var i: usize = 1;
+    while (i < args.len) : (i += 1) {
+        const arg = args[i];
+        if (i + 1 >= args.len) return error.InvalidArgs;
+        const value = args[i + 1];
+        i += 1;
+        if (std.mem.eql(u8, arg, "--filter")) {
+            o.filter = value;
+        } else if (std.mem.eql(u8, arg, "--runs")) {
+            o.runs = try std.fmt.parseInt(usize, value, 10);
+        } else if (std.mem.eql(u8, arg, "--json")) {
+            o.json_path = value;
+        } else if (std.mem.eql(u8, arg, "--baseline")) {
+            o.baseline_path = value;
+        } else if (std.mem.eql(u8, arg, "--threshold")) {
+            o.threshold_pct = try std.fmt.parseFloat(f64, value);
+        } else if (std.mem.eql(u8, arg, "--fuzz")) {
+            fuzz_cases.* = try std.fmt.parseInt(usize, value, 10);
+        } else {
+            return error.InvalidArgs;
+        }
+    }
+    return o;
+}
+
+fn crlfCase(input: []const u8, allocator: std.mem.Allocator) anyerror!void {
+    const out = try text.toCRLF(allocator, input);
+    defer allocator.free(out);
+    std.mem.doNotOptimizeAway(out.ptr);
+}
+
+// The byte-at-a-time conversion toCRLF used before the kernels.
+fn crlfBytewise(input: []const u8, allocator: std.mem.Allocator) anyerror!void {
+    const out = try bytewiseCRLF(allocator, input);
+    defer allocator.free(out);
+    std.mem.doNotOptimizeAway(out.ptr);
+}
+
+fn bytewiseCRLF(allocator: std.mem.Allocator, s: []const u8) ![]u8 {
+    const out = try allocator.alloc(u8, s.len * 2);
+    var w: usize = 0;
+    for (s) |c| {
+        if (c == '\n') {
+            out[w] = '\r';
+            w += 1;
+        }
+        out[w] = c;
+        w += 1;
+    }
+    return allocator.realloc(out, w);
+}
+
+fn escapeCase(input: []const u8, allocator: std.mem.Allocator) anyerror!void {
+    const out = try kernels.jsonEscapeAlloc(allocator, input);
+    defer allocator.free(out);
+    std.mem.doNotOptimizeAway(out.ptr);
+}
+
+fn stringifyCase(input: []const u8, allocator: std.mem.Allocator) anyerror!void {
+    const out = try std.json.stringifyAlloc(allocator, input, .{});
+    defer allocator.free(out);
+    std.mem.doNotOptimizeAway(out.ptr);
+}
+
+fn utf8Case(input: []const u8, allocator: std.mem.Allocator) anyerror!void {
+    _ = allocator;
+    std.mem.doNotOptimizeAway(kernels.utf8Validate(input));
+}
+
+fn utf8StdCase(input: []const u8, allocator: std.mem.Allocator) anyerror!void {
+    _ = allocator;
+    std.mem.doNotOptimizeAway(std.unicode.utf8ValidateSlice(input));
+}
+
+// Feeds random inputs to the kernels and to the code they replace and
+// checks the outputs match. Inputs mix ASCII, the bytes the kernels look
+// for, valid multi-byte sequences and random (often invalid) bytes, at
+// lengths around the vector width so the tails are covered.
+fn fuzzKernels(allocator: std.mem.Allocator, cases: usize) !void {
+    var prng = std.Random.DefaultPrng.init(0x6f686d797a6967);
+    const random = prng.random();
+    var buf: [512]u8 = undefined;
+
+    for (0..cases) |_| {
+        const s = randomText(random, &buf);
+
+        if (kernels.countByte(s, '\n') != kernels.scalar.countByte(s, '\n')) return fuzzMismatch("countByte", s);
+
+        const crlf = try text.toCRLF(allocator, s);
+        defer allocator.free(crlf);
+        const crlf_ref = try bytewiseCRLF(allocator, s);
+        defer allocator.free(crlf_ref);
+        if (!std.mem.eql(u8, crlf, crlf_ref)) return fuzzMismatch("toCRLF", s);
+
+        const valid = std.unicode.utf8ValidateSlice(s);
+        if (kernels.utf8Validate(s) != valid) return fuzzMismatch("utf8Validate", s);
+        if (kernels.utf8ValidPrefix(s) != kernels.scalar.utf8ValidPrefix(s)) return fuzzMismatch("utf8ValidPrefix", s);
+
+        // std.json only emits strings for valid UTF-8.
+        if (valid) {
+            const escaped = try kernels.jsonEscapeAlloc(allocator, s);
+            defer allocator.free(escaped);
+            const escaped_ref = try std.json.stringifyAlloc(allocator, s, .{});
+            defer allocator.free(escaped_ref);
+            if (!std.mem.eql(u8, escaped, escaped_ref)) return fuzzMismatch("jsonEscape", s);
+        }
+    }
+    std.debug.print("text kernels: {d} fuzz cases match the reference ({d}-byte vectors)\n\n", .{ cases, kernels.lanes });
+}
+
+fn randomText(random: std.Random, buf: []u8) []u8 {
+    const pieces = [_][]const u8{ "a", "Zq", " ", "\n", "\"", "\\", "\t", "\r", "\x01", "\x1f", "\x7f", "é", "한", "😀", "\xed\xa0\x80", "\xc0\xaf", "\xf4\x90\x80\x80" };
+    const len = random.uintLessThan(usize, buf.len);
+    var w: usize = 0;
+    while (w < len) {
+        if (random.uintLessThan(u8, 8) == 0) {
+            buf[w] = random.int(u8);
+            w += 1;
+            continue;
+        }
+        // Mostly plain ASCII runs so the vector fast paths get exercised.
+        const p = if (random.boolean()) pieces[0] else pieces[random.uintLessThan(usize, pieces.len)];
+        const n = @min(p.len, len - w);
+        @memcpy(buf[w..][0..n], p[0..n]);
+        w += n;
+    }
+    return buf[0..len];
+}
+
+fn fuzzMismatch(kernel: []const u8, input: []const u8) error{KernelMismatch} {
+    std.debug.print("text kernels: {s} differs from the reference for input {any}\n", .{ kernel, input });
+    return error.KernelMismatch;
+}
+
+const doc_delta = "streamed delta: a few tokens of model output, appended\r\n";
+
+// One streamed delta: append it, then take it out again so the document
+// keeps its size across iterations.
+fn docAppendCase(doc: *PieceTable, allocator: std.mem.Allocator) anyerror!void {
+    _ = allocator;
+    const change = try doc.append(doc_delta);
+    _ = try doc.replace(change.start, change.start + doc_delta.len, "");
+    std.mem.doNotOptimizeAway(doc.len);
+}
+
+// What every update cost before: the whole text copied into a new string.
+fn docFullCopyCase(doc: *PieceTable, allocator: std.mem.Allocator) anyerror!void {
+    const out = try doc.toOwnedText(allocator);
+    defer allocator.free(out);
+    std.mem.doNotOptimizeAway(out.ptr);
+}
+
+fn spanCase(_: void, allocator: std.mem.Allocator) anyerror!void {
+    _ = allocator;
+    const span = trace.begin("bench/span");
+    span.end();
+}
+
+fn credentialsCachedCase(provider: *credentials.Provider, allocator: std.mem.Allocator) anyerror!void {
+    var auth = provider.authHeader(allocator, null) orelse return error.NoKey;
+    auth.deinit(allocator);
+}
+
+// What every click cost before: the whole chain.
+fn credentialsResolveCase(provider: *credentials.Provider, allocator: std.mem.Allocator) anyerror!void {
+    provider.deinit();
+    var auth = provider.authHeader(allocator, null) orelse return error.NoKey;
+    auth.deinit(allocator);
+}
+
+const VectorCase = struct {
+    vectors: []const f32,
+    ivf: *const vector_index.Ivf,
+    query: []const f32,
+    nprobe: usize = 8,
+};
+
+fn searchFlatCase(ctx: *VectorCase, allocator: std.mem.Allocator) anyerror!void {
+    _ = allocator;
+    var out: [10]vector_index.Hit = undefined;
+    const hits = vector_index.searchFlat(ctx.vectors, vector_dims, ctx.query, &out);
+    std.mem.doNotOptimizeAway(hits.len);
+}
+
+fn searchIvfCase(ctx: *VectorCase, allocator: std.mem.Allocator) anyerror!void {
+    _ = allocator;
+    var out: [10]vector_index.Hit = undefined;
+    const hits = ctx.ivf.search(ctx.vectors, ctx.query, ctx.nprobe, &out);
+    std.mem.doNotOptimizeAway(hits.len);
+}
+
+// Aborts on a wrong result; prints IVF recall@10 over 100 fixture queries.
+fn checkVectorSearch(ctx: *const VectorCase, n: usize) !void {
+    const dims = vector_dims;
+    for (0..100) |q| {
+        const a = ctx.vectors[q * dims ..][0..dims];
+        const b = ctx.vectors[(n - 1 - q) * dims ..][0..dims];
+        if (@abs(vector_index.dot(a, b) - vector_index.scalar.dot(a, b)) > 1e-4) return vectorMismatch("dot", n);
+    }
+
+    var found: usize = 0;
+    for (0..100) |q| {
+        const query = ctx.vectors[q * (n / 100) * dims ..][0..dims];
+        var exact_buf: [10]vector_index.Hit = undefined;
+        var all_buf: [10]vector_index.Hit = undefined;
+        var approx_buf: [10]vector_index.Hit = undefined;
+        const exact = vector_index.searchFlat(ctx.vectors, dims, query, &exact_buf);
+        const all = ctx.ivf.search(ctx.vectors, query, ctx.ivf.listCount(), &all_buf);
+        for (exact, all) |e, x| if (e.score != x.score) return vectorMismatch("ivf(all lists)", n);
+        const approx = ctx.ivf.search(ctx.vectors, query, ctx.nprobe, &approx_buf);
+        for (approx) |x| {
+            for (exact) |e| {
+                if (e.index == x.index) found += 1;
+            }
+        }
+    }
+    std.debug.print("vec: {d} rows, {d} lists, nprobe {d}: recall@10 {d}%\n", .{ n, ctx.ivf.listCount(), ctx.nprobe, found * 100 / 1000 });
+}
+
+fn vectorMismatch(what: []const u8, n: usize) error{KernelMismatch} {
+    std.debug.print("vector search mismatch in {s} ({d} rows)\n", .{ what, n });
+    return error.KernelMismatch;
+}
+
+// count unit vectors scattered around 64 seeded cluster centres, so the
+// IVF index sees the kind of structure real embeddings have.
+fn fixtureVectors(allocator: std.mem.Allocator, count: usize, dims: usize, seed: u64) ![]f32 {
+    var prng = std.Random.DefaultPrng.init(seed);
+    const random = prng.random();
+    const centres = try allocator.alloc(f32, 64 * dims);
+    defer allocator.free(centres);
+    for (centres) |*x| x.* = random.floatNorm(f32);
+    const out = try allocator.alloc(f32, count * dims);
+    for (0..count) |i| {
+        const c = random.uintLessThan(usize, 64);
+        const row = out[i * dims ..][0..dims];
+        for (row, centres[c * dims ..][0..dims]) |*x, m| x.* = m + 0.5 * random.floatNorm(f32);
+        vector_index.normalize(row);
+    }
+    return out;
+}
+
+const TokenizerCase = struct {
+    tokenizer: *const openai.Tokenizer,
+    text: []const u8,
+};
+
+fn tokenCountCase(ctx: *TokenizerCase, allocator: std.mem.Allocator) anyerror!void {
+    _ = allocator;
+    std.mem.doNotOptimizeAway(ctx.tokenizer.count(ctx.text));
+}
+
+fn tokenEncodeCase(ctx: *TokenizerCase, allocator: std.mem.Allocator) anyerror!void {
+    var tokens: std.ArrayListUnmanaged(openai.tokenizer.Rank) = .{};
+    defer tokens.deinit(allocator);
+    try ctx.tokenizer.encode(allocator, ctx.text, &tokens);
+    std.mem.doNotOptimizeAway(tokens.items.len);
+}
+
+// Aborts unless the pieces cover the input, decode(encode(text)) gives it
+// back and `count` agrees with `encode`.
+fn checkTokenizer(allocator: std.mem.Allocator, tok: *const openai.Tokenizer, input: []const u8) !void {
+    var pieces = openai.tokenizer.Pieces{ .text = input, .encoding = tok.encoding };
+    var pos: usize = 0;
+    while (pieces.next()) |piece| {
+        if (piece.ptr != input.ptr + pos) return tokenizerMismatch("pieces", input.len);
+        pos += piece.len;
+    }
+    if (pos != input.len) return tokenizerMismatch("pieces", input.len);
+
+    var tokens: std.ArrayListUnmanaged(openai.tokenizer.Rank) = .{};
+    defer tokens.deinit(allocator);
+    try tok.encode(allocator, input, &tokens);
+    var round_trip: std.ArrayListUnmanaged(u8) = .{};
+    defer round_trip.deinit(allocator);
+    try tok.decode(allocator, tokens.items, &round_trip);
+    if (!std.mem.eql(u8, round_trip.items, input)) return tokenizerMismatch("decode(encode)", input.len);
+    if (tok.count(input) != tokens.items.len) return tokenizerMismatch("count", input.len);
+}
+
+fn tokenizerMismatch(what: []const u8, n: usize) error{KernelMismatch} {
+    std.debug.print("tokenizer mismatch in {s} ({d} bytes)\n", .{ what, n });
+    return error.KernelMismatch;
+}
+
+// cl100k-style tokenizer over a small vocabulary: the 256 single bytes,
+// then every 2..8 byte prefix of the pieces in the synthetic prompt, ranked
+// shortest first so merges grow left to right like learned BPE merges.
+fn fixtureTokenizer(allocator: std.mem.Allocator) !openai.Tokenizer {
+    const sample = try syntheticPrompt(allocator, 1024);
+    defer allocator.free(sample);
+    var vocab: std.StringArrayHashMapUnmanaged(void) = .{};
+    defer vocab.deinit(allocator);
+    for (2..9) |len| {
+        var pieces = openai.tokenizer.Pieces{ .text = sample, .encoding = .cl100k_base };
+        while (pieces.next()) |piece| {
+            if (piece.len >= len) try vocab.put(allocator, piece[0..len], {});
+        }
+    }
+
+    var file: std.ArrayListUnmanaged(u8) = .{};
+    defer file.deinit(allocator);
+    const w = file.writer(allocator);
+    const enc = std.base64.standard.Encoder;
+    var b64: [16]u8 = undefined;
+    for (0..256) |b| {
+        const byte = [1]u8{@intCast(b)};
+        try w.print("{s} {d}\n", .{ enc.encode(&b64, &byte), b });
+    }
+    for (vocab.keys(), 256..) |token, rank| {
+        try w.print("{s} {d}\n", .{ enc.encode(&b64, token), rank });
+    }
+    return openai.Tokenizer.parse(allocator, .cl100k_base, file.items);
+}
+
+const http_fixture_body = "{\"object\":\"list\",\"data\":[{\"id\":\"gpt-4o-mini\",\"object\":\"model\",\"created\":1721172741,\"owned_by\":\"system\"}]}";
+
+// `n` concurrent GETs against the loopback server.
+const HttpCase = struct {
+    url: []const u8,
+    n: usize,
+    loop: *event_http.Loop,
+    client: *openai.Client,
+    failures: usize = 0,
+};
+
+// All n requests in flight on this thread through one event loop.
+fn eventedCase(ctx: *HttpCase, allocator: std.mem.Allocator) anyerror!void {
+    _ = allocator;
+    for (0..ctx.n) |_| try ctx.loop.submit(.{ .url = ctx.url }, .{ .ctx = ctx, .onDone = eventedDone });
+    try ctx.loop.run();
+    if (ctx.failures != 0) return error.RequestFailed;
+}
+
+fn eventedDone(opaque_ctx: ?*anyopaque, result: anyerror!event_http.Response) void {
+    const ctx: *HttpCase = @ptrCast(@alignCast(opaque_ctx.?));
+    var resp = result catch {
+        ctx.failures += 1;
+        return;
+    };
+    defer resp.deinit(ctx.loop.allocator);
+    if (resp.status != 200 or resp.body.len != http_fixture_body.len) ctx.failures += 1;
+}
+
+// What concurrency cost before: one blocking thread per request on the
+// shared pooled client.
+fn threadPerRequestCase(ctx: *HttpCase, allocator: std.mem.Allocator) anyerror!void {
+    const threads = try allocator.alloc(std.Thread, ctx.n);
+    defer allocator.free(threads);
+    var failures = std.atomic.Value(usize).init(0);
+    for (threads) |*t| t.* = try std.Thread.spawn(.{ .stack_size = 256 * 1024 }, blockingGet, .{ ctx, &failures });
+    for (threads) |t| t.join();
+    if (failures.load(.monotonic) != 0) return error.RequestFailed;
+}
+
+fn blockingGet(ctx: *HttpCase, failures: *std.atomic.Value(usize)) void {
+    const allocator = std.heap.smp_allocator;
+    var req = ctx.client.send(.{ .method = .GET, .url = ctx.url }, null, 0, null) catch {
+        _ = failures.fetchAdd(1, .monotonic);
+        return;
+    };
+    defer req.deinit();
+    const body = openai.client.readBody(allocator, &req, null) catch {
+        _ = failures.fetchAdd(1, .monotonic);
+        return;
+    };
+    defer allocator.free(body);
+    if (body.len != http_fixture_body.len) _ = failures.fetchAdd(1, .monotonic);
+}
+
+// Aborts unless one evented request returns the fixture body intact.
+fn checkEvented(ctx: *HttpCase) !void {
+    var future = event_http.Future{};
+    try ctx.loop.submit(.{ .url = ctx.url }, future.callback());
+    var resp = try future.wait(ctx.loop);
+    defer resp.deinit(ctx.loop.allocator);
+    if (resp.status != 200 or !std.mem.eql(u8, resp.body, http_fixture_body)) {
+        std.debug.print("evented http: unexpected response {d} {s}\n", .{ resp.status, resp.body });
+        return error.KernelMismatch;
+    }
+}
+
+const HedgeCase = struct {
+    url: []const u8,
+    client: *openai.Client,
+    hedger: *hedge.Hedger,
+};
+
+// One GET attempt for the hedger; the result is the body length.
+const HedgeAttempt = struct {
+    case: *HedgeCase,
+
+    pub fn attempt(self: *const HedgeAttempt, cancel: *const hedge.Hedger.Cancel) anyerror!usize {
+        if (cancel.load(.acquire)) return error.Canceled;
+        return getBodyLen(self.case);
+    }
+
+    pub fn discard(_: *const HedgeAttempt, _: usize) void {}
+    pub fn deinit(_: *HedgeAttempt) void {}
+};
+
+fn getBodyLen(ctx: *HedgeCase) !usize {
+    const allocator = std.heap.smp_allocator;
+    var req = try ctx.client.send(.{ .method = .GET, .url = ctx.url }, null, 0, null);
+    defer req.deinit();
+    const body = try openai.client.readBody(allocator, &req, null);
+    defer allocator.free(body);
+    return body.len;
+}
+
+fn unhedgedCase(ctx: *HedgeCase, allocator: std.mem.Allocator) anyerror!void {
+    _ = allocator;
+    std.mem.doNotOptimizeAway(try getBodyLen(ctx));
+}
+
+fn hedgedCase(ctx: *HedgeCase, allocator: std.mem.Allocator) anyerror!void {
+    _ = allocator;
+    std.mem.doNotOptimizeAway(try ctx.hedger.race(usize, HedgeAttempt, .{ .case = ctx }));
+}
+
+// Prints p50 / p99 of 400 requests without and with hedging, plus the
+// hedge counters; aborts on a wrong body.
+fn checkHedging(allocator: std.mem.Allocator, ctx: *HedgeCase) !void {
+    const n = 400;
+    const lat = try allocator.alloc(u64, n);
+    defer allocator.free(lat);
+    for ([_]bool{ false, true }) |hedged| {
+        for (lat) |*l| {
+            var timer = try std.time.Timer.start();
+            const len = if (hedged)
+                try ctx.hedger.race(usize, HedgeAttempt, .{ .case = ctx })
+            else
+                try getBodyLen(ctx);
+            l.* = timer.read();
+            if (len != http_fixture_body.len) {
+                std.debug.print("hedge: body of {d} bytes, expected {d}\n", .{ len, http_fixture_body.len });
+                return error.KernelMismatch;
+            }
+        }
+        std.mem.sort(u64, lat, {}, std.sort.asc(u64));
+        std.debug.print("hedge {s}: p50 {d} us, p99 {d} us\n", .{ if (hedged) "on " else "off", lat[n / 2] / 1000, lat[n * 99 / 100] / 1000 });
+    }
+    const st = ctx.hedger.stats();
+    std.debug.print("hedge: {d} requests, {d} hedges issued, {d} won, {d} denied by budget\n", .{ st.requests, st.hedges_issued, st.hedges_won, st.hedges_denied });
+}
+
+// How long the deadline server holds each response.
+const stall_ms = 200;
+
+// Bookkeeping one bounded request adds, without the request.
+fn guardCase(token: *openai.deadline.CancelToken, allocator: std.mem.Allocator) anyerror!void {
+    _ = allocator;
+    const deadline = openai.deadline;
+    var guard: deadline.Guard = undefined;
+    try guard.start(deadline.Context.init(.{ .connect_ms = 10_000, .first_byte_ms = 30_000, .total_ms = 60_000 }, token));
+    defer guard.finish();
+    try guard.phase(.first_byte);
+    try guard.phase(.body);
+}
+
+// A request waiting on a stalled response head must stop at its
+// first-byte deadline, and when its token is canceled.
+fn checkDeadline(client: *openai.Client) !void {
+    const deadline = openai.deadline;
+    try expectStopped(client, deadline.Context.init(.{ .first_byte_ms = 50 }, null), error.DeadlineExceeded);
+
+    var token: deadline.CancelToken = .{};
+    const canceler = try std.Thread.spawn(.{}, cancelAfter, .{ &token, 50 });
+    defer canceler.join();
+    try expectStopped(client, deadline.Context.init(.{}, &token), error.Canceled);
+}
+
+fn cancelAfter(token: *openai.deadline.CancelToken, ms: u64) void {
+    std.Thread.sleep(ms * std.time.ns_per_ms);
+    token.cancel();
+}
+
+fn expectStopped(client: *openai.Client, ctx: openai.deadline.Context, want: anyerror) !void {
+    const allocator = std.heap.smp_allocator;
+    var timer = try std.time.Timer.start();
+    const result = openai.fetchModelsJsonCtx(allocator, client, "sk-bench", ctx);
+    const ms = timer.read() / std.time.ns_per_ms;
+    if (result) |resp| {
+        allocator.free(resp.body);
+        std.debug.print("deadline: request completed, expected {s}\n", .{@errorName(want)});
+        return error.KernelMismatch;
+    } else |e| {
+        if (e != want or ms >= stall_ms * 3 / 4) {
+            std.debug.print("deadline: {s} after {d} ms, expected {s} before {d} ms\n", .{ @errorName(e), ms, @errorName(want), stall_ms * 3 / 4 });
+            return error.KernelMismatch;
+        }
+        std.debug.print("deadline: {s} after {d} ms\n", .{ @errorName(e), ms });
+    }
+}
+
+fn cstrCase(input: []const u8, allocator: std.mem.Allocator) anyerror!void {
+    const out = try cstr.toCString(allocator, input);
+    defer allocator.free(out);
+    std.mem.doNotOptimizeAway(out.ptr);
+}
+
+// Previous path: full DOM, then one dupe per id.
+fn domExtract(body: []u8, allocator: std.mem.Allocator) anyerror!void {
+    var parsed = try std.json.parseFromSlice(std.json.Value, allocator, body, .{ .ignore_unknown_fields = true });
+    defer parsed.deinit();
+    const data = parsed.value.object.get("data") orelse return error.InvalidResponse;
+
+    var ids: std.ArrayListUnmanaged([]u8) = .{};
+    defer {
+        for (ids.items) |id| allocator.free(id);
+        ids.deinit(allocator);
+    }
+    for (data.array.items) |item| {
+        const id = item.object.get("id") orelse continue;
+        try ids.append(allocator, try allocator.dupe(u8, id.string));
+    }
+    std.mem.doNotOptimizeAway(ids.items.len);
+}
+
+// Typed decoder: ids are slices into body.
+fn typedExtract(body: []u8, allocator: std.mem.Allocator) anyerror!void {
+    const ids = try openai.extractModelIds(allocator, body);
+    defer allocator.free(ids);
+    std.mem.doNotOptimizeAway(ids.len);
+}
+
+// What the model list flow does with a 200 body before showing it:
+// decode, join ids with LF, convert to CRLF.
+fn displayText(body: []u8, allocator: std.mem.Allocator) anyerror!void {
+    const ids = try openai.extractModelIds(allocator, body);
+    defer allocator.free(ids);
+    const joined = try std.mem.join(allocator, "\n", ids);
+    defer allocator.free(joined);
+    const out = try text.toCRLF(allocator, joined);
+    defer allocator.free(out);
+    std.mem.doNotOptimizeAway(out.ptr);
+}
+
+fn buildBody(prompt: []const u8, allocator: std.mem.Allocator) anyerror!void {
+    const body = try openai.chatgpt.buildChatBody(allocator, "gpt-4o-mini", prompt, false);
+    defer allocator.free(body);
+    std.mem.doNotOptimizeAway(body.ptr);
+}
+
+// Writes the streamed body to a counting sink: no allocation at any size.
+fn streamBody(prompt: []const u8, allocator: std.mem.Allocator) anyerror!void {
+    _ = allocator;
+    const messages = [_]openai.request_body.Message{.{ .role = .user, .content = .{ .bytes = prompt } }};
+    const body = openai.ChatBody{ .model = "gpt-4o-mini", .messages = &messages };
+    var sink = std.io.countingWriter(std.io.null_writer);
+    try body.writeTo(sink.writer());
+    std.mem.doNotOptimizeAway(sink.bytes_written);
+}
+
+// The streamed body, from a slice and from a reader, must match
+// `buildChatBody` byte for byte, and its precomputed length the real one.
+fn checkRequestBody(allocator: std.mem.Allocator, prompt: []const u8) !void {
+    const built = try openai.chatgpt.buildChatBody(allocator, "gpt-4o-mini", prompt, false);
+    defer allocator.free(built);
+    var out = std.ArrayList(u8).init(allocator);
+    defer out.deinit();
+
+    const from_slice = [_]openai.request_body.Message{.{ .role = .user, .content = .{ .bytes = prompt } }};
+    const body = openai.ChatBody{ .model = "gpt-4o-mini", .messages = &from_slice };
+    try body.writeTo(out.writer());
+    if (!std.mem.eql(u8, out.items, built) or body.contentLength() != built.len) return error.KernelMismatch;
+
+    out.clearRetainingCapacity();
+    var stream = std.io.fixedBufferStream(prompt);
+    const from_reader = [_]openai.request_body.Message{.{ .role = .user, .content = .{ .reader = stream.reader().any() } }};
+    const streamed = openai.ChatBody{ .model = "gpt-4o-mini", .messages = &from_reader };
+    try streamed.writeTo(out.writer());
+    if (!std.mem.eql(u8, out.items, built) or streamed.contentLength() != null) return error.KernelMismatch;
+}
+
+// ~n bytes of short LF-terminated lines, like a model list.
+fn syntheticLines(allocator: std.mem.Allocator, n: usize) ![]u8 {
+    const out = try allocator.alloc(u8, n);
+    for (out, 0..) |*c, i| c.* = if (i % 24 == 23) '\n' else 'a' + @as(u8, @intCast(i % 26));
+    return out;
+}
+
+// n bytes of prose with the characters JSON escaping has to handle
+// (quotes, backslashes, newlines, tabs) sprinkled in.
+fn syntheticPrompt(allocator: std.mem.Allocator, n: usize) ![]u8 {
+    const sample = "Summarize the \"quoted\" text below.\n\tIt has C:\\paths and plain words; ";
+    const out = try allocator.alloc(u8, n);
+    for (out, 0..) |*c, i| c.* = sample[i % sample.len];
+    return out;
+}
+
+// ~n bytes of mostly ASCII text with some multi-byte characters, like a
+// transcript in a mixed-language conversation.
+fn syntheticUtf8(allocator: std.mem.Allocator, n: usize) ![]u8 {
+    const sample = "The model said: 안녕하세요, ça va? Answer in 日本語 please. ";
+    const out = try allocator.alloc(u8, n);
+    for (out, 0..) |*c, i| c.* = sample[i % sample.len];
+    // Cutting the sample mid-character would make the tail invalid.
+    const end = kernels.utf8ValidPrefix(out);
+    @memset(out[end..], ' ');
+    return out;
+}
+
+// Mirrors the real payload shape: a few scalar fields per model plus
+// fields the client never reads.
+fn syntheticModelList(allocator: std.mem.Allocator, n: usize) ![]u8 {
+    var out: std.ArrayListUnmanaged(u8) = .{};
+    errdefer out.deinit(allocator);
+    try out.appendSlice(allocator, "{\"object\":\"list\",\"data\":[");
+    var buf: [256]u8 = undefined;
+    for (0..n) |i| {
+        if (i > 0) try out.append(allocator, ',');
+        const item = try std.fmt.bufPrint(&buf,
+            \\{{"id":"model-{d}-preview","object":"model","created":{d},"owned_by":"system","permission":[{{"allow_view":true}}]}}
+        , .{ i, 1700000000 + i });
+        try out.appendSlice(allocator, item);
+    }
+    try out.appendSlice(allocator, "]}");
+    return out.toOwnedSlice(allocator);
+}
@@ -0,0 +1,205 @@
+//! Minimal benchmark harness.
+//! - Each case is warmed up (which also calibrates the iteration count so a
+//!   run lasts at least `min_run_ns`), then timed over `runs` runs; the
+//!   median run is reported.
+//! - The case's allocator is wrapped in a CountingAllocator, giving
+//!   bytes/op and allocations/op next to ns/op.
+//! - Results print as a text table and can be written as JSON. A previous
+//!   JSON file can be loaded as a baseline: every case then shows its
+//!   ns/op change in percent, and slowdowns past `threshold_pct` are
+//!   counted as regressions.
+const std = @import("std");
+const openai = @import("openai");
+const CountingAllocator = @import("../util/counting_allocator.zig").CountingAllocator;
+
+pub const Options = struct {
+    warmup_ns: u64 = 100 * std.time.ns_per_ms,
+    min_run_ns: u64 = 50 * std.time.ns_per_ms,
+    runs: usize = 5,
+    // Only cases whose name contains this substring run.
+    filter: ?[]const u8 = null,
+    // Write results here as JSON.
+    json_path: ?[]const u8 = null,
+    // Compare against a JSON file written by an earlier run.
+    baseline_path: ?[]const u8 = null,
+    // ns/op increase (percent) counted as a regression.
+    threshold_pct: f64 = 10,
+};
+
+pub const Result = struct {
+    // Case name; must outlive the harness (string literals in practice).
+    name: []const u8,
+    // Input size parameter (items or bytes, depending on the case).
+    size: usize,
+    // Bytes of input processed per op, for GB/s (0 if not meaningful).
+    input_bytes: usize,
+    ns_per_op: f64,
+    bytes_per_op: f64,
+    allocs_per_op: f64,
+};
+
+// Shape of the JSON report; also what `--baseline` reads back.
+const Report = struct {
+    results: []const BaselineEntry,
+};
+
+const BaselineEntry = struct {
+    name: []const u8,
+    size: usize,
+    ns_per_op: f64,
+};
+
+pub const Harness = struct {
+    allocator: std.mem.Allocator,
+    options: Options,
+    results: std.ArrayListUnmanaged(Result) = .{},
+    // Baseline file contents; entries point into it.
+    baseline_bytes: ?[]u8 = null,
+    baseline: []const BaselineEntry = &.{},
+    regressions: usize = 0,
+
+    pub fn init(allocator: std.mem.Allocator, options: Options) !Harness {
+        var h = Harness{ .allocator = allocator, .options = options };
+        if (options.baseline_path) |path| {
+            const bytes = try std.fs.cwd().readFileAlloc(allocator, path, 16 * 1024 * 1024);
+            errdefer allocator.free(bytes);
+            const report = try openai.decode.decodeLeaky(Report, allocator, bytes);
+            h.baseline_bytes = bytes;
+            h.baseline = report.results;
+        }
+        printHeader(options.baseline_path != null);
+        return h;
+    }
+
+    pub fn deinit(self: *Harness) void {
+        self.results.deinit(self.allocator);
+        if (self.baseline_bytes) |b| {
+            self.allocator.free(self.baseline);
+            self.allocator.free(b);
+        }
+    }
+
+    // Benchmarks `f(ctx, allocator)`. The allocator passed in counts every
+    // allocation the case makes; `f` must free what it allocates.
+    pub fn run(
+        self: *Harness,
+        name: []const u8,
+        size: usize,
+        input_bytes: usize,
+        ctx: anytype,
+        comptime f: fn (@TypeOf(ctx), std.mem.Allocator) anyerror!void,
+    ) !void {
+        if (self.options.filter) |filter| {
+            if (std.mem.indexOf(u8, name, filter) == null) return;
+        }
+
+        var counting = CountingAllocator.init(self.allocator);
+        const a = counting.allocator();
+
+        // Warmup doubles as calibration: iterations per run ≈ min_run_ns
+        // worth of ops at the warmed-up speed.
+        var timer = try std.time.Timer.start();
+        var warm_iters: u64 = 0;
+        while (warm_iters == 0 or timer.read() < self.options.warmup_ns) : (warm_iters += 1) {
+            try f(ctx, a);
+        }
+        const warm_ns = @max(timer.read(), 1);
+        const iters = @max(1, self.options.min_run_ns * warm_iters / warm_ns);
+
+        const samples = try self.allocator.alloc(f64, @max(self.options.runs, 1));
+        defer self.allocator.free(samples);
+        for (samples) |*sample| {
+            counting.reset();
+            timer.reset();
+            for (0..iters) |_| try f(ctx, a);
+            sample.* = @as(f64, @floatFromInt(timer.read())) / @as(f64, @floatFromInt(iters));
+        }
+        std.mem.sort(f64, samples, {}, std.sort.asc(f64));
+
+        // Allocation counts are deterministic per op; take the last run's.
+        const n: f64 = @floatFromInt(iters);
+        const result = Result{
+            .name = name,
+            .size = size,
+            .input_bytes = input_bytes,
+            .ns_per_op = samples[samples.len / 2],
+            .bytes_per_op = @as(f64, @floatFromInt(counting.bytes_allocated)) / n,
+            .allocs_per_op = @as(f64, @floatFromInt(counting.allocs)) / n,
+        };
+        try self.results.append(self.allocator, result);
+        self.printRow(result);
+    }
+
+    // Writes the JSON report (if requested) and prints the regression
+    // summary. Returns the number of regressions against the baseline.
+    pub fn finish(self: *Harness) !usize {
+        if (self.options.json_path) |path| {
+            const json = try self.toJson();
+            defer self.allocator.free(json);
+            try std.fs.cwd().writeFile(.{ .sub_path = path, .data = json });
+            std.debug.print("wrote {s}\n", .{path});
+        }
+        if (self.options.baseline_path) |path| {
+            std.debug.print("{d} regression(s) over {d:.0}% vs {s}\n", .{ self.regressions, self.options.threshold_pct, path });
+        }
+        return self.regressions;
+    }
+
+    fn toJson(self: *Harness) ![]u8 {
+        var out: std.ArrayListUnmanaged(u8) = .{};
+        errdefer out.deinit(self.allocator);
+        try out.appendSlice(self.allocator, "{\"results\":[\n");
+        for (self.results.items, 0..) |r, i| {
+            const name = try std.json.stringifyAlloc(self.allocator, r.name, .{});
+            defer self.allocator.free(name);
+            const line = try std.fmt.allocPrint(self.allocator,
+                \\{{"name":{s},"size":{d},"input_bytes":{d},"ns_per_op":{d:.3},"bytes_per_op":{d:.3},"allocs_per_op":{d:.3}}}{s}
+                \\
+            , .{ name, r.size, r.input_bytes, r.ns_per_op, r.bytes_per_op, r.allocs_per_op, if (i + 1 < self.results.items.len) "," else "" });
+            defer self.allocator.free(line);
+            try out.appendSlice(self.allocator, line);
+        }
+        try out.appendSlice(self.allocator, "]}\n");
+        return out.toOwnedSlice(self.allocator);
+    }
+
+    fn baselineFor(self: *Harness, r: Result) ?f64 {
+        for (self.baseline) |b| {
+            if (b.size == r.size and std.mem.eql(u8, b.name, r.name)) return b.ns_per_op;
+        }
+        return null;
+    }
+
+    fn printHeader(with_baseline: bool) void {
+        std.debug.print("{s:<28} {s:>8} {s:>12} {s:>10} {s:>12} {s:>10}{s}\n", .{
+            "case", "size", "ns/op", "GB/s", "B/op", "allocs/op", if (with_baseline) "   vs base" else "",
+        });
+    }
+
+    fn printRow(self: *Harness, r: Result) void {
+        // Bytes per nanosecond is GB/s.
+        var gbps_buf: [32]u8 = undefined;
+        const gbps = if (r.input_bytes == 0) "-" else std.fmt.bufPrint(&gbps_buf, "{d:.3}", .{
+            @as(f64, @floatFromInt(r.input_bytes)) / @max(r.ns_per_op, 1e-9),
+        }) catch "?";
+
+        var delta_buf: [48]u8 = undefined;
+        var delta: []const u8 = "";
+        if (self.options.baseline_path != null) {
+            if (self.baselineFor(r)) |base| {
+                const pct = (r.ns_per_op - base) / @max(base, 1e-9) * 100;
+                const regressed = pct > self.options.threshold_pct;
+                if (regressed) self.regressions += 1;
+                delta = std.fmt.bufPrint(&delta_buf, "   {s}{d:.1}%{s}", .{
+                    if (pct >= 0) "+" else "", pct, if (regressed) "  REGRESSION" else "",
+                }) catch "";
+            } else {
+                delta = "   (new)";
+            }
+        }
+
+        std.debug.print("{s:<28} {d:>8} {d:>12.1} {s:>10} {d:>12.1} {d:>10.2}{s}\n", .{
+            r.name, r.size, r.ns_per_op, gbps, r.bytes_per_op, r.allocs_per_op, delta,
+        });
+    }
+};
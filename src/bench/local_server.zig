@@ -0,0 +1,106 @@
+//! Loopback HTTP/1.1 server for transport benchmarks.
+//! - Answers every request with the same keep-alive 200 response; request
+//!   bodies (Content-Length) are read and discarded.
+//! - One thread per connection, so it never becomes the bottleneck of a
+//!   single-threaded client.
+//! - Optional latency spikes (every `spike_every`th request waits
+//!   `spike_ms`) stand in for a slow server replica.
+const std = @import("std");
+
+pub const Options = struct {
+    spike_every: u32 = 0,
+    spike_ms: u32 = 0,
+};
+
+// Requests answered, across servers (drives the spike schedule).
+var served = std.atomic.Value(u64).init(0);
+
+pub const LocalServer = struct {
+    server: std.net.Server,
+    thread: std.Thread,
+    body: []const u8,
+    options: Options,
+    stopping: std.atomic.Value(bool) = std.atomic.Value(bool).init(false),
+
+    // `body` must outlive every connection (a string literal in practice).
+    pub fn start(allocator: std.mem.Allocator, body: []const u8, options: Options) !*LocalServer {
+        const self = try allocator.create(LocalServer);
+        errdefer allocator.destroy(self);
+        const addr = try std.net.Address.parseIp("127.0.0.1", 0);
+        self.* = .{ .server = try addr.listen(.{ .reuse_address = true, .kernel_backlog = 1024 }), .thread = undefined, .body = body, .options = options };
+        errdefer self.server.deinit();
+        self.thread = try std.Thread.spawn(.{}, acceptLoop, .{self});
+        return self;
+    }
+
+    pub fn port(self: *const LocalServer) u16 {
+        return self.server.listen_address.getPort();
+    }
+
+    // Close client connections first; connection threads end on EOF.
+    pub fn stop(self: *LocalServer, allocator: std.mem.Allocator) void {
+        self.stopping.store(true, .release);
+        // Wake the blocking accept.
+        if (std.net.tcpConnectToAddress(self.server.listen_address)) |s| s.close() else |_| {}
+        self.thread.join();
+        self.server.deinit();
+        allocator.destroy(self);
+    }
+
+    fn acceptLoop(self: *LocalServer) void {
+        while (!self.stopping.load(.acquire)) {
+            const conn = self.server.accept() catch continue;
+            if (self.stopping.load(.acquire)) {
+                conn.stream.close();
+                return;
+            }
+            const t = std.Thread.spawn(.{ .stack_size = 64 * 1024 }, serve, .{ conn.stream, self.body, self.options }) catch {
+                conn.stream.close();
+                continue;
+            };
+            t.detach();
+        }
+    }
+
+    fn serve(stream: std.net.Stream, body: []const u8, options: Options) void {
+        defer stream.close();
+        var head_buf: [128]u8 = undefined;
+        const head = std.fmt.bufPrint(&head_buf, "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nContent-Length: {d}\r\n\r\n", .{body.len}) catch return;
+        var buf: [16 * 1024]u8 = undefined;
+        var len: usize = 0;
+        while (true) {
+            const end = std.mem.indexOf(u8, buf[0..len], "\r\n\r\n") orelse {
+                if (len == buf.len) return;
+                const n = stream.read(buf[len..]) catch return;
+                if (n == 0) return;
+                len += n;
+                continue;
+            };
+            var skip = end + 4 + contentLength(buf[0..end]);
+            // Drop the request (and any body bytes still to arrive).
+            while (skip > len) {
+                skip -= len;
+                len = stream.read(&buf) catch return;
+                if (len == 0) return;
+            }
+            std.mem.copyForwards(u8, buf[0 .. len - skip], buf[skip..len]);
+            len -= skip;
+            const n = served.fetchAdd(1, .monotonic);
+            if (options.spike_every != 0 and n % options.spike_every == options.spike_every - 1) {
+                std.Thread.sleep(@as(u64, options.spike_ms) * std.time.ns_per_ms);
+            }
+            stream.writeAll(head) catch return;
+            stream.writeAll(body) catch return;
+        }
+    }
+
+    fn contentLength(head: []const u8) usize {
+        var lines = std.mem.splitSequence(u8, head, "\r\n");
+        while (lines.next()) |line| {
+            const colon = std.mem.indexOfScalar(u8, line, ':') orelse continue;
+            if (!std.ascii.eqlIgnoreCase(line[0..colon], "content-length")) continue;
+            return std.fmt.parseInt(usize, std.mem.trim(u8, line[colon + 1 ..], " \t"), 10) catch 0;
+        }
+        return 0;
+    }
+};
@@ -0,0 +1,166 @@
+const std = @import("std");
+const secrets = @import("../platform/secrets.zig");
+const trace = @import("trace");
+
+// Process-lifetime API key cache in front of the provider chain
+// environment variable → stored key file → prompt.
+// - The chain runs once; afterwards `authHeader` hands out a copy of the
+//   prebuilt "Authorization: Bearer <key>\r\n" line without touching the
+//   environment, the file or DPAPI.
+// - The cached header sits in a `secrets.SecretBuffer` (own pages, locked,
+//   zeroed on free).
+// - `invalidate` (after a 401) drops the cache and remembers the rejected
+//   key, so the next resolve skips sources that still hold it and moves on
+//   to the prompt.
+// Thread-safe; the prompt source only runs when the caller passes one
+// (UI thread).
+pub const Source = enum { env, file, prompt };
+
+// Asks the user for a key. Returns an allocated key (zeroed and freed by
+// the provider) or null when cancelled.
+pub const PromptFn = *const fn (allocator: std.mem.Allocator) ?[]u8;
+
+pub const Provider = struct {
+    env_var: []const u8,
+    // Key file override; null uses the app data key file.
+    key_file: ?[]const u8 = null,
+    mutex: std.Thread.Mutex = .{},
+    cached: ?Cached = null,
+    // Hash of the last key the server rejected.
+    rejected: ?u64 = null,
+    // Bumped whenever the cached key changes; lets `invalidate` ignore
+    // reports about a key that was already replaced.
+    generation: u64 = 0,
+    counters: Stats = .{},
+
+    const header_prefix = "Authorization: Bearer ";
+    const header_suffix = "\r\n";
+
+    const Cached = struct {
+        header: secrets.SecretBuffer,
+        source: Source,
+    };
+
+    pub const Stats = struct {
+        // Chain runs (env / file / prompt lookups).
+        resolves: u64 = 0,
+        // Headers served from the cache.
+        hits: u64 = 0,
+        invalidations: u64 = 0,
+    };
+
+    // A copy of the header for one request. Call `deinit` to zero it.
+    pub const Auth = struct {
+        header: []u8,
+        generation: u64,
+        source: Source,
+
+        pub fn deinit(self: *Auth, allocator: std.mem.Allocator) void {
+            std.crypto.secureZero(u8, self.header);
+            allocator.free(self.header);
+            self.* = undefined;
+        }
+    };
+
+    pub fn init(env_var: []const u8) Provider {
+        return .{ .env_var = env_var };
+    }
+
+    // Zeroes the cached key; call at exit.
+    pub fn deinit(self: *Provider) void {
+        self.mutex.lock();
+        defer self.mutex.unlock();
+        self.dropLocked();
+    }
+
+    // Returns the header line, resolving the key through the chain on the
+    // first call (or after `invalidate`). `prompt` is only consulted when
+    // the environment and the key file have nothing usable.
+    pub fn authHeader(self: *Provider, allocator: std.mem.Allocator, prompt: ?PromptFn) ?Auth {
+        self.mutex.lock();
+        defer self.mutex.unlock();
+        if (self.cached == null) {
+            const span = trace.begin("credentials/resolve");
+            defer span.end();
+            self.counters.resolves += 1;
+            self.resolveLocked(allocator, prompt) catch return null;
+            if (self.cached == null) return null;
+        } else {
+            self.counters.hits += 1;
+        }
+        const cached = &self.cached.?;
+        const header = allocator.dupe(u8, cached.header.bytes()) catch return null;
+        return .{ .header = header, .generation = self.generation, .source = cached.source };
+    }
+
+    // Reports that the server rejected the key of `generation` (HTTP 401).
+    pub fn invalidate(self: *Provider, generation: u64) void {
+        self.mutex.lock();
+        defer self.mutex.unlock();
+        if (generation != self.generation) return;
+        const cached = self.cached orelse return;
+        const header = cached.header.bytes();
+        self.rejected = keyHash(header[header_prefix.len .. header.len - header_suffix.len]);
+        self.dropLocked();
+        self.counters.invalidations += 1;
+    }
+
+    pub fn stats(self: *Provider) Stats {
+        self.mutex.lock();
+        defer self.mutex.unlock();
+        return self.counters;
+    }
+
+    fn resolveLocked(self: *Provider, allocator: std.mem.Allocator, prompt: ?PromptFn) !void {
+        if (std.process.getEnvVarOwned(allocator, self.env_var) catch null) |k| {
+            defer wipe(allocator, k);
+            if (try self.acceptLocked(k, .env)) return;
+        }
+        const stored = if (self.key_file) |path|
+            secrets.loadEncryptedFrom(allocator, path) catch null
+        else
+            secrets.loadEncrypted(allocator) catch null;
+        if (stored) |k| {
+            defer wipe(allocator, k);
+            if (try self.acceptLocked(k, .file)) return;
+        }
+        const ask = prompt orelse return;
+        // The prompt is modal; other threads wait for its answer.
+        if (ask(allocator)) |k| {
+            defer wipe(allocator, k);
+            _ = try self.acceptLocked(k, .prompt);
+        }
+    }
+
+    // Caches `key` unless it is empty or was rejected before.
+    fn acceptLocked(self: *Provider, key: []const u8, source: Source) !bool {
+        const trimmed = std.mem.trim(u8, key, " \t\r\n");
+        if (trimmed.len == 0) return false;
+        if (self.rejected) |r| if (r == keyHash(trimmed)) return false;
+        var buf = try secrets.SecretBuffer.init(header_prefix.len + trimmed.len + header_suffix.len);
+        const out = buf.bytes();
+        @memcpy(out[0..header_prefix.len], header_prefix);
+        @memcpy(out[header_prefix.len..][0..trimmed.len], trimmed);
+        @memcpy(out[out.len - header_suffix.len ..], header_suffix);
+        self.cached = .{ .header = buf, .source = source };
+        self.generation += 1;
+        return true;
+    }
+
+    fn dropLocked(self: *Provider) void {
+        if (self.cached) |*cached| cached.header.deinit();
+        self.cached = null;
+    }
+
+    fn keyHash(key: []const u8) u64 {
+        return std.hash.Wyhash.hash(0, key);
+    }
+
+    fn wipe(allocator: std.mem.Allocator, key: []u8) void {
+        std.crypto.secureZero(u8, key);
+        allocator.free(key);
+    }
+};
+
+// The OpenAI key shared by every feature of the process.
+pub var openai = Provider.init("OPENAI_API_KEY");
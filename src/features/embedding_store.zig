@@ -0,0 +1,184 @@
+const std = @import("std");
+const mmap = @import("../platform/mmap.zig");
+const models_cache = @import("models_cache.zig");
+const trace = @import("trace");
+
+// Local embedding store (%APPDATA%\ohmyzig\embeddings.bin), read zero-copy
+// via mmap: searches run straight over the mapped vectors.
+//
+// Layout (host byte order, little endian on every supported target):
+//   [0..64)   Header
+//   keys      count x u64          (`key(model, text)` of each row)
+//   vectors   count x dims x f32   (unit length; 64-byte aligned)
+//
+// Rows are only ever added: `Builder` writes the old rows plus the new ones
+// to a temp file and renames it over the store, like models.bin.
+pub const magic = "OMZE";
+pub const version: u16 = 1;
+pub const header_size: u32 = 64;
+pub const file_name = "embeddings.bin";
+
+const vector_align = 64;
+
+const Header = struct {
+    dims: u32,
+    count: u32,
+    keys_offset: u32,
+    vectors_offset: u32,
+
+    const off_magic = 0;
+    const off_version = 4;
+    const off_dims = 8;
+    const off_count = 12;
+    const off_keys = 16;
+    const off_vectors = 20;
+
+    fn encode(h: Header, out: *[header_size]u8) void {
+        @memset(out, 0);
+        @memcpy(out[off_magic..][0..4], magic);
+        std.mem.writeInt(u16, out[off_version..][0..2], version, .little);
+        std.mem.writeInt(u32, out[off_dims..][0..4], h.dims, .little);
+        std.mem.writeInt(u32, out[off_count..][0..4], h.count, .little);
+        std.mem.writeInt(u32, out[off_keys..][0..4], h.keys_offset, .little);
+        std.mem.writeInt(u32, out[off_vectors..][0..4], h.vectors_offset, .little);
+    }
+
+    fn decode(bytes: []const u8) !Header {
+        if (bytes.len < header_size) return error.CorruptCache;
+        if (!std.mem.eql(u8, bytes[off_magic..][0..4], magic)) return error.CorruptCache;
+        if (std.mem.readInt(u16, bytes[off_version..][0..2], .little) != version) return error.UnsupportedCacheVersion;
+        const h = Header{
+            .dims = std.mem.readInt(u32, bytes[off_dims..][0..4], .little),
+            .count = std.mem.readInt(u32, bytes[off_count..][0..4], .little),
+            .keys_offset = std.mem.readInt(u32, bytes[off_keys..][0..4], .little),
+            .vectors_offset = std.mem.readInt(u32, bytes[off_vectors..][0..4], .little),
+        };
+        const keys_end = @as(u64, h.keys_offset) + @as(u64, h.count) * 8;
+        const vectors_end = @as(u64, h.vectors_offset) + @as(u64, h.count) * h.dims * 4;
+        if (h.dims == 0 or keys_end > bytes.len or vectors_end > bytes.len) return error.CorruptCache;
+        if (h.keys_offset % 8 != 0 or h.vectors_offset % vector_align != 0) return error.CorruptCache;
+        return h;
+    }
+};
+
+// Identifies an embedded text. The model is part of the key: vectors of
+// different models are not comparable.
+pub fn key(model: []const u8, text: []const u8) u64 {
+    var h = std.hash.Wyhash.init(0);
+    h.update(model);
+    h.update("\n");
+    h.update(text);
+    return h.final();
+}
+
+// Open, validated view of the store. Slices are valid until `close`.
+pub const Reader = struct {
+    map: mmap.MappedFile,
+    dims: usize,
+    keys: []const u64,
+    vectors: []const f32,
+    // key -> row, built once at open.
+    rows: std.AutoHashMapUnmanaged(u64, u32) = .{},
+    allocator: std.mem.Allocator,
+
+    // Returns null when there is no usable store (missing or corrupt).
+    pub fn open(allocator: std.mem.Allocator, path: []const u8) !?Reader {
+        const span = trace.begin("cache/embeddings_open");
+        defer span.end();
+        var map = (try mmap.MappedFile.openRead(allocator, path)) orelse return null;
+        errdefer map.close();
+        const h = Header.decode(map.bytes) catch {
+            map.close();
+            return null;
+        };
+        // Mappings are page aligned, so aligned offsets give aligned slices.
+        const keys_ptr: [*]const u64 = @ptrCast(@alignCast(map.bytes.ptr + h.keys_offset));
+        const vectors_ptr: [*]const f32 = @ptrCast(@alignCast(map.bytes.ptr + h.vectors_offset));
+        var self = Reader{
+            .map = map,
+            .dims = h.dims,
+            .keys = keys_ptr[0..h.count],
+            .vectors = vectors_ptr[0 .. @as(usize, h.count) * h.dims],
+            .allocator = allocator,
+        };
+        errdefer self.rows.deinit(allocator);
+        try self.rows.ensureTotalCapacity(allocator, h.count);
+        for (self.keys, 0..) |k, i| self.rows.putAssumeCapacity(k, @intCast(i));
+        return self;
+    }
+
+    pub fn close(self: *Reader) void {
+        self.rows.deinit(self.allocator);
+        self.map.close();
+    }
+
+    pub fn count(self: *const Reader) usize {
+        return self.keys.len;
+    }
+
+    pub fn row(self: *const Reader, i: usize) []const f32 {
+        return self.vectors[i * self.dims ..][0..self.dims];
+    }
+
+    // Row of an already embedded text, if any.
+    pub fn find(self: *const Reader, k: u64) ?usize {
+        return self.rows.get(k);
+    }
+};
+
+// Collects rows for a new store file.
+pub const Builder = struct {
+    allocator: std.mem.Allocator,
+    dims: usize,
+    keys: std.ArrayListUnmanaged(u64) = .{},
+    vectors: std.ArrayListUnmanaged(f32) = .{},
+
+    pub fn init(allocator: std.mem.Allocator, dims: usize) Builder {
+        return .{ .allocator = allocator, .dims = dims };
+    }
+
+    pub fn deinit(self: *Builder) void {
+        self.keys.deinit(self.allocator);
+        self.vectors.deinit(self.allocator);
+    }
+
+    // `vector` must be unit length and `dims` long.
+    pub fn add(self: *Builder, k: u64, vector: []const f32) !void {
+        if (vector.len != self.dims) return error.DimensionMismatch;
+        try self.keys.append(self.allocator, k);
+        try self.vectors.appendSlice(self.allocator, vector);
+    }
+
+    // Copies every row of an existing store (its dims must match).
+    pub fn addAll(self: *Builder, reader: *const Reader) !void {
+        if (reader.dims != self.dims) return error.DimensionMismatch;
+        try self.keys.appendSlice(self.allocator, reader.keys);
+        try self.vectors.appendSlice(self.allocator, reader.vectors);
+    }
+
+    // Atomically replaces the store at `path` with the collected rows.
+    // Close readers of `path` first (Windows will not replace a mapped file).
+    pub fn write(self: *const Builder, path: []const u8) !void {
+        const span = trace.begin("cache/embeddings_write");
+        defer span.end();
+        const n = self.keys.items.len;
+        const keys_offset: usize = header_size;
+        const vectors_offset = std.mem.alignForward(usize, keys_offset + n * 8, vector_align);
+        const total = vectors_offset + self.vectors.items.len * 4;
+        if (total > std.math.maxInt(u32)) return error.CacheTooLarge;
+
+        const out = try self.allocator.alloc(u8, total);
+        defer self.allocator.free(out);
+        @memset(out[keys_offset..vectors_offset], 0);
+        @memcpy(out[keys_offset..][0 .. n * 8], std.mem.sliceAsBytes(self.keys.items));
+        @memcpy(out[vectors_offset..], std.mem.sliceAsBytes(self.vectors.items));
+        const h = Header{
+            .dims = @intCast(self.dims),
+            .count = @intCast(n),
+            .keys_offset = @intCast(keys_offset),
+            .vectors_offset = @intCast(vectors_offset),
+        };
+        h.encode(out[0..header_size]);
+        try models_cache.replaceFile(self.allocator, path, out);
+    }
+};
@@ -0,0 +1,75 @@
+const std = @import("std");
+const ui = @import("../platform/ui.zig");
+const PieceTable = @import("../util/piece_table.zig").PieceTable;
+const text_util = @import("../util/text.zig");
+const trace = @import("trace");
+
+// Text model behind the main window's edit control. Updates go through the
+// piece table, and only the range that changed is sent to the control, so
+// appending a delta or refreshing a mostly unchanged list costs the size of
+// the change, not of the whole text. UI thread only.
+// The control is a Unicode (UTF-16) edit control. The model holds the text
+// as valid UTF-8, as the control shows it, and byte offsets are converted
+// to UTF-16 positions before they reach it.
+pub const MainView = struct {
+    doc: PieceTable,
+    // Length of the control's text in UTF-16 code units.
+    units: usize = 0,
+    // False after an edit failed for lack of memory: the model no longer
+    // matches the control, so the next setText replaces all of it.
+    synced: bool = true,
+
+    pub fn init(allocator: std.mem.Allocator) MainView {
+        return .{ .doc = PieceTable.init(allocator) };
+    }
+
+    pub fn deinit(self: *MainView) void {
+        self.doc.deinit();
+    }
+
+    // Shows `raw` (bytes of malformed UTF-8 become '?'); the control
+    // receives only the span between the common prefix and suffix of the
+    // old and new text. `scratch` is used for the C string of that span.
+    pub fn setText(self: *MainView, scratch: std.mem.Allocator, raw: []const u8) void {
+        const span = trace.begin("ui/update");
+        defer span.end();
+        const text = text_util.validUtf8(scratch, raw) catch return;
+        if (self.synced) {
+            if (self.doc.setText(text)) |change| {
+                if (change) |ch| {
+                    const edit = text_util.controlEdit(text, self.units, ch.start, ch.start + ch.text.len);
+                    ui.replaceMainRange(scratch, edit.start, edit.end, edit.text);
+                    self.units = edit.new_len;
+                }
+                return;
+            } else |_| {}
+        }
+        // Full update, then rebuild the model from scratch.
+        const allocator = self.doc.allocator;
+        self.doc.deinit();
+        self.doc = PieceTable.init(allocator);
+        ui.setMainText(scratch, text);
+        self.units = text_util.utf16Len(text);
+        self.synced = if (self.doc.append(text)) |_| true else |_| false;
+    }
+
+    // Appends `text` at the end (streamed output, transcripts). Dropped
+    // while out of sync; the next setText shows the full text again.
+    // Each call should carry whole characters (decoded stream deltas do); a
+    // character split across calls shows as '?'.
+    pub fn append(self: *MainView, scratch: std.mem.Allocator, raw: []const u8) void {
+        const span = trace.begin("ui/update");
+        defer span.end();
+        if (!self.synced) return;
+        const text = text_util.validUtf8(scratch, raw) catch {
+            self.synced = false;
+            return;
+        };
+        const change = self.doc.append(text) catch {
+            self.synced = false;
+            return;
+        };
+        ui.replaceMainRange(scratch, self.units, self.units, change.text);
+        self.units += text_util.utf16Len(change.text);
+    }
+};
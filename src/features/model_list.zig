@@ -1,180 +1,461 @@
 const std = @import("std");
+const openai = @import("openai");
 const ui = @import("../platform/ui.zig");
 const http = @import("../platform/http.zig");
 const secrets = @import("../platform/secrets.zig");
+const credentials = @import("credentials.zig");
+const paths = @import("../platform/paths.zig");
+const executor = @import("../util/executor.zig");
+const request_arena = @import("../util/request_arena.zig");
+const text_util = @import("../util/text.zig");
+const models_cache = @import("models_cache.zig");
+const MainView = @import("main_view.zig").MainView;
+const trace = @import("trace");
+const deadline = @import("deadline");
+const single_flight = @import("../util/single_flight.zig");
+const hedge = @import("../util/hedge.zig");
 
 fn showMessageBox(allocator: std.mem.Allocator, title: []const u8, body: []const u8) void {
     ui.showInfoMessage(allocator, title, body);
 }
 
-// Fetches available model ids from OpenAI and displays them in a Win32 message box.
-pub fn showAvailableModelsWithWin32(allocator: std.mem.Allocator) void {
-    var api_key_mem: ?[]u8 = null;
-    var api_key_slice: []const u8 = undefined;
-    // 1) Try process env
-    if (std.process.getEnvVarOwned(allocator, "OPENAI_API_KEY") catch null) |k| {
-        api_key_mem = k;
-        api_key_slice = k;
-    } else {
-        // 2) Try encrypted key in AppData
-        if (secrets.loadEncrypted(allocator) catch null) |loaded| {
-            api_key_mem = loaded;
-            api_key_slice = loaded;
-        } else {
-            // 3) Prompt user for API key
-            var save = false;
-            const maybe_key = ui.promptApiKey(allocator, &save);
-            if (maybe_key) |kz| {
-                api_key_mem = kz;
-                api_key_slice = kz;
-                if (save) {
-                    secrets.saveEncrypted(allocator, api_key_slice) catch |e| {
-                        var buf: [160]u8 = undefined;
-                        const msg = std.fmt.bufPrint(&buf, "Failed to save encrypted key: {s}", .{@errorName(e)}) catch "Failed to save encrypted key";
-                        showMessageBox(allocator, "OpenAI Models", msg);
-                    };
-                }
-            } else {
-                showMessageBox(allocator, "OpenAI Models", "API key is required to list models.");
-                return;
-            }
+// Default age after which the cached list is revalidated in the background.
+// Override with OHMYZIG_MODELS_TTL (seconds).
+const default_models_ttl_s: i64 = 24 * 60 * 60;
+
+// Authorization header for a models request, from the process-wide key
+// cache; the environment / key file / prompt chain only runs on the first
+// request and after a 401. UI thread (the prompt is modal).
+// allow_prompt: false for background refreshes, which never interrupt the user.
+fn resolveAuth(allocator: std.mem.Allocator, allow_prompt: bool) ?credentials.Provider.Auth {
+    return credentials.openai.authHeader(allocator, if (allow_prompt) promptApiKey else null);
+}
+
+// Last link of the chain: asks the user, optionally saving the key.
+fn promptApiKey(allocator: std.mem.Allocator) ?[]u8 {
+    var save = false;
+    const key = ui.promptApiKey(allocator, &save) orelse {
+        showMessageBox(allocator, "OpenAI Models", "API key is required to list models.");
+        return null;
+    };
+    if (save) {
+        secrets.saveEncrypted(allocator, key) catch |e| {
+            var buf: [160]u8 = undefined;
+            const msg = std.fmt.bufPrint(&buf, "Failed to save encrypted key: {s}", .{@errorName(e)}) catch "Failed to save encrypted key";
+            showMessageBox(allocator, "OpenAI Models", msg);
+        };
+    }
+    return key;
+}
+
+// Background fetch of the models list. `run` does the network, parsing and
+// cache write on a worker; `complete` applies the result on the UI thread.
+// The job and everything it allocates live in one request arena, released
+// in `destroy`.
+const ModelsJob = struct {
+    job: executor.Job = .{ .run = run, .complete = complete },
+    // Arena allocator; individual frees are optional.
+    allocator: std.mem.Allocator,
+    arena: *request_arena.RequestArena,
+    arenas: *request_arena.ArenaPool,
+    jobs: *executor.Executor,
+    view: *MainView,
+    // "Authorization: Bearer ...\r\n"; zeroed in `destroy`.
+    auth_header: []u8,
+    // Credential generation the header came from (for 401 invalidation).
+    auth_generation: u64,
+    mode: Mode,
+    outcome: Outcome = .{ .message = "" },
+
+    const Mode = enum {
+        // User asked for it: errors and offline fallbacks are shown.
+        foreground,
+        // Stale-while-revalidate refresh: only a changed list is applied.
+        revalidate,
+    };
+
+    const Outcome = union(enum) {
+        // Server answered 304; the cached list is current.
+        not_modified,
+        // CRLF text for the main view
+        text: []u8,
+        // Cached text shown after a network failure
+        cached: []u8,
+        // Error message for a message box
+        message: []const u8,
+    };
+
+    fn run(job: *executor.Job) void {
+        const self: *ModelsJob = @fieldParentPtr("job", job);
+        self.outcome = fetchModelsText(self.allocator, self.auth_header, self.auth_generation);
+    }
+
+    fn complete(job: *executor.Job) void {
+        const self: *ModelsJob = @fieldParentPtr("job", job);
+        const allocator = self.allocator;
+        defer self.destroy();
+        if (self.mode == .revalidate and self.outcome != .text) return;
+        switch (self.outcome) {
+            .not_modified => {},
+            .text => |t| {
+                self.view.setText(allocator, t);
+                self.jobs.markFirstPaint();
+            },
+            .cached => |t| ui.showScrollableText(allocator, "Available OpenAI Models (cached)", t),
+            .message => |m| showMessageBox(allocator, "OpenAI Models", m),
         }
     }
-    defer if (api_key_mem) |m| allocator.free(m);
+
+    // Frees the job, its key and outcome in one go.
+    fn destroy(self: *ModelsJob) void {
+        std.crypto.secureZero(u8, self.auth_header);
+        self.arenas.release(self.arena);
+    }
+};
+
+fn failure(allocator: std.mem.Allocator, comptime fmt: []const u8, e: anyerror) ModelsJob.Outcome {
+    const msg = std.fmt.allocPrint(allocator, fmt, .{@errorName(e)}) catch return .{ .message = "" };
+    return .{ .message = msg };
+}
+
+// Worker-side part of the flow: GET /v1/models, parse, cache. No UI calls.
+// When a cached list exists the request is conditional, and a 304 answer
+// only refreshes the fetch time (no body, no parse, no id rewrite).
+fn fetchModelsText(allocator: std.mem.Allocator, auth_header: []const u8, auth_generation: u64) ModelsJob.Outcome {
+    const span = trace.begin("models/fetch");
+    defer span.end();
+
+    const cache_path = paths.appDataFile(allocator, models_cache.file_name) catch |e| {
+        return failure(allocator, "Cache path error: {s}", e);
+    };
+    defer allocator.free(cache_path);
 
     // HTTP GET /v1/models using WinINet (works reliably under Zig 0.15)
-    // Build Authorization header: "Authorization: Bearer <key>\r\n"
-    const header = std.fmt.allocPrint(allocator, "Authorization: Bearer {s}\r\n", .{api_key_slice}) catch |e| {
-        var buf: [128]u8 = undefined;
-        const msg = std.fmt.bufPrint(&buf, "Header build error: {s}", .{@errorName(e)}) catch "Header build error";
-        showMessageBox(allocator, "OpenAI Models", msg);
-        return;
+    // Build header block: "Authorization: Bearer <key>\r\n" plus validators
+    // (read straight from the mapped cache, released before the request).
+    const header = blk: {
+        var cached = models_cache.Reader.open(allocator, cache_path) catch null;
+        defer if (cached) |*r| r.close();
+        const meta: ?models_cache.Meta = if (cached) |*r| r.meta() else null;
+        break :blk buildModelsHeader(allocator, auth_header, meta) catch |e| {
+            return failure(allocator, "Header build error: {s}", e);
+        };
     };
-    defer allocator.free(header);
+    defer {
+        std.crypto.secureZero(u8, header);
+        allocator.free(header);
+    }
 
-    const body = http.get(allocator, "https://api.openai.com/v1/models", header) catch |e| {
-        // Try fallback to cached list
-        if (loadModelsCache(allocator) catch null) |cached| {
-            defer allocator.free(cached);
-            ui.showScrollableText(allocator, "Available OpenAI Models (cached)", cached);
-            return;
+    const url = modelsUrl(allocator) catch |e| return failure(allocator, "URL error: {s}", e);
+    defer allocator.free(url);
+
+    // Identical requests already in flight (repeated clicks, startup
+    // revalidation overlapping a manual refresh) are joined instead of
+    // downloading and parsing the list again.
+    const key = single_flight.requestKey("GET", url, header);
+    const joined = fetches.join(key) catch return fetchAndParse(allocator, url, cache_path, header, auth_generation);
+    defer fetches.release(joined.call);
+    if (!joined.leader) {
+        const shared = fetches.wait(joined.call) orelse return fetchAndParse(allocator, url, cache_path, header, auth_generation);
+        return shared.copy(allocator) catch .{ .message = "" };
+    }
+    const outcome = fetchAndParse(allocator, url, cache_path, header, auth_generation);
+    fetches.publish(joined.call, SharedOutcome.init(fetches.allocator, outcome) catch null);
+    return outcome;
+}
+
+// GET /v1/models on the default API host, or on OHMYZIG_BASE_URL (scheme +
+// host + port, e.g. "http://127.0.0.1:8080" for the mock server). Caller
+// frees.
+fn modelsUrl(allocator: std.mem.Allocator) ![]u8 {
+    const base = std.process.getEnvVarOwned(allocator, "OHMYZIG_BASE_URL") catch null;
+    defer if (base) |b| allocator.free(b);
+    const host = std.mem.trimRight(u8, std.mem.trim(u8, base orelse openai.Client.default_base_url, " "), "/");
+    return std.fmt.allocPrint(allocator, "{s}/v1/models", .{host});
+}
+
+// In-flight models fetches, keyed by request. Process-wide like the HTTP
+// session it fronts.
+var fetches = single_flight.SingleFlight(SharedOutcome).init(std.heap.smp_allocator, .{ .free = SharedOutcome.free });
+
+// Coalescing counters for the models fetch (leaders = requests sent,
+// coalesced = refreshes that reused one of them).
+pub fn fetchStats() single_flight.SingleFlight(SharedOutcome).Stats {
+    return fetches.stats();
+}
+
+// Hedging for the models GET (opt-in, OHMYZIG_HEDGE=1): a response slower
+// than the recent p95 gets a second request, within a 10% load budget.
+var hedger = hedge.Hedger.init(.{});
+
+// Hedges issued / won for the models fetch.
+pub fn hedgeStats() hedge.Hedger.Stats {
+    return hedger.stats();
+}
+
+// Limits for the models GET, so a hung server frees the worker within a
+// minute instead of whenever the OS gives up on the socket.
+const fetch_timeouts = deadline.Timeouts{ .connect_ms = 10_000, .first_byte_ms = 30_000, .total_ms = 60_000 };
+
+// Shared by every models fetch; see `cancelFetches`.
+var fetch_token: deadline.CancelToken = .{};
+
+// Aborts models fetches in flight (and fails any started later), so the
+// workers can be joined at exit without waiting for the network.
+pub fn cancelFetches() void {
+    fetch_token.cancel();
+}
+
+// An outcome copied out of the leader's arena so coalesced jobs can share
+// it; each job copies it into its own arena.
+const SharedOutcome = struct {
+    outcome: ModelsJob.Outcome,
+
+    fn init(allocator: std.mem.Allocator, o: ModelsJob.Outcome) !SharedOutcome {
+        return .{ .outcome = try dupeOutcome(allocator, o) };
+    }
+
+    fn copy(self: *const SharedOutcome, allocator: std.mem.Allocator) !ModelsJob.Outcome {
+        return dupeOutcome(allocator, self.outcome);
+    }
+
+    fn free(allocator: std.mem.Allocator, self: *SharedOutcome) void {
+        switch (self.outcome) {
+            .not_modified => {},
+            .text, .cached => |t| allocator.free(t),
+            .message => |m| allocator.free(m),
         }
-        var buf: [128]u8 = undefined;
-        const msg = std.fmt.bufPrint(&buf, "HTTP error: {s}", .{@errorName(e)}) catch "HTTP error";
-        showMessageBox(allocator, "OpenAI Models", msg);
-        return;
+    }
+
+    fn dupeOutcome(allocator: std.mem.Allocator, o: ModelsJob.Outcome) !ModelsJob.Outcome {
+        return switch (o) {
+            .not_modified => .not_modified,
+            .text => |t| .{ .text = try allocator.dupe(u8, t) },
+            .cached => |t| .{ .cached = try allocator.dupe(u8, t) },
+            .message => |m| .{ .message = try allocator.dupe(u8, m) },
+        };
+    }
+};
+
+// GET, parse and cache for one (possibly coalesced) models request.
+fn fetchAndParse(allocator: std.mem.Allocator, url: []const u8, cache_path: []const u8, header: []const u8, auth_generation: u64) ModelsJob.Outcome {
+    var info: http.RequestInfo = .{};
+    const ctx = deadline.Context.init(fetch_timeouts, &fetch_token);
+    const got = if (hedgingEnabled(allocator))
+        http.getHedged(allocator, url, header, &info, &hedger, ctx)
+    else
+        http.getWithInfo(allocator, url, header, &info, ctx);
+    const body = got catch |e| {
+        // Try fallback to cached list
+        if (loadModelsCache(allocator) catch null) |cached| return .{ .cached = cached.text };
+        if (e == error.DeadlineExceeded) return .{ .message = "The models request timed out. Try again later." };
+        return failure(allocator, "HTTP error: {s}", e);
     };
     defer allocator.free(body);
 
-    // Parse and extract model ids from JSON
-    var parsed = std.json.parseFromSlice(std.json.Value, allocator, body, .{ .ignore_unknown_fields = true }) catch |e| {
-        var buf: [256]u8 = undefined;
-        const msg = std.fmt.bufPrint(&buf, "Parse error: {s}", .{@errorName(e)}) catch "Parse error";
-        showMessageBox(allocator, "OpenAI Models", msg);
-        return;
+    if (info.status == 304) {
+        models_cache.touch(allocator, cache_path, std.time.timestamp()) catch {};
+        return .not_modified;
+    }
+    if (info.status == 429) {
+        // Rate limited: no automatic retry from the UI; say when to try again.
+        if (loadModelsCache(allocator) catch null) |cached| return .{ .cached = cached.text };
+        const msg = if (info.retry_after_s) |s|
+            std.fmt.allocPrint(allocator, "Rate limited by the API. Try again in {d} s.", .{s})
+        else
+            allocator.dupe(u8, "Rate limited by the API. Try again shortly.");
+        return .{ .message = msg catch "" };
+    }
+    if (info.status == 401) {
+        // Drop the cached key; the next request resolves it again and
+        // skips sources that still hold the rejected one.
+        credentials.openai.invalidate(auth_generation);
+        return .{ .message = "The API key was rejected (HTTP 401). You will be asked for a key on the next request." };
+    }
+    if (info.status != 200) {
+        const msg = std.fmt.allocPrint(allocator, "HTTP status {d}", .{info.status}) catch "";
+        return .{ .message = msg };
+    }
+
+    // Parse and extract model ids (typed, single pass; ids point into body)
+    const parse_span = trace.begin("models/parse");
+    const list = openai.decode.decodeLeaky(openai.schema.ModelList, allocator, body) catch |e| {
+        parse_span.end();
+        return failure(allocator, "Parse error: {s}", e);
     };
-    defer parsed.deinit();
+    parse_span.end();
+    defer allocator.free(list.data);
 
-    const root = parsed.value;
-    const data = root.object.get("data") orelse {
-        showMessageBox(allocator, "OpenAI Models", "Invalid response: missing 'data'");
-        return;
+    const ids = allocator.alloc([]const u8, list.data.len) catch |e| {
+        return failure(allocator, "Parse error: {s}", e);
     };
-    const arr = data.array;
+    defer allocator.free(ids);
+    for (list.data, ids) |model, *id| id.* = model.id;
+
     // Join ids with newlines into a single buffer
-    var list_buf: std.ArrayListUnmanaged(u8) = .{};
-    defer list_buf.deinit(allocator);
-    var count: usize = 0;
-    for (arr.items) |item| {
-        const obj = item.object;
-        const id_val = obj.get("id") orelse continue;
-        const id_str = id_val.string;
-        if (count > 0) _ = list_buf.append(allocator, '\n') catch {};
-        _ = list_buf.appendSlice(allocator, id_str) catch {};
-        count += 1;
-    }
-    if (count == 0) {
-        _ = list_buf.appendSlice(allocator, "No models returned.") catch {};
-    }
+    const joined = if (ids.len == 0)
+        allocator.dupe(u8, models_cache.empty_list_text)
+    else
+        std.mem.join(allocator, "\n", ids);
+    const list_text = joined catch |e| return failure(allocator, "Parse error: {s}", e);
+    defer allocator.free(list_text);
+
+    // Save cache (ids + validators) for offline viewing and revalidation
+    models_cache.write(allocator, cache_path, ids, .{
+        .fetched_at = std.time.timestamp(),
+        .etag = info.etag(),
+        .last_modified = info.lastModified(),
+    }, .{ .compress = cacheCompression(allocator) }) catch {};
 
     // Convert to Windows CRLF for proper line breaks in EDIT control
-    const crlf_text_opt = toCRLF(allocator, list_buf.items) catch null;
-    if (crlf_text_opt) |crlf_text| {
-        defer allocator.free(crlf_text);
-        // Save cache for offline viewing
-        saveModelsCache(allocator, crlf_text) catch {};
-        // Update main window area
-        ui.setMainText(allocator, crlf_text);
-    } else {
+    const crlf_text = text_util.toCRLF(allocator, list_text) catch {
         // Fallback: update with LF text
-        ui.setMainText(allocator, list_buf.items);
+        const lf = allocator.dupe(u8, list_text) catch return .{ .message = "" };
+        return .{ .text = lf };
+    };
+    return .{ .text = crlf_text };
+}
+
+// `auth_header` is the prebuilt Authorization line (credentials.zig).
+fn buildModelsHeader(allocator: std.mem.Allocator, auth_header: []const u8, meta: ?models_cache.Meta) ![]u8 {
+    var out: std.ArrayListUnmanaged(u8) = .{};
+    errdefer out.deinit(allocator);
+    // Sized up front so the header is never reallocated (which would leave
+    // copies of the key behind).
+    try out.ensureTotalCapacity(allocator, auth_header.len + 128 + if (meta) |m| m.etag.len + m.last_modified.len else 0);
+    try out.appendSlice(allocator, auth_header);
+    if (meta) |m| {
+        if (m.etag.len > 0) {
+            try out.appendSlice(allocator, "If-None-Match: ");
+            try out.appendSlice(allocator, m.etag);
+            try out.appendSlice(allocator, "\r\n");
+        }
+        if (m.last_modified.len > 0) {
+            try out.appendSlice(allocator, "If-Modified-Since: ");
+            try out.appendSlice(allocator, m.last_modified);
+            try out.appendSlice(allocator, "\r\n");
+        }
     }
+    return out.toOwnedSlice(allocator);
+}
+
+fn submitModelsJob(
+    allocator: std.mem.Allocator,
+    jobs: *executor.Executor,
+    arenas: *request_arena.ArenaPool,
+    view: *MainView,
+    mode: ModelsJob.Mode,
+) void {
+    var auth = resolveAuth(allocator, mode == .foreground) orelse return;
+    defer auth.deinit(allocator);
+
+    const job = createJob(jobs, arenas, view, mode, auth) catch {
+        if (mode == .foreground) showMessageBox(allocator, "OpenAI Models", "Out of memory");
+        return;
+    };
+    _ = jobs.submit(&job.job);
+}
+
+fn createJob(jobs: *executor.Executor, arenas: *request_arena.ArenaPool, view: *MainView, mode: ModelsJob.Mode, auth: credentials.Provider.Auth) !*ModelsJob {
+    const ra = try arenas.acquire(if (mode == .foreground) "models/fetch" else "models/revalidate");
+    errdefer arenas.release(ra);
+    const allocator = ra.allocator();
+    const job = try allocator.create(ModelsJob);
+    job.* = .{
+        .allocator = allocator,
+        .arena = ra,
+        .arenas = arenas,
+        .jobs = jobs,
+        .view = view,
+        .auth_header = try allocator.dupe(u8, auth.header),
+        .auth_generation = auth.generation,
+        .mode = mode,
+    };
+    return job;
+}
+
+// Fetches available model ids from OpenAI and displays them in the main view.
+// Only the key lookup happens here; the request runs on `jobs` and the
+// result is applied when the UI thread drains completions.
+pub fn showAvailableModelsWithWin32(allocator: std.mem.Allocator, jobs: *executor.Executor, arenas: *request_arena.ArenaPool, view: *MainView) void {
+    const span = trace.begin("models/submit");
+    defer span.end();
+    submitModelsJob(allocator, jobs, arenas, view, .foreground);
 }
 
 // Shows cached list if present; otherwise fetches online and shows.
-pub fn showModelsOfflineFirst(allocator: std.mem.Allocator) void {
+// A cached list older than the TTL is shown immediately and revalidated in
+// the background (stale-while-revalidate).
+pub fn showModelsOfflineFirst(allocator: std.mem.Allocator, jobs: *executor.Executor, arenas: *request_arena.ArenaPool, view: *MainView) void {
+    migrateLegacyCache(allocator);
     if (loadModelsCache(allocator) catch null) |cached| {
-        defer allocator.free(cached);
-        ui.setMainText(allocator, cached);
+        defer allocator.free(cached.text);
+        view.setText(allocator, cached.text);
+        jobs.markFirstPaint();
+
+        const age = std.time.timestamp() - cached.fetched_at;
+        if (age >= modelsTtlSeconds(allocator)) submitModelsJob(allocator, jobs, arenas, view, .revalidate);
         return;
     }
     // No cache; fetch online (this will also save cache on success)
-    showAvailableModelsWithWin32(allocator);
+    showAvailableModelsWithWin32(allocator, jobs, arenas, view);
 }
 
-// Called by the button and on startup to (re)populate main window list area.
-pub fn updateModelsInMain(allocator: std.mem.Allocator) void {
+// Called by the "Update Model List" button: conditional refresh, so an
+// unchanged list costs one 304 round trip and no parsing.
+pub fn updateModelsInMain(allocator: std.mem.Allocator, jobs: *executor.Executor, arenas: *request_arena.ArenaPool, view: *MainView) void {
     // Try online first; on error, show cached
-    const header_result = blk: {
-        // Reuse the same flow by invoking the public function
-        showAvailableModelsWithWin32(allocator);
-        break :blk {};
-    };
-    _ = header_result;
-}
-
-fn toCRLF(allocator: std.mem.Allocator, s: []const u8) ![]u8 {
-    // Worst case allocate 2x for simplicity
-    var out = try allocator.alloc(u8, s.len * 2);
-    var n: usize = 0;
-    for (s) |ch| {
-        if (ch == '\n') {
-            out[n] = '\r';
-            n += 1;
-            out[n] = '\n';
-            n += 1;
-        } else {
-            out[n] = ch;
-            n += 1;
-        }
-    }
-    return out[0..n];
+    showAvailableModelsWithWin32(allocator, jobs, arenas, view);
 }
 
-fn modelsCachePath(allocator: std.mem.Allocator) ![]u8 {
-    const appdata = try std.process.getEnvVarOwned(allocator, "APPDATA");
-    defer allocator.free(appdata);
-    const dir = try std.fs.path.join(allocator, &.{ appdata, "ohmyzig" });
-    defer allocator.free(dir);
-    try std.fs.cwd().makePath(dir);
-    return try std.fs.path.join(allocator, &.{ dir, "models.txt" });
+fn modelsTtlSeconds(allocator: std.mem.Allocator) i64 {
+    const v = std.process.getEnvVarOwned(allocator, "OHMYZIG_MODELS_TTL") catch return default_models_ttl_s;
+    defer allocator.free(v);
+    return std.fmt.parseInt(i64, std.mem.trim(u8, v, " "), 10) catch default_models_ttl_s;
 }
 
-fn saveModelsCache(allocator: std.mem.Allocator, text: []const u8) !void {
-    const path = try modelsCachePath(allocator);
-    defer allocator.free(path);
-    var file = try std.fs.cwd().createFile(path, .{ .truncate = true });
-    defer file.close();
-    _ = try file.writeAll(text);
+// OHMYZIG_CACHE_COMPRESS=1 stores the models cache deflated.
+fn cacheCompression(allocator: std.mem.Allocator) bool {
+    const v = std.process.getEnvVarOwned(allocator, "OHMYZIG_CACHE_COMPRESS") catch return false;
+    defer allocator.free(v);
+    return std.mem.eql(u8, std.mem.trim(u8, v, " "), "1");
 }
 
-fn loadModelsCache(allocator: std.mem.Allocator) !?[]u8 {
-    const path = modelsCachePath(allocator) catch return null;
+// OHMYZIG_HEDGE=1 hedges slow models requests (see `hedger`).
+fn hedgingEnabled(allocator: std.mem.Allocator) bool {
+    const v = std.process.getEnvVarOwned(allocator, "OHMYZIG_HEDGE") catch return false;
+    defer allocator.free(v);
+    return std.mem.eql(u8, std.mem.trim(u8, v, " "), "1");
+}
+
+const CachedView = struct {
+    // CRLF display text (owned)
+    text: []u8,
+    fetched_at: i64,
+};
+
+// Builds the display text straight from the mapped cache.
+fn loadModelsCache(allocator: std.mem.Allocator) !?CachedView {
+    const path = paths.appDataFile(allocator, models_cache.file_name) catch return null;
     defer allocator.free(path);
-    const file = std.fs.cwd().openFile(path, .{ .mode = .read_only }) catch return null;
-    defer file.close();
-    const data = try file.readToEndAlloc(allocator, 1 << 20);
-    return data;
+    var reader = (try models_cache.Reader.open(allocator, path)) orelse return null;
+    defer reader.close();
+
+    var text: std.ArrayListUnmanaged(u8) = .{};
+    errdefer text.deinit(allocator);
+    for (0..reader.count()) |i| {
+        if (i > 0) try text.appendSlice(allocator, "\r\n");
+        try text.appendSlice(allocator, reader.id(i));
+    }
+    if (reader.count() == 0) try text.appendSlice(allocator, models_cache.empty_list_text);
+    return .{ .text = try text.toOwnedSlice(allocator), .fetched_at = reader.meta().fetched_at };
+}
+
+// Converts a pre-binary models.txt cache on first start after upgrade.
+fn migrateLegacyCache(allocator: std.mem.Allocator) void {
+    const dir = paths.appDataDir(allocator) catch return;
+    defer allocator.free(dir);
+    _ = models_cache.migrateLegacy(allocator, dir) catch {};
 }
 
 // platform-specific helpers moved into src/platform/* adapters
@@ -0,0 +1,510 @@
+const std = @import("std");
+const mmap = @import("../platform/mmap.zig");
+const trace = @import("trace");
+
+// Binary models cache (%APPDATA%\ohmyzig\models.bin), read zero-copy via mmap.
+//
+// Layout (little endian, version 2):
+//   [0..64)   Header
+//   index     count x { offset: u32, len: u32 }   (relative to strings block)
+//   strings   model ids and validator strings, back to back; raw deflate
+//             when `flag_compressed` is set (opt-in, see WriteOptions)
+//
+// Uncompressed files are read zero-copy; a compressed strings block is
+// inflated once into an owned buffer at open. Version 1 files (no
+// compression) are still read.
+//
+// Writers build the whole file under a unique temp name and rename it over
+// models.bin, so concurrent instances only ever see a complete file.
+pub const magic = "OMZM";
+pub const version: u16 = 2;
+const min_version: u16 = 1;
+pub const header_size: u32 = 64;
+
+// Header flag: the strings block is raw deflate; `strings_len` is its
+// inflated size and `stored_len` its size in the file.
+pub const flag_compressed: u16 = 1 << 0;
+const known_flags = flag_compressed;
+// Deflate expands its input at most ~1032:1 (a 258-byte match in two
+// bits). A header claiming more is corrupt; checked before `open`
+// allocates the inflated block.
+const max_inflate_ratio = 1032;
+
+pub const file_name = "models.bin";
+// Pre-binary cache files, migrated on first open.
+const legacy_text_name = "models.txt";
+const legacy_meta_name = "models.meta";
+// Shown instead of an empty list; the legacy text cache stored it as its
+// only line.
+pub const empty_list_text = "No models returned.";
+
+pub const Header = struct {
+    flags: u16 = 0,
+    count: u32 = 0,
+    fetched_at: i64 = 0,
+    index_offset: u32 = header_size,
+    strings_offset: u32 = 0,
+    strings_len: u32 = 0,
+    // Bytes of the strings block in the file (== strings_len unless
+    // compressed).
+    stored_len: u32 = 0,
+    etag: Span = .{},
+    last_modified: Span = .{},
+
+    // Field offsets within the 64-byte header.
+    const off_magic = 0;
+    const off_version = 4;
+    const off_flags = 6;
+    const off_count = 8;
+    const off_fetched_at = 12;
+    const off_index = 20;
+    const off_strings = 24;
+    const off_strings_len = 28;
+    const off_etag = 32;
+    const off_last_modified = 40;
+    const off_stored_len = 48;
+
+    fn encode(h: Header, out: *[header_size]u8) void {
+        @memset(out, 0);
+        @memcpy(out[off_magic..][0..4], magic);
+        std.mem.writeInt(u16, out[off_version..][0..2], version, .little);
+        std.mem.writeInt(u16, out[off_flags..][0..2], h.flags, .little);
+        std.mem.writeInt(u32, out[off_count..][0..4], h.count, .little);
+        std.mem.writeInt(i64, out[off_fetched_at..][0..8], h.fetched_at, .little);
+        std.mem.writeInt(u32, out[off_index..][0..4], h.index_offset, .little);
+        std.mem.writeInt(u32, out[off_strings..][0..4], h.strings_offset, .little);
+        std.mem.writeInt(u32, out[off_strings_len..][0..4], h.strings_len, .little);
+        h.etag.encode(out[off_etag..][0..8]);
+        h.last_modified.encode(out[off_last_modified..][0..8]);
+        std.mem.writeInt(u32, out[off_stored_len..][0..4], h.stored_len, .little);
+    }
+
+    fn decode(bytes: []const u8) !Header {
+        if (bytes.len < header_size) return error.CorruptCache;
+        if (!std.mem.eql(u8, bytes[off_magic..][0..4], magic)) return error.CorruptCache;
+        const v = std.mem.readInt(u16, bytes[off_version..][0..2], .little);
+        if (v < min_version or v > version) return error.UnsupportedCacheVersion;
+        var h = Header{
+            .flags = std.mem.readInt(u16, bytes[off_flags..][0..2], .little),
+            .count = std.mem.readInt(u32, bytes[off_count..][0..4], .little),
+            .fetched_at = std.mem.readInt(i64, bytes[off_fetched_at..][0..8], .little),
+            .index_offset = std.mem.readInt(u32, bytes[off_index..][0..4], .little),
+            .strings_offset = std.mem.readInt(u32, bytes[off_strings..][0..4], .little),
+            .strings_len = std.mem.readInt(u32, bytes[off_strings_len..][0..4], .little),
+            .etag = Span.decode(bytes[off_etag..][0..8]),
+            .last_modified = Span.decode(bytes[off_last_modified..][0..8]),
+        };
+        if (h.flags & ~known_flags != 0) return error.UnsupportedCacheVersion;
+        h.stored_len = if (h.flags & flag_compressed != 0)
+            std.mem.readInt(u32, bytes[off_stored_len..][0..4], .little)
+        else
+            h.strings_len;
+        // Everything the reader touches must lie inside the file.
+        const index_end = @as(u64, h.index_offset) + @as(u64, h.count) * 8;
+        const strings_end = @as(u64, h.strings_offset) + h.stored_len;
+        if (index_end > bytes.len or strings_end > bytes.len) return error.CorruptCache;
+        if (@as(u64, h.strings_len) > @as(u64, h.stored_len) * max_inflate_ratio) return error.CorruptCache;
+        if (!h.etag.fits(h.strings_len) or !h.last_modified.fits(h.strings_len)) return error.CorruptCache;
+        return h;
+    }
+};
+
+// Offset/length pair relative to the strings block.
+pub const Span = struct {
+    offset: u32 = 0,
+    len: u32 = 0,
+
+    fn encode(s: Span, out: *[8]u8) void {
+        std.mem.writeInt(u32, out[0..4], s.offset, .little);
+        std.mem.writeInt(u32, out[4..8], s.len, .little);
+    }
+
+    fn decode(b: *const [8]u8) Span {
+        return .{
+            .offset = std.mem.readInt(u32, b[0..4], .little),
+            .len = std.mem.readInt(u32, b[4..8], .little),
+        };
+    }
+
+    fn fits(s: Span, strings_len: u32) bool {
+        return @as(u64, s.offset) + s.len <= strings_len;
+    }
+};
+
+// Metadata stored alongside the ids.
+pub const Meta = struct {
+    fetched_at: i64 = 0,
+    etag: []const u8 = "",
+    last_modified: []const u8 = "",
+};
+
+// Open, validated view of models.bin. All returned slices point into the
+// mapping (or the inflated strings block) and are valid until `close`.
+pub const Reader = struct {
+    allocator: std.mem.Allocator,
+    map: mmap.MappedFile,
+    header: Header,
+    strings: []const u8,
+    // Inflated strings block of a compressed file.
+    inflated: ?[]u8 = null,
+
+    // Returns null when there is no usable cache (missing or corrupt).
+    pub fn open(allocator: std.mem.Allocator, path: []const u8) !?Reader {
+        const span = trace.begin("cache/models_open");
+        defer span.end();
+        var map = (try mmap.MappedFile.openRead(allocator, path)) orelse return null;
+        errdefer map.close();
+        const header = Header.decode(map.bytes) catch {
+            map.close();
+            return null;
+        };
+        const stored = map.bytes[header.strings_offset..][0..header.stored_len];
+        if (header.flags & flag_compressed == 0) {
+            return .{ .allocator = allocator, .map = map, .header = header, .strings = stored };
+        }
+        const inflated = try allocator.alloc(u8, header.strings_len);
+        errdefer allocator.free(inflated);
+        inflate(stored, inflated) catch {
+            allocator.free(inflated);
+            map.close();
+            return null;
+        };
+        return .{ .allocator = allocator, .map = map, .header = header, .strings = inflated, .inflated = inflated };
+    }
+
+    pub fn close(self: *Reader) void {
+        if (self.inflated) |b| self.allocator.free(b);
+        self.map.close();
+    }
+
+    pub fn count(self: *const Reader) usize {
+        return self.header.count;
+    }
+
+    // Returns the i-th model id (i < count()).
+    pub fn id(self: *const Reader, i: usize) []const u8 {
+        const entry = self.map.bytes[self.header.index_offset + i * 8 ..][0..8];
+        return self.span(Span.decode(entry));
+    }
+
+    pub fn meta(self: *const Reader) Meta {
+        return .{
+            .fetched_at = self.header.fetched_at,
+            .etag = self.span(self.header.etag),
+            .last_modified = self.span(self.header.last_modified),
+        };
+    }
+
+    fn span(self: *const Reader, s: Span) []const u8 {
+        if (!s.fits(self.header.strings_len)) return "";
+        return self.strings[s.offset..][0..s.len];
+    }
+};
+
+// Inflates `stored` into `out`, which must be filled exactly.
+fn inflate(stored: []const u8, out: []u8) !void {
+    var in = std.io.fixedBufferStream(stored);
+    var dst = std.io.fixedBufferStream(out);
+    try std.compress.flate.decompress(in.reader(), dst.writer());
+    if (dst.pos != out.len) return error.CorruptCache;
+}
+
+pub const WriteOptions = struct {
+    // Deflate the strings block. Kept only when it comes out smaller.
+    compress: bool = false,
+};
+
+// Bytes handed to `write` vs. bytes written, across all writes.
+var bytes_raw = std.atomic.Value(u64).init(0);
+var bytes_stored = std.atomic.Value(u64).init(0);
+
+pub const Stats = struct {
+    bytes_raw: u64,
+    bytes_stored: u64,
+};
+
+pub fn stats() Stats {
+    return .{ .bytes_raw = bytes_raw.load(.monotonic), .bytes_stored = bytes_stored.load(.monotonic) };
+}
+
+// Serializes ids + meta into the current layout. Caller frees the result.
+pub fn encode(allocator: std.mem.Allocator, ids: []const []const u8, meta: Meta, options: WriteOptions) ![]u8 {
+    var strings_len: usize = meta.etag.len + meta.last_modified.len;
+    for (ids) |s| strings_len += s.len;
+
+    const index_offset: usize = header_size;
+    const strings_offset = index_offset + ids.len * 8;
+    const total = strings_offset + strings_len;
+    if (total > std.math.maxInt(u32)) return error.CacheTooLarge;
+
+    const out = try allocator.alloc(u8, total);
+    errdefer allocator.free(out);
+    const strings = out[strings_offset..];
+
+    var pos: u32 = 0;
+    for (ids, 0..) |s, i| {
+        @memcpy(strings[pos..][0..s.len], s);
+        const entry = Span{ .offset = pos, .len = @intCast(s.len) };
+        entry.encode(out[index_offset + i * 8 ..][0..8]);
+        pos += @intCast(s.len);
+    }
+    const etag = Span{ .offset = pos, .len = @intCast(meta.etag.len) };
+    @memcpy(strings[pos..][0..meta.etag.len], meta.etag);
+    pos += etag.len;
+    const last_modified = Span{ .offset = pos, .len = @intCast(meta.last_modified.len) };
+    @memcpy(strings[pos..][0..meta.last_modified.len], meta.last_modified);
+
+    var header = Header{
+        .count = @intCast(ids.len),
+        .fetched_at = meta.fetched_at,
+        .index_offset = @intCast(index_offset),
+        .strings_offset = @intCast(strings_offset),
+        .strings_len = @intCast(strings_len),
+        .stored_len = @intCast(strings_len),
+        .etag = etag,
+        .last_modified = last_modified,
+    };
+    if (options.compress) {
+        if (try compressStrings(allocator, out, strings_offset)) |packed_file| {
+            allocator.free(out);
+            header.flags |= flag_compressed;
+            header.stored_len = @intCast(packed_file.len - strings_offset);
+            header.encode(packed_file[0..header_size]);
+            return packed_file;
+        }
+    }
+    header.encode(out[0..header_size]);
+    return out;
+}
+
+// Returns header + index + deflated strings, or null when deflate does not
+// shrink the strings block.
+fn compressStrings(allocator: std.mem.Allocator, file: []const u8, strings_offset: usize) !?[]u8 {
+    var packed_file = std.ArrayList(u8).init(allocator);
+    errdefer packed_file.deinit();
+    try packed_file.appendSlice(file[0..strings_offset]);
+    var in = std.io.fixedBufferStream(file[strings_offset..]);
+    try std.compress.flate.compress(in.reader(), packed_file.writer(), .{});
+    if (packed_file.items.len >= file.len) {
+        packed_file.deinit();
+        return null;
+    }
+    return try packed_file.toOwnedSlice();
+}
+
+// Serializes writers within the process, so concurrent refreshes finish
+// one rename before the next starts (and `touch` never reads a file that
+// a write is about to replace). Other processes are covered by the rename.
+var write_mutex: std.Thread.Mutex = .{};
+
+// Atomically replaces the cache at `path` with ids + meta.
+pub fn write(allocator: std.mem.Allocator, path: []const u8, ids: []const []const u8, meta: Meta, options: WriteOptions) !void {
+    const span = trace.begin("cache/models_write");
+    defer span.end();
+    write_mutex.lock();
+    defer write_mutex.unlock();
+    const bytes = try encode(allocator, ids, meta, options);
+    defer allocator.free(bytes);
+    try replaceFile(allocator, path, bytes);
+
+    var raw: u64 = header_size + ids.len * 8 + meta.etag.len + meta.last_modified.len;
+    for (ids) |s| raw += s.len;
+    _ = bytes_raw.fetchAdd(raw, .monotonic);
+    _ = bytes_stored.fetchAdd(bytes.len, .monotonic);
+}
+
+// Rewrites only fetched_at (after a 304), keeping ids and validators.
+pub fn touch(allocator: std.mem.Allocator, path: []const u8, fetched_at: i64) !void {
+    const span = trace.begin("cache/models_touch");
+    defer span.end();
+    write_mutex.lock();
+    defer write_mutex.unlock();
+    var reader = (try Reader.open(allocator, path)) orelse return;
+    const copy = allocator.dupe(u8, reader.map.bytes) catch |e| {
+        reader.close();
+        return e;
+    };
+    // Release the view before replacing (Windows refuses to replace a mapped file).
+    reader.close();
+    defer allocator.free(copy);
+
+    std.mem.writeInt(i64, copy[Header.off_fetched_at..][0..8], fetched_at, .little);
+    try replaceFile(allocator, path, copy);
+}
+
+// Writes bytes to a unique temp file next to `path`, then renames it over
+// `path`. Readers see either the old or the new file, never a partial one.
+// Also used by the embedding store.
+pub fn replaceFile(allocator: std.mem.Allocator, path: []const u8, bytes: []const u8) !void {
+    var rand: [4]u8 = undefined;
+    std.crypto.random.bytes(&rand);
+    const tmp = try std.fmt.allocPrint(allocator, "{s}.{x}.tmp", .{ path, std.mem.readInt(u32, &rand, .little) });
+    defer allocator.free(tmp);
+
+    var file = try std.fs.cwd().createFile(tmp, .{ .exclusive = true });
+    // A failed write or sync leaves no temp file behind either; the file is
+    // closed first (Windows cannot delete an open file).
+    errdefer std.fs.cwd().deleteFile(tmp) catch {};
+    {
+        defer file.close();
+        try file.writeAll(bytes);
+        try file.sync();
+    }
+
+    // Another instance may still have the old file mapped; on Windows the
+    // replace fails until it unmaps, which readers do right after reading.
+    var attempt: usize = 0;
+    while (true) : (attempt += 1) {
+        std.fs.cwd().rename(tmp, path) catch |e| {
+            if (e == error.AccessDenied and attempt < 10) {
+                std.Thread.sleep(20 * std.time.ns_per_ms);
+                continue;
+            }
+            return e;
+        };
+        return;
+    }
+}
+
+// One-time migration from models.txt (+ models.meta) to models.bin in
+// `dir`. Returns true when a legacy cache was converted.
+pub fn migrateLegacy(allocator: std.mem.Allocator, dir: []const u8) !bool {
+    const txt_path = try std.fs.path.join(allocator, &.{ dir, legacy_text_name });
+    defer allocator.free(txt_path);
+    const meta_path = try std.fs.path.join(allocator, &.{ dir, legacy_meta_name });
+    defer allocator.free(meta_path);
+    const bin_path = try std.fs.path.join(allocator, &.{ dir, file_name });
+    defer allocator.free(bin_path);
+
+    const text = std.fs.cwd().readFileAlloc(allocator, txt_path, 1 << 20) catch |e| switch (e) {
+        error.FileNotFound => return false,
+        else => return e,
+    };
+    defer allocator.free(text);
+
+    // The text cache holds display lines (CRLF); one id per line, or only
+    // the placeholder for an empty list.
+    var ids: std.ArrayListUnmanaged([]const u8) = .{};
+    defer ids.deinit(allocator);
+    var lines = std.mem.tokenizeAny(u8, text, "\r\n");
+    while (lines.next()) |line| {
+        if (std.mem.eql(u8, line, empty_list_text)) continue;
+        try ids.append(allocator, line);
+    }
+
+    var meta = Meta{};
+    var meta_buf: [512]u8 = undefined;
+    if (std.fs.cwd().readFile(meta_path, &meta_buf)) |meta_text| {
+        var it = std.mem.tokenizeAny(u8, meta_text, "\r\n");
+        while (it.next()) |line| {
+            const eq = std.mem.indexOfScalar(u8, line, '=') orelse continue;
+            const key = line[0..eq];
+            const value = line[eq + 1 ..];
+            if (std.mem.eql(u8, key, "fetched_at")) {
+                meta.fetched_at = std.fmt.parseInt(i64, value, 10) catch 0;
+            } else if (std.mem.eql(u8, key, "etag")) {
+                meta.etag = value;
+            } else if (std.mem.eql(u8, key, "last_modified")) {
+                meta.last_modified = value;
+            }
+        }
+    } else |_| {}
+
+    try write(allocator, bin_path, ids.items, meta, .{});
+    std.fs.cwd().deleteFile(txt_path) catch {};
+    std.fs.cwd().deleteFile(meta_path) catch {};
+    return true;
+}
+
+const CountingAllocator = @import("../util/counting_allocator.zig").CountingAllocator;
+
+fn testIds(allocator: std.mem.Allocator, n: usize) ![][]const u8 {
+    const ids = try allocator.alloc([]const u8, n);
+    for (ids, 0..) |*id, i| id.* = try std.fmt.allocPrint(allocator, "gpt-test-model-{d}", .{i});
+    return ids;
+}
+
+fn freeIds(allocator: std.mem.Allocator, ids: [][]const u8) void {
+    for (ids) |id| allocator.free(id);
+    allocator.free(ids);
+}
+
+test "compressed cache reads back the ids and validators" {
+    const allocator = std.testing.allocator;
+    var tmp = std.testing.tmpDir(.{});
+    defer tmp.cleanup();
+    const dir = try tmp.dir.realpathAlloc(allocator, ".");
+    defer allocator.free(dir);
+    const path = try std.fs.path.join(allocator, &.{ dir, file_name });
+    defer allocator.free(path);
+
+    const ids = try testIds(allocator, 200);
+    defer freeIds(allocator, ids);
+    const meta = Meta{ .fetched_at = 1700000000, .etag = "\"v42\"", .last_modified = "Tue, 14 Nov 2023 22:13:20 GMT" };
+    try write(allocator, path, ids, meta, .{ .compress = true });
+
+    var reader = (try Reader.open(allocator, path)).?;
+    defer reader.close();
+    try std.testing.expect(reader.header.flags & flag_compressed != 0);
+    try std.testing.expect(reader.header.stored_len < reader.header.strings_len);
+    try std.testing.expectEqual(ids.len, reader.count());
+    for (ids, 0..) |id, i| try std.testing.expectEqualStrings(id, reader.id(i));
+    try std.testing.expectEqual(meta.fetched_at, reader.meta().fetched_at);
+    try std.testing.expectEqualStrings(meta.etag, reader.meta().etag);
+    try std.testing.expectEqualStrings(meta.last_modified, reader.meta().last_modified);
+}
+
+test "an inflated size beyond the deflate ratio is corrupt" {
+    const allocator = std.testing.allocator;
+    const ids = try testIds(allocator, 200);
+    defer freeIds(allocator, ids);
+    const bytes = try encode(allocator, ids, .{}, .{ .compress = true });
+    defer allocator.free(bytes);
+    _ = try Header.decode(bytes);
+
+    std.mem.writeInt(u32, bytes[Header.off_strings_len..][0..4], std.math.maxInt(u32), .little);
+    try std.testing.expectError(error.CorruptCache, Header.decode(bytes));
+
+    // `open` gives up before allocating the claimed size.
+    var tmp = std.testing.tmpDir(.{});
+    defer tmp.cleanup();
+    try tmp.dir.writeFile(.{ .sub_path = file_name, .data = bytes });
+    const path = try tmp.dir.realpathAlloc(allocator, file_name);
+    defer allocator.free(path);
+    var counting = CountingAllocator.init(allocator);
+    try std.testing.expect(try Reader.open(counting.allocator(), path) == null);
+    try std.testing.expect(counting.peak_bytes < 1 << 20);
+}
+
+test "legacy text cache migrates, without the empty-list placeholder" {
+    const allocator = std.testing.allocator;
+    var tmp = std.testing.tmpDir(.{});
+    defer tmp.cleanup();
+    const dir = try tmp.dir.realpathAlloc(allocator, ".");
+    defer allocator.free(dir);
+    const path = try std.fs.path.join(allocator, &.{ dir, file_name });
+    defer allocator.free(path);
+
+    try std.testing.expect(!try migrateLegacy(allocator, dir));
+
+    try tmp.dir.writeFile(.{ .sub_path = legacy_text_name, .data = "gpt-4o\r\ngpt-4o-mini\r\n" });
+    try tmp.dir.writeFile(.{ .sub_path = legacy_meta_name, .data = "fetched_at=1700000000\r\netag=\"v1\"\r\n" });
+    try std.testing.expect(try migrateLegacy(allocator, dir));
+    {
+        var reader = (try Reader.open(allocator, path)).?;
+        defer reader.close();
+        try std.testing.expectEqual(@as(usize, 2), reader.count());
+        try std.testing.expectEqualStrings("gpt-4o-mini", reader.id(1));
+        try std.testing.expectEqual(@as(i64, 1700000000), reader.meta().fetched_at);
+        try std.testing.expectEqualStrings("\"v1\"", reader.meta().etag);
+    }
+    try std.testing.expectError(error.FileNotFound, tmp.dir.access(legacy_text_name, .{}));
+    try std.testing.expectError(error.FileNotFound, tmp.dir.access(legacy_meta_name, .{}));
+
+    // A file holding only the placeholder is an empty list.
+    try tmp.dir.writeFile(.{ .sub_path = legacy_text_name, .data = empty_list_text });
+    try std.testing.expect(try migrateLegacy(allocator, dir));
+    var reader = (try Reader.open(allocator, path)).?;
+    defer reader.close();
+    try std.testing.expectEqual(@as(usize, 0), reader.count());
+}
@@ -0,0 +1,119 @@
+const std = @import("std");
+const openai = @import("openai");
+const store = @import("embedding_store.zig");
+const vector_index = @import("../util/vector_index.zig");
+const trace = @import("trace");
+
+// Semantic lookup over locally stored embeddings.
+// - `ensure` embeds only texts the store does not hold yet (batched through
+//   `openai.embed`) and appends them to the store.
+// - `search` ranks stored rows by cosine similarity to a query text. A
+//   query that was embedded before is answered from the store without any
+//   network access.
+// - Sets of at least `Options.ivf_min_rows` rows get an IVF index, rebuilt
+//   when the store changes; smaller sets are scanned exhaustively.
+// Not thread-safe; use from one worker at a time.
+pub const SemanticIndex = struct {
+    allocator: std.mem.Allocator,
+    path: []const u8,
+    options: Options,
+    reader: ?store.Reader = null,
+    ivf: ?vector_index.Ivf = null,
+
+    pub const Options = struct {
+        embed: openai.embeddings.Options = .{},
+        ivf_min_rows: usize = 20_000,
+        // Clusters scanned per IVF query.
+        nprobe: usize = 8,
+    };
+
+    // `path` must outlive the index. Use one store per embedding model:
+    // vectors of different models do not compare.
+    pub fn open(allocator: std.mem.Allocator, path: []const u8, options: Options) !SemanticIndex {
+        var self = SemanticIndex{ .allocator = allocator, .path = path, .options = options };
+        try self.reload();
+        return self;
+    }
+
+    pub fn close(self: *SemanticIndex) void {
+        self.closeStore();
+    }
+
+    pub fn count(self: *const SemanticIndex) usize {
+        return if (self.reader) |*r| r.count() else 0;
+    }
+
+    // Stored vector of `text`, if it was embedded before.
+    pub fn vectorFor(self: *const SemanticIndex, text: []const u8) ?[]const f32 {
+        const r = if (self.reader) |*r| r else return null;
+        const i = r.find(store.key(self.options.embed.model, text)) orelse return null;
+        return r.row(i);
+    }
+
+    // Makes sure every text has a stored vector; only missing ones are sent.
+    pub fn ensure(self: *SemanticIndex, client: *openai.Client, api_key: []const u8, texts: []const []const u8) !void {
+        const model = self.options.embed.model;
+        var missing: std.ArrayListUnmanaged([]const u8) = .{};
+        defer missing.deinit(self.allocator);
+        var seen: std.AutoHashMapUnmanaged(u64, void) = .{};
+        defer seen.deinit(self.allocator);
+        for (texts) |t| {
+            const k = store.key(model, t);
+            if (self.reader) |*r| if (r.find(k) != null) continue;
+            if ((try seen.getOrPut(self.allocator, k)).found_existing) continue;
+            try missing.append(self.allocator, t);
+        }
+        if (missing.items.len == 0) return;
+
+        var fresh = try openai.embed(self.allocator, client, api_key, missing.items, self.options.embed);
+        defer fresh.deinit(self.allocator);
+
+        var builder = store.Builder.init(self.allocator, fresh.dims);
+        defer builder.deinit();
+        if (self.reader) |*r| try builder.addAll(r);
+        for (missing.items, 0..) |t, i| {
+            const v = fresh.row(i);
+            vector_index.normalize(v);
+            try builder.add(store.key(model, t), v);
+        }
+        // The old view must be closed before the file is replaced.
+        self.closeStore();
+        try builder.write(self.path);
+        try self.reload();
+    }
+
+    // Top matches for `query` (k = out.len), best first. Embeds the query
+    // (and stores it) only when it has not been seen before.
+    pub fn search(self: *SemanticIndex, client: *openai.Client, api_key: []const u8, query: []const u8, out: []vector_index.Hit) ![]vector_index.Hit {
+        if (self.vectorFor(query) == null) try self.ensure(client, api_key, &.{query});
+        return self.searchVector(self.vectorFor(query) orelse return error.UnexpectedResponse, out);
+    }
+
+    // Top matches for a unit-length vector; never touches the network.
+    pub fn searchVector(self: *const SemanticIndex, query: []const f32, out: []vector_index.Hit) []vector_index.Hit {
+        const span = trace.begin("embeddings/search");
+        defer span.end();
+        const r = if (self.reader) |*r| r else return out[0..0];
+        if (query.len != r.dims) return out[0..0];
+        if (self.ivf) |*ivf| return ivf.search(r.vectors, query, self.options.nprobe, out);
+        return vector_index.searchFlat(r.vectors, r.dims, query, out);
+    }
+
+    fn reload(self: *SemanticIndex) !void {
+        self.closeStore();
+        self.reader = try store.Reader.open(self.allocator, self.path);
+        const r = if (self.reader) |*r| r else return;
+        if (r.count() >= self.options.ivf_min_rows) {
+            const span = trace.begin("embeddings/ivf_build");
+            defer span.end();
+            self.ivf = try vector_index.Ivf.build(self.allocator, r.vectors, r.dims, .{});
+        }
+    }
+
+    fn closeStore(self: *SemanticIndex) void {
+        if (self.ivf) |*ivf| ivf.deinit();
+        self.ivf = null;
+        if (self.reader) |*r| r.close();
+        self.reader = null;
+    }
+};
@@ -0,0 +1,362 @@
+//! Load generator for the OpenAI client stack
+//! (`zig build loadgen -- [options]`, usually against `zig build mock`).
+//! - Open loop: request i is due at start + i / rate, whether or not
+//!   earlier ones have answered. Latency is measured from that due time,
+//!   so time spent waiting for a free worker counts (no coordinated
+//!   omission); the service time alone is reported next to it.
+//! - Requests go through the same helpers the app and batch runner use
+//!   (`fetchModelsJson`, `chatCompletion`, `chatCompletionStream`, `embed`)
+//!   on one shared pooled `Client`.
+//! - Reports throughput and p50 / p99 / p999 / max latency, plus failures
+//!   by error; `--json` writes the same summary for scripts.
+const std = @import("std");
+const openai = @import("openai");
+
+const usage =
+    \\usage: ohmyzig-loadgen [options]
+    \\  --base-url URL    API base URL (default http://127.0.0.1:8080, the mock server)
+    \\  --endpoint E      models | chat | stream | embeddings (default chat)
+    \\  --rate N          requests started per second (default 100)
+    \\  --duration S      seconds of load (default 10)
+    \\  --workers N       threads and pooled connections (default 64)
+    \\  --prompt-bytes N  prompt / embedding input size (default 256)
+    \\  --inputs N        inputs per embeddings request (default 16)
+    \\  --model NAME      model id sent (default gpt-4o-mini)
+    \\  --json PATH       also write the summary as JSON
+    \\The API key is read from OPENAI_API_KEY (a placeholder is sent without it).
+    \\
+;
+
+const Endpoint = enum { models, chat, stream, embeddings };
+
+const Options = struct {
+    base_url: []const u8 = "http://127.0.0.1:8080",
+    endpoint: Endpoint = .chat,
+    rate: f64 = 100,
+    duration_s: f64 = 10,
+    workers: usize = 64,
+    prompt_bytes: usize = 256,
+    inputs: usize = 16,
+    model: []const u8 = "gpt-4o-mini",
+    json_path: ?[]const u8 = null,
+};
+
+pub fn main() !void {
+    const allocator = std.heap.smp_allocator;
+
+    const args = try std.process.argsAlloc(allocator);
+    defer std.process.argsFree(allocator, args);
+    const options = parseArgs(args) catch {
+        std.debug.print("{s}", .{usage});
+        std.process.exit(2);
+    };
+
+    const env_key = std.process.getEnvVarOwned(allocator, "OPENAI_API_KEY") catch null;
+    defer if (env_key) |k| allocator.free(k);
+
+    var client = openai.Client.init(allocator, .{
+        .max_idle_connections = @intCast(options.workers),
+        .base_url = options.base_url,
+    });
+    defer client.deinit();
+
+    const prompt = try allocator.alloc(u8, options.prompt_bytes);
+    defer allocator.free(prompt);
+    for (prompt, 0..) |*c, i| c.* = if (i % 6 == 5) ' ' else 'a' + @as(u8, @intCast(i % 26));
+    const inputs = try allocator.alloc([]const u8, options.inputs);
+    defer allocator.free(inputs);
+    @memset(inputs, prompt);
+
+    const total: usize = @intFromFloat(@max(1, options.rate * options.duration_s));
+    var run = Run{
+        .options = options,
+        .client = &client,
+        .api_key = env_key orelse "sk-loadgen",
+        .prompt = prompt,
+        .inputs = inputs,
+        .total = total,
+        .interval_ns = @intFromFloat(std.time.ns_per_s / options.rate),
+        .start = try std.time.Instant.now(),
+    };
+    const workers = try allocator.alloc(Worker, options.workers);
+    defer allocator.free(workers);
+
+    const threads = try allocator.alloc(std.Thread, options.workers);
+    defer allocator.free(threads);
+    var started: usize = 0;
+    defer for (workers[0..started]) |*w| w.deinit();
+    for (workers, threads) |*w, *t| {
+        w.* = .{ .run = &run };
+        t.* = std.Thread.spawn(.{}, Worker.loop, .{w}) catch |e| {
+            run.stopping.store(true, .release);
+            for (threads[0..started]) |s| s.join();
+            return e;
+        };
+        started += 1;
+    }
+    for (threads) |t| t.join();
+    const wall_ns = (try std.time.Instant.now()).since(run.start);
+
+    var summary = try Summary.collect(allocator, workers, wall_ns, options, total);
+    defer summary.deinit(allocator);
+    summary.print();
+    if (options.json_path) |path| try summary.writeJson(path);
+}
+
+fn parseArgs(args: []const []const u8) !Options {
+    var o = Options{};
+    var i: usize = 1;
+    while (i < args.len) : (i += 1) {
+        const arg = args[i];
+        if (i + 1 >= args.len) return error.InvalidArgs;
+        const value = args[i + 1];
+        i += 1;
+        if (std.mem.eql(u8, arg, "--base-url")) {
+            o.base_url = value;
+        } else if (std.mem.eql(u8, arg, "--endpoint")) {
+            o.endpoint = std.meta.stringToEnum(Endpoint, value) orelse return error.InvalidArgs;
+        } else if (std.mem.eql(u8, arg, "--rate")) {
+            o.rate = try std.fmt.parseFloat(f64, value);
+            if (!(o.rate > 0)) return error.InvalidArgs;
+        } else if (std.mem.eql(u8, arg, "--duration")) {
+            o.duration_s = try std.fmt.parseFloat(f64, value);
+            if (!(o.duration_s > 0)) return error.InvalidArgs;
+        } else if (std.mem.eql(u8, arg, "--workers")) {
+            o.workers = try std.fmt.parseInt(usize, value, 10);
+            if (o.workers == 0 or o.workers > std.math.maxInt(u32)) return error.InvalidArgs;
+        } else if (std.mem.eql(u8, arg, "--prompt-bytes")) {
+            o.prompt_bytes = try std.fmt.parseInt(usize, value, 10);
+        } else if (std.mem.eql(u8, arg, "--inputs")) {
+            o.inputs = try std.fmt.parseInt(usize, value, 10);
+            if (o.inputs == 0) return error.InvalidArgs;
+        } else if (std.mem.eql(u8, arg, "--model")) {
+            o.model = value;
+        } else if (std.mem.eql(u8, arg, "--json")) {
+            o.json_path = value;
+        } else {
+            return error.InvalidArgs;
+        }
+    }
+    return o;
+}
+
+// Shared, read-only state of a run plus the ticket counter.
+const Run = struct {
+    options: Options,
+    client: *openai.Client,
+    api_key: []const u8,
+    prompt: []const u8,
+    inputs: []const []const u8,
+    total: usize,
+    interval_ns: u64,
+    start: std.time.Instant,
+    // Index of the next request to start.
+    next: std.atomic.Value(usize) = std.atomic.Value(usize).init(0),
+    stopping: std.atomic.Value(bool) = std.atomic.Value(bool).init(false),
+};
+
+// One thread; records its own samples so the hot path takes no lock.
+const Worker = struct {
+    run: *Run,
+    // Due time to completion, per successful request.
+    latencies_ns: std.ArrayListUnmanaged(u64) = .{},
+    // Send to completion, per successful request.
+    service_ns: std.ArrayListUnmanaged(u64) = .{},
+    failures: std.StringHashMapUnmanaged(u64) = .{},
+
+    fn deinit(self: *Worker) void {
+        const allocator = std.heap.smp_allocator;
+        self.latencies_ns.deinit(allocator);
+        self.service_ns.deinit(allocator);
+        self.failures.deinit(allocator);
+    }
+
+    fn loop(self: *Worker) void {
+        const r = self.run;
+        // Request-scoped allocations; reset after every request.
+        var arena = std.heap.ArenaAllocator.init(std.heap.smp_allocator);
+        defer arena.deinit();
+        while (!r.stopping.load(.acquire)) {
+            const i = r.next.fetchAdd(1, .monotonic);
+            if (i >= r.total) return;
+            const due = i * r.interval_ns;
+            const now = sinceStart(r);
+            if (due > now) std.Thread.sleep(due - now);
+
+            const sent = sinceStart(r);
+            const result = self.send(arena.allocator());
+            const done = sinceStart(r);
+            _ = arena.reset(.retain_capacity);
+            self.record(result, done -| due, done -| sent) catch return;
+        }
+    }
+
+    fn send(self: *Worker, allocator: std.mem.Allocator) !void {
+        const r = self.run;
+        const o = r.options;
+        switch (o.endpoint) {
+            .models => {
+                const resp = try openai.fetchModelsJson(allocator, r.client, r.api_key);
+                if (resp.status != .ok) return statusError(resp.status);
+            },
+            .chat => {
+                const body = try openai.chatCompletion(allocator, r.client, r.api_key, o.model, r.prompt);
+                // The helper passes error bodies through.
+                if (std.mem.startsWith(u8, body, "{\"error\"")) return error.ErrorResponse;
+            },
+            .stream => {
+                const m = try openai.chatCompletionStream(allocator, r.client, r.api_key, o.model, r.prompt, .{ .onDelta = ignoreDelta });
+                if (m.deltas == 0) return error.EmptyStream;
+            },
+            .embeddings => {
+                var e = try openai.embed(allocator, r.client, r.api_key, r.inputs, .{});
+                e.deinit(allocator);
+            },
+        }
+    }
+
+    fn record(self: *Worker, result: anyerror!void, latency_ns: u64, service_ns: u64) !void {
+        const allocator = std.heap.smp_allocator;
+        if (result) |_| {
+            try self.latencies_ns.append(allocator, latency_ns);
+            try self.service_ns.append(allocator, service_ns);
+        } else |e| {
+            const entry = try self.failures.getOrPut(allocator, @errorName(e));
+            entry.value_ptr.* = if (entry.found_existing) entry.value_ptr.* + 1 else 1;
+        }
+    }
+
+    fn ignoreDelta(_: ?*anyopaque, _: []const u8) anyerror!void {}
+};
+
+fn sinceStart(r: *const Run) u64 {
+    const now = std.time.Instant.now() catch return 0;
+    return now.since(r.start);
+}
+
+fn statusError(status: std.http.Status) anyerror {
+    return switch (status) {
+        .too_many_requests => error.RateLimited,
+        else => if (@intFromEnum(status) >= 500) error.ServerError else error.UnexpectedStatus,
+    };
+}
+
+const Summary = struct {
+    endpoint: Endpoint,
+    target_rate: f64,
+    requests: usize,
+    succeeded: usize,
+    failed: u64,
+    wall_ns: u64,
+    // Sorted ascending.
+    latencies_ns: []u64,
+    service_ns: []u64,
+    failures: std.StringArrayHashMapUnmanaged(u64) = .{},
+
+    fn collect(allocator: std.mem.Allocator, workers: []const Worker, wall_ns: u64, options: Options, total: usize) !Summary {
+        var ok: usize = 0;
+        for (workers) |w| ok += w.latencies_ns.items.len;
+        const latencies = try allocator.alloc(u64, ok);
+        errdefer allocator.free(latencies);
+        const service = try allocator.alloc(u64, ok);
+        errdefer allocator.free(service);
+        var s = Summary{
+            .endpoint = options.endpoint,
+            .target_rate = options.rate,
+            .requests = total,
+            .succeeded = ok,
+            .failed = 0,
+            .wall_ns = wall_ns,
+            .latencies_ns = latencies,
+            .service_ns = service,
+        };
+        var at: usize = 0;
+        for (workers) |w| {
+            const n = w.latencies_ns.items.len;
+            @memcpy(latencies[at..][0..n], w.latencies_ns.items);
+            @memcpy(service[at..][0..n], w.service_ns.items);
+            at += n;
+            var it = w.failures.iterator();
+            while (it.next()) |f| {
+                const entry = try s.failures.getOrPut(allocator, f.key_ptr.*);
+                entry.value_ptr.* = if (entry.found_existing) entry.value_ptr.* + f.value_ptr.* else f.value_ptr.*;
+                s.failed += f.value_ptr.*;
+            }
+        }
+        std.mem.sort(u64, latencies, {}, std.sort.asc(u64));
+        std.mem.sort(u64, service, {}, std.sort.asc(u64));
+        return s;
+    }
+
+    fn deinit(self: *Summary, allocator: std.mem.Allocator) void {
+        allocator.free(self.latencies_ns);
+        allocator.free(self.service_ns);
+        self.failures.deinit(allocator);
+    }
+
+    fn throughput(self: *const Summary) f64 {
+        return @as(f64, @floatFromInt(self.succeeded)) / toSeconds(@max(self.wall_ns, 1));
+    }
+
+    fn print(self: *const Summary) void {
+        std.debug.print("{s}: {d} requests ({d} failed) in {d:.2}s, target {d:.1} req/s\n", .{
+            @tagName(self.endpoint), self.requests, self.failed, toSeconds(self.wall_ns), self.target_rate,
+        });
+        std.debug.print("throughput: {d:.1} req/s\n", .{self.throughput()});
+        if (self.succeeded > 0) {
+            for ([_]struct { []const u8, []const u64 }{
+                .{ "latency", self.latencies_ns },
+                .{ "service", self.service_ns },
+            }) |row| {
+                const s = row[1];
+                std.debug.print("{s} ms: p50 {d:.2}  p99 {d:.2}  p999 {d:.2}  max {d:.2}\n", .{
+                    row[0], toMs(percentile(s, 50)), toMs(percentile(s, 99)), toMs(percentile(s, 99.9)), toMs(s[s.len - 1]),
+                });
+            }
+        }
+        var it = self.failures.iterator();
+        while (it.next()) |f| std.debug.print("failed: {s} x{d}\n", .{ f.key_ptr.*, f.value_ptr.* });
+    }
+
+    fn writeJson(self: *const Summary, path: []const u8) !void {
+        const file = try std.fs.cwd().createFile(path, .{});
+        defer file.close();
+        var buffered = std.io.bufferedWriter(file.writer());
+        const w = buffered.writer();
+        try w.print("{{\"endpoint\":\"{s}\",\"target_rate\":{d},\"requests\":{d},\"succeeded\":{d},\"failed\":{d},\"wall_s\":{d:.3},\"throughput\":{d:.3}", .{
+            @tagName(self.endpoint), self.target_rate, self.requests, self.succeeded, self.failed, toSeconds(self.wall_ns), self.throughput(),
+        });
+        for ([_]struct { []const u8, []const u64 }{
+            .{ "latency_ms", self.latencies_ns },
+            .{ "service_ms", self.service_ns },
+        }) |row| {
+            const s = row[1];
+            if (s.len == 0) continue;
+            try w.print(",\"{s}\":{{\"p50\":{d:.3},\"p99\":{d:.3},\"p999\":{d:.3},\"max\":{d:.3}}}", .{
+                row[0], toMs(percentile(s, 50)), toMs(percentile(s, 99)), toMs(percentile(s, 99.9)), toMs(s[s.len - 1]),
+            });
+        }
+        try w.writeAll(",\"failures\":{");
+        var it = self.failures.iterator();
+        var first = true;
+        while (it.next()) |f| : (first = false) {
+            try w.print("{s}\"{s}\":{d}", .{ if (first) "" else ",", f.key_ptr.*, f.value_ptr.* });
+        }
+        try w.writeAll("}}\n");
+        try buffered.flush();
+    }
+};
+
+// Nearest-rank percentile of a sorted, non-empty slice.
+fn percentile(sorted: []const u64, p: f64) u64 {
+    const rank: usize = @intFromFloat(@ceil(p / 100 * @as(f64, @floatFromInt(sorted.len))));
+    return sorted[@min(sorted.len - 1, rank -| 1)];
+}
+
+fn toMs(ns: u64) f64 {
+    return @as(f64, @floatFromInt(ns)) / std.time.ns_per_ms;
+}
+
+fn toSeconds(ns: u64) f64 {
+    return @as(f64, @floatFromInt(ns)) / std.time.ns_per_s;
+}
@@ -3,7 +3,14 @@
 //! - Shows a simple Win32 window via a C helper implementation
 const std = @import("std");
 const models_feature = @import("features/model_list.zig");
+const MainView = @import("features/main_view.zig").MainView;
+const credentials = @import("features/credentials.zig");
 const ui = @import("platform/ui.zig");
+const http = @import("platform/http.zig");
+const executor = @import("util/executor.zig");
+const request_arena = @import("util/request_arena.zig");
+const BufferPool = @import("util/buffer_pool.zig").BufferPool;
+const trace = @import("trace");
 
 // Import C headers so their functions are available as `c.*` in Zig.
 // c_functions.h: simple arithmetic example (uses libc printf)
@@ -13,12 +20,63 @@ const c = @cImport({
     @cInclude("win32_ui.h");
 });
 
+// Background jobs (network, parsing, cache I/O) run here so the message
+// loop never blocks; results come back through OnJobsCompleted.
+var jobs: executor.Executor = undefined;
+
+// Long-lived allocations (executor, pools) use the general-purpose
+// allocator. Each UI callback and each background job gets its own arena
+// from `arenas`; the arenas' chunks are recycled through `buffers`.
+const gpa = std.heap.smp_allocator;
+var buffers = BufferPool.init(gpa, .{});
+var arenas = request_arena.ArenaPool.init(buffers.allocator(), .{});
+
+// Text model of the main view; updates reach the edit control as ranges.
+var main_view = MainView.init(gpa);
+
 pub fn main() anyerror!void {
+    // OHMYZIG_TRACE=<prefix> records request spans and writes
+    // <prefix>.trace.json and <prefix>.jsonl on exit.
+    const trace_prefix = trace.enableFromEnv(gpa, "OHMYZIG_TRACE");
+    defer if (trace_prefix) |prefix| {
+        trace.exportFiles(gpa, prefix) catch {};
+        trace.reset();
+        gpa.free(prefix);
+    };
+    defer buffers.deinit();
+    defer arenas.deinit();
+    defer main_view.deinit();
+    // Zeroes the cached API key.
+    defer credentials.openai.deinit();
+    // Pooled connections outlive the workers that use them.
+    defer http.shutdown();
+    try jobs.init(gpa, .{ .threads = 2, .notify = wakeUi });
+    defer jobs.deinit();
+    // Runs before jobs.deinit: a models fetch stuck on the network must not
+    // hold up joining the workers.
+    defer models_feature.cancelFetches();
+
     // Start the Win32 UI and run the message loop.
     // Create a simple Win32 window and run the message loop.
     ui.createSimpleWindow();
 }
 
+fn wakeUi(_: ?*anyopaque) void {
+    ui.postJobsCompleted();
+}
+
 pub export fn OnShowModelsRequest() callconv(.c) void {
-    models_feature.showModelsOfflineFirst(std.heap.page_allocator);
+    const ra = arenas.acquire("models/show") catch return;
+    defer arenas.release(ra);
+    models_feature.showModelsOfflineFirst(ra.allocator(), &jobs, &arenas, &main_view);
+}
+
+pub export fn OnUpdateModelsRequest() callconv(.c) void {
+    const ra = arenas.acquire("models/update") catch return;
+    defer arenas.release(ra);
+    models_feature.updateModelsInMain(ra.allocator(), &jobs, &arenas, &main_view);
+}
+
+pub export fn OnJobsCompleted() callconv(.c) void {
+    _ = jobs.drainCompletions();
 }
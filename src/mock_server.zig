@@ -0,0 +1,618 @@
+//! Local mock of the OpenAI endpoints the app uses, for offline and load
+//! testing (`zig build mock -- [options]`, then point a client at
+//! `http://127.0.0.1:PORT`: `Client.Options.base_url`, `--base-url` of the
+//! batch runner and load generator, OHMYZIG_BASE_URL for the app).
+//! - GET /v1/models, POST /v1/chat/completions (plain, or SSE when the body
+//!   asks for "stream":true) and POST /v1/embeddings.
+//! - Every answer waits for a latency drawn from a configurable
+//!   distribution; a share of requests can be failed with 500 or 429
+//!   (with retry-after-ms), and response sizes are set on the command line.
+//! - Successful JSON bodies can be sent gzip- or deflate-encoded (when the
+//!   request's Accept-Encoding allows it) to exercise client decoding.
+//! - HTTP/1.1 keep-alive, one thread per connection. Request bodies may be
+//!   sent with Content-Length or chunked. Connections idle for
+//!   `--idle-timeout-ms` are closed without notice, like a server's
+//!   keep-alive timeout.
+//! - Deterministic for a given `--seed` and request order per connection.
+//! - Tests run it in-process: `Server.start` on port 0, `port()`, `stop()`.
+const std = @import("std");
+
+const usage =
+    \\usage: ohmyzig-mock [options]
+    \\  --port N              listen port (default 8080, 0 = any free port)
+    \\  --latency SPEC        per-request delay: fixed:MS, uniform:LO-HI, exp:MEAN
+    \\                        or lognormal:MEDIAN,SIGMA (ms, default fixed:0)
+    \\  --error-rate P        share of requests answered 500 (default 0)
+    \\  --ratelimit-rate P    share of requests answered 429 (default 0)
+    \\  --retry-after-ms N    retry-after-ms sent with a 429 (default 100)
+    \\  --response-bytes N    chat answer content size (default 64)
+    \\  --sse-chunks N        content deltas per streamed answer (default 8)
+    \\  --sse-interval-ms N   pause between streamed deltas (default 0)
+    \\  --models N            ids in the models list (default 20)
+    \\  --dims N              embedding dimensions (default 8)
+    \\  --content-encoding E  identity, gzip or deflate for 200 JSON bodies
+    \\                        the client accepts (default identity)
+    \\  --idle-timeout-ms N   close connections idle this long (default 0: never)
+    \\  --seed N              random seed (default 1)
+    \\
+;
+
+pub const Latency = union(enum) {
+    fixed: f64,
+    uniform: struct { lo: f64, hi: f64 },
+    exponential: f64,
+    lognormal: struct { median: f64, sigma: f64 },
+
+    fn parse(spec: []const u8) !Latency {
+        const colon = std.mem.indexOfScalar(u8, spec, ':') orelse return error.InvalidArgs;
+        const kind = spec[0..colon];
+        const args = spec[colon + 1 ..];
+        if (std.mem.eql(u8, kind, "fixed")) return .{ .fixed = try std.fmt.parseFloat(f64, args) };
+        if (std.mem.eql(u8, kind, "exp")) return .{ .exponential = try std.fmt.parseFloat(f64, args) };
+        if (std.mem.eql(u8, kind, "uniform")) {
+            const dash = std.mem.indexOfScalar(u8, args, '-') orelse return error.InvalidArgs;
+            const lo = try std.fmt.parseFloat(f64, args[0..dash]);
+            const hi = try std.fmt.parseFloat(f64, args[dash + 1 ..]);
+            if (hi < lo) return error.InvalidArgs;
+            return .{ .uniform = .{ .lo = lo, .hi = hi } };
+        }
+        if (std.mem.eql(u8, kind, "lognormal")) {
+            const comma = std.mem.indexOfScalar(u8, args, ',') orelse return error.InvalidArgs;
+            return .{ .lognormal = .{
+                .median = try std.fmt.parseFloat(f64, args[0..comma]),
+                .sigma = try std.fmt.parseFloat(f64, args[comma + 1 ..]),
+            } };
+        }
+        return error.InvalidArgs;
+    }
+
+    fn sampleMs(self: Latency, rng: std.Random) f64 {
+        const ms = switch (self) {
+            .fixed => |v| v,
+            .uniform => |u| u.lo + (u.hi - u.lo) * rng.float(f64),
+            .exponential => |mean| mean * rng.floatExp(f64),
+            .lognormal => |l| l.median * @exp(l.sigma * rng.floatNorm(f64)),
+        };
+        return @max(ms, 0);
+    }
+};
+
+pub const Options = struct {
+    port: u16 = 8080,
+    latency: Latency = .{ .fixed = 0 },
+    error_rate: f64 = 0,
+    ratelimit_rate: f64 = 0,
+    retry_after_ms: u64 = 100,
+    response_bytes: usize = 64,
+    sse_chunks: usize = 8,
+    sse_interval_ms: u64 = 0,
+    models: usize = 20,
+    dims: usize = 8,
+    content_encoding: ContentEncoding = .identity,
+    // 0: keep connections open until the client closes them.
+    idle_timeout_ms: u64 = 0,
+    seed: u64 = 1,
+};
+
+pub const ContentEncoding = enum { identity, gzip, deflate };
+
+// Largest request body accepted (413 above).
+const max_body_bytes = 64 << 20;
+
+pub fn main() !void {
+    const allocator = std.heap.smp_allocator;
+
+    const args = try std.process.argsAlloc(allocator);
+    defer std.process.argsFree(allocator, args);
+    const options = parseArgs(args) catch {
+        std.debug.print("{s}", .{usage});
+        std.process.exit(2);
+    };
+
+    var server = try Server.init(allocator, options);
+    defer server.deinit();
+    std.debug.print("mock OpenAI API on http://127.0.0.1:{d}\n", .{server.port()});
+    server.acceptLoop();
+}
+
+fn parseArgs(args: []const []const u8) !Options {
+    var o = Options{};
+    var i: usize = 1;
+    while (i < args.len) : (i += 1) {
+        const arg = args[i];
+        if (i + 1 >= args.len) return error.InvalidArgs;
+        const value = args[i + 1];
+        i += 1;
+        if (std.mem.eql(u8, arg, "--port")) {
+            o.port = try std.fmt.parseInt(u16, value, 10);
+        } else if (std.mem.eql(u8, arg, "--latency")) {
+            o.latency = try Latency.parse(value);
+        } else if (std.mem.eql(u8, arg, "--error-rate")) {
+            o.error_rate = try parseRate(value);
+        } else if (std.mem.eql(u8, arg, "--ratelimit-rate")) {
+            o.ratelimit_rate = try parseRate(value);
+        } else if (std.mem.eql(u8, arg, "--retry-after-ms")) {
+            o.retry_after_ms = try std.fmt.parseInt(u64, value, 10);
+        } else if (std.mem.eql(u8, arg, "--response-bytes")) {
+            o.response_bytes = try std.fmt.parseInt(usize, value, 10);
+        } else if (std.mem.eql(u8, arg, "--sse-chunks")) {
+            o.sse_chunks = try std.fmt.parseInt(usize, value, 10);
+            if (o.sse_chunks == 0) return error.InvalidArgs;
+        } else if (std.mem.eql(u8, arg, "--sse-interval-ms")) {
+            o.sse_interval_ms = try std.fmt.parseInt(u64, value, 10);
+        } else if (std.mem.eql(u8, arg, "--models")) {
+            o.models = try std.fmt.parseInt(usize, value, 10);
+        } else if (std.mem.eql(u8, arg, "--dims")) {
+            o.dims = try std.fmt.parseInt(usize, value, 10);
+            if (o.dims == 0) return error.InvalidArgs;
+        } else if (std.mem.eql(u8, arg, "--content-encoding")) {
+            o.content_encoding = std.meta.stringToEnum(ContentEncoding, value) orelse return error.InvalidArgs;
+        } else if (std.mem.eql(u8, arg, "--idle-timeout-ms")) {
+            o.idle_timeout_ms = try std.fmt.parseInt(u64, value, 10);
+        } else if (std.mem.eql(u8, arg, "--seed")) {
+            o.seed = try std.fmt.parseInt(u64, value, 10);
+        } else {
+            return error.InvalidArgs;
+        }
+    }
+    if (o.error_rate + o.ratelimit_rate > 1) return error.InvalidArgs;
+    return o;
+}
+
+fn parseRate(value: []const u8) !f64 {
+    const p = try std.fmt.parseFloat(f64, value);
+    if (p < 0 or p > 1) return error.InvalidArgs;
+    return p;
+}
+
+pub const Server = struct {
+    allocator: std.mem.Allocator,
+    options: Options,
+    listener: std.net.Server,
+    // Bodies that do not depend on the request, built once.
+    models_body: []u8,
+    chat_body: []u8,
+    // One `data:` event per delta plus the final [DONE].
+    sse_events: [][]u8,
+    connections: std.atomic.Value(u64) = std.atomic.Value(u64).init(0),
+    requests: std.atomic.Value(u64) = std.atomic.Value(u64).init(0),
+    // Set by `start` / `stop` for an in-process server.
+    accept_thread: ?std.Thread = null,
+    stopping: std.atomic.Value(bool) = std.atomic.Value(bool).init(false),
+    // Sockets of the connections being served, so `stop` can end them.
+    live_mutex: std.Thread.Mutex = .{},
+    live_done: std.Thread.Condition = .{},
+    live: std.ArrayListUnmanaged(std.posix.socket_t) = .{},
+
+    fn init(allocator: std.mem.Allocator, options: Options) !Server {
+        const addr = try std.net.Address.parseIp("127.0.0.1", options.port);
+        var listener = try addr.listen(.{ .reuse_address = true, .kernel_backlog = 1024 });
+        errdefer listener.deinit();
+        const content = try allocator.alloc(u8, options.response_bytes);
+        defer allocator.free(content);
+        for (content, 0..) |*c, i| c.* = if (i % 8 == 7) ' ' else 'a' + @as(u8, @intCast(i % 26));
+
+        const models_body = try buildModels(allocator, options.models);
+        errdefer allocator.free(models_body);
+        const chat_body = try std.fmt.allocPrint(allocator,
+            \\{{"id":"chatcmpl-mock","object":"chat.completion","created":0,"model":"mock","choices":[{{"index":0,"message":{{"role":"assistant","content":"{s}"}},"finish_reason":"stop"}}],"usage":{{"prompt_tokens":0,"completion_tokens":{d},"total_tokens":{d}}}}}
+        , .{ content, content.len / 4, content.len / 4 });
+        errdefer allocator.free(chat_body);
+        const sse_events = try buildSseEvents(allocator, content, options.sse_chunks);
+        return .{
+            .allocator = allocator,
+            .options = options,
+            .listener = listener,
+            .models_body = models_body,
+            .chat_body = chat_body,
+            .sse_events = sse_events,
+        };
+    }
+
+    fn deinit(self: *Server) void {
+        for (self.sse_events) |e| self.allocator.free(e);
+        self.allocator.free(self.sse_events);
+        self.allocator.free(self.chat_body);
+        self.allocator.free(self.models_body);
+        self.live.deinit(self.allocator);
+        self.listener.deinit();
+    }
+
+    // Listens (`options.port` 0 picks a free port) and accepts on a
+    // background thread until `stop`.
+    pub fn start(allocator: std.mem.Allocator, options: Options) !*Server {
+        const self = try allocator.create(Server);
+        errdefer allocator.destroy(self);
+        self.* = try Server.init(allocator, options);
+        errdefer self.deinit();
+        self.accept_thread = try std.Thread.spawn(.{}, acceptLoop, .{self});
+        return self;
+    }
+
+    pub fn port(self: *const Server) u16 {
+        return self.listener.listen_address.getPort();
+    }
+
+    // Stops accepting, ends the open connections, waits for their threads
+    // and frees the server.
+    pub fn stop(self: *Server) void {
+        self.stopping.store(true, .release);
+        // Wakes the blocked accept; the loop sees `stopping` and returns.
+        if (std.net.tcpConnectToAddress(self.listener.listen_address)) |s| s.close() else |_| {}
+        if (self.accept_thread) |t| t.join();
+
+        self.live_mutex.lock();
+        for (self.live.items) |fd| std.posix.shutdown(fd, .both) catch {};
+        while (self.live.items.len > 0) self.live_done.wait(&self.live_mutex);
+        self.live_mutex.unlock();
+
+        const allocator = self.allocator;
+        self.deinit();
+        allocator.destroy(self);
+    }
+
+    fn acceptLoop(self: *Server) void {
+        while (!self.stopping.load(.acquire)) {
+            const conn = self.listener.accept() catch continue;
+            if (self.stopping.load(.acquire)) {
+                conn.stream.close();
+                return;
+            }
+            const n = self.connections.fetchAdd(1, .monotonic);
+            self.track(conn.stream) catch {
+                conn.stream.close();
+                continue;
+            };
+            const t = std.Thread.spawn(.{ .stack_size = 256 * 1024 }, serve, .{ self, conn.stream, n }) catch {
+                self.untrack(conn.stream);
+                continue;
+            };
+            t.detach();
+        }
+    }
+
+    fn track(self: *Server, stream: std.net.Stream) !void {
+        self.live_mutex.lock();
+        defer self.live_mutex.unlock();
+        try self.live.append(self.allocator, stream.handle);
+    }
+
+    // Closes the stream under the lock, so `stop` never shuts down a
+    // descriptor that has been closed and reused.
+    fn untrack(self: *Server, stream: std.net.Stream) void {
+        self.live_mutex.lock();
+        defer self.live_mutex.unlock();
+        for (self.live.items, 0..) |fd, i| if (fd == stream.handle) {
+            _ = self.live.swapRemove(i);
+            break;
+        };
+        stream.close();
+        self.live_done.signal();
+    }
+
+    fn serve(self: *Server, stream: std.net.Stream, conn_index: u64) void {
+        defer self.untrack(stream);
+        var prng = std.Random.DefaultPrng.init(self.options.seed ^ (conn_index *% 0x9e3779b97f4a7c15));
+        var conn = Connection{ .stream = stream };
+        defer conn.body.deinit(self.allocator);
+        if (self.options.idle_timeout_ms > 0) {
+            // A read that waits longer fails with WouldBlock, which ends
+            // the connection below.
+            const ms = self.options.idle_timeout_ms;
+            const tv = std.posix.timeval{ .sec = @intCast(ms / 1000), .usec = @intCast(ms % 1000 * 1000) };
+            std.posix.setsockopt(stream.handle, std.posix.SOL.SOCKET, std.posix.SO.RCVTIMEO, &std.mem.toBytes(tv)) catch {};
+        }
+        while (true) {
+            const req = conn.next(self.allocator) catch |e| {
+                if (e == error.BodyTooLarge) writeResponse(stream, 413, "{\"error\":{\"message\":\"body too large\"}}") catch {};
+                return;
+            } orelse return;
+            self.answer(stream, req, prng.random()) catch return;
+            if (req.close) return;
+        }
+    }
+
+    fn answer(self: *Server, stream: std.net.Stream, req: Request, rng: std.Random) !void {
+        const o = self.options;
+        _ = self.requests.fetchAdd(1, .monotonic);
+        const delay_ms = o.latency.sampleMs(rng);
+        if (delay_ms > 0) std.Thread.sleep(@intFromFloat(delay_ms * std.time.ns_per_ms));
+
+        const roll = rng.float(f64);
+        if (roll < o.error_rate) {
+            return writeResponse(stream, 500, "{\"error\":{\"message\":\"mock failure\",\"type\":\"server_error\"}}");
+        }
+        if (roll < o.error_rate + o.ratelimit_rate) {
+            var head_buf: [256]u8 = undefined;
+            const body = "{\"error\":{\"message\":\"mock rate limit\",\"type\":\"requests\"}}";
+            const head = try std.fmt.bufPrint(&head_buf, "HTTP/1.1 429 Too Many Requests\r\nContent-Type: application/json\r\nretry-after-ms: {d}\r\nContent-Length: {d}\r\n\r\n", .{ o.retry_after_ms, body.len });
+            try stream.writeAll(head);
+            return stream.writeAll(body);
+        }
+
+        if (std.mem.eql(u8, req.path, "/v1/models")) {
+            if (req.method != .GET) return writeResponse(stream, 405, "{}");
+            return self.writeOk(stream, req, self.models_body);
+        }
+        if (std.mem.eql(u8, req.path, "/v1/chat/completions")) {
+            if (req.method != .POST) return writeResponse(stream, 405, "{}");
+            if (wantsStream(req.body)) return self.writeSse(stream);
+            return self.writeOk(stream, req, self.chat_body);
+        }
+        if (std.mem.eql(u8, req.path, "/v1/embeddings")) {
+            if (req.method != .POST) return writeResponse(stream, 405, "{}");
+            return self.writeEmbeddings(stream, req, rng);
+        }
+        return writeResponse(stream, 404, "{\"error\":{\"message\":\"unknown endpoint\"}}");
+    }
+
+    // One chunk per event, so the client sees deltas as they are written.
+    fn writeSse(self: *Server, stream: std.net.Stream) !void {
+        try stream.writeAll("HTTP/1.1 200 OK\r\nContent-Type: text/event-stream\r\nTransfer-Encoding: chunked\r\n\r\n");
+        for (self.sse_events, 0..) |event, i| {
+            if (i > 0 and self.options.sse_interval_ms > 0) std.Thread.sleep(self.options.sse_interval_ms * std.time.ns_per_ms);
+            var size_buf: [24]u8 = undefined;
+            try stream.writeAll(try std.fmt.bufPrint(&size_buf, "{x}\r\n", .{event.len}));
+            try stream.writeAll(event);
+            try stream.writeAll("\r\n");
+        }
+        try stream.writeAll("0\r\n\r\n");
+    }
+
+    // One vector of `dims` values per input; values are random but shaped
+    // like the real thing (unit length is not promised by the mock).
+    fn writeEmbeddings(self: *Server, stream: std.net.Stream, req: Request, rng: std.Random) !void {
+        const inputs = countInputs(self.allocator, req.body) catch return writeResponse(stream, 400, "{\"error\":{\"message\":\"invalid input\"}}");
+        var out: std.ArrayListUnmanaged(u8) = .{};
+        defer out.deinit(self.allocator);
+        const w = out.writer(self.allocator);
+        try w.writeAll("{\"object\":\"list\",\"model\":\"mock-embedding\",\"data\":[");
+        for (0..inputs) |i| {
+            if (i > 0) try w.writeByte(',');
+            try w.print("{{\"object\":\"embedding\",\"index\":{d},\"embedding\":[", .{i});
+            for (0..self.options.dims) |d| {
+                if (d > 0) try w.writeByte(',');
+                try w.print("{d:.6}", .{rng.float(f32) * 2 - 1});
+            }
+            try w.writeAll("]}");
+        }
+        try w.writeAll("],\"usage\":{\"prompt_tokens\":0,\"total_tokens\":0}}");
+        return self.writeOk(stream, req, out.items);
+    }
+
+    // 200 with `body`, encoded per `--content-encoding` when the request
+    // accepts that coding.
+    fn writeOk(self: *Server, stream: std.net.Stream, req: Request, body: []const u8) !void {
+        const coding = self.options.content_encoding;
+        if (coding == .identity or std.ascii.indexOfIgnoreCase(req.accept_encoding, @tagName(coding)) == null) {
+            return writeResponse(stream, 200, body);
+        }
+        var encoded: std.ArrayListUnmanaged(u8) = .{};
+        defer encoded.deinit(self.allocator);
+        var in = std.io.fixedBufferStream(body);
+        switch (coding) {
+            .gzip => try std.compress.gzip.compress(in.reader(), encoded.writer(self.allocator), .{}),
+            // HTTP "deflate" is the zlib format.
+            .deflate => try std.compress.zlib.compress(in.reader(), encoded.writer(self.allocator), .{}),
+            .identity => unreachable,
+        }
+        var head_buf: [192]u8 = undefined;
+        const head = try std.fmt.bufPrint(&head_buf, "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nContent-Encoding: {s}\r\nContent-Length: {d}\r\n\r\n", .{
+            @tagName(coding), encoded.items.len,
+        });
+        try stream.writeAll(head);
+        try stream.writeAll(encoded.items);
+    }
+};
+
+fn buildModels(allocator: std.mem.Allocator, n: usize) ![]u8 {
+    var out: std.ArrayListUnmanaged(u8) = .{};
+    errdefer out.deinit(allocator);
+    const w = out.writer(allocator);
+    try w.writeAll("{\"object\":\"list\",\"data\":[");
+    for (0..n) |i| {
+        if (i > 0) try w.writeByte(',');
+        try w.print("{{\"id\":\"mock-model-{d}\",\"object\":\"model\",\"created\":0,\"owned_by\":\"mock\"}}", .{i});
+    }
+    try w.writeAll("]}");
+    return out.toOwnedSlice(allocator);
+}
+
+// `content` split into `chunks` chat.completion.chunk events, then [DONE].
+fn buildSseEvents(allocator: std.mem.Allocator, content: []const u8, chunks: usize) ![][]u8 {
+    const events = try allocator.alloc([]u8, chunks + 1);
+    var built: usize = 0;
+    errdefer {
+        for (events[0..built]) |e| allocator.free(e);
+        allocator.free(events);
+    }
+    const step = std.math.divCeil(usize, content.len, chunks) catch unreachable;
+    for (0..chunks) |i| {
+        const start = @min(content.len, i * step);
+        const end = @min(content.len, start + step);
+        events[i] = try std.fmt.allocPrint(allocator,
+            \\data: {{"id":"chatcmpl-mock","object":"chat.completion.chunk","created":0,"model":"mock","choices":[{{"index":0,"delta":{{"content":"{s}"}},"finish_reason":null}}]}}
+            \\
+            \\
+        , .{content[start..end]});
+        built += 1;
+    }
+    events[chunks] = try allocator.dupe(u8, "data: [DONE]\n\n");
+    return events;
+}
+
+fn wantsStream(body: []const u8) bool {
+    return std.mem.indexOf(u8, body, "\"stream\":true") != null;
+}
+
+// Number of inputs of an embeddings request ("input" is a string or an
+// array of strings).
+fn countInputs(allocator: std.mem.Allocator, body: []const u8) !usize {
+    const parsed = try std.json.parseFromSlice(std.json.Value, allocator, body, .{});
+    defer parsed.deinit();
+    const input = switch (parsed.value) {
+        .object => |o| o.get("input") orelse return error.InvalidInput,
+        else => return error.InvalidInput,
+    };
+    return switch (input) {
+        .string => 1,
+        .array => |a| a.items.len,
+        else => error.InvalidInput,
+    };
+}
+
+fn writeResponse(stream: std.net.Stream, status: u16, body: []const u8) !void {
+    var head_buf: [160]u8 = undefined;
+    const head = try std.fmt.bufPrint(&head_buf, "HTTP/1.1 {d} {s}\r\nContent-Type: application/json\r\nContent-Length: {d}\r\n\r\n", .{
+        status, reason(status), body.len,
+    });
+    try stream.writeAll(head);
+    try stream.writeAll(body);
+}
+
+fn reason(status: u16) []const u8 {
+    return switch (status) {
+        200 => "OK",
+        400 => "Bad Request",
+        404 => "Not Found",
+        405 => "Method Not Allowed",
+        413 => "Payload Too Large",
+        500 => "Internal Server Error",
+        else => "Status",
+    };
+}
+
+const Request = struct {
+    method: enum { GET, POST, other },
+    // All point into the connection's buffers; valid until the next request.
+    path: []const u8,
+    body: []const u8,
+    // Accept-Encoding value ("" when absent).
+    accept_encoding: []const u8,
+    close: bool,
+};
+
+// Buffered reader over one keep-alive connection.
+const Connection = struct {
+    stream: std.net.Stream,
+    buf: [16 * 1024]u8 = undefined,
+    start: usize = 0,
+    end: usize = 0,
+    head: [4 * 1024]u8 = undefined,
+    body: std.ArrayListUnmanaged(u8) = .{},
+
+    // Next request, or null on a clean end of the connection.
+    fn next(self: *Connection, allocator: std.mem.Allocator) !?Request {
+        // Request head, up to the blank line.
+        var head_len: usize = 0;
+        while (true) {
+            if (std.mem.indexOf(u8, self.head[0..head_len], "\r\n\r\n") != null) break;
+            if (head_len == self.head.len) return error.HeadTooLarge;
+            const b = (try self.readByte()) orelse {
+                if (head_len == 0) return null;
+                return error.EndOfStream;
+            };
+            self.head[head_len] = b;
+            head_len += 1;
+        }
+        const head = self.head[0 .. head_len - 4];
+
+        var lines = std.mem.splitSequence(u8, head, "\r\n");
+        const request_line = lines.next() orelse return error.BadRequest;
+        var parts = std.mem.splitScalar(u8, request_line, ' ');
+        const method = parts.next() orelse return error.BadRequest;
+        const target = parts.next() orelse return error.BadRequest;
+        const path = target[0 .. std.mem.indexOfScalar(u8, target, '?') orelse target.len];
+
+        var content_length: usize = 0;
+        var chunked = false;
+        var close = false;
+        var accept_encoding: []const u8 = "";
+        while (lines.next()) |line| {
+            const colon = std.mem.indexOfScalar(u8, line, ':') orelse continue;
+            const name = line[0..colon];
+            const value = std.mem.trim(u8, line[colon + 1 ..], " \t");
+            if (std.ascii.eqlIgnoreCase(name, "content-length")) {
+                content_length = std.fmt.parseInt(usize, value, 10) catch return error.BadRequest;
+            } else if (std.ascii.eqlIgnoreCase(name, "transfer-encoding")) {
+                chunked = std.ascii.indexOfIgnoreCase(value, "chunked") != null;
+            } else if (std.ascii.eqlIgnoreCase(name, "connection")) {
+                close = std.ascii.eqlIgnoreCase(value, "close");
+            } else if (std.ascii.eqlIgnoreCase(name, "accept-encoding")) {
+                accept_encoding = value;
+            }
+        }
+
+        self.body.clearRetainingCapacity();
+        if (chunked) {
+            try self.readChunked(allocator);
+        } else {
+            if (content_length > max_body_bytes) return error.BodyTooLarge;
+            try self.body.resize(allocator, content_length);
+            try self.readExact(self.body.items);
+        }
+        return .{
+            .method = if (std.mem.eql(u8, method, "GET")) .GET else if (std.mem.eql(u8, method, "POST")) .POST else .other,
+            .path = path,
+            .body = self.body.items,
+            .accept_encoding = accept_encoding,
+            .close = close,
+        };
+    }
+
+    fn readChunked(self: *Connection, allocator: std.mem.Allocator) !void {
+        while (true) {
+            var line_buf: [64]u8 = undefined;
+            const line = try self.readLine(&line_buf);
+            const size_end = std.mem.indexOfAny(u8, line, "; ") orelse line.len;
+            const size = std.fmt.parseInt(usize, line[0..size_end], 16) catch return error.BadRequest;
+            if (size == 0) {
+                // Trailers (none expected) end with an empty line.
+                while ((try self.readLine(&line_buf)).len != 0) {}
+                return;
+            }
+            if (self.body.items.len + size > max_body_bytes) return error.BodyTooLarge;
+            const old = self.body.items.len;
+            try self.body.resize(allocator, old + size);
+            try self.readExact(self.body.items[old..]);
+            if ((try self.readLine(&line_buf)).len != 0) return error.BadRequest;
+        }
+    }
+
+    // Line without its CRLF.
+    fn readLine(self: *Connection, out: []u8) ![]const u8 {
+        var n: usize = 0;
+        while (true) {
+            const b = (try self.readByte()) orelse return error.EndOfStream;
+            if (b == '\n') return std.mem.trimRight(u8, out[0..n], "\r");
+            if (n == out.len) return error.BadRequest;
+            out[n] = b;
+            n += 1;
+        }
+    }
+
+    fn readExact(self: *Connection, out: []u8) !void {
+        var filled: usize = 0;
+        // Buffered bytes first, then straight from the socket.
+        const buffered = @min(out.len, self.end - self.start);
+        @memcpy(out[0..buffered], self.buf[self.start..][0..buffered]);
+        self.start += buffered;
+        filled = buffered;
+        while (filled < out.len) {
+            const n = try self.stream.read(out[filled..]);
+            if (n == 0) return error.EndOfStream;
+            filled += n;
+        }
+    }
+
+    fn readByte(self: *Connection) !?u8 {
+        if (self.start == self.end) {
+            self.start = 0;
+            self.end = try self.stream.read(&self.buf);
+            if (self.end == 0) return null;
+        }
+        const b = self.buf[self.start];
+        self.start += 1;
+        return b;
+    }
+};
@@ -1,52 +1,322 @@
 const std = @import("std");
+const client_mod = @import("client.zig");
+const Client = client_mod.Client;
+const sse = @import("sse.zig");
+const decode = @import("decode.zig");
+const schema = @import("schema.zig");
+const ratelimit = @import("ratelimit.zig");
+const ResponseCache = @import("response_cache.zig").ResponseCache;
+const conversation = @import("conversation.zig");
+const request_body = @import("request_body.zig");
+const kernels = @import("text_kernels");
+const deadline = @import("deadline");
+const trace = @import("trace");
 
 // Calls OpenAI Chat Completions API.
 // model: pass any available chat model id (e.g., "gpt-4o-mini", "gpt-3.5-turbo").
 // prompt: user content. Properly JSON-escaped before sending.
+// client: shared pooled client; keep-alive connections are reused across calls.
+// Returns error.RateLimited if the API still answers 429 after the client's
+// scheduler (if any) gave up retrying.
+// With `client.response_cache` set, an identical earlier request is answered
+// from disk and successful responses are stored.
+// The body is escaped straight into the connection (request_body.zig).
 pub fn chatCompletion(
     allocator: std.mem.Allocator,
+    client: *Client,
     api_key: []const u8,
     model: []const u8,
     prompt: []const u8,
 ) ![]u8 {
-    var client = std.http.Client{ .allocator = allocator };
-    defer client.deinit();
+    return chatCompletionCtx(allocator, client, api_key, model, prompt, .{});
+}
+
+// `chatCompletion` bounded by `ctx`: rate-limit waits and retry backoff
+// end on cancel and count against its total budget. Fails with error.DeadlineExceeded or
+// error.Canceled; a canceled request's connection is closed, not pooled.
+pub fn chatCompletionCtx(
+    allocator: std.mem.Allocator,
+    client: *Client,
+    api_key: []const u8,
+    model: []const u8,
+    prompt: []const u8,
+    ctx: deadline.Context,
+) ![]u8 {
+    const resp = try chatCompletionResponse(allocator, client, api_key, model, prompt, ctx);
+    return resp.body;
+}
+
+pub const ChatResponse = struct {
+    status: std.http.Status,
+    body: []u8,
+};
+
+// `chatCompletionCtx` that also returns the HTTP status, so callers can
+// tell an answer from an error body (400, 401, 500, ...). The wrappers
+// above return either as the body. Cache hits report 200.
+pub fn chatCompletionResponse(
+    allocator: std.mem.Allocator,
+    client: *Client,
+    api_key: []const u8,
+    model: []const u8,
+    prompt: []const u8,
+    ctx: deadline.Context,
+) !ChatResponse {
+    const span = trace.begin("openai/chatCompletion");
+    defer span.end();
+
+    const messages = [_]request_body.Message{.{ .role = .user, .content = .{ .bytes = prompt } }};
+    const body = request_body.ChatBody{ .model = model, .messages = &messages };
+    return postChat(allocator, client, api_key, body, promptTokens(client, prompt), ctx);
+}
+
+// Chat completion whose message contents may be readers or memory-mapped
+// files as well as slices; memory use does not depend on their size.
+// Token reservations count in-memory contents only. Bodies with a reader
+// are neither cached nor retried by the scheduler.
+pub fn chatCompletionBody(
+    allocator: std.mem.Allocator,
+    client: *Client,
+    api_key: []const u8,
+    body: request_body.ChatBody,
+) ![]u8 {
+    const span = trace.begin("openai/chatCompletion");
+    defer span.end();
+
+    var tokens: u64 = conversation.reply_overhead;
+    for (body.messages) |m| {
+        tokens += conversation.message_overhead;
+        switch (m.content) {
+            .bytes => |b| tokens += if (client.tokenizer) |t| t.count(b) else ratelimit.estimateTokens(b),
+            .reader => {},
+        }
+    }
+    const resp = try postChat(allocator, client, api_key, body, tokens, .{});
+    return resp.body;
+}
+
+// Tokens the scheduler reserves for a single-prompt request: exact with
+// `client.tokenizer`, estimated otherwise.
+fn promptTokens(client: *const Client, prompt: []const u8) u64 {
+    const t = client.tokenizer orelse return ratelimit.estimateTokens(prompt);
+    return t.count(prompt) + conversation.message_overhead + conversation.reply_overhead;
+}
+
+// Chat completion over a whole message history, e.g. a
+// `Conversation.window`. The scheduler reserves the messages' cached
+// token counts.
+pub fn chatCompletionMessages(
+    allocator: std.mem.Allocator,
+    client: *Client,
+    api_key: []const u8,
+    model: []const u8,
+    messages: []const conversation.Message,
+) ![]u8 {
+    const span = trace.begin("openai/chatCompletion");
+    defer span.end();
+
+    // Only the message list is allocated; contents are streamed.
+    const parts = try allocator.alloc(request_body.Message, messages.len);
+    defer allocator.free(parts);
+    var tokens: u64 = conversation.reply_overhead;
+    for (messages, parts) |m, *p| {
+        p.* = .{ .role = m.role, .content = .{ .bytes = m.content } };
+        tokens += m.tokens;
+    }
+    const body = request_body.ChatBody{ .model = model, .messages = parts };
+    const resp = try postChat(allocator, client, api_key, body, tokens, .{});
+    return resp.body;
+}
+
+// Sends a chat body through the response cache and scheduler.
+fn postChat(allocator: std.mem.Allocator, client: *Client, api_key: []const u8, body: request_body.ChatBody, tokens: u64, ctx: deadline.Context) !ChatResponse {
+    const auth_header = try std.fmt.allocPrint(allocator, "Bearer {s}", .{api_key});
+    defer allocator.free(auth_header);
+
+    const url = try client.url(allocator, "/v1/chat/completions");
+    defer allocator.free(url);
+
+    // A reader content can only be read once: such bodies bypass the cache.
+    const cache = if (body.contentLength() != null) client.response_cache else null;
+    var cache_key: ResponseCache.Key = undefined;
+    if (cache) |c| {
+        cache_key = try ResponseCache.keyStreamed(client.base_url, body);
+        // A broken cache only costs the network round trip.
+        if (c.get(allocator, cache_key) catch null) |hit| return .{ .status = .ok, .body = hit };
+    }
+
+    var guard: deadline.Guard = undefined;
+    try guard.start(ctx);
+    defer guard.finish();
+    var req = try client.sendBody(.{
+        .method = .POST,
+        .url = url,
+        .headers = &.{
+            .{ .name = "Content-Type", .value = "application/json" },
+            .{ .name = "Authorization", .value = auth_header },
+        },
+    }, body, tokens, &guard);
+    defer client_mod.release(&req, &guard);
+    // Still 429 after the scheduler's retries (or no scheduler attached).
+    if (req.response.status == .too_many_requests) return error.RateLimited;
+
+    const resp_body = try client_mod.readBody(allocator, &req, &guard);
+    if (cache) |c| {
+        if (req.response.status == .ok) c.put(cache_key, resp_body) catch {};
+    }
+    return .{ .status = req.response.status, .body = resp_body };
+}
+
+// Builds the request JSON for a single user message, for transports that
+// need the whole body in memory (the event loop).
+// stream: adds "stream":true so the server answers with SSE deltas.
+// The prompt is escaped straight into a body allocated at its exact size.
+pub fn buildChatBody(allocator: std.mem.Allocator, model: []const u8, prompt: []const u8, stream: bool) ![]u8 {
+    const head = "{\"model\":\"";
+    const stream_field: []const u8 = if (stream) "\",\"stream\":true," else "\",";
+    const messages = "\"messages\":[{\"role\":\"user\",\"content\":";
+    const tail = "}]}";
+
+    const escaped_len = kernels.jsonEscapedLen(prompt) + 2;
+    const out = try allocator.alloc(u8, head.len + model.len + stream_field.len + messages.len + escaped_len + tail.len);
+    var w: usize = 0;
+    for ([_][]const u8{ head, model, stream_field, messages }) |part| {
+        @memcpy(out[w..][0..part.len], part);
+        w += part.len;
+    }
+    kernels.jsonEscapeInto(out[w..][0..escaped_len], prompt);
+    w += escaped_len;
+    @memcpy(out[w..], tail);
+    return out;
+}
+
+// Receives each content delta of a streamed completion, in order.
+// `text` is only valid during the call.
+pub const DeltaCallback = struct {
+    ctx: ?*anyopaque = null,
+    onDelta: *const fn (ctx: ?*anyopaque, text: []const u8) anyerror!void,
+};
+
+pub const StreamMetrics = struct {
+    // Request start to the first non-empty content delta.
+    time_to_first_token_ns: ?u64 = null,
+    // Request start to end of stream.
+    total_ns: u64 = 0,
+    // Number of content deltas delivered.
+    deltas: usize = 0,
+    // Total content bytes delivered.
+    content_bytes: usize = 0,
+};
+
+// Streams a chat completion ("stream": true) and calls `on_delta` for each
+// content delta as it arrives. Memory use is bounded by one SSE event, no
+// matter how long the answer is; nothing is accumulated here.
+pub fn chatCompletionStream(
+    allocator: std.mem.Allocator,
+    client: *Client,
+    api_key: []const u8,
+    model: []const u8,
+    prompt: []const u8,
+    on_delta: DeltaCallback,
+) !StreamMetrics {
+    return chatCompletionStreamCtx(allocator, client, api_key, model, prompt, on_delta, .{});
+}
+
+// `chatCompletionStream` bounded by `ctx`. Set `idle_ms` to catch a stream
+// that stalls between deltas: every read re-arms it. Deltas delivered
+// before a deadline or cancel stay delivered.
+pub fn chatCompletionStreamCtx(
+    allocator: std.mem.Allocator,
+    client: *Client,
+    api_key: []const u8,
+    model: []const u8,
+    prompt: []const u8,
+    on_delta: DeltaCallback,
+    ctx: deadline.Context,
+) !StreamMetrics {
+    var timer = try std.time.Timer.start();
 
     const auth_header = try std.fmt.allocPrint(allocator, "Bearer {s}", .{api_key});
     defer allocator.free(auth_header);
 
-    var req = try client.request(.{
+    const url = try client.url(allocator, "/v1/chat/completions");
+    defer allocator.free(url);
+
+    const messages = [_]request_body.Message{.{ .role = .user, .content = .{ .bytes = prompt } }};
+    const body = request_body.ChatBody{ .model = model, .messages = &messages, .stream = true };
+
+    var guard: deadline.Guard = undefined;
+    try guard.start(ctx);
+    defer guard.finish();
+    var req = try client.sendBody(.{
         .method = .POST,
-        .url = "https://api.openai.com/v1/chat/completions",
+        .url = url,
         .headers = &.{
             .{ .name = "Content-Type", .value = "application/json" },
+            .{ .name = "Accept", .value = "text/event-stream" },
             .{ .name = "Authorization", .value = auth_header },
         },
-    });
-    defer req.deinit();
-
-    // Escape the prompt as a JSON string (includes quotes)
-    const escaped_prompt = try std.json.stringifyAlloc(allocator, prompt, .{});
-    defer allocator.free(escaped_prompt);
-
-    // Compose request body with dynamic model and escaped prompt
-    const body = try std.fmt.allocPrint(
-        allocator,
-        "{{\"model\":\"{s}\",\"messages\":[{{\"role\":\"user\",\"content\":{s}}}]}}",
-        .{ model, escaped_prompt },
-    );
-    defer allocator.free(body);
-
-    try req.writeAll(body);
-    try req.finish();
-
-    const resp_body = try req.readToEndAlloc(allocator, 1024 * 1024);
-    return resp_body;
+    }, body, promptTokens(client, prompt), &guard);
+    defer client_mod.release(&req, &guard);
+    if (req.response.status == .too_many_requests) return error.RateLimited;
+    if (req.response.status != .ok) return error.UnexpectedStatus;
+
+    var parser = try sse.Parser.init(allocator, sse.Parser.default_max_event_bytes);
+    defer parser.deinit();
+
+    var handler = StreamHandler{
+        .on_delta = on_delta,
+        .timer = &timer,
+    };
+    var buf: [4096]u8 = undefined;
+    while (!handler.done) {
+        const n = try client_mod.readGuarded(&req, &buf, &guard);
+        if (n == 0) {
+            try parser.finish(&handler);
+            break;
+        }
+        try parser.feed(buf[0..n], &handler);
+    }
+
+    handler.metrics.total_ns = timer.read();
+    return handler.metrics;
 }
 
+const StreamHandler = struct {
+    on_delta: DeltaCallback,
+    timer: *std.time.Timer,
+    metrics: StreamMetrics = .{},
+    done: bool = false,
+
+    pub fn onEvent(self: *StreamHandler, event: sse.Event) !void {
+        if (self.done) return;
+        if (std.mem.eql(u8, event.data, "[DONE]")) {
+            self.done = true;
+            return;
+        }
+        // Typed decode straight from the event buffer; the choices array
+        // comes from a stack buffer, so no heap traffic per delta.
+        var scratch: [4096]u8 = undefined;
+        var fba = std.heap.FixedBufferAllocator.init(&scratch);
+        const chunk = try decode.decodeLeaky(schema.ChatCompletionChunk, fba.allocator(), event.data);
+
+        for (chunk.choices) |choice| {
+            const text = choice.delta.content orelse continue;
+            if (text.len == 0) continue;
+            if (self.metrics.time_to_first_token_ns == null) {
+                self.metrics.time_to_first_token_ns = self.timer.read();
+            }
+            self.metrics.deltas += 1;
+            self.metrics.content_bytes += text.len;
+            try self.on_delta.onDelta(self.on_delta.ctx, text);
+        }
+    }
+};
+
 // Optional helper: picks model from env var OPENAI_MODEL, or defaults to gpt-3.5-turbo.
 pub fn chatCompletionWithEnvModel(
     allocator: std.mem.Allocator,
+    client: *Client,
     api_key: []const u8,
     prompt: []const u8,
 ) ![]u8 {
@@ -62,5 +332,65 @@ pub fn chatCompletionWithEnvModel(
         try model_buf.appendSlice("gpt-3.5-turbo");
     }
 
-    return try chatCompletion(allocator, api_key, model_buf.items, prompt);
+    return try chatCompletion(allocator, client, api_key, model_buf.items, prompt);
+}
+
+// Collects streamed deltas for the tests below.
+const TextSink = struct {
+    text: std.ArrayListUnmanaged(u8) = .{},
+
+    fn onDelta(ctx: ?*anyopaque, text: []const u8) anyerror!void {
+        const self: *TextSink = @ptrCast(@alignCast(ctx.?));
+        try self.text.appendSlice(std.testing.allocator, text);
+    }
+
+    fn callback(self: *TextSink) DeltaCallback {
+        return .{ .ctx = self, .onDelta = onDelta };
+    }
+};
+
+test "recorded stream decodes to the answer text" {
+    var sink = TextSink{};
+    defer sink.text.deinit(std.testing.allocator);
+    var timer = try std.time.Timer.start();
+    var handler = StreamHandler{ .on_delta = sink.callback(), .timer = &timer };
+    var parser = try sse.Parser.init(std.testing.allocator, sse.Parser.default_max_event_bytes);
+    defer parser.deinit();
+
+    // Socket-sized reads that cut events mid-line.
+    const fixture = @embedFile("testdata/chat_stream.sse");
+    var i: usize = 0;
+    while (i < fixture.len and !handler.done) : (i += 100) {
+        try parser.feed(fixture[i..@min(fixture.len, i + 100)], &handler);
+    }
+
+    try std.testing.expect(handler.done);
+    try std.testing.expectEqualStrings("Caf\u{e9} \"au lait\",\nplease.", sink.text.items);
+    // The role-only and finish deltas carry no content.
+    try std.testing.expectEqual(@as(usize, 3), handler.metrics.deltas);
+    try std.testing.expectEqual(sink.text.items.len, handler.metrics.content_bytes);
+    try std.testing.expect(handler.metrics.time_to_first_token_ns != null);
+}
+
+test "stream from the mock server arrives delta by delta" {
+    const mock = @import("mock_server");
+    const allocator = std.testing.allocator;
+    const server = try mock.Server.start(allocator, .{ .port = 0, .response_bytes = 40, .sse_chunks = 5 });
+    defer server.stop();
+
+    var base_buf: [64]u8 = undefined;
+    const base = try std.fmt.bufPrint(&base_buf, "http://127.0.0.1:{d}", .{server.port()});
+    var client = Client.init(allocator, .{ .base_url = base });
+    defer client.deinit();
+
+    var sink = TextSink{};
+    defer sink.text.deinit(allocator);
+    const metrics = try chatCompletionStream(allocator, &client, "test-key", "mock", "hi", sink.callback());
+
+    // The mock's content: a-z cycling, every 8th byte a space.
+    var expected: [40]u8 = undefined;
+    for (&expected, 0..) |*c, j| c.* = if (j % 8 == 7) ' ' else 'a' + @as(u8, @intCast(j % 26));
+    try std.testing.expectEqualStrings(&expected, sink.text.items);
+    try std.testing.expectEqual(@as(usize, 5), metrics.deltas);
+    try std.testing.expectEqual(@as(usize, 40), metrics.content_bytes);
 }
@@ -0,0 +1,494 @@
+const std = @import("std");
+const Scheduler = @import("ratelimit.zig").Scheduler;
+const ResponseCache = @import("response_cache.zig").ResponseCache;
+const Tokenizer = @import("tokenizer.zig").Tokenizer;
+const deadline = @import("deadline");
+const trace = @import("trace");
+
+// Long-lived HTTP client shared by the OpenAI helpers.
+// std.http.Client keeps finished keep-alive connections in its connection
+// pool (keyed by host, port and protocol), so reusing one Client across
+// calls skips DNS, TCP and the TLS handshake for repeat requests.
+// Create one per process (or per worker group) and pass it to
+// `fetchModelsJson` / `chatCompletion`.
+pub const Client = struct {
+    http: std.http.Client,
+    // Scheme + host (+ port) the helpers send requests to, no trailing slash.
+    base_url: []const u8,
+    // Optional rate-limit scheduler consulted by `send`.
+    scheduler: ?*Scheduler = null,
+    // Optional on-disk cache consulted by `chatCompletion`.
+    response_cache: ?*ResponseCache = null,
+    // Optional local tokenizer for exact prompt token counts.
+    tokenizer: ?*const Tokenizer = null,
+    mutex: std.Thread.Mutex = .{},
+    counters: Stats = .{},
+
+    pub const default_base_url = "https://api.openai.com";
+
+    pub const Options = struct {
+        // Idle keep-alive connections kept open across requests.
+        max_idle_connections: u32 = 4,
+        // Point at a local mock server for offline testing, e.g.
+        // "http://127.0.0.1:8080". Must outlive the client.
+        base_url: []const u8 = default_base_url,
+        // Shared by every request of this client; must outlive it.
+        scheduler: ?*Scheduler = null,
+        // Opt-in response cache for identical chat requests; must outlive
+        // the client.
+        response_cache: ?*ResponseCache = null,
+        // Chat helpers reserve exact prompt token counts with the scheduler
+        // instead of the ~4 bytes/token estimate; must outlive the client.
+        tokenizer: ?*const Tokenizer = null,
+    };
+
+    pub const Stats = struct {
+        requests: u64 = 0,
+        connections_new: u64 = 0,
+        connections_reused: u64 = 0,
+        // Responses that arrived gzip/deflate-encoded. std.http.Client
+        // offers "gzip, deflate" by default and decodes transparently.
+        compressed_responses: u64 = 0,
+    };
+
+    pub const RequestInfo = struct {
+        reused_connection: bool = false,
+    };
+
+    pub fn init(allocator: std.mem.Allocator, options: Options) Client {
+        return .{
+            .http = .{
+                .allocator = allocator,
+                .connection_pool = .{ .free_size = options.max_idle_connections },
+            },
+            .base_url = std.mem.trimRight(u8, options.base_url, "/"),
+            .scheduler = options.scheduler,
+            .response_cache = options.response_cache,
+            .tokenizer = options.tokenizer,
+        };
+    }
+
+    pub fn deinit(self: *Client) void {
+        self.http.deinit();
+    }
+
+    // What the helpers pass to `request` / `send` / `sendBody`.
+    pub const RequestOptions = struct {
+        method: std.http.Method,
+        url: []const u8,
+        headers: []const std.http.Header = &.{},
+        // Whether the scheduler may re-send the request after a 502 / 503 /
+        // 504, i.e. sending it twice is harmless. Null follows the method:
+        // GET yes, POST no. 429s are retried either way.
+        idempotent: ?bool = null,
+    };
+
+    // Opens a request on a pooled connection when one is idle for the host.
+    // `info` (optional) receives whether the connection was reused.
+    pub fn request(self: *Client, options: RequestOptions, info: ?*RequestInfo) !std.http.Client.Request {
+        const uri = try std.Uri.parse(options.url);
+        const protocol = std.http.Client.Connection.Protocol.fromScheme(uri.scheme) orelse return error.UnsupportedUriScheme;
+        var host_buf: [std.Uri.host_name_max]u8 = undefined;
+        const host = try uri.getHost(&host_buf);
+        const port: u16 = uri.port orelse switch (protocol) {
+            .plain => 80,
+            .tls => 443,
+        };
+        // The idle connection is taken out of the pool here, under the pool
+        // mutex, and handed to the request, so reuse is known for this
+        // request alone whatever other threads do with the pool. A
+        // connection released after this lookup may still be picked up by
+        // `http.request`; it is counted as new.
+        const pooled = self.http.connection_pool.findConnection(.{ .host = host, .port = port, .protocol = protocol });
+        const reused = pooled != null;
+        // DNS, TCP and TLS happen here for a new connection.
+        const span = trace.begin("openai/connect");
+        const req = try self.http.request(.{
+            .method = options.method,
+            .url = options.url,
+            .headers = options.headers,
+            .connection = pooled,
+        });
+        span.end();
+
+        self.mutex.lock();
+        self.counters.requests += 1;
+        if (reused) self.counters.connections_reused += 1 else self.counters.connections_new += 1;
+        self.mutex.unlock();
+
+        if (info) |i| i.reused_connection = reused;
+        return req;
+    }
+
+    // Opens a request, sends `body` (null for GET) and waits for the
+    // response head. With a scheduler attached it first waits for
+    // rate-limit budget (`tokens` is the estimated token cost) and re-sends
+    // on 429, and on 502 / 503 / 504 for idempotent requests, as the
+    // scheduler directs. The final response
+    // is returned either way; callers check `req.response.status`.
+    // With a started `guard` each phase runs under its deadline and an
+    // abort shuts the socket down. Budget waits and retry backoff end when
+    // the guard fires and count against its total deadline. The request is
+    // returned still attached to the guard, so end it with `release` rather
+    // than `req.deinit()`.
+    pub fn send(self: *Client, options: RequestOptions, body: ?[]const u8, tokens: u64, guard: ?*deadline.Guard) !std.http.Client.Request {
+        const idempotent = options.idempotent orelse options.method.idempotent();
+        var attempt: u32 = 0;
+        while (true) : (attempt += 1) {
+            if (self.scheduler) |s| try s.acquire(tokens, guard);
+
+            // The request lives in this block, so its errdefer cannot
+            // release it again once it has been released for a retry.
+            const delay = attempt: {
+                var req = try self.guardedRequest(options, guard);
+                errdefer release(&req, guard);
+                const span = trace.begin("openai/first_byte");
+                if (body) |b| req.writeAll(b) catch |e| return failed(guard, e);
+                req.finish() catch |e| return failed(guard, e);
+                span.end();
+                if (guard) |g| try g.phase(.body);
+                self.noteCompression(&req);
+
+                const s = self.scheduler orelse return req;
+                const delay = s.observe(req.response.status, req.response.iterateHeaders(), attempt, idempotent) orelse return req;
+                release(&req, guard);
+                break :attempt delay;
+            };
+            try backoff(self.scheduler.?, delay, guard);
+        }
+    }
+
+    // `request` under `guard`'s connect phase, then hands the guard the
+    // socket to shut down and starts the first-byte phase. The connect
+    // itself cannot be interrupted (there is no socket to close yet), so a
+    // deadline that passes during it is reported once it returns.
+    fn guardedRequest(self: *Client, options: RequestOptions, guard: ?*deadline.Guard) !std.http.Client.Request {
+        const g = guard orelse return self.request(options, null);
+        try g.phase(.connect);
+        var req = self.request(options, null) catch |e| return g.failed(e);
+        errdefer release(&req, guard);
+        if (req.connection) |conn| try g.setTarget(.{ .ctx = conn, .abort = shutdownConnection });
+        try g.phase(.first_byte);
+        return req;
+    }
+
+    // Like `send`, but `body.writeTo(writer)` writes the body straight into
+    // the connection (see request_body.zig). It goes out with
+    // Content-Length when `body.contentLength()` knows it, chunked
+    // otherwise. A body of unknown length cannot be written twice, so its
+    // first response is returned without scheduler retries.
+    pub fn sendBody(self: *Client, options: RequestOptions, body: anytype, tokens: u64, guard: ?*deadline.Guard) !std.http.Client.Request {
+        const length = body.contentLength();
+        const idempotent = options.idempotent orelse options.method.idempotent();
+        var attempt: u32 = 0;
+        while (true) : (attempt += 1) {
+            if (self.scheduler) |s| try s.acquire(tokens, guard);
+
+            // As in `send`: the request's errdefer ends with this block.
+            const delay = attempt: {
+                var req = try self.guardedRequest(options, guard);
+                errdefer release(&req, guard);
+                req.transfer_encoding = if (length) |n| .{ .content_length = n } else .chunked;
+                const span = trace.begin("openai/first_byte");
+                body.writeTo(req.writer()) catch |e| return failed(guard, e);
+                req.finish() catch |e| return failed(guard, e);
+                span.end();
+                if (guard) |g| try g.phase(.body);
+                self.noteCompression(&req);
+
+                const s = self.scheduler orelse return req;
+                // Observed even when not retrying: the headers update the buckets.
+                const delay = s.observe(req.response.status, req.response.iterateHeaders(), attempt, idempotent) orelse return req;
+                if (length == null) return req;
+                release(&req, guard);
+                break :attempt delay;
+            };
+            try backoff(self.scheduler.?, delay, guard);
+        }
+    }
+
+    // Joins base_url and an API path ("/v1/models"). Caller frees.
+    pub fn url(self: *const Client, allocator: std.mem.Allocator, path: []const u8) ![]u8 {
+        return std.fmt.allocPrint(allocator, "{s}{s}", .{ self.base_url, path });
+    }
+
+    pub fn stats(self: *Client) Stats {
+        self.mutex.lock();
+        defer self.mutex.unlock();
+        return self.counters;
+    }
+
+    fn noteCompression(self: *Client, req: *const std.http.Client.Request) void {
+        if (req.response.transfer_compression == .identity) return;
+        self.mutex.lock();
+        self.counters.compressed_responses += 1;
+        self.mutex.unlock();
+    }
+};
+
+// Ends a request from `Client.send` / `sendBody`. The guard's abort target
+// is detached first, so no abort can touch the connection once it is back
+// in the pool; a connection the guard shut down is closed, not pooled.
+pub fn release(req: *std.http.Client.Request, guard: ?*deadline.Guard) void {
+    if (guard) |g| {
+        g.setTarget(null) catch {};
+        if (g.reason() != null) if (req.connection) |conn| {
+            conn.closing = true;
+        };
+    }
+    req.deinit();
+}
+
+// Sleeps `delay` before a retry; a guard cuts the sleep short when it
+// fires. The time actually slept is counted as scheduler wait.
+fn backoff(s: *Scheduler, delay: u64, guard: ?*deadline.Guard) deadline.Error!void {
+    const g = guard orelse {
+        std.Thread.sleep(delay);
+        s.noteWait(delay);
+        return;
+    };
+    const start = deadline.now();
+    defer s.noteWait(deadline.now() - start);
+    try g.sleep(delay);
+}
+
+fn failed(guard: ?*deadline.Guard, err: anyerror) anyerror {
+    const g = guard orelse return err;
+    return g.failed(err);
+}
+
+// Abort target: a reader or writer blocked on the socket returns at once.
+fn shutdownConnection(ctx: *anyopaque) void {
+    const conn: *std.http.Client.Connection = @ptrCast(@alignCast(ctx));
+    std.posix.shutdown(conn.stream.handle, .both) catch {};
+}
+
+// Reads the rest of the response body straight into one allocation presized
+// from Content-Length: no intermediate buffer and no size ceiling. Bodies
+// without a length (chunked) or with a Content-Encoding, whose length is
+// that of the compressed bytes, grow in 16 KiB steps. Caller frees.
+// With a `guard` each read re-arms its idle limit, and a read cut short by
+// it fails with the guard's reason.
+pub fn readBody(allocator: std.mem.Allocator, req: *std.http.Client.Request, guard: ?*deadline.Guard) ![]u8 {
+    const span = trace.begin("openai/body");
+    defer span.end();
+    const read_chunk = 16 * 1024;
+    var list: std.ArrayListUnmanaged(u8) = .{};
+    errdefer list.deinit(allocator);
+    if (req.response.content_length != null and req.response.transfer_compression == .identity) {
+        const len = req.response.content_length.?;
+        const n = std.math.cast(usize, len) orelse return error.OutOfMemory;
+        try list.ensureTotalCapacityPrecise(allocator, n);
+    }
+    while (true) {
+        const space = list.unusedCapacitySlice();
+        if (space.len == 0) {
+            // Presized buffer is full: probe for EOF before growing it.
+            var probe: [512]u8 = undefined;
+            const n = try readGuarded(req, &probe, guard);
+            if (n == 0) break;
+            try list.ensureUnusedCapacity(allocator, n + read_chunk);
+            list.appendSliceAssumeCapacity(probe[0..n]);
+            continue;
+        }
+        const n = try readGuarded(req, space, guard);
+        if (n == 0) break;
+        list.items.len += n;
+    }
+    return list.toOwnedSlice(allocator);
+}
+
+// One body read under `guard` (see `readBody`).
+pub fn readGuarded(req: *std.http.Client.Request, buf: []u8, guard: ?*deadline.Guard) !usize {
+    const g = guard orelse return req.read(buf);
+    try g.phase(.body);
+    const n = req.read(buf) catch |e| return g.failed(e);
+    // A shut-down socket can also read as a clean end of the body.
+    if (n == 0) if (g.reason()) |e| return e;
+    return n;
+}
+
+test "second request reuses the pooled connection" {
+    const mock = @import("mock_server");
+    const allocator = std.testing.allocator;
+    const server = try mock.Server.start(allocator, .{ .port = 0 });
+    defer server.stop();
+
+    var base_buf: [64]u8 = undefined;
+    const base = try std.fmt.bufPrint(&base_buf, "http://127.0.0.1:{d}", .{server.port()});
+    var client = Client.init(allocator, .{ .base_url = base });
+    defer client.deinit();
+    const models_url = try client.url(allocator, "/v1/models");
+    defer allocator.free(models_url);
+
+    for (0..3) |i| {
+        var info: Client.RequestInfo = .{};
+        var req = try client.request(.{ .method = .GET, .url = models_url }, &info);
+        defer req.deinit();
+        try req.finish();
+        try std.testing.expectEqual(std.http.Status.ok, req.response.status);
+        allocator.free(try readBody(allocator, &req, null));
+        try std.testing.expectEqual(i > 0, info.reused_connection);
+    }
+
+    const s = client.stats();
+    try std.testing.expectEqual(@as(u64, 3), s.requests);
+    try std.testing.expectEqual(@as(u64, 1), s.connections_new);
+    try std.testing.expectEqual(@as(u64, 2), s.connections_reused);
+    try std.testing.expectEqual(@as(u64, 1), server.connections.load(.monotonic));
+}
+
+test "concurrent requests count each connection once" {
+    const mock = @import("mock_server");
+    const allocator = std.testing.allocator;
+    const server = try mock.Server.start(allocator, .{ .port = 0 });
+    defer server.stop();
+
+    var base_buf: [64]u8 = undefined;
+    const base = try std.fmt.bufPrint(&base_buf, "http://127.0.0.1:{d}", .{server.port()});
+    var client = Client.init(allocator, .{ .base_url = base, .max_idle_connections = 8 });
+    defer client.deinit();
+    const models_url = try client.url(allocator, "/v1/models");
+    defer allocator.free(models_url);
+
+    const Worker = struct {
+        fn run(c: *Client, u: []const u8, reused: *u64) void {
+            for (0..8) |_| {
+                var info: Client.RequestInfo = .{};
+                var req = c.request(.{ .method = .GET, .url = u }, &info) catch return;
+                defer req.deinit();
+                req.finish() catch return;
+                const body = readBody(std.testing.allocator, &req, null) catch return;
+                std.testing.allocator.free(body);
+                if (info.reused_connection) reused.* += 1;
+            }
+        }
+    };
+    var reused = [_]u64{0} ** 4;
+    var threads: [4]std.Thread = undefined;
+    for (&threads, &reused) |*t, *r| t.* = try std.Thread.spawn(.{}, Worker.run, .{ &client, models_url, r });
+    for (threads) |t| t.join();
+
+    // Each request's own answer adds up to the counters, and no request
+    // claimed a reuse the server did not see.
+    var reused_total: u64 = 0;
+    for (reused) |r| reused_total += r;
+    const s = client.stats();
+    try std.testing.expectEqual(@as(u64, 32), s.requests);
+    try std.testing.expectEqual(reused_total, s.connections_reused);
+    try std.testing.expect(s.connections_reused <= s.requests - server.connections.load(.monotonic));
+}
+
+// Test helpers for the guarded paths.
+fn cancelAfter(token: *deadline.CancelToken, ms: u64) void {
+    std.Thread.sleep(ms * std.time.ns_per_ms);
+    token.cancel();
+}
+
+// Request body of known length for `sendBody`.
+const TestBody = struct {
+    bytes: []const u8,
+
+    pub fn contentLength(self: TestBody) ?u64 {
+        return self.bytes.len;
+    }
+
+    pub fn writeTo(self: TestBody, writer: anytype) !void {
+        try writer.writeAll(self.bytes);
+    }
+};
+
+test "cancel during retry backoff fails the call once" {
+    const mock = @import("mock_server");
+    const allocator = std.testing.allocator;
+    // Every answer is a 429 asking for a 5 s pause.
+    const server = try mock.Server.start(allocator, .{ .port = 0, .ratelimit_rate = 1, .retry_after_ms = 5000 });
+    defer server.stop();
+
+    var base_buf: [64]u8 = undefined;
+    const base = try std.fmt.bufPrint(&base_buf, "http://127.0.0.1:{d}", .{server.port()});
+    var scheduler = try Scheduler.init(.{});
+    var client = Client.init(allocator, .{ .base_url = base, .scheduler = &scheduler });
+    defer client.deinit();
+    const chat_url = try client.url(allocator, "/v1/chat/completions");
+    defer allocator.free(chat_url);
+    const options = RequestOptions{ .method = .POST, .url = chat_url, .idempotent = true };
+
+    for (0..2) |round| {
+        var token: deadline.CancelToken = .{};
+        var guard: deadline.Guard = undefined;
+        try guard.start(deadline.Context.init(.{}, &token));
+        defer guard.finish();
+        const canceler = try std.Thread.spawn(.{}, cancelAfter, .{ &token, 100 });
+        defer canceler.join();
+
+        var timer = try std.time.Timer.start();
+        const result = if (round == 0)
+            client.send(options, "{}", 0, &guard)
+        else
+            client.sendBody(options, TestBody{ .bytes = "{}" }, 0, &guard);
+        try std.testing.expectError(error.Canceled, result);
+        try std.testing.expect(timer.read() < 2 * std.time.ns_per_s);
+        // Lift the pause the 429 set, so the next round sends at once.
+        scheduler.paused_until = 0;
+    }
+    try std.testing.expectEqual(@as(u64, 2), server.requests.load(.monotonic));
+    try std.testing.expectEqual(@as(u64, 2), scheduler.stats().throttled);
+}
+
+test "a first-byte timeout fails the call and closes the connection" {
+    const mock = @import("mock_server");
+    const allocator = std.testing.allocator;
+    const server = try mock.Server.start(allocator, .{ .port = 0, .latency = .{ .fixed = 400 } });
+    defer server.stop();
+
+    var base_buf: [64]u8 = undefined;
+    const base = try std.fmt.bufPrint(&base_buf, "http://127.0.0.1:{d}", .{server.port()});
+    var client = Client.init(allocator, .{ .base_url = base });
+    defer client.deinit();
+    const models_url = try client.url(allocator, "/v1/models");
+    defer allocator.free(models_url);
+
+    var guard: deadline.Guard = undefined;
+    try guard.start(deadline.Context.init(.{ .first_byte_ms = 50 }, null));
+    defer guard.finish();
+    var timer = try std.time.Timer.start();
+    try std.testing.expectError(error.DeadlineExceeded, client.send(.{ .method = .GET, .url = models_url }, null, 0, &guard));
+    try std.testing.expect(timer.read() < 300 * std.time.ns_per_ms);
+    try std.testing.expectEqual(@as(usize, 0), client.http.connection_pool.free_len);
+}
+
+test "cancel during a blocked body read closes the connection" {
+    const mock = @import("mock_server");
+    const allocator = std.testing.allocator;
+    // The stream sends its first delta, then stalls for a second.
+    const server = try mock.Server.start(allocator, .{ .port = 0, .sse_chunks = 4, .sse_interval_ms = 1000 });
+    defer server.stop();
+
+    var base_buf: [64]u8 = undefined;
+    const base = try std.fmt.bufPrint(&base_buf, "http://127.0.0.1:{d}", .{server.port()});
+    var client = Client.init(allocator, .{ .base_url = base });
+    defer client.deinit();
+    const chat_url = try client.url(allocator, "/v1/chat/completions");
+    defer allocator.free(chat_url);
+
+    var token: deadline.CancelToken = .{};
+    var guard: deadline.Guard = undefined;
+    try guard.start(deadline.Context.init(.{}, &token));
+    defer guard.finish();
+    var req = try client.send(.{ .method = .POST, .url = chat_url }, "{\"stream\":true}", 0, &guard);
+    try std.testing.expectEqual(std.http.Status.ok, req.response.status);
+
+    const canceler = try std.Thread.spawn(.{}, cancelAfter, .{ &token, 100 });
+    defer canceler.join();
+    var timer = try std.time.Timer.start();
+    var buf: [4096]u8 = undefined;
+    const err = while (true) {
+        const n = readGuarded(&req, &buf, &guard) catch |e| break e;
+        if (n == 0) break error.EndOfStream;
+    };
+    release(&req, &guard);
+    try std.testing.expectEqual(@as(anyerror, error.Canceled), err);
+    try std.testing.expect(timer.read() < 800 * std.time.ns_per_ms);
+    try std.testing.expectEqual(@as(usize, 0), client.http.connection_pool.free_len);
+}
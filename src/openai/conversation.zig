@@ -0,0 +1,296 @@
+const std = @import("std");
+const Tokenizer = @import("tokenizer.zig").Tokenizer;
+const chatgpt = @import("chatgpt.zig");
+const client_mod = @import("client.zig");
+const Client = client_mod.Client;
+const decode = @import("decode.zig");
+const schema = @import("schema.zig");
+const trace = @import("trace");
+
+// Multi-turn chat history that fits a token budget.
+// - Each message is tokenized once, when it is appended; budgeting a
+//   request afterwards is a sum over cached counts.
+// - `window` picks the system messages plus the newest turns that fit the
+//   budget, `trim` drops the rest for good, and `compact` first asks the
+//   model to summarize the turns that would be dropped.
+// - Counts follow OpenAI's chat format accounting: every message costs
+//   its content plus `message_overhead`, and the reply primer adds
+//   `reply_overhead` per request.
+// Not thread-safe.
+pub const Role = enum {
+    system,
+    user,
+    assistant,
+
+    pub fn name(self: Role) []const u8 {
+        return @tagName(self);
+    }
+};
+
+// Framing tokens per message (<|start|>, role, <|message|>, <|end|>).
+pub const message_overhead = 4;
+// Every reply is primed with <|start|>assistant<|message|>.
+pub const reply_overhead = 3;
+
+pub const Message = struct {
+    role: Role,
+    content: []const u8,
+    // Content tokens plus `message_overhead`.
+    tokens: usize,
+};
+
+// Messages chosen for one request. `messages` belongs to the caller
+// (free with the allocator passed to `window`); the contents still belong
+// to the conversation.
+pub const Window = struct {
+    messages: []Message,
+    // Prompt tokens including `reply_overhead`.
+    tokens: usize,
+    // Non-system messages left out.
+    dropped: usize,
+};
+
+pub const Conversation = struct {
+    allocator: std.mem.Allocator,
+    tokenizer: *const Tokenizer,
+    messages: std.ArrayListUnmanaged(Message) = .{},
+    // Sum of `Message.tokens`.
+    total: usize = 0,
+
+    pub fn init(allocator: std.mem.Allocator, tokenizer: *const Tokenizer) Conversation {
+        return .{ .allocator = allocator, .tokenizer = tokenizer };
+    }
+
+    pub fn deinit(self: *Conversation) void {
+        for (self.messages.items) |m| self.allocator.free(m.content);
+        self.messages.deinit(self.allocator);
+    }
+
+    // Appends a copy of `content`.
+    pub fn append(self: *Conversation, role: Role, content: []const u8) !void {
+        const owned = try self.allocator.dupe(u8, content);
+        errdefer self.allocator.free(owned);
+        const tokens = self.tokenizer.count(content) + message_overhead;
+        try self.messages.append(self.allocator, .{ .role = role, .content = owned, .tokens = tokens });
+        self.total += tokens;
+    }
+
+    // Prompt tokens of the whole history, reply primer included.
+    pub fn tokenCount(self: *const Conversation) usize {
+        return self.total + reply_overhead;
+    }
+
+    // System messages plus the newest run of other messages whose total
+    // stays within `budget`. A window never starts with an assistant turn
+    // whose question was cut off. error.ContextTooLarge when not even the
+    // system messages and the last message fit.
+    pub fn window(self: *const Conversation, allocator: std.mem.Allocator, budget: usize) !Window {
+        const items = self.messages.items;
+        const first = try self.firstKept(budget);
+        var out = try allocator.alloc(Message, self.keptCount(first));
+        var n: usize = 0;
+        var tokens: usize = reply_overhead;
+        for (items, 0..) |m, i| {
+            if (m.role != .system and i < first) continue;
+            out[n] = m;
+            n += 1;
+            tokens += m.tokens;
+        }
+        return .{ .messages = out, .tokens = tokens, .dropped = first - self.systemBefore(first) };
+    }
+
+    // Drops the non-system messages `window(budget)` would leave out.
+    // Returns how many were dropped.
+    pub fn trim(self: *Conversation, budget: usize) !usize {
+        const first = try self.firstKept(budget);
+        return self.dropBefore(first);
+    }
+
+    // Like `trim`, but the dropped turns are first condensed into a system
+    // message ("Summary of the earlier conversation: ...") by `model`, so
+    // long sessions keep their context. Falls back to plain trimming when
+    // the summary itself would not fit.
+    pub fn compact(self: *Conversation, client: *Client, api_key: []const u8, model: []const u8, budget: usize) !usize {
+        const first = try self.firstKept(budget);
+        if (first == self.systemBefore(first)) return 0;
+        const span = trace.begin("conversation/compact");
+        defer span.end();
+
+        var transcript: std.ArrayListUnmanaged(u8) = .{};
+        defer transcript.deinit(self.allocator);
+        try transcript.appendSlice(self.allocator, "Summarize the conversation below in a few sentences. Keep names, decisions and open questions.\n\n");
+        for (self.messages.items[0..first]) |m| {
+            if (m.role == .system) continue;
+            try transcript.writer(self.allocator).print("{s}: {s}\n", .{ m.role.name(), m.content });
+        }
+
+        const body = try chatgpt.chatCompletion(self.allocator, client, api_key, model, transcript.items);
+        defer self.allocator.free(body);
+        var arena = std.heap.ArenaAllocator.init(self.allocator);
+        defer arena.deinit();
+        const completion = try decode.decodeLeaky(schema.ChatCompletion, arena.allocator(), body);
+        if (completion.choices.len == 0) return error.UnexpectedResponse;
+        const summary_text = completion.choices[0].message.content orelse return error.UnexpectedResponse;
+
+        const summary = try std.fmt.allocPrint(self.allocator, "Summary of the earlier conversation: {s}", .{summary_text});
+        errdefer self.allocator.free(summary);
+        const summary_tokens = self.tokenizer.count(summary) + message_overhead;
+
+        const dropped = self.dropBefore(first);
+        // The summary goes after the leading system messages.
+        var at: usize = 0;
+        while (at < self.messages.items.len and self.messages.items[at].role == .system) at += 1;
+        try self.messages.insert(self.allocator, at, .{ .role = .system, .content = summary, .tokens = summary_tokens });
+        self.total += summary_tokens;
+        if (self.tokenCount() > budget) {
+            _ = self.messages.orderedRemove(at);
+            self.total -= summary_tokens;
+            self.allocator.free(summary);
+        }
+        return dropped;
+    }
+
+    // Index of the oldest non-system message in the window.
+    fn firstKept(self: *const Conversation, budget: usize) !usize {
+        const items = self.messages.items;
+        var used: usize = reply_overhead;
+        for (items) |m| {
+            if (m.role == .system) used += m.tokens;
+        }
+        var first = items.len;
+        while (first > 0) {
+            const m = items[first - 1];
+            if (m.role != .system) {
+                if (used + m.tokens > budget) break;
+                used += m.tokens;
+            }
+            first -= 1;
+        }
+        // Nothing but system messages left out: the last message must fit.
+        if (first == items.len and items.len > 0 and items[items.len - 1].role != .system) return error.ContextTooLarge;
+        if (used > budget) return error.ContextTooLarge;
+        // Skip an answer whose question fell out of the window.
+        while (first < items.len and items[first].role == .assistant) first += 1;
+        return first;
+    }
+
+    fn keptCount(self: *const Conversation, first: usize) usize {
+        return self.systemBefore(first) + (self.messages.items.len - first);
+    }
+
+    fn systemBefore(self: *const Conversation, end: usize) usize {
+        var n: usize = 0;
+        for (self.messages.items[0..end]) |m| {
+            if (m.role == .system) n += 1;
+        }
+        return n;
+    }
+
+    fn dropBefore(self: *Conversation, first: usize) usize {
+        const items = self.messages.items;
+        var w: usize = 0;
+        for (items, 0..) |m, i| {
+            if (m.role != .system and i < first) {
+                self.total -= m.tokens;
+                self.allocator.free(m.content);
+                continue;
+            }
+            items[w] = m;
+            w += 1;
+        }
+        const dropped = items.len - w;
+        self.messages.shrinkRetainingCapacity(w);
+        return dropped;
+    }
+};
+
+// Byte-level tokenizer (no merges): a message costs its length plus
+// `message_overhead`, which keeps the budgets below easy to follow.
+fn byteTokenizer() !Tokenizer {
+    const data = try @import("tokenizer.zig").test_support.ranksFile(std.testing.allocator, &.{});
+    defer std.testing.allocator.free(data);
+    return Tokenizer.parse(std.testing.allocator, .cl100k_base, data);
+}
+
+fn expectContents(w: Window, want: []const []const u8) !void {
+    try std.testing.expectEqual(want.len, w.messages.len);
+    for (want, w.messages) |content, m| try std.testing.expectEqualStrings(content, m.content);
+}
+
+// sys (10 tokens), then u1 a1 u2 a2 (6 each): 34 tokens, 37 with the
+// reply primer.
+fn testConversation(tok: *const Tokenizer) !Conversation {
+    var conv = Conversation.init(std.testing.allocator, tok);
+    errdefer conv.deinit();
+    try conv.append(.system, "system");
+    try conv.append(.user, "u1");
+    try conv.append(.assistant, "a1");
+    try conv.append(.user, "u2");
+    try conv.append(.assistant, "a2");
+    return conv;
+}
+
+test "window keeps system messages and the newest turns" {
+    const allocator = std.testing.allocator;
+    var tok = try byteTokenizer();
+    defer tok.deinit();
+    var conv = try testConversation(&tok);
+    defer conv.deinit();
+    try std.testing.expectEqual(@as(usize, 37), conv.tokenCount());
+
+    const all = try conv.window(allocator, 37);
+    defer allocator.free(all.messages);
+    try expectContents(all, &.{ "system", "u1", "a1", "u2", "a2" });
+    try std.testing.expectEqual(@as(usize, 0), all.dropped);
+
+    const recent = try conv.window(allocator, 25);
+    defer allocator.free(recent.messages);
+    try expectContents(recent, &.{ "system", "u2", "a2" });
+    try std.testing.expectEqual(@as(usize, 25), recent.tokens);
+    try std.testing.expectEqual(@as(usize, 2), recent.dropped);
+
+    // 31 would fit a1 too, but its question u1 does not: a1 is skipped.
+    const orphan = try conv.window(allocator, 31);
+    defer allocator.free(orphan.messages);
+    try expectContents(orphan, &.{ "system", "u2", "a2" });
+    try std.testing.expectEqual(@as(usize, 2), orphan.dropped);
+
+    // System messages plus the last message need 19.
+    try std.testing.expectError(error.ContextTooLarge, conv.window(allocator, 18));
+    try std.testing.expectError(error.ContextTooLarge, conv.trim(12));
+}
+
+test "a system message between turns is kept" {
+    const allocator = std.testing.allocator;
+    var tok = try byteTokenizer();
+    defer tok.deinit();
+    var conv = Conversation.init(allocator, &tok);
+    defer conv.deinit();
+    try conv.append(.system, "system");
+    try conv.append(.user, "u1");
+    try conv.append(.assistant, "a1");
+    try conv.append(.system, "N");
+    try conv.append(.user, "u2");
+    try conv.append(.assistant, "a2");
+
+    // 3 + 10 + 5 for the system messages, 12 for u2 a2.
+    const w = try conv.window(allocator, 30);
+    defer allocator.free(w.messages);
+    try expectContents(w, &.{ "system", "N", "u2", "a2" });
+    try std.testing.expectEqual(@as(usize, 30), w.tokens);
+    try std.testing.expectEqual(@as(usize, 2), w.dropped);
+}
+
+test "trim drops what the window leaves out" {
+    var tok = try byteTokenizer();
+    defer tok.deinit();
+    var conv = try testConversation(&tok);
+    defer conv.deinit();
+
+    try std.testing.expectEqual(@as(usize, 2), try conv.trim(31));
+    try std.testing.expectEqual(@as(usize, 3), conv.messages.items.len);
+    try std.testing.expectEqual(Role.system, conv.messages.items[0].role);
+    try std.testing.expectEqual(@as(usize, 25), conv.tokenCount());
+    // Already within budget: nothing more to drop.
+    try std.testing.expectEqual(@as(usize, 0), try conv.trim(31));
+}
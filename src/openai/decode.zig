@@ -0,0 +1,432 @@
+const std = @import("std");
+
+// Single-pass JSON decoder specialized at comptime for the target type.
+// - Walks the input once; fields not present in `T` are skipped without
+//   building any intermediate values.
+// - Strings are returned as slices into `body`. Strings with escapes are
+//   unescaped in place (the decoded form is never longer than the escaped
+//   one), so `body` must be mutable and outlive the result.
+// - Only slices of non-string types allocate (one array per JSON array).
+//
+// Supported field types: structs, optionals, bool, ints, floats, enums
+// (from strings), `[]const u8`, slices and single pointers of the above.
+// Missing fields take their default value, `null` for optionals, or fail
+// with `error.MissingField`.
+
+pub const Error = error{
+    SyntaxError,
+    UnexpectedEnd,
+    UnexpectedToken,
+    InvalidNumber,
+    InvalidEnumTag,
+    MissingField,
+    OutOfMemory,
+};
+
+// Owns the arrays allocated while decoding; strings still point into body.
+pub fn Parsed(comptime T: type) type {
+    return struct {
+        arena: *std.heap.ArenaAllocator,
+        value: T,
+
+        pub fn deinit(self: @This()) void {
+            const child = self.arena.child_allocator;
+            self.arena.deinit();
+            child.destroy(self.arena);
+        }
+    };
+}
+
+pub fn decode(comptime T: type, allocator: std.mem.Allocator, body: []u8) Error!Parsed(T) {
+    const arena = try allocator.create(std.heap.ArenaAllocator);
+    errdefer allocator.destroy(arena);
+    arena.* = std.heap.ArenaAllocator.init(allocator);
+    errdefer arena.deinit();
+    return .{ .arena = arena, .value = try decodeLeaky(T, arena.allocator(), body) };
+}
+
+// Like `decode`, but arrays come from `allocator` directly and are not
+// tracked; use with an arena or free the slices yourself.
+pub fn decodeLeaky(comptime T: type, allocator: std.mem.Allocator, body: []u8) Error!T {
+    var s = Scanner{ .buf = body };
+    const value = try decodeValue(T, &s, allocator);
+    s.skipWs();
+    if (s.i != s.buf.len) return error.UnexpectedToken;
+    return value;
+}
+
+fn decodeValue(comptime T: type, s: *Scanner, allocator: std.mem.Allocator) Error!T {
+    switch (@typeInfo(T)) {
+        .bool => {
+            if (s.consumeLiteral("true")) return true;
+            if (s.consumeLiteral("false")) return false;
+            return error.UnexpectedToken;
+        },
+        .int => {
+            const num = try s.number();
+            return std.fmt.parseInt(T, num, 10) catch error.InvalidNumber;
+        },
+        .float => {
+            const num = try s.number();
+            return std.fmt.parseFloat(T, num) catch error.InvalidNumber;
+        },
+        .optional => |info| {
+            if (s.consumeLiteral("null")) return null;
+            return try decodeValue(info.child, s, allocator);
+        },
+        .@"enum" => {
+            const tag = try s.string();
+            return std.meta.stringToEnum(T, tag) orelse error.InvalidEnumTag;
+        },
+        .pointer => |info| switch (info.size) {
+            .slice => {
+                if (info.child == u8) return try s.string();
+                return try decodeArray(info.child, s, allocator);
+            },
+            .one => {
+                const p = try allocator.create(info.child);
+                p.* = try decodeValue(info.child, s, allocator);
+                return p;
+            },
+            else => @compileError("unsupported pointer type " ++ @typeName(T)),
+        },
+        .@"struct" => return try decodeStruct(T, s, allocator),
+        else => @compileError("unsupported type " ++ @typeName(T)),
+    }
+}
+
+fn decodeArray(comptime E: type, s: *Scanner, allocator: std.mem.Allocator) Error![]E {
+    try s.expect('[');
+    var list: std.ArrayListUnmanaged(E) = .{};
+    errdefer list.deinit(allocator);
+    if (try s.peek() == ']') {
+        s.i += 1;
+        return list.toOwnedSlice(allocator);
+    }
+    while (true) {
+        try list.append(allocator, try decodeValue(E, s, allocator));
+        switch (try s.next()) {
+            ',' => continue,
+            ']' => break,
+            else => return error.SyntaxError,
+        }
+    }
+    return list.toOwnedSlice(allocator);
+}
+
+fn decodeStruct(comptime T: type, s: *Scanner, allocator: std.mem.Allocator) Error!T {
+    const fields = @typeInfo(T).@"struct".fields;
+    var result: T = undefined;
+    var seen = [_]bool{false} ** fields.len;
+
+    try s.expect('{');
+    if (try s.peek() == '}') {
+        s.i += 1;
+    } else while (true) {
+        if (try s.peek() != '"') return error.SyntaxError;
+        const key = try s.string();
+        try s.expect(':');
+        matched: {
+            inline for (fields, 0..) |f, idx| {
+                if (std.mem.eql(u8, key, f.name)) {
+                    @field(result, f.name) = try decodeValue(f.type, s, allocator);
+                    seen[idx] = true;
+                    break :matched;
+                }
+            }
+            try s.skipValue();
+        }
+        switch (try s.next()) {
+            ',' => continue,
+            '}' => break,
+            else => return error.SyntaxError,
+        }
+    }
+
+    inline for (fields, 0..) |f, idx| {
+        if (!seen[idx]) {
+            if (f.defaultValue()) |d| {
+                @field(result, f.name) = d;
+            } else if (@typeInfo(f.type) == .optional) {
+                @field(result, f.name) = null;
+            } else {
+                return error.MissingField;
+            }
+        }
+    }
+    return result;
+}
+
+const Scanner = struct {
+    buf: []u8,
+    i: usize = 0,
+
+    fn skipWs(s: *Scanner) void {
+        while (s.i < s.buf.len) : (s.i += 1) {
+            switch (s.buf[s.i]) {
+                ' ', '\t', '\r', '\n' => {},
+                else => return,
+            }
+        }
+    }
+
+    fn peek(s: *Scanner) Error!u8 {
+        s.skipWs();
+        if (s.i >= s.buf.len) return error.UnexpectedEnd;
+        return s.buf[s.i];
+    }
+
+    fn next(s: *Scanner) Error!u8 {
+        const ch = try s.peek();
+        s.i += 1;
+        return ch;
+    }
+
+    fn expect(s: *Scanner, ch: u8) Error!void {
+        if (try s.next() != ch) return error.UnexpectedToken;
+    }
+
+    fn consumeLiteral(s: *Scanner, comptime lit: []const u8) bool {
+        s.skipWs();
+        if (!std.mem.startsWith(u8, s.buf[s.i..], lit)) return false;
+        s.i += lit.len;
+        return true;
+    }
+
+    fn number(s: *Scanner) Error![]const u8 {
+        s.skipWs();
+        const start = s.i;
+        while (s.i < s.buf.len) : (s.i += 1) {
+            switch (s.buf[s.i]) {
+                '0'...'9', '-', '+', '.', 'e', 'E' => {},
+                else => break,
+            }
+        }
+        if (s.i == start) return error.InvalidNumber;
+        return s.buf[start..s.i];
+    }
+
+    // Returns the string contents, unescaping in place when needed.
+    fn string(s: *Scanner) Error![]u8 {
+        try s.expect('"');
+        const start = s.i;
+        // Fast path: no escapes
+        while (s.i < s.buf.len) : (s.i += 1) {
+            switch (s.buf[s.i]) {
+                '"' => {
+                    const out = s.buf[start..s.i];
+                    s.i += 1;
+                    return out;
+                },
+                '\\' => break,
+                else => {},
+            }
+        }
+        // Slow path: compact the decoded bytes towards `start`
+        var w = s.i;
+        while (s.i < s.buf.len) {
+            const ch = s.buf[s.i];
+            if (ch == '"') {
+                s.i += 1;
+                return s.buf[start..w];
+            }
+            if (ch != '\\') {
+                s.buf[w] = ch;
+                w += 1;
+                s.i += 1;
+                continue;
+            }
+            if (s.i + 1 >= s.buf.len) return error.UnexpectedEnd;
+            const esc = s.buf[s.i + 1];
+            s.i += 2;
+            const decoded: u8 = switch (esc) {
+                '"' => '"',
+                '\\' => '\\',
+                '/' => '/',
+                'b' => 0x08,
+                'f' => 0x0c,
+                'n' => '\n',
+                'r' => '\r',
+                't' => '\t',
+                'u' => {
+                    var cp: u21 = try s.hex4();
+                    if (cp >= 0xD800 and cp <= 0xDBFF) {
+                        // High surrogate must be followed by \uDC00-\uDFFF
+                        if (s.i + 1 >= s.buf.len or s.buf[s.i] != '\\' or s.buf[s.i + 1] != 'u') return error.SyntaxError;
+                        s.i += 2;
+                        const lo = try s.hex4();
+                        if (lo < 0xDC00 or lo > 0xDFFF) return error.SyntaxError;
+                        cp = 0x10000 + ((cp - 0xD800) << 10) + (lo - 0xDC00);
+                    } else if (cp >= 0xDC00 and cp <= 0xDFFF) {
+                        return error.SyntaxError;
+                    }
+                    w += std.unicode.utf8Encode(cp, s.buf[w..][0..4]) catch return error.SyntaxError;
+                    continue;
+                },
+                else => return error.SyntaxError,
+            };
+            s.buf[w] = decoded;
+            w += 1;
+        }
+        return error.UnexpectedEnd;
+    }
+
+    fn hex4(s: *Scanner) Error!u21 {
+        if (s.i + 4 > s.buf.len) return error.UnexpectedEnd;
+        const v = std.fmt.parseInt(u16, s.buf[s.i..][0..4], 16) catch return error.SyntaxError;
+        s.i += 4;
+        return v;
+    }
+
+    fn skipString(s: *Scanner) Error!void {
+        // Opening quote already consumed
+        while (s.i < s.buf.len) : (s.i += 1) {
+            switch (s.buf[s.i]) {
+                '"' => {
+                    s.i += 1;
+                    return;
+                },
+                '\\' => s.i += 1,
+                else => {},
+            }
+        }
+        return error.UnexpectedEnd;
+    }
+
+    // Skips one value of any kind without materializing it.
+    fn skipValue(s: *Scanner) Error!void {
+        var depth: usize = 0;
+        while (true) {
+            const ch = try s.next();
+            switch (ch) {
+                '"' => try s.skipString(),
+                '{', '[' => depth += 1,
+                '}', ']' => {
+                    if (depth == 0) return error.SyntaxError;
+                    depth -= 1;
+                },
+                ',', ':' => if (depth == 0) return error.SyntaxError,
+                else => {
+                    // number / true / false / null: run to the next delimiter
+                    while (s.i < s.buf.len) : (s.i += 1) {
+                        switch (s.buf[s.i]) {
+                            ',', '}', ']', ' ', '\t', '\r', '\n' => break,
+                            else => {},
+                        }
+                    }
+                },
+            }
+            if (depth == 0) return;
+        }
+    }
+};
+
+const schema = @import("schema.zig");
+
+// Decodes `fixture` with this decoder and with std.json (unknown fields
+// ignored) and expects the same value.
+fn expectMatchesStdJson(comptime T: type, fixture: []const u8) !void {
+    const allocator = std.testing.allocator;
+    const body = try allocator.dupe(u8, fixture);
+    defer allocator.free(body);
+    const ours = try decode(T, allocator, body);
+    defer ours.deinit();
+    const theirs = try std.json.parseFromSlice(T, allocator, fixture, .{ .ignore_unknown_fields = true });
+    defer theirs.deinit();
+    try std.testing.expectEqualDeep(theirs.value, ours.value);
+}
+
+test "model list fixture matches std.json" {
+    try expectMatchesStdJson(schema.ModelList, @embedFile("testdata/models_escaped.json"));
+
+    const body = try std.testing.allocator.dupe(u8, @embedFile("testdata/models_escaped.json"));
+    defer std.testing.allocator.free(body);
+    const list = try decode(schema.ModelList, std.testing.allocator, body);
+    defer list.deinit();
+    const data = list.value.data;
+    try std.testing.expectEqual(@as(usize, 4), data.len);
+    try std.testing.expectEqualStrings("ft:gpt-4o-mini:acme/team:caf\u{e9}:abc", data[1].id);
+    try std.testing.expectEqual(@as(i64, -1), data[1].created);
+    try std.testing.expectEqualStrings("user-\"quoted\" \\ back", data[1].owned_by);
+    // Surrogate pair and BMP escapes, unescaped in place.
+    try std.testing.expectEqualStrings("emoji-\u{1F600}-\u{65e5}\u{672c}", data[2].id);
+    try std.testing.expectEqualStrings("tab\there\nnewline\r\x08\x0c", data[2].owned_by);
+    // Missing fields with defaults.
+    try std.testing.expectEqualStrings("plain", data[3].id);
+    try std.testing.expectEqual(@as(i64, 0), data[3].created);
+    try std.testing.expectEqualStrings("", data[3].owned_by);
+}
+
+test "chat completion fixture matches std.json" {
+    try expectMatchesStdJson(schema.ChatCompletion, @embedFile("testdata/chat_completion.json"));
+
+    const body = try std.testing.allocator.dupe(u8, @embedFile("testdata/chat_completion.json"));
+    defer std.testing.allocator.free(body);
+    const completion = try decode(schema.ChatCompletion, std.testing.allocator, body);
+    defer completion.deinit();
+    const c = completion.value;
+    try std.testing.expectEqualStrings("chatcmpl-ABC", c.id);
+    try std.testing.expectEqualStrings("Line 1\nLine \"2\" \u{2014} caf\u{e9} \u{1F389} \\o/", c.choices[0].message.content.?);
+    try std.testing.expect(c.choices[1].message.content == null);
+    try std.testing.expectEqualStrings("tool_calls", c.choices[1].finish_reason.?);
+    try std.testing.expectEqual(@as(u64, 46), c.usage.?.total_tokens);
+}
+
+fn expectDecodeError(comptime T: type, expected: Error, json: []const u8) !void {
+    var arena = std.heap.ArenaAllocator.init(std.testing.allocator);
+    defer arena.deinit();
+    const body = try arena.allocator().dupe(u8, json);
+    try std.testing.expectError(expected, decodeLeaky(T, arena.allocator(), body));
+}
+
+test "missing required fields, trailing garbage and bad escapes fail" {
+    try expectDecodeError(schema.ModelList, error.MissingField, "{}");
+    try expectDecodeError(schema.ModelList, error.MissingField, "{\"data\":[{\"created\":1}]}");
+    try expectDecodeError(schema.ModelList, error.UnexpectedToken, "{\"data\":[]} x");
+    try expectDecodeError(schema.ModelList, error.UnexpectedToken, "{\"data\":[]}{}");
+    try expectDecodeError(schema.ModelList, error.UnexpectedEnd, "{\"data\":[{\"id\":\"a\"}");
+    try expectDecodeError(schema.ModelList, error.SyntaxError, "{\"data\":[{\"id\":\"a\"} {\"id\":\"b\"}]}");
+    // Lone low surrogate, high surrogate without its pair, unknown escape.
+    try expectDecodeError(schema.Model, error.SyntaxError, "{\"id\":\"\\udc00\"}");
+    try expectDecodeError(schema.Model, error.SyntaxError, "{\"id\":\"\\ud83d x\"}");
+    try expectDecodeError(schema.Model, error.SyntaxError, "{\"id\":\"\\q\"}");
+    try expectDecodeError(schema.Model, error.UnexpectedEnd, "{\"id\":\"abc\\");
+    try expectDecodeError(schema.Model, error.InvalidNumber, "{\"id\":\"a\",\"created\":1.5}");
+    // An unbalanced unknown value.
+    try expectDecodeError(schema.Model, error.SyntaxError, "{\"id\":\"a\",\"x\":]}");
+
+    // Trailing whitespace is fine.
+    var arena = std.heap.ArenaAllocator.init(std.testing.allocator);
+    defer arena.deinit();
+    const body = try arena.allocator().dupe(u8, "{\"data\":[]} \r\n\t");
+    const list = try decodeLeaky(schema.ModelList, arena.allocator(), body);
+    try std.testing.expectEqual(@as(usize, 0), list.data.len);
+}
+
+test "enum, pointer and nested slice fields" {
+    const Shape = struct {
+        kind: enum { circle, square },
+        size: *const struct { w: u32, h: u32 = 1 },
+        tags: []const []const u8 = &.{},
+        ratio: f64 = 1,
+        flag: bool = false,
+        note: ?[]const u8,
+    };
+    const allocator = std.testing.allocator;
+    const body = try allocator.dupe(u8, "{\"kind\":\"square\",\"size\":{\"w\":3},\"tags\":[\"a\",\"b\\n\"],\"ratio\":-0.25e1,\"flag\":true}");
+    defer allocator.free(body);
+    const parsed = try decode(Shape, allocator, body);
+    defer parsed.deinit();
+    const v = parsed.value;
+    try std.testing.expectEqual(.square, v.kind);
+    try std.testing.expectEqual(@as(u32, 3), v.size.w);
+    try std.testing.expectEqual(@as(u32, 1), v.size.h);
+    try std.testing.expectEqual(@as(usize, 2), v.tags.len);
+    try std.testing.expectEqualStrings("b\n", v.tags[1]);
+    try std.testing.expectEqual(@as(f64, -2.5), v.ratio);
+    try std.testing.expect(v.flag);
+    try std.testing.expect(v.note == null);
+
+    try expectDecodeError(Shape, error.InvalidEnumTag, "{\"kind\":\"hexagon\",\"size\":{\"w\":1}}");
+    try expectDecodeError(Shape, error.MissingField, "{\"kind\":\"circle\"}");
+}
@@ -0,0 +1,207 @@
+const std = @import("std");
+const client_mod = @import("client.zig");
+const Client = client_mod.Client;
+const decode = @import("decode.zig");
+const schema = @import("schema.zig");
+const ratelimit = @import("ratelimit.zig");
+const kernels = @import("text_kernels");
+const deadline = @import("deadline");
+const trace = @import("trace");
+
+pub const default_model = "text-embedding-3-small";
+
+pub const Options = struct {
+    model: []const u8 = default_model,
+    // Estimated tokens per request (`ratelimit.estimateTokens`); the API
+    // rejects requests above 300k, this leaves headroom for the estimate.
+    max_batch_tokens: u64 = 100_000,
+    // Inputs per request (API limit: 2048).
+    max_batch_inputs: usize = 2048,
+    // Bounds every batch request; the total budget covers the whole call.
+    context: deadline.Context = .{},
+};
+
+// Inputs [start, end) sent in one request.
+pub const Batch = struct {
+    start: usize,
+    end: usize,
+};
+
+// Splits `inputs` into consecutive batches that stay under both limits. An
+// input that alone exceeds the token budget gets a batch of its own (the
+// server decides whether it fits the model). Caller frees.
+pub fn planBatches(allocator: std.mem.Allocator, inputs: []const []const u8, options: Options) ![]Batch {
+    var batches: std.ArrayListUnmanaged(Batch) = .{};
+    errdefer batches.deinit(allocator);
+    var start: usize = 0;
+    var tokens: u64 = 0;
+    for (inputs, 0..) |input, i| {
+        const t = ratelimit.estimateTokens(input);
+        const full = i - start >= options.max_batch_inputs or tokens + t > options.max_batch_tokens;
+        if (i > start and full) {
+            try batches.append(allocator, .{ .start = start, .end = i });
+            start = i;
+            tokens = 0;
+        }
+        tokens += t;
+    }
+    if (start < inputs.len) try batches.append(allocator, .{ .start = start, .end = inputs.len });
+    return batches.toOwnedSlice(allocator);
+}
+
+// Embeddings of a list of inputs, row-major: input i is
+// `vectors[i * dims ..][0..dims]`.
+pub const Embeddings = struct {
+    vectors: []f32,
+    dims: usize,
+
+    pub fn row(self: Embeddings, i: usize) []f32 {
+        return self.vectors[i * self.dims ..][0..self.dims];
+    }
+
+    pub fn deinit(self: *Embeddings, allocator: std.mem.Allocator) void {
+        allocator.free(self.vectors);
+    }
+};
+
+// Embeds every input, as few requests as the batch limits allow. Batches
+// go out one after another over the client's pooled connection and pass
+// through its rate-limit scheduler. Caller owns the result.
+pub fn embed(allocator: std.mem.Allocator, client: *Client, api_key: []const u8, inputs: []const []const u8, options: Options) !Embeddings {
+    const span = trace.begin("openai/embed");
+    defer span.end();
+    const batches = try planBatches(allocator, inputs, options);
+    defer allocator.free(batches);
+
+    var out = Embeddings{ .vectors = &.{}, .dims = 0 };
+    errdefer out.deinit(allocator);
+    for (batches) |b| {
+        var result = try embedBatch(allocator, client, api_key, inputs[b.start..b.end], options.model, options.context);
+        defer result.deinit();
+        const data = result.value.data;
+        if (data.len != b.end - b.start) return error.UnexpectedResponse;
+        if (out.dims == 0) {
+            if (data.len == 0 or data[0].embedding.len == 0) return error.UnexpectedResponse;
+            out.dims = data[0].embedding.len;
+            out.vectors = try allocator.alloc(f32, inputs.len * out.dims);
+        }
+        // Rows may arrive in any order; `index` is relative to the batch.
+        for (data) |d| {
+            if (d.index >= data.len or d.embedding.len != out.dims) return error.UnexpectedResponse;
+            @memcpy(out.row(b.start + d.index), d.embedding);
+        }
+    }
+    return out;
+}
+
+fn embedBatch(allocator: std.mem.Allocator, client: *Client, api_key: []const u8, inputs: []const []const u8, model: []const u8, ctx: deadline.Context) !decode.Parsed(schema.EmbeddingList) {
+    const auth_header = try std.fmt.allocPrint(allocator, "Bearer {s}", .{api_key});
+    defer allocator.free(auth_header);
+
+    const url = try client.url(allocator, "/v1/embeddings");
+    defer allocator.free(url);
+
+    const body = try buildEmbeddingsBody(allocator, model, inputs);
+    defer allocator.free(body);
+
+    var tokens: u64 = 0;
+    for (inputs) |s| tokens += ratelimit.estimateTokens(s);
+
+    var guard: deadline.Guard = undefined;
+    try guard.start(ctx);
+    defer guard.finish();
+    var req = try client.send(.{
+        .method = .POST,
+        .url = url,
+        .headers = &.{
+            .{ .name = "Content-Type", .value = "application/json" },
+            .{ .name = "Authorization", .value = auth_header },
+        },
+        // Embedding the same inputs twice has no side effect.
+        .idempotent = true,
+    }, body, tokens, &guard);
+    defer client_mod.release(&req, &guard);
+    if (req.response.status == .too_many_requests) return error.RateLimited;
+    if (req.response.status != .ok) return error.UnexpectedStatus;
+
+    const resp_body = try client_mod.readBody(allocator, &req, &guard);
+    defer allocator.free(resp_body);
+    // The decoded value holds no slices into the body (only floats).
+    return decode.decode(schema.EmbeddingList, allocator, resp_body);
+}
+
+// Builds {"model":"...","encoding_format":"float","input":["...",...]}
+// in one allocation of the exact size.
+pub fn buildEmbeddingsBody(allocator: std.mem.Allocator, model: []const u8, inputs: []const []const u8) ![]u8 {
+    const head = "{\"model\":\"";
+    const mid = "\",\"encoding_format\":\"float\",\"input\":[";
+    const tail = "]}";
+
+    var len: usize = head.len + model.len + mid.len + tail.len;
+    for (inputs, 0..) |s, i| len += kernels.jsonEscapedLen(s) + 2 + @intFromBool(i > 0);
+    const out = try allocator.alloc(u8, len);
+    var w: usize = 0;
+    for ([_][]const u8{ head, model, mid }) |part| {
+        @memcpy(out[w..][0..part.len], part);
+        w += part.len;
+    }
+    for (inputs, 0..) |s, i| {
+        if (i > 0) {
+            out[w] = ',';
+            w += 1;
+        }
+        const n = kernels.jsonEscapedLen(s) + 2;
+        kernels.jsonEscapeInto(out[w..][0..n], s);
+        w += n;
+    }
+    @memcpy(out[w..], tail);
+    return out;
+}
+
+test "batches split on the input and token limits" {
+    const allocator = std.testing.allocator;
+    // estimateTokens: len / 4 + 1, so "abcd" is 2 tokens.
+    const inputs = [_][]const u8{ "abcd", "abcd", "abcd", "x" ** 40, "abcd", "abcd", "abcd" };
+    const batches = try planBatches(allocator, &inputs, .{ .max_batch_inputs = 2, .max_batch_tokens = 6 });
+    defer allocator.free(batches);
+    // The 11-token input is over the budget alone and gets its own batch.
+    const want = [_]Batch{ .{ .start = 0, .end = 2 }, .{ .start = 2, .end = 3 }, .{ .start = 3, .end = 4 }, .{ .start = 4, .end = 6 }, .{ .start = 6, .end = 7 } };
+    try std.testing.expectEqual(want.len, batches.len);
+    for (want, batches) |w, b| try std.testing.expectEqual(w, b);
+
+    const none = try planBatches(allocator, &.{}, .{});
+    defer allocator.free(none);
+    try std.testing.expectEqual(@as(usize, 0), none.len);
+}
+
+test "embed fills every row across batches from the mock server" {
+    const mock = @import("mock_server");
+    const allocator = std.testing.allocator;
+    const server = try mock.Server.start(allocator, .{ .port = 0, .dims = 16 });
+    defer server.stop();
+    var base_buf: [64]u8 = undefined;
+    const base = try std.fmt.bufPrint(&base_buf, "http://127.0.0.1:{d}", .{server.port()});
+    var client = Client.init(allocator, .{ .base_url = base });
+    defer client.deinit();
+
+    var inputs: [20][]const u8 = undefined;
+    var names: [20][16]u8 = undefined;
+    for (&inputs, &names, 0..) |*input, *name, i| input.* = try std.fmt.bufPrint(name, "input {d}", .{i});
+    var result = try embed(allocator, &client, "sk-test", &inputs, .{ .max_batch_inputs = 7 });
+    defer result.deinit(allocator);
+
+    try std.testing.expectEqual(@as(usize, 16), result.dims);
+    try std.testing.expectEqual(@as(usize, 20 * 16), result.vectors.len);
+    // 7 + 7 + 6 inputs.
+    try std.testing.expectEqual(@as(u64, 3), server.requests.load(.monotonic));
+    // Mock values are random in [-1, 1) with six decimals; an unwritten
+    // row would hold the allocator's fill (about -3e-13 in debug builds).
+    for (0..inputs.len) |i| {
+        var written = false;
+        for (result.row(i)) |x| {
+            try std.testing.expect(x >= -1 and x <= 1);
+            written = written or @abs(x) >= 1e-6;
+        }
+        try std.testing.expect(written);
+    }
+}
@@ -0,0 +1,61 @@
+const std = @import("std");
+const event_http = @import("event_http");
+const Client = @import("client.zig").Client;
+const chatgpt = @import("chatgpt.zig");
+
+// The OpenAI helpers on the event-driven transport: hundreds of requests
+// in flight on one thread instead of one thread per request.
+// - Same endpoints and bodies as `fetchModelsJson` / `chatCompletion`; the
+//   URL comes from `client.base_url`, which must be http:// here (a local
+//   server or a TLS-terminating proxy, see event_http.zig).
+// - The client's scheduler and response cache are not consulted: both may
+//   block, and the loop thread must not.
+// - Results arrive through `event_http.Callback` (or a `Future`) when the
+//   loop is polled. Status handling is up to the callback.
+pub const Loop = event_http.Loop;
+pub const Future = event_http.Future;
+pub const Callback = event_http.Callback;
+pub const Response = event_http.Response;
+
+// Queues GET /v1/models.
+pub fn fetchModelsJsonAsync(
+    allocator: std.mem.Allocator,
+    loop: *Loop,
+    client: *const Client,
+    api_key: []const u8,
+    callback: Callback,
+) !void {
+    const url = try client.url(allocator, "/v1/models");
+    defer allocator.free(url);
+    const headers = try authHeader(allocator, api_key);
+    defer wipe(allocator, headers);
+    try loop.submit(.{ .method = .GET, .url = url, .headers = headers }, callback);
+}
+
+// Queues a chat completion for a single user prompt.
+pub fn chatCompletionAsync(
+    allocator: std.mem.Allocator,
+    loop: *Loop,
+    client: *const Client,
+    api_key: []const u8,
+    model: []const u8,
+    prompt: []const u8,
+    callback: Callback,
+) !void {
+    const url = try client.url(allocator, "/v1/chat/completions");
+    defer allocator.free(url);
+    const headers = try authHeader(allocator, api_key);
+    defer wipe(allocator, headers);
+    const body = try chatgpt.buildChatBody(allocator, model, prompt, false);
+    defer allocator.free(body);
+    try loop.submit(.{ .method = .POST, .url = url, .headers = headers, .body = body }, callback);
+}
+
+fn authHeader(allocator: std.mem.Allocator, api_key: []const u8) ![]u8 {
+    return std.fmt.allocPrint(allocator, "Authorization: Bearer {s}\r\n", .{api_key});
+}
+
+fn wipe(allocator: std.mem.Allocator, bytes: []u8) void {
+    std.crypto.secureZero(u8, bytes);
+    allocator.free(bytes);
+}
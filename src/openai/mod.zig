@@ -1,10 +1,45 @@
 // Public entry for the OpenAI helpers.
 // Re-export submodules so callers can `@import("openai")` and access APIs.
+const std = @import("std");
+pub const client = @import("client.zig");
 pub const chatgpt = @import("chatgpt.zig");
 pub const models = @import("models.zig");
+pub const sse = @import("sse.zig");
+pub const decode = @import("decode.zig");
+pub const schema = @import("schema.zig");
+pub const ratelimit = @import("ratelimit.zig");
+pub const response_cache = @import("response_cache.zig");
+pub const embeddings = @import("embeddings.zig");
+pub const tokenizer = @import("tokenizer.zig");
+pub const conversation = @import("conversation.zig");
+pub const evented = @import("evented.zig");
+pub const request_body = @import("request_body.zig");
+// Deadlines and cancellation for the *Ctx calls.
+pub const deadline = @import("deadline");
 
 // Convenience re-exports
+pub const Client = client.Client;
+pub const Scheduler = ratelimit.Scheduler;
+pub const ResponseCache = response_cache.ResponseCache;
+pub const Tokenizer = tokenizer.Tokenizer;
+pub const Conversation = conversation.Conversation;
+pub const EventLoop = evented.Loop;
+pub const ChatBody = request_body.ChatBody;
 pub const chatCompletion = chatgpt.chatCompletion;
+pub const chatCompletionCtx = chatgpt.chatCompletionCtx;
+pub const chatCompletionResponse = chatgpt.chatCompletionResponse;
+pub const ChatResponse = chatgpt.ChatResponse;
+pub const chatCompletionMessages = chatgpt.chatCompletionMessages;
+pub const chatCompletionBody = chatgpt.chatCompletionBody;
+pub const chatCompletionStream = chatgpt.chatCompletionStream;
+pub const chatCompletionStreamCtx = chatgpt.chatCompletionStreamCtx;
 pub const chatCompletionWithEnvModel = chatgpt.chatCompletionWithEnvModel;
 pub const fetchModelsJson = models.fetchModelsJson;
+pub const fetchModelsJsonCtx = models.fetchModelsJsonCtx;
 pub const extractModelIds = models.extractModelIds;
+pub const embed = embeddings.embed;
+
+// `zig build test` reaches the submodules' tests through this root.
+test {
+    std.testing.refAllDecls(@This());
+}
@@ -1,53 +1,83 @@
 const std = @import("std");
+const client_mod = @import("client.zig");
+const Client = client_mod.Client;
+const decode = @import("decode.zig");
+const schema = @import("schema.zig");
+const deadline = @import("deadline");
+const trace = @import("trace");
 
 pub const ModelsResponse = struct {
     status: std.http.Status,
     body: []u8,
 };
 
-// Fetches the raw Models list JSON from OpenAI.
+// Fetches the raw Models list JSON from OpenAI over a pooled connection.
 // Caller owns the returned body and must free it.
-pub fn fetchModelsJson(allocator: std.mem.Allocator, api_key: []const u8) !ModelsResponse {
-    var client = std.http.Client{ .allocator = allocator };
-    defer client.deinit();
+pub fn fetchModelsJson(allocator: std.mem.Allocator, client: *Client, api_key: []const u8) !ModelsResponse {
+    return fetchModelsJsonCtx(allocator, client, api_key, .{});
+}
 
+// `fetchModelsJson` bounded by `ctx`: fails with error.DeadlineExceeded or
+// error.Canceled, with the connection shut down rather than pooled.
+pub fn fetchModelsJsonCtx(allocator: std.mem.Allocator, client: *Client, api_key: []const u8, ctx: deadline.Context) !ModelsResponse {
+    const span = trace.begin("openai/fetchModelsJson");
+    defer span.end();
     const auth_header = try std.fmt.allocPrint(allocator, "Bearer {s}", .{api_key});
     defer allocator.free(auth_header);
 
-    var req = try client.request(.{
+    const url = try client.url(allocator, "/v1/models");
+    defer allocator.free(url);
+
+    var guard: deadline.Guard = undefined;
+    try guard.start(ctx);
+    defer guard.finish();
+    var req = try client.send(.{
         .method = .GET,
-        .url = "https://api.openai.com/v1/models",
+        .url = url,
         .headers = &.{
             .{ .name = "Authorization", .value = auth_header },
         },
-    });
-    defer req.deinit();
+    }, null, 0, &guard);
+    defer client_mod.release(&req, &guard);
 
-    try req.finish();
     const status = req.response.status;
-    const body = try req.readToEndAlloc(allocator, 1024 * 1024);
+    const body = try client_mod.readBody(allocator, &req, &guard);
     return .{ .status = status, .body = body };
 }
 
-// Basic parser that extracts model ids from the models JSON response.
-// Returns a heap-allocated array of heap-allocated strings (caller frees all).
-pub fn extractModelIds(allocator: std.mem.Allocator, json_bytes: []const u8) ![][]u8 {
-    var parsed = try std.json.parseFromSlice(std.json.Value, allocator, json_bytes, .{ .ignore_unknown_fields = true });
-    defer parsed.deinit();
-
-    const root = parsed.value;
-    const data = root.object.get("data") orelse return error.InvalidResponse;
-    var list = std.ArrayList([]u8).init(allocator);
-    defer list.deinit();
-
-    const arr = data.array orelse return error.InvalidResponse;
-    for (arr.items) |item| {
-        const obj = item.object orelse continue;
-        const id_val = obj.get("id") orelse continue;
-        const id_str = id_val.string orelse continue;
-        const dup = try allocator.dupe(u8, id_str);
-        try list.append(dup);
-    }
+// Extracts model ids from the models JSON response with the typed decoder.
+// The ids are slices into `json_bytes` (which may be modified in place to
+// unescape strings); only the returned outer slice is allocated.
+pub fn extractModelIds(allocator: std.mem.Allocator, json_bytes: []u8) ![][]const u8 {
+    const span = trace.begin("openai/decode");
+    defer span.end();
+    const list = try decode.decodeLeaky(schema.ModelList, allocator, json_bytes);
+    defer allocator.free(list.data);
 
-    return try list.toOwnedSlice();
+    const ids = try allocator.alloc([]const u8, list.data.len);
+    for (list.data, ids) |m, *id| id.* = m.id;
+    return ids;
+}
+
+test "gzip- and deflate-encoded model lists decode and are counted" {
+    const mock = @import("mock_server");
+    const allocator = std.testing.allocator;
+    for ([_]mock.ContentEncoding{ .identity, .gzip, .deflate }) |coding| {
+        const server = try mock.Server.start(allocator, .{ .port = 0, .models = 300, .content_encoding = coding });
+        defer server.stop();
+        var base_buf: [64]u8 = undefined;
+        const base = try std.fmt.bufPrint(&base_buf, "http://127.0.0.1:{d}", .{server.port()});
+        var client = Client.init(allocator, .{ .base_url = base });
+        defer client.deinit();
+
+        const res = try fetchModelsJson(allocator, &client, "sk-test");
+        defer allocator.free(res.body);
+        try std.testing.expectEqual(std.http.Status.ok, res.status);
+        const ids = try extractModelIds(allocator, res.body);
+        defer allocator.free(ids);
+        try std.testing.expectEqual(@as(usize, 300), ids.len);
+        try std.testing.expectEqualStrings("mock-model-299", ids[299]);
+        const compressed: u64 = if (coding == .identity) 0 else 1;
+        try std.testing.expectEqual(compressed, client.stats().compressed_responses);
+    }
 }
@@ -0,0 +1,323 @@
+const std = @import("std");
+const deadline = @import("deadline");
+
+// Client-side rate-limit scheduler shared by every request of a Client.
+// - Two token buckets (requests, tokens) are seeded from the
+//   x-ratelimit-{limit,remaining,reset}-{requests,tokens} response headers
+//   and refill linearly until the advertised reset. `acquire` blocks until
+//   both buckets cover the next request, so callers slow down before the
+//   server starts answering 429.
+// - A 429 pauses *all* callers until Retry-After (or retry-after-ms) has
+//   passed; without one, and for transient 5xx answers to idempotent
+//   requests, the retrying caller backs off exponentially with full
+//   jitter. Retries therefore spread out instead of arriving as a storm.
+// Until the first response with rate-limit headers arrives the buckets are
+// unknown and never block.
+pub const Scheduler = struct {
+    mutex: std.Thread.Mutex = .{},
+    cond: std.Thread.Condition = .{},
+    options: Options,
+    epoch: std.time.Instant,
+    prng: std.Random.DefaultPrng,
+
+    requests: Bucket = .{},
+    tokens: Bucket = .{},
+    // Nobody starts a request before this (ns since epoch).
+    paused_until: u64 = 0,
+    counters: Stats = .{},
+
+    pub const Options = struct {
+        // Retries after the first attempt for 429 / transient 5xx answers.
+        max_retries: u32 = 5,
+        // Backoff cap grows as base * 2^attempt, up to max.
+        base_backoff_ms: u64 = 500,
+        max_backoff_ms: u64 = 30_000,
+        // Longest Retry-After honored; larger values are clamped.
+        max_retry_after_ms: u64 = 120_000,
+    };
+
+    pub const Stats = struct {
+        // 429 answers seen.
+        throttled: u64 = 0,
+        // Requests re-sent after a 429 / 5xx.
+        retries: u64 = 0,
+        // Total time callers spent blocked in `acquire` / backoff.
+        waited_ns: u64 = 0,
+    };
+
+    pub fn init(options: Options) !Scheduler {
+        var seed: u64 = undefined;
+        std.crypto.random.bytes(std.mem.asBytes(&seed));
+        return .{
+            .options = options,
+            .epoch = try std.time.Instant.now(),
+            .prng = std.Random.DefaultPrng.init(seed),
+        };
+    }
+
+    // Blocks until a request costing `tokens` fits both budgets, then
+    // reserves it. `tokens` is an estimate (prompt + expected completion).
+    // With a `guard` the wait ends as soon as it fires (cancel or total
+    // deadline), and nothing is reserved.
+    pub fn acquire(self: *Scheduler, tokens: u64, guard: ?*deadline.Guard) deadline.Error!void {
+        if (guard) |g| try g.setTarget(.{ .ctx = self, .abort = wakeWaiters });
+        defer if (guard) |g| g.setTarget(null) catch {};
+        self.mutex.lock();
+        defer self.mutex.unlock();
+
+        const start = self.now();
+        while (true) {
+            if (guard) |g| g.check() catch |e| {
+                self.counters.waited_ns += self.now() - start;
+                return e;
+            };
+            const t = self.now();
+            self.requests.refill(t);
+            self.tokens.refill(t);
+
+            var wait: u64 = if (self.paused_until > t) self.paused_until - t else 0;
+            wait = @max(wait, self.requests.waitFor(1));
+            wait = @max(wait, self.tokens.waitFor(tokens));
+            if (wait == 0) break;
+            // Woken early when a response refreshes the budgets.
+            self.cond.timedWait(&self.mutex, wait) catch {};
+        }
+        self.requests.take(1);
+        self.tokens.take(tokens);
+        self.counters.waited_ns += self.now() - start;
+    }
+
+    // Abort target while a guarded `acquire` waits. Taking the mutex means
+    // the broadcast cannot fall between a waiter's check and its wait.
+    fn wakeWaiters(ctx: *anyopaque) void {
+        const self: *Scheduler = @ptrCast(@alignCast(ctx));
+        self.mutex.lock();
+        defer self.mutex.unlock();
+        self.cond.broadcast();
+    }
+
+    // Feeds a response's status and headers back into the scheduler.
+    // `headers` is anything with `next() ?std.http.Header`.
+    // Returns how long to wait before retrying, or null when the response
+    // should be handed to the caller (success, non-retryable status, or
+    // retries exhausted after `attempt`).
+    // A 429 was refused before any work, so it is always retryable. A
+    // 502/503/504 may come after the server acted on the request, so it is
+    // retried only when `idempotent` says sending it twice is harmless.
+    pub fn observe(self: *Scheduler, status: std.http.Status, headers: anytype, attempt: u32, idempotent: bool) ?u64 {
+        const info = Limits.parse(headers);
+
+        self.mutex.lock();
+        defer self.mutex.unlock();
+
+        const t = self.now();
+        if (info.requests.valid()) self.requests.update(info.requests, t);
+        if (info.tokens.valid()) self.tokens.update(info.tokens, t);
+        defer self.cond.broadcast();
+
+        const retryable = status == .too_many_requests or (idempotent and switch (status) {
+            .bad_gateway, .service_unavailable, .gateway_timeout => true,
+            else => false,
+        });
+        if (status == .too_many_requests) self.counters.throttled += 1;
+        if (!retryable or attempt >= self.options.max_retries) return null;
+        self.counters.retries += 1;
+
+        if (info.retry_after_ns) |ra| {
+            // Honor the server's hint, plus up to 10% jitter so waiting
+            // callers do not all resume on the same tick.
+            const capped = @min(ra, self.options.max_retry_after_ms * std.time.ns_per_ms);
+            const delay = capped + self.prng.random().uintAtMost(u64, capped / 10);
+            if (status == .too_many_requests) self.paused_until = @max(self.paused_until, t + delay);
+            return delay;
+        }
+        return self.backoff(attempt);
+    }
+
+    // Records time spent sleeping before a retry.
+    pub fn noteWait(self: *Scheduler, ns: u64) void {
+        self.mutex.lock();
+        defer self.mutex.unlock();
+        self.counters.waited_ns += ns;
+    }
+
+    pub fn stats(self: *Scheduler) Stats {
+        self.mutex.lock();
+        defer self.mutex.unlock();
+        return self.counters;
+    }
+
+    // Full jitter: uniform in [0, min(max, base * 2^attempt)].
+    fn backoff(self: *Scheduler, attempt: u32) u64 {
+        const shift: u6 = @intCast(@min(attempt, 20));
+        const cap_ms = @min(self.options.max_backoff_ms, self.options.base_backoff_ms << shift);
+        return self.prng.random().uintAtMost(u64, cap_ms * std.time.ns_per_ms);
+    }
+
+    fn now(self: *Scheduler) u64 {
+        const t = std.time.Instant.now() catch return 0;
+        return t.since(self.epoch);
+    }
+};
+
+// Linear-refill bucket modelled on the server's window: `remaining` goes
+// back up to `limit` by the time `reset` elapses.
+const Bucket = struct {
+    known: bool = false,
+    limit: f64 = 0,
+    available: f64 = 0,
+    // Refill rate in units per ns.
+    rate: f64 = 0,
+    updated: u64 = 0,
+
+    fn update(b: *Bucket, w: Limits.Window, t: u64) void {
+        const limit: f64 = @floatFromInt(w.limit.?);
+        const remaining: f64 = @floatFromInt(w.remaining.?);
+        b.known = true;
+        b.limit = limit;
+        b.available = remaining;
+        b.updated = t;
+        if (w.reset_ns) |reset| {
+            if (reset > 0 and limit > remaining) b.rate = (limit - remaining) / @as(f64, @floatFromInt(reset));
+        }
+    }
+
+    fn refill(b: *Bucket, t: u64) void {
+        if (!b.known or t <= b.updated) return;
+        b.available = @min(b.limit, b.available + b.rate * @as(f64, @floatFromInt(t - b.updated)));
+        b.updated = t;
+    }
+
+    // ns until `cost` is available; 0 when it already is or unknowable.
+    fn waitFor(b: *const Bucket, cost: u64) u64 {
+        if (!b.known) return 0;
+        const c: f64 = @floatFromInt(@min(cost, @as(u64, @intFromFloat(b.limit))));
+        if (b.available >= c) return 0;
+        if (b.rate <= 0) return 0;
+        return @intFromFloat(@ceil((c - b.available) / b.rate));
+    }
+
+    fn take(b: *Bucket, cost: u64) void {
+        if (!b.known) return;
+        b.available -= @floatFromInt(cost);
+    }
+};
+
+// Rate-limit headers of one response.
+pub const Limits = struct {
+    requests: Window = .{},
+    tokens: Window = .{},
+    retry_after_ns: ?u64 = null,
+
+    pub const Window = struct {
+        limit: ?u64 = null,
+        remaining: ?u64 = null,
+        reset_ns: ?u64 = null,
+
+        fn valid(w: Window) bool {
+            return w.limit != null and w.remaining != null and w.limit.? > 0;
+        }
+    };
+
+    pub fn parse(headers: anytype) Limits {
+        var l = Limits{};
+        var it = headers;
+        while (it.next()) |h| {
+            const v = std.mem.trim(u8, h.value, " \t");
+            if (eql(h.name, "x-ratelimit-limit-requests")) {
+                l.requests.limit = std.fmt.parseInt(u64, v, 10) catch null;
+            } else if (eql(h.name, "x-ratelimit-remaining-requests")) {
+                l.requests.remaining = std.fmt.parseInt(u64, v, 10) catch null;
+            } else if (eql(h.name, "x-ratelimit-reset-requests")) {
+                l.requests.reset_ns = parseDuration(v);
+            } else if (eql(h.name, "x-ratelimit-limit-tokens")) {
+                l.tokens.limit = std.fmt.parseInt(u64, v, 10) catch null;
+            } else if (eql(h.name, "x-ratelimit-remaining-tokens")) {
+                l.tokens.remaining = std.fmt.parseInt(u64, v, 10) catch null;
+            } else if (eql(h.name, "x-ratelimit-reset-tokens")) {
+                l.tokens.reset_ns = parseDuration(v);
+            } else if (eql(h.name, "retry-after-ms")) {
+                // More precise than retry-after; wins when both are sent.
+                if (std.fmt.parseFloat(f64, v)) |ms| {
+                    l.retry_after_ns = @intFromFloat(@max(ms, 0) * std.time.ns_per_ms);
+                } else |_| {}
+            } else if (eql(h.name, "retry-after") and l.retry_after_ns == null) {
+                // Delta-seconds only; the HTTP-date form is not used by the API.
+                if (std.fmt.parseInt(u64, v, 10)) |s| l.retry_after_ns = s * std.time.ns_per_s else |_| {}
+            }
+        }
+        return l;
+    }
+
+    fn eql(a: []const u8, b: []const u8) bool {
+        return std.ascii.eqlIgnoreCase(a, b);
+    }
+};
+
+// Parses Go-style durations as sent in x-ratelimit-reset-*: "1s", "6m0s",
+// "59.5ms", "1h2m3.4s". Returns null on anything else.
+pub fn parseDuration(s: []const u8) ?u64 {
+    if (s.len == 0) return null;
+    var total: f64 = 0;
+    var i: usize = 0;
+    while (i < s.len) {
+        const start = i;
+        while (i < s.len and (std.ascii.isDigit(s[i]) or s[i] == '.')) i += 1;
+        if (i == start) return null;
+        const value = std.fmt.parseFloat(f64, s[start..i]) catch return null;
+
+        const unit_start = i;
+        while (i < s.len and std.ascii.isAlphabetic(s[i])) i += 1;
+        const unit = s[unit_start..i];
+        const scale: f64 = if (std.mem.eql(u8, unit, "h"))
+            std.time.ns_per_hour
+        else if (std.mem.eql(u8, unit, "m"))
+            std.time.ns_per_min
+        else if (std.mem.eql(u8, unit, "s"))
+            std.time.ns_per_s
+        else if (std.mem.eql(u8, unit, "ms"))
+            std.time.ns_per_ms
+        else if (std.mem.eql(u8, unit, "us"))
+            std.time.ns_per_us
+        else if (std.mem.eql(u8, unit, "ns"))
+            1
+        else
+            return null;
+        total += value * scale;
+    }
+    return @intFromFloat(total);
+}
+
+// Rough token estimate for budgeting before a tokenizer is involved:
+// ~4 bytes of English text per token.
+pub fn estimateTokens(text: []const u8) u64 {
+    return text.len / 4 + 1;
+}
+
+// Header source with no headers, for `observe` in tests.
+const NoHeaders = struct {
+    fn next(_: *NoHeaders) ?std.http.Header {
+        return null;
+    }
+};
+
+test "5xx is retried only for idempotent requests" {
+    var s = try Scheduler.init(.{ .base_backoff_ms = 1, .max_backoff_ms = 1 });
+    var h = NoHeaders{};
+    try std.testing.expectEqual(@as(?u64, null), s.observe(.service_unavailable, &h, 0, false));
+    try std.testing.expectEqual(@as(?u64, null), s.observe(.bad_gateway, &h, 0, false));
+    try std.testing.expect(s.observe(.service_unavailable, &h, 0, true) != null);
+    try std.testing.expect(s.observe(.gateway_timeout, &h, 0, true) != null);
+    // Never retried, idempotent or not.
+    try std.testing.expectEqual(@as(?u64, null), s.observe(.internal_server_error, &h, 0, true));
+    try std.testing.expectEqual(@as(u64, 2), s.stats().retries);
+}
+
+test "429 is retried for any request until retries run out" {
+    var s = try Scheduler.init(.{ .max_retries = 2, .base_backoff_ms = 1, .max_backoff_ms = 1 });
+    var h = NoHeaders{};
+    try std.testing.expect(s.observe(.too_many_requests, &h, 0, false) != null);
+    try std.testing.expect(s.observe(.too_many_requests, &h, 1, false) != null);
+    try std.testing.expectEqual(@as(?u64, null), s.observe(.too_many_requests, &h, 2, false));
+    try std.testing.expectEqual(@as(u64, 3), s.stats().throttled);
+}
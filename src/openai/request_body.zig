@@ -0,0 +1,106 @@
+const std = @import("std");
+const kernels = @import("text_kernels");
+const conversation = @import("conversation.zig");
+
+// Chat request bodies written straight into the connection instead of
+// being built in memory first.
+// - Contents are escaped `block` bytes at a time through a stack buffer,
+//   so peak memory does not grow with the prompt.
+// - When every content is in memory (or memory-mapped) the exact length is
+//   counted up front and the body goes out with Content-Length; a reader
+//   has no length until it is drained, so such bodies are sent chunked.
+// - Same bytes as `buildChatBody` for a single prompt, so response cache
+//   keys do not change.
+pub const block = 4096;
+
+// Text of one message.
+pub const Source = union(enum) {
+    // In-memory text, or the `bytes` of a `MappedFile`
+    // (src/platform/mmap.zig): pages are read as they are escaped.
+    bytes: []const u8,
+    // Read to EOF while the body is written (e.g. `file.reader().any()`).
+    // Can only be sent once.
+    reader: std.io.AnyReader,
+};
+
+pub const Message = struct {
+    role: conversation.Role,
+    content: Source,
+};
+
+pub const ChatBody = struct {
+    model: []const u8,
+    messages: []const Message,
+    // Adds "stream":true so the server answers with SSE deltas.
+    stream: bool = false,
+
+    const head = "{\"model\":\"";
+    const stream_field = "\",\"stream\":true,";
+    const plain_field = "\",";
+    const open = "\"messages\":[";
+    const role_field = "{\"role\":\"";
+    const content_field = "\",\"content\":";
+    const tail = "]}";
+
+    // Exact length in bytes, or null when a content is a reader. Counting
+    // reads in-memory contents once without copying them.
+    pub fn contentLength(self: ChatBody) ?u64 {
+        var len: u64 = head.len + self.model.len + self.fieldAfterModel().len + open.len + tail.len;
+        for (self.messages, 0..) |m, i| {
+            const s = switch (m.content) {
+                .bytes => |b| b,
+                .reader => return null,
+            };
+            len += @intFromBool(i > 0) + role_field.len + m.role.name().len + content_field.len;
+            len += kernels.jsonEscapedLen(s) + 2 + 1;
+        }
+        return len;
+    }
+
+    // Writes the body to `writer` (anything with `writeAll`).
+    pub fn writeTo(self: ChatBody, writer: anytype) !void {
+        try writer.writeAll(head);
+        try writer.writeAll(self.model);
+        try writer.writeAll(self.fieldAfterModel());
+        try writer.writeAll(open);
+        for (self.messages, 0..) |m, i| {
+            if (i > 0) try writer.writeAll(",");
+            try writer.writeAll(role_field);
+            try writer.writeAll(m.role.name());
+            try writer.writeAll(content_field);
+            try writer.writeAll("\"");
+            try writeEscaped(writer, m.content);
+            try writer.writeAll("\"}");
+        }
+        try writer.writeAll(tail);
+    }
+
+    fn fieldAfterModel(self: ChatBody) []const u8 {
+        return if (self.stream) stream_field else plain_field;
+    }
+};
+
+fn writeEscaped(writer: anytype, source: Source) !void {
+    // Worst case every byte becomes a \u00XX escape.
+    var out: [block * 6]u8 = undefined;
+    switch (source) {
+        .bytes => |s| {
+            var i: usize = 0;
+            while (i < s.len) {
+                const end = @min(s.len, i + block);
+                const n = kernels.jsonEscapeContentInto(&out, s[i..end]);
+                try writer.writeAll(out[0..n]);
+                i = end;
+            }
+        },
+        .reader => |r| {
+            var in: [block]u8 = undefined;
+            while (true) {
+                const got = try r.read(&in);
+                if (got == 0) break;
+                const n = kernels.jsonEscapeContentInto(&out, in[0..got]);
+                try writer.writeAll(out[0..n]);
+            }
+        },
+    }
+}
@@ -0,0 +1,253 @@
+const std = @import("std");
+const trace = @import("trace");
+
+// Opt-in on-disk cache of chat completion responses, content-addressed by
+// the SHA-256 of the canonical request (base URL + JSON request body).
+// - One file per entry, `<hex key>.json`, holding the raw response body, or
+//   its gzip form with `Options.compress` (told apart by the gzip magic, so
+//   one directory can hold both).
+//   Entries are written under a unique temp name and renamed into place, so
+//   readers (and other processes) never see a partial entry.
+// - An in-memory index (size, creation and last-use time) is built from a
+//   directory scan at open. A lookup is one hash-map probe plus one small
+//   file read; no directory walk, no parsing.
+// - Size-bounded: after a store, least recently used entries are deleted
+//   until the total is under `max_bytes`. Entries older than `ttl_s` count
+//   as misses and are deleted when found.
+// Thread-safe; share one instance per directory.
+pub const ResponseCache = struct {
+    allocator: std.mem.Allocator,
+    dir: std.fs.Dir,
+    options: Options,
+    mutex: std.Thread.Mutex = .{},
+    index: std.AutoHashMapUnmanaged(Key, Entry) = .{},
+    total_bytes: u64 = 0,
+    counters: Stats = .{},
+
+    pub const Key = [32]u8;
+
+    pub const Options = struct {
+        // Upper bound on the summed size of all entries.
+        max_bytes: u64 = 64 * 1024 * 1024,
+        // Entries older than this are not served.
+        ttl_s: u64 = 7 * 24 * 60 * 60,
+        // Gzip entries on store. `max_bytes` bounds the stored size.
+        compress: bool = false,
+    };
+
+    pub const Stats = struct {
+        hits: u64 = 0,
+        misses: u64 = 0,
+        // Misses caused by an entry past its TTL (also counted in misses).
+        expired: u64 = 0,
+        stores: u64 = 0,
+        evictions: u64 = 0,
+        entries: usize = 0,
+        bytes: u64 = 0,
+        // Response bytes handed to `put` vs. bytes written for them.
+        put_raw_bytes: u64 = 0,
+        put_stored_bytes: u64 = 0,
+    };
+
+    const Entry = struct {
+        size: u64,
+        // Wall-clock ns (file mtime for entries found at open).
+        created: i128,
+        last_used: i128,
+    };
+
+    const ext = ".json";
+    const name_len = 64 + ext.len;
+
+    // Opens (creating if needed) the cache directory and indexes its entries.
+    pub fn open(allocator: std.mem.Allocator, dir_path: []const u8, options: Options) !ResponseCache {
+        try std.fs.cwd().makePath(dir_path);
+        var dir = try std.fs.cwd().openDir(dir_path, .{ .iterate = true });
+        errdefer dir.close();
+
+        var self = ResponseCache{ .allocator = allocator, .dir = dir, .options = options };
+        errdefer self.index.deinit(allocator);
+
+        var it = dir.iterate();
+        while (try it.next()) |e| {
+            if (e.kind != .file) continue;
+            const k = parseName(e.name) orelse continue;
+            const st = dir.statFile(e.name) catch continue;
+            try self.index.put(allocator, k, .{ .size = st.size, .created = st.mtime, .last_used = st.mtime });
+            self.total_bytes += st.size;
+        }
+        // Not shared yet, so no lock needed.
+        self.evictLocked();
+        return self;
+    }
+
+    pub fn close(self: *ResponseCache) void {
+        self.index.deinit(self.allocator);
+        self.dir.close();
+    }
+
+    // Cache key for a request: SHA-256 over base URL and body. The body is
+    // built deterministically (`buildChatBody`), so equal (model, prompt)
+    // pairs map to the same key.
+    pub fn key(base_url: []const u8, body: []const u8) Key {
+        var h = std.crypto.hash.sha2.Sha256.init(.{});
+        h.update(base_url);
+        h.update("\n");
+        h.update(body);
+        return h.finalResult();
+    }
+
+    // `key` for a body that is only ever written out (`body.writeTo`, e.g.
+    // a streamed `ChatBody`), hashed as it is produced.
+    pub fn keyStreamed(base_url: []const u8, body: anytype) !Key {
+        var h = std.crypto.hash.sha2.Sha256.init(.{});
+        h.update(base_url);
+        h.update("\n");
+        try body.writeTo(h.writer());
+        return h.finalResult();
+    }
+
+    // Returns a copy of the cached response (caller frees), or null.
+    pub fn get(self: *ResponseCache, allocator: std.mem.Allocator, k: Key) !?[]u8 {
+        const span = trace.begin("cache/response_get");
+        defer span.end();
+        const now = std.time.nanoTimestamp();
+        {
+            self.mutex.lock();
+            defer self.mutex.unlock();
+            const entry = self.index.getPtr(k) orelse {
+                self.counters.misses += 1;
+                return null;
+            };
+            if (now - entry.created > @as(i128, self.options.ttl_s) * std.time.ns_per_s) {
+                self.removeLocked(k);
+                self.counters.expired += 1;
+                self.counters.misses += 1;
+                return null;
+            }
+            entry.last_used = now;
+        }
+
+        const name = fileName(k);
+        const stored = self.dir.readFileAlloc(allocator, &name, std.math.maxInt(u32)) catch |e| switch (e) {
+            error.FileNotFound => {
+                // Evicted by another process sharing the directory.
+                self.mutex.lock();
+                defer self.mutex.unlock();
+                if (self.index.fetchRemove(k)) |kv| self.total_bytes -= kv.value.size;
+                self.counters.misses += 1;
+                return null;
+            },
+            else => return e,
+        };
+        const data = if (isGzip(stored)) blk: {
+            defer allocator.free(stored);
+            break :blk try gunzip(allocator, stored);
+        } else stored;
+
+        self.mutex.lock();
+        self.counters.hits += 1;
+        self.mutex.unlock();
+        return data;
+    }
+
+    // Stores `response` under `k`, replacing any previous entry, then
+    // evicts down to `max_bytes`.
+    pub fn put(self: *ResponseCache, k: Key, response: []const u8) !void {
+        const span = trace.begin("cache/response_put");
+        defer span.end();
+        const name = fileName(k);
+        const compressed = if (self.options.compress) try gzip(self.allocator, response) else null;
+        defer if (compressed) |b| self.allocator.free(b);
+        const stored = compressed orelse response;
+        var rand: [4]u8 = undefined;
+        std.crypto.random.bytes(&rand);
+        var tmp_buf: [name_len + 16]u8 = undefined;
+        const tmp = try std.fmt.bufPrint(&tmp_buf, "{s}.{x}.tmp", .{ name[0..64], std.mem.readInt(u32, &rand, .little) });
+
+        {
+            var file = try self.dir.createFile(tmp, .{ .exclusive = true });
+            errdefer self.dir.deleteFile(tmp) catch {};
+            defer file.close();
+            try file.writeAll(stored);
+        }
+        self.dir.rename(tmp, &name) catch |e| {
+            self.dir.deleteFile(tmp) catch {};
+            return e;
+        };
+
+        const now = std.time.nanoTimestamp();
+        self.mutex.lock();
+        defer self.mutex.unlock();
+        const gop = try self.index.getOrPut(self.allocator, k);
+        if (gop.found_existing) self.total_bytes -= gop.value_ptr.size;
+        gop.value_ptr.* = .{ .size = stored.len, .created = now, .last_used = now };
+        self.total_bytes += stored.len;
+        self.counters.stores += 1;
+        self.counters.put_raw_bytes += response.len;
+        self.counters.put_stored_bytes += stored.len;
+        self.evictLocked();
+    }
+
+    pub fn stats(self: *ResponseCache) Stats {
+        self.mutex.lock();
+        defer self.mutex.unlock();
+        var s = self.counters;
+        s.entries = self.index.count();
+        s.bytes = self.total_bytes;
+        return s;
+    }
+
+    // Drops least recently used entries until under the size bound. A scan
+    // per eviction is fine: evictions only happen on stores.
+    fn evictLocked(self: *ResponseCache) void {
+        while (self.total_bytes > self.options.max_bytes and self.index.count() > 0) {
+            var it = self.index.iterator();
+            var oldest = it.next().?;
+            while (it.next()) |e| {
+                if (e.value_ptr.last_used < oldest.value_ptr.last_used) oldest = e;
+            }
+            self.removeLocked(oldest.key_ptr.*);
+            self.counters.evictions += 1;
+        }
+    }
+
+    fn removeLocked(self: *ResponseCache, k: Key) void {
+        const kv = self.index.fetchRemove(k) orelse return;
+        self.total_bytes -= kv.value.size;
+        const name = fileName(k);
+        self.dir.deleteFile(&name) catch {};
+    }
+
+    // JSON never starts with 0x1f, so the magic is unambiguous.
+    fn isGzip(data: []const u8) bool {
+        return data.len >= 2 and data[0] == 0x1f and data[1] == 0x8b;
+    }
+
+    fn gzip(allocator: std.mem.Allocator, data: []const u8) ![]u8 {
+        var out = std.ArrayList(u8).init(allocator);
+        errdefer out.deinit();
+        var in = std.io.fixedBufferStream(data);
+        try std.compress.gzip.compress(in.reader(), out.writer(), .{});
+        return out.toOwnedSlice();
+    }
+
+    fn gunzip(allocator: std.mem.Allocator, data: []const u8) ![]u8 {
+        var out = std.ArrayList(u8).init(allocator);
+        errdefer out.deinit();
+        var in = std.io.fixedBufferStream(data);
+        try std.compress.gzip.decompress(in.reader(), out.writer());
+        return out.toOwnedSlice();
+    }
+
+    fn fileName(k: Key) [name_len]u8 {
+        return std.fmt.bytesToHex(k, .lower) ++ ext.*;
+    }
+
+    fn parseName(name: []const u8) ?Key {
+        if (name.len != name_len or !std.mem.endsWith(u8, name, ext)) return null;
+        var k: Key = undefined;
+        _ = std.fmt.hexToBytes(&k, name[0..64]) catch return null;
+        return k;
+    }
+};
@@ -0,0 +1,67 @@
+// Typed shapes of the OpenAI responses we read.
+// Decoded with `decode.zig`: only the fields listed here are extracted,
+// everything else in the payload is skipped. String fields are slices into
+// the response body.
+
+// GET /v1/models
+pub const Model = struct {
+    id: []const u8,
+    created: i64 = 0,
+    owned_by: []const u8 = "",
+};
+
+pub const ModelList = struct {
+    data: []const Model,
+};
+
+// POST /v1/chat/completions
+pub const ChatMessage = struct {
+    role: []const u8 = "",
+    content: ?[]const u8 = null,
+};
+
+pub const ChatChoice = struct {
+    index: u32 = 0,
+    message: ChatMessage = .{},
+    finish_reason: ?[]const u8 = null,
+};
+
+pub const Usage = struct {
+    prompt_tokens: u64 = 0,
+    completion_tokens: u64 = 0,
+    total_tokens: u64 = 0,
+};
+
+pub const ChatCompletion = struct {
+    id: []const u8 = "",
+    model: []const u8 = "",
+    choices: []const ChatChoice = &.{},
+    usage: ?Usage = null,
+};
+
+// One `chat.completion.chunk` event of a streamed completion.
+pub const ChatDelta = struct {
+    role: ?[]const u8 = null,
+    content: ?[]const u8 = null,
+};
+
+pub const ChatChunkChoice = struct {
+    index: u32 = 0,
+    delta: ChatDelta = .{},
+    finish_reason: ?[]const u8 = null,
+};
+
+pub const ChatCompletionChunk = struct {
+    choices: []const ChatChunkChoice = &.{},
+};
+
+// POST /v1/embeddings ("encoding_format": "float")
+pub const Embedding = struct {
+    index: u32 = 0,
+    embedding: []const f32,
+};
+
+pub const EmbeddingList = struct {
+    data: []const Embedding,
+    usage: ?Usage = null,
+};
@@ -0,0 +1,199 @@
+const std = @import("std");
+
+// Incremental server-sent-events (text/event-stream) parser.
+// Feed it arbitrary chunks as they arrive from the socket; complete events
+// are handed to `handler.onEvent(event)` as soon as their terminating blank
+// line is seen. Memory is fixed at init: one partial line plus one event's
+// data, so a stream of any length runs in constant space.
+pub const Event = struct {
+    // Value of the last `event:` field, or "message" when absent.
+    name: []const u8,
+    // `data:` lines joined with '\n'. Valid only during the callback; the
+    // handler may modify it in place (e.g. to unescape JSON strings).
+    data: []u8,
+};
+
+pub const Parser = struct {
+    allocator: std.mem.Allocator,
+    // Current (incomplete) line.
+    line: []u8,
+    line_len: usize = 0,
+    // Data of the event being assembled.
+    data: []u8,
+    data_len: usize = 0,
+    has_data: bool = false,
+    name_buf: [64]u8 = undefined,
+    name_len: usize = 0,
+
+    // Largest line and largest event payload accepted.
+    pub const default_max_event_bytes: usize = 64 * 1024;
+
+    pub fn init(allocator: std.mem.Allocator, max_event_bytes: usize) !Parser {
+        const line = try allocator.alloc(u8, max_event_bytes);
+        errdefer allocator.free(line);
+        const data = try allocator.alloc(u8, max_event_bytes);
+        return .{ .allocator = allocator, .line = line, .data = data };
+    }
+
+    pub fn deinit(self: *Parser) void {
+        self.allocator.free(self.line);
+        self.allocator.free(self.data);
+    }
+
+    // Consumes `bytes`; may call `handler.onEvent` zero or more times.
+    pub fn feed(self: *Parser, bytes: []const u8, handler: anytype) !void {
+        var rest = bytes;
+        while (rest.len > 0) {
+            const nl = std.mem.indexOfScalar(u8, rest, '\n') orelse {
+                try self.appendLine(rest);
+                return;
+            };
+            try self.appendLine(rest[0..nl]);
+            rest = rest[nl + 1 ..];
+
+            var line = self.line[0..self.line_len];
+            self.line_len = 0;
+            if (line.len > 0 and line[line.len - 1] == '\r') line = line[0 .. line.len - 1];
+            try self.processLine(line, handler);
+        }
+    }
+
+    // Dispatches a trailing event that was not followed by a blank line
+    // (call once the stream hits EOF).
+    pub fn finish(self: *Parser, handler: anytype) !void {
+        if (self.line_len > 0) {
+            var line = self.line[0..self.line_len];
+            self.line_len = 0;
+            if (line[line.len - 1] == '\r') line = line[0 .. line.len - 1];
+            try self.processLine(line, handler);
+        }
+        try self.dispatch(handler);
+    }
+
+    fn appendLine(self: *Parser, part: []const u8) !void {
+        if (self.line_len + part.len > self.line.len) return error.EventTooLarge;
+        @memcpy(self.line[self.line_len..][0..part.len], part);
+        self.line_len += part.len;
+    }
+
+    fn processLine(self: *Parser, line: []const u8, handler: anytype) !void {
+        // Blank line terminates the event
+        if (line.len == 0) return self.dispatch(handler);
+        // Comment / keep-alive
+        if (line[0] == ':') return;
+
+        const colon = std.mem.indexOfScalar(u8, line, ':');
+        const field = if (colon) |i| line[0..i] else line;
+        var value: []const u8 = if (colon) |i| line[i + 1 ..] else "";
+        if (value.len > 0 and value[0] == ' ') value = value[1..];
+
+        if (std.mem.eql(u8, field, "data")) {
+            const sep: usize = if (self.has_data) 1 else 0;
+            if (self.data_len + sep + value.len > self.data.len) return error.EventTooLarge;
+            if (sep == 1) {
+                self.data[self.data_len] = '\n';
+                self.data_len += 1;
+            }
+            @memcpy(self.data[self.data_len..][0..value.len], value);
+            self.data_len += value.len;
+            self.has_data = true;
+        } else if (std.mem.eql(u8, field, "event")) {
+            const n = @min(value.len, self.name_buf.len);
+            @memcpy(self.name_buf[0..n], value[0..n]);
+            self.name_len = n;
+        }
+        // `id` and `retry` are not used by the OpenAI stream.
+    }
+
+    fn dispatch(self: *Parser, handler: anytype) !void {
+        defer {
+            self.data_len = 0;
+            self.has_data = false;
+            self.name_len = 0;
+        }
+        if (!self.has_data) return;
+        const name = if (self.name_len > 0) self.name_buf[0..self.name_len] else "message";
+        try handler.onEvent(.{ .name = name, .data = self.data[0..self.data_len] });
+    }
+};
+
+// Copies of the events seen, for comparing runs.
+const Recorder = struct {
+    allocator: std.mem.Allocator,
+    names: std.ArrayListUnmanaged([]u8) = .{},
+    datas: std.ArrayListUnmanaged([]u8) = .{},
+
+    fn deinit(self: *Recorder) void {
+        for (self.names.items) |n| self.allocator.free(n);
+        for (self.datas.items) |d| self.allocator.free(d);
+        self.names.deinit(self.allocator);
+        self.datas.deinit(self.allocator);
+    }
+
+    pub fn onEvent(self: *Recorder, event: Event) !void {
+        try self.names.append(self.allocator, try self.allocator.dupe(u8, event.name));
+        try self.datas.append(self.allocator, try self.allocator.dupe(u8, event.data));
+    }
+};
+
+// Recorded chat.completion.chunk stream: a role-only delta, a keep-alive
+// comment, one CRLF-terminated event, escapes, an empty finish delta, [DONE].
+const chat_fixture = @embedFile("testdata/chat_stream.sse");
+
+fn feedSplit(allocator: std.mem.Allocator, input: []const u8, step: usize, rec: *Recorder) !void {
+    var parser = try Parser.init(allocator, Parser.default_max_event_bytes);
+    defer parser.deinit();
+    var i: usize = 0;
+    while (i < input.len) : (i += step) try parser.feed(input[i..@min(input.len, i + step)], rec);
+    try parser.finish(rec);
+}
+
+test "recorded stream yields one event per data block" {
+    const allocator = std.testing.allocator;
+    var rec = Recorder{ .allocator = allocator };
+    defer rec.deinit();
+    try feedSplit(allocator, chat_fixture, chat_fixture.len, &rec);
+
+    try std.testing.expectEqual(@as(usize, 6), rec.datas.items.len);
+    for (rec.names.items) |n| try std.testing.expectEqualStrings("message", n);
+    try std.testing.expectEqualStrings("[DONE]", rec.datas.items[5]);
+    // The CRLF event carries no trailing '\r'.
+    try std.testing.expect(std.mem.endsWith(u8, rec.datas.items[1], "}]}"));
+}
+
+test "events do not depend on how the stream is split" {
+    const allocator = std.testing.allocator;
+    var whole = Recorder{ .allocator = allocator };
+    defer whole.deinit();
+    try feedSplit(allocator, chat_fixture, chat_fixture.len, &whole);
+
+    for ([_]usize{ 1, 2, 3, 7, 64, 509 }) |step| {
+        var split = Recorder{ .allocator = allocator };
+        defer split.deinit();
+        try feedSplit(allocator, chat_fixture, step, &split);
+        try std.testing.expectEqual(whole.datas.items.len, split.datas.items.len);
+        for (whole.datas.items, split.datas.items) |a, b| try std.testing.expectEqualStrings(a, b);
+    }
+}
+
+test "multi-line data, event names and a trailing event at EOF" {
+    const allocator = std.testing.allocator;
+    var rec = Recorder{ .allocator = allocator };
+    defer rec.deinit();
+    try feedSplit(allocator, "event: ping\ndata: a\ndata:b\n\ndata: last", 5, &rec);
+
+    try std.testing.expectEqual(@as(usize, 2), rec.datas.items.len);
+    try std.testing.expectEqualStrings("ping", rec.names.items[0]);
+    try std.testing.expectEqualStrings("a\nb", rec.datas.items[0]);
+    try std.testing.expectEqualStrings("message", rec.names.items[1]);
+    try std.testing.expectEqualStrings("last", rec.datas.items[1]);
+}
+
+test "an event over the limit fails instead of growing" {
+    const allocator = std.testing.allocator;
+    var parser = try Parser.init(allocator, 16);
+    defer parser.deinit();
+    var rec = Recorder{ .allocator = allocator };
+    defer rec.deinit();
+    try std.testing.expectError(error.EventTooLarge, parser.feed("data: 0123456789abcdef\n\n", &rec));
+}
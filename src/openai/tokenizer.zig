@@ -0,0 +1,521 @@
+const std = @import("std");
+const trace = @import("trace");
+
+// Local byte-pair-encoding tokenizer compatible with OpenAI's tiktoken
+// encodings (cl100k_base, o200k_base).
+// - Ranks come from a tiktoken mergeable-ranks file: one
+//   "<base64 token bytes> <rank>" per line. The files are not bundled;
+//   download them next to the app data (e.g. cl100k_base.tiktoken).
+// - Text is split into pieces by the encoding's pre-tokenizer, then each
+//   piece is merged pair by pair, lowest rank first.
+// - The pre-tokenizers below are hand-written versions of the tiktoken
+//   regexes. Character classes are exact for ASCII, Latin-1, Latin
+//   Extended-A, Greek and Cyrillic; in other scripts every code point
+//   that is not a known space, digit, mark or punctuation counts as a
+//   caseless letter, so counts there can drift slightly from tiktoken.
+// - `count` does not allocate for pieces under `max_stack_piece` bytes,
+//   cheap enough to run on every keystroke.
+// Immutable after load; share one instance across threads.
+pub const Encoding = enum {
+    cl100k_base,
+    o200k_base,
+
+    // Encoding used by a chat model id.
+    pub fn forModel(model: []const u8) Encoding {
+        const o200k = [_][]const u8{ "gpt-4o", "gpt-4.1", "gpt-4.5", "gpt-5", "o1", "o3", "o4", "chatgpt-4o" };
+        for (o200k) |prefix| if (std.mem.startsWith(u8, model, prefix)) return .o200k_base;
+        return .cl100k_base;
+    }
+};
+
+pub const Rank = u32;
+
+pub const Tokenizer = struct {
+    allocator: std.mem.Allocator,
+    encoding: Encoding,
+    // Token bytes -> rank; keys point into `bytes`.
+    ranks: std.StringHashMapUnmanaged(Rank) = .{},
+    // Rank -> token bytes (for `decode`); null where the file has a gap.
+    tokens: []?[]const u8 = &.{},
+    bytes: []u8 = &.{},
+
+    // Pieces up to this length are merged in a stack buffer.
+    pub const max_stack_piece = 256;
+
+    // Parses a mergeable-ranks file already in memory.
+    pub fn parse(allocator: std.mem.Allocator, encoding: Encoding, data: []const u8) !Tokenizer {
+        const span = trace.begin("tokenizer/load");
+        defer span.end();
+        var self = Tokenizer{ .allocator = allocator, .encoding = encoding };
+        errdefer self.deinit();
+
+        // Decoded tokens are shorter than their base64 form.
+        self.bytes = try allocator.alloc(u8, data.len);
+        var lines: usize = 0;
+        var max_rank: Rank = 0;
+        var it = std.mem.tokenizeScalar(u8, data, '\n');
+        while (it.next()) |_| lines += 1;
+        try self.ranks.ensureTotalCapacity(allocator, @intCast(lines));
+
+        var used: usize = 0;
+        it.reset();
+        while (it.next()) |raw| {
+            const line = std.mem.trimRight(u8, raw, "\r");
+            if (line.len == 0) continue;
+            const sp = std.mem.indexOfScalar(u8, line, ' ') orelse return error.InvalidRanksFile;
+            const b64 = line[0..sp];
+            const rank = std.fmt.parseInt(Rank, line[sp + 1 ..], 10) catch return error.InvalidRanksFile;
+            const decoder = std.base64.standard.Decoder;
+            const n = decoder.calcSizeForSlice(b64) catch return error.InvalidRanksFile;
+            const token = self.bytes[used..][0..n];
+            decoder.decode(token, b64) catch return error.InvalidRanksFile;
+            used += n;
+            const gop = self.ranks.getOrPutAssumeCapacity(token);
+            if (gop.found_existing) return error.InvalidRanksFile;
+            gop.value_ptr.* = rank;
+            max_rank = @max(max_rank, rank);
+        }
+        // BPE needs every single byte as a token.
+        for (0..256) |b| {
+            const byte = [1]u8{@intCast(b)};
+            if (!self.ranks.contains(&byte)) return error.InvalidRanksFile;
+        }
+
+        self.tokens = try allocator.alloc(?[]const u8, @as(usize, max_rank) + 1);
+        @memset(self.tokens, null);
+        var rit = self.ranks.iterator();
+        while (rit.next()) |e| self.tokens[e.value_ptr.*] = e.key_ptr.*;
+        return self;
+    }
+
+    pub fn loadFile(allocator: std.mem.Allocator, encoding: Encoding, path: []const u8) !Tokenizer {
+        const data = try std.fs.cwd().readFileAlloc(allocator, path, 64 << 20);
+        defer allocator.free(data);
+        return parse(allocator, encoding, data);
+    }
+
+    pub fn deinit(self: *Tokenizer) void {
+        self.ranks.deinit(self.allocator);
+        self.allocator.free(self.tokens);
+        self.allocator.free(self.bytes);
+    }
+
+    // Number of tokens in `text`.
+    pub fn count(self: *const Tokenizer, text: []const u8) usize {
+        var n: usize = 0;
+        var pieces = Pieces{ .text = text, .encoding = self.encoding };
+        while (pieces.next()) |piece| {
+            if (self.ranks.contains(piece)) {
+                n += 1;
+                continue;
+            }
+            n += self.mergePiece(piece, null) catch piece.len;
+        }
+        return n;
+    }
+
+    // Appends the tokens of `text` to `out`.
+    pub fn encode(self: *const Tokenizer, allocator: std.mem.Allocator, text: []const u8, out: *std.ArrayListUnmanaged(Rank)) !void {
+        var pieces = Pieces{ .text = text, .encoding = self.encoding };
+        while (pieces.next()) |piece| {
+            if (self.ranks.get(piece)) |r| {
+                try out.append(allocator, r);
+                continue;
+            }
+            try out.ensureUnusedCapacity(allocator, piece.len);
+            _ = try self.mergePiece(piece, out);
+        }
+    }
+
+    // Appends the bytes of `tokens` to `out`.
+    pub fn decode(self: *const Tokenizer, allocator: std.mem.Allocator, tokens: []const Rank, out: *std.ArrayListUnmanaged(u8)) !void {
+        for (tokens) |t| {
+            const bytes = if (t < self.tokens.len) self.tokens[t] else null;
+            try out.appendSlice(allocator, bytes orelse return error.UnknownToken);
+        }
+    }
+
+    // Byte-pair merge of one piece: repeatedly joins the adjacent pair with
+    // the lowest rank. `starts` holds the token boundaries. Appends the
+    // ranks to `out` (capacity reserved by the caller) and returns the
+    // token count.
+    fn mergePiece(self: *const Tokenizer, piece: []const u8, out: ?*std.ArrayListUnmanaged(Rank)) !usize {
+        var stack: [max_stack_piece + 1]u32 = undefined;
+        const heap = if (piece.len > max_stack_piece) try self.allocator.alloc(u32, piece.len + 1) else null;
+        defer if (heap) |h| self.allocator.free(h);
+        const starts_buf = heap orelse stack[0 .. piece.len + 1];
+        for (starts_buf, 0..) |*s, i| s.* = @intCast(i);
+        var starts = starts_buf;
+
+        while (starts.len > 2) {
+            var best: Rank = std.math.maxInt(Rank);
+            var best_i: usize = 0;
+            for (0..starts.len - 2) |i| {
+                const r = self.ranks.get(piece[starts[i]..starts[i + 2]]) orelse continue;
+                if (r < best) {
+                    best = r;
+                    best_i = i;
+                }
+            }
+            if (best == std.math.maxInt(Rank)) break;
+            // Drop the boundary between the pair.
+            std.mem.copyForwards(u32, starts[best_i + 1 ..], starts[best_i + 2 ..]);
+            starts = starts[0 .. starts.len - 1];
+        }
+
+        const n = starts.len - 1;
+        if (out) |o| {
+            for (0..n) |i| o.appendAssumeCapacity(self.ranks.get(piece[starts[i]..starts[i + 1]]).?);
+        }
+        return n;
+    }
+};
+
+// Splits text into the pieces the encoding's regex would produce.
+// Concatenating the pieces always gives back the input.
+pub const Pieces = struct {
+    text: []const u8,
+    encoding: Encoding,
+    pos: usize = 0,
+
+    pub fn next(self: *Pieces) ?[]const u8 {
+        if (self.pos >= self.text.len) return null;
+        const start = self.pos;
+        const end = switch (self.encoding) {
+            .cl100k_base => self.matchCl100k(start),
+            .o200k_base => self.matchO200k(start),
+        };
+        std.debug.assert(end > start);
+        self.pos = end;
+        return self.text[start..end];
+    }
+
+    // 's|'t|'re|'ve|'m|'ll|'d
+    // | [^\r\n\p{L}\p{N}]?\p{L}+
+    // | \p{N}{1,3}
+    // | ' '?[^\s\p{L}\p{N}]+[\r\n]*
+    // | \s*[\r\n]+ | \s+(?!\S) | \s+
+    fn matchCl100k(self: *const Pieces, p: usize) usize {
+        if (self.contraction(p)) |e| return e;
+        if (self.letters(p, isLetter)) |e| return e;
+        if (self.digits(p)) |e| return e;
+        if (self.punctuation(p, false)) |e| return e;
+        return self.whitespace(p);
+    }
+
+    // [^\r\n\p{L}\p{N}]?[\p{Lu}\p{Lt}\p{Lm}\p{Lo}\p{M}]*[\p{Ll}\p{Lm}\p{Lo}\p{M}]+(contraction)?
+    // | [^\r\n\p{L}\p{N}]?[\p{Lu}\p{Lt}\p{Lm}\p{Lo}\p{M}]+[\p{Ll}\p{Lm}\p{Lo}\p{M}]*(contraction)?
+    // | \p{N}{1,3}
+    // | ' '?[^\s\p{L}\p{N}]+[\r\n/]*
+    // | \s*[\r\n]+ | \s+(?!\S) | \s+
+    fn matchO200k(self: *const Pieces, p: usize) usize {
+        if (self.casedWord(p)) |e| return e;
+        if (self.digits(p)) |e| return e;
+        if (self.punctuation(p, true)) |e| return e;
+        return self.whitespace(p);
+    }
+
+    fn contraction(self: *const Pieces, p: usize) ?usize {
+        const t = self.text;
+        if (p + 1 >= t.len or t[p] != '\'') return null;
+        const a = std.ascii.toLower(t[p + 1]);
+        if (a == 's' or a == 't' or a == 'm' or a == 'd') return p + 2;
+        if (p + 2 >= t.len) return null;
+        const b = std.ascii.toLower(t[p + 2]);
+        if ((a == 'r' and b == 'e') or (a == 'v' and b == 'e') or (a == 'l' and b == 'l')) return p + 3;
+        return null;
+    }
+
+    // Optional prefix (not newline, letter or digit) followed by a run of
+    // `class` characters.
+    fn letters(self: *const Pieces, p: usize, comptime class: fn (Class) bool) ?usize {
+        const first = self.decodeAt(p);
+        var i = p;
+        if (!class(first.class)) {
+            if (!isPrefix(first)) return null;
+            i += first.len;
+        }
+        const run_start = i;
+        while (i < self.text.len) {
+            const cp = self.decodeAt(i);
+            if (!class(cp.class)) break;
+            i += cp.len;
+        }
+        return if (i > run_start) i else null;
+    }
+
+    fn casedWord(self: *const Pieces, p: usize) ?usize {
+        const first = self.decodeAt(p);
+        var i = p;
+        if (!isLetter(first.class)) {
+            if (!isPrefix(first)) return null;
+            i += first.len;
+        }
+        const word_start = i;
+        // Alternative 1: upper* lower+ (greedy, with the one-character
+        // give-back the regex does when the upper run ends in a caseless
+        // letter).
+        const upper_end = self.runEnd(i, isUpperish);
+        const lower_end = self.runEnd(upper_end, isLowerish);
+        var end: ?usize = null;
+        if (lower_end > upper_end) {
+            end = lower_end;
+        } else if (upper_end > word_start) {
+            const last = self.lastCodepointStart(word_start, upper_end);
+            if (isLowerish(self.decodeAt(last).class)) end = upper_end;
+        }
+        // Alternative 2: upper+ lower*.
+        if (end == null and upper_end > word_start) end = lower_end;
+        const e = end orelse return null;
+        return self.contraction(e) orelse e;
+    }
+
+    fn digits(self: *const Pieces, p: usize) ?usize {
+        var i = p;
+        var n: usize = 0;
+        while (n < 3 and i < self.text.len) : (n += 1) {
+            const cp = self.decodeAt(i);
+            if (cp.class != .number) break;
+            i += cp.len;
+        }
+        return if (n > 0) i else null;
+    }
+
+    // ' '?[^\s\p{L}\p{N}]+ then trailing newlines (and '/' for o200k).
+    fn punctuation(self: *const Pieces, p: usize, slash: bool) ?usize {
+        var i = p;
+        if (self.text[i] == ' ') i += 1;
+        const run_start = i;
+        i = self.runEnd(i, isOther);
+        if (i == run_start) return null;
+        while (i < self.text.len) : (i += 1) {
+            const ch = self.text[i];
+            if (!(ch == '\r' or ch == '\n' or (slash and ch == '/'))) break;
+        }
+        return i;
+    }
+
+    // \s*[\r\n]+ | \s+(?!\S) | \s+
+    fn whitespace(self: *const Pieces, p: usize) usize {
+        const end = self.runEnd(p, isSpace);
+        if (end == p) {
+            // Not reachable for well-formed classes; consume one unit so
+            // the splitter always advances.
+            return p + self.decodeAt(p).len;
+        }
+        // Last newline in the run: \s* gives back everything after it.
+        var i = end;
+        while (i > p) : (i -= 1) {
+            const ch = self.text[i - 1];
+            if (ch == '\r' or ch == '\n') return i;
+        }
+        if (end == self.text.len) return end;
+        // Leave the last whitespace character for the next word.
+        const last = self.lastCodepointStart(p, end);
+        return if (last > p) last else end;
+    }
+
+    fn runEnd(self: *const Pieces, start: usize, comptime class: fn (Class) bool) usize {
+        var i = start;
+        while (i < self.text.len) {
+            const cp = self.decodeAt(i);
+            if (!class(cp.class)) break;
+            i += cp.len;
+        }
+        return i;
+    }
+
+    fn lastCodepointStart(self: *const Pieces, lo: usize, end: usize) usize {
+        var i = end - 1;
+        while (i > lo and self.text[i] & 0xc0 == 0x80) i -= 1;
+        return i;
+    }
+
+    fn decodeAt(self: *const Pieces, i: usize) Codepoint {
+        return classify(self.text[i..]);
+    }
+
+    fn isPrefix(cp: Codepoint) bool {
+        return cp.class != .number and cp.class != .newline and !isLetter(cp.class);
+    }
+};
+
+pub const Class = enum { upper, lower, caseless, mark, number, space, newline, other };
+
+fn isLetter(c: Class) bool {
+    return c == .upper or c == .lower or c == .caseless;
+}
+
+// o200k letter classes (marks join words).
+fn isUpperish(c: Class) bool {
+    return c == .upper or c == .caseless or c == .mark;
+}
+
+fn isLowerish(c: Class) bool {
+    return c == .lower or c == .caseless or c == .mark;
+}
+
+fn isSpace(c: Class) bool {
+    return c == .space or c == .newline;
+}
+
+// [^\s\p{L}\p{N}]
+fn isOther(c: Class) bool {
+    return c == .other or c == .mark;
+}
+
+const Codepoint = struct {
+    len: usize,
+    class: Class,
+};
+
+fn classify(s: []const u8) Codepoint {
+    const b = s[0];
+    if (b < 0x80) return .{ .len = 1, .class = asciiClass(b) };
+    const len = std.unicode.utf8ByteSequenceLength(b) catch return .{ .len = 1, .class = .other };
+    if (len > s.len) return .{ .len = 1, .class = .other };
+    const cp = std.unicode.utf8Decode(s[0..len]) catch return .{ .len = 1, .class = .other };
+    return .{ .len = len, .class = unicodeClass(cp) };
+}
+
+fn asciiClass(b: u8) Class {
+    return switch (b) {
+        'A'...'Z' => .upper,
+        'a'...'z' => .lower,
+        '0'...'9' => .number,
+        '\r', '\n' => .newline,
+        ' ', '\t', 0x0b, 0x0c => .space,
+        else => .other,
+    };
+}
+
+fn unicodeClass(cp: u21) Class {
+    return switch (cp) {
+        0x85, 0xa0, 0x1680, 0x2000...0x200a, 0x2028, 0x2029, 0x202f, 0x205f, 0x3000 => .space,
+        0xaa, 0xba => .caseless,
+        0xb5, 0xdf...0xf6, 0xf8...0xff => .lower,
+        0xb2, 0xb3, 0xb9, 0xbc...0xbe => .number,
+        0xa1...0xa9, 0xab...0xb1, 0xb4, 0xb6...0xb8, 0xbb, 0xbf, 0xd7, 0xf7 => .other,
+        0xc0...0xd6, 0xd8...0xde => .upper,
+        // Latin Extended-A: mostly upper/lower pairs.
+        0x100...0x137, 0x14a...0x177 => if (cp % 2 == 0) .upper else .lower,
+        0x139...0x148, 0x179...0x17e => if (cp % 2 == 1) .upper else .lower,
+        0x138, 0x149, 0x17f => .lower,
+        0x178 => .upper,
+        0x300...0x36f, 0x483...0x489, 0x591...0x5bd, 0x610...0x61a, 0x64b...0x65f, 0x900...0x903, 0x93a...0x94f, 0x1ab0...0x1aff, 0x1dc0...0x1dff, 0x20d0...0x20ff, 0xfe00...0xfe0f, 0xfe20...0xfe2f => .mark,
+        0x386, 0x388...0x38f, 0x391...0x3a9 => .upper,
+        0x3ac...0x3ce => .lower,
+        0x400...0x42f => .upper,
+        0x430...0x45f => .lower,
+        0x660...0x669, 0x6f0...0x6f9, 0x966...0x96f, 0x2070...0x2079, 0x2080...0x2089, 0x2150...0x218b, 0x2460...0x249b, 0x3007, 0x3021...0x3029, 0xff10...0xff19 => .number,
+        0x2010...0x2027, 0x2030...0x205e, 0x2190...0x245f, 0x249c...0x2bff, 0x3001...0x3004, 0x3008...0x3020, 0x3030, 0xe000...0xf8ff, 0xfe10...0xfe1f, 0xfe30...0xfe6f, 0xff01...0xff0f, 0xff1a...0xff20, 0xff3b...0xff40, 0xff5b...0xff65, 0x1f000...0x1faff => .other,
+        else => .caseless,
+    };
+}
+
+// Helpers for the tokenizer and conversation tests.
+pub const test_support = struct {
+    // Ranks file holding every single byte (rank = byte value), then
+    // `merges` with ranks 256, 257, ... Caller frees.
+    pub fn ranksFile(allocator: std.mem.Allocator, merges: []const []const u8) ![]u8 {
+        var out: std.ArrayListUnmanaged(u8) = .{};
+        errdefer out.deinit(allocator);
+        const w = out.writer(allocator);
+        var b64: [64]u8 = undefined;
+        for (0..256) |b| {
+            const byte = [1]u8{@intCast(b)};
+            try w.print("{s} {d}\n", .{ std.base64.standard.Encoder.encode(&b64, &byte), b });
+        }
+        for (merges, 256..) |m, rank| {
+            try w.print("{s} {d}\n", .{ std.base64.standard.Encoder.encode(&b64, m), rank });
+        }
+        return out.toOwnedSlice(allocator);
+    }
+};
+
+const test_merges = [_][]const u8{ "th", "he", "the", " t", " the", "in", "ing" };
+
+fn testTokenizer(encoding: Encoding) !Tokenizer {
+    const data = try test_support.ranksFile(std.testing.allocator, &test_merges);
+    defer std.testing.allocator.free(data);
+    return Tokenizer.parse(std.testing.allocator, encoding, data);
+}
+
+fn expectRoundTrip(tok: *const Tokenizer, text: []const u8) ![]Rank {
+    const allocator = std.testing.allocator;
+    var tokens: std.ArrayListUnmanaged(Rank) = .{};
+    errdefer tokens.deinit(allocator);
+    try tok.encode(allocator, text, &tokens);
+    try std.testing.expectEqual(tokens.items.len, tok.count(text));
+    var bytes: std.ArrayListUnmanaged(u8) = .{};
+    defer bytes.deinit(allocator);
+    try tok.decode(allocator, tokens.items, &bytes);
+    try std.testing.expectEqualStrings(text, bytes.items);
+    return tokens.toOwnedSlice(allocator);
+}
+
+test "synthetic ranks encode, decode and count consistently" {
+    var tok = try testTokenizer(.cl100k_base);
+    defer tok.deinit();
+    try std.testing.expectEqual(@as(usize, 256 + test_merges.len), tok.tokens.len);
+
+    // "the" is a token; " thing" merges th, in, ing; " then" merges
+    // th, the, " the" and keeps 'n'.
+    const tokens = try expectRoundTrip(&tok, "the thing then");
+    defer std.testing.allocator.free(tokens);
+    try std.testing.expectEqualSlices(Rank, &.{ 258, ' ', 256, 262, 260, 'n' }, tokens);
+
+    // Pieces longer than `max_stack_piece` merge in a heap buffer.
+    const long = try expectRoundTrip(&tok, "thing" ** 60);
+    defer std.testing.allocator.free(long);
+    try std.testing.expectEqual(@as(usize, 120), long.len);
+    const mixed = try expectRoundTrip(&tok, "na\u{ef}ve \u{41f}\u{440}\u{438}\u{432}\u{435}\u{442}, 12345!\r\n\tthe end\n");
+    defer std.testing.allocator.free(mixed);
+
+    var out: std.ArrayListUnmanaged(u8) = .{};
+    defer out.deinit(std.testing.allocator);
+    try std.testing.expectError(error.UnknownToken, tok.decode(std.testing.allocator, &.{999}, &out));
+}
+
+test "ranks files without every byte or with duplicates are rejected" {
+    const allocator = std.testing.allocator;
+    const data = try test_support.ranksFile(allocator, &.{"th"});
+    defer allocator.free(data);
+
+    // Drop the line of byte 0 ("AA== 0").
+    const eol = std.mem.indexOfScalar(u8, data, '\n').?;
+    try std.testing.expectError(error.InvalidRanksFile, Tokenizer.parse(allocator, .cl100k_base, data[eol + 1 ..]));
+
+    const dup = try std.mem.concat(allocator, u8, &.{ data, "dGg= 999\n" });
+    defer allocator.free(dup);
+    try std.testing.expectError(error.InvalidRanksFile, Tokenizer.parse(allocator, .cl100k_base, dup));
+    try std.testing.expectError(error.InvalidRanksFile, Tokenizer.parse(allocator, .cl100k_base, "not-a-ranks-line\n"));
+}
+
+fn expectPieces(encoding: Encoding, text: []const u8, want: []const []const u8) !void {
+    var pieces = Pieces{ .text = text, .encoding = encoding };
+    for (want) |w| try std.testing.expectEqualStrings(w, pieces.next() orelse return error.TestExpectedMorePieces);
+    try std.testing.expect(pieces.next() == null);
+}
+
+test "cl100k pieces" {
+    // Contractions split off the word before them.
+    try expectPieces(.cl100k_base, "I'm don't we'll", &.{ "I", "'m", " don", "'t", " we", "'ll" });
+    // Digits come in runs of at most three; a space before a digit stands alone.
+    try expectPieces(.cl100k_base, "12345 6", &.{ "123", "45", " ", "6" });
+    // Whitespace runs end at their last newline; otherwise the last space
+    // goes to the next word.
+    try expectPieces(.cl100k_base, "a  \n\nb", &.{ "a", "  \n\n", "b" });
+    try expectPieces(.cl100k_base, "a   b", &.{ "a", "  ", " b" });
+    try expectPieces(.cl100k_base, "end.\n", &.{ "end", ".\n" });
+    // Multi-byte letters stay in their word.
+    try expectPieces(.cl100k_base, "na\u{ef}ve \u{41f}\u{440}\u{438}\u{432}\u{435}\u{442}", &.{ "na\u{ef}ve", " \u{41f}\u{440}\u{438}\u{432}\u{435}\u{442}" });
+}
+
+test "o200k pieces" {
+    // Words split at case changes and keep their contraction.
+    try expectPieces(.o200k_base, "HelloWorld I'm", &.{ "Hello", "World", " I'm" });
+    try expectPieces(.o200k_base, "2024/05", &.{ "202", "4", "/", "05" });
+    try expectPieces(.o200k_base, "x  \n y", &.{ "x", "  \n", " y" });
+    try expectPieces(.o200k_base, "\u{c9}cole na\u{ef}ve", &.{ "\u{c9}cole", " na\u{ef}ve" });
+}
@@ -0,0 +1,1030 @@
+const std = @import("std");
+const builtin = @import("builtin");
+const trace = @import("trace");
+
+const posix = std.posix;
+const linux = std.os.linux;
+
+// Event-driven HTTP/1.1 client: many requests in flight on one thread.
+// - Non-blocking sockets driven by epoll, or by io_uring poll requests
+//   (`Backend.io_uring`; falls back to epoll where the kernel or a seccomp
+//   policy refuses io_uring).
+// - `submit` queues a request and returns at once; the callback runs on the
+//   thread that calls `poll` / `run` when the response is complete.
+//   `Future` wraps a callback for callers that want to wait on one result.
+// - Connections are kept alive and reused per host:port; at most
+//   `max_connections_per_host` are open, further requests wait their turn.
+// - Plain http:// only: std's TLS client needs a blocking stream. Point it
+//   at a local server, a mock, or a TLS-terminating proxy; https:// fails
+//   with error.UnsupportedUriScheme. Host names are resolved once per
+//   host (blocking) and cached.
+// Linux only (`supported`). Not thread-safe; one loop per thread.
+pub const supported = builtin.os.tag == .linux;
+
+pub const Backend = enum { epoll, io_uring };
+
+pub const Options = struct {
+    backend: Backend = .epoll,
+    max_connections_per_host: u32 = 256,
+    // Idle keep-alive connections kept per host:port.
+    max_idle_per_host: u32 = 64,
+    // From submit to the last body byte.
+    timeout_ms: u32 = 60_000,
+    max_response_bytes: usize = 64 << 20,
+};
+
+pub const Method = enum { GET, POST };
+
+pub const Request = struct {
+    method: Method = .GET,
+    url: []const u8,
+    // Extra header lines, each ending in "\r\n" (e.g. Authorization).
+    headers: []const u8 = "",
+    // Sent with Content-Type `content_type` when not empty.
+    body: []const u8 = "",
+    content_type: []const u8 = "application/json",
+};
+
+// `body` is allocated with the loop's allocator and owned by the callback.
+pub const Response = struct {
+    status: u16,
+    body: []u8,
+    reused_connection: bool,
+
+    pub fn deinit(self: *Response, allocator: std.mem.Allocator) void {
+        allocator.free(self.body);
+        self.* = undefined;
+    }
+};
+
+// Runs once per request, on the polling thread.
+pub const Callback = struct {
+    ctx: ?*anyopaque = null,
+    onDone: *const fn (ctx: ?*anyopaque, result: anyerror!Response) void,
+};
+
+// One pending result. Keep it alive (and in place) until it completes.
+pub const Future = struct {
+    result: ?(anyerror!Response) = null,
+
+    pub fn callback(self: *Future) Callback {
+        return .{ .ctx = self, .onDone = done };
+    }
+
+    pub fn isDone(self: *const Future) bool {
+        return self.result != null;
+    }
+
+    // Drives `loop` until this request completes (other requests progress
+    // meanwhile).
+    pub fn wait(self: *Future, loop: *Loop) anyerror!Response {
+        while (self.result == null) try loop.poll(null);
+        return self.result.?;
+    }
+
+    fn done(ctx: ?*anyopaque, result: anyerror!Response) void {
+        const self: *Future = @ptrCast(@alignCast(ctx.?));
+        self.result = result;
+    }
+};
+
+pub const Stats = struct {
+    requests: u64 = 0,
+    connections_new: u64 = 0,
+    connections_reused: u64 = 0,
+    // Requests resent because a reused keep-alive connection turned out to
+    // be closed by the server.
+    stale_retries: u64 = 0,
+    timeouts: u64 = 0,
+    // Most requests in flight at once (queued included).
+    max_in_flight: usize = 0,
+};
+
+pub const Loop = struct {
+    allocator: std.mem.Allocator,
+    options: Options,
+    poller: Poller,
+    hosts: std.StringHashMapUnmanaged(*Host) = .{},
+    // Open connections by id; poll events carry the id, so an event for a
+    // connection that was closed meanwhile is dropped.
+    conns: std.AutoHashMapUnmanaged(u64, *Conn) = .{},
+    next_id: u64 = 1,
+    in_flight: usize = 0,
+    counters: Stats = .{},
+
+    pub fn init(allocator: std.mem.Allocator, options: Options) !Loop {
+        if (!supported) return error.Unsupported;
+        return .{ .allocator = allocator, .options = options, .poller = try Poller.init(options.backend) };
+    }
+
+    // Fails queued and in-flight requests with error.Canceled; their
+    // callbacks must not submit.
+    pub fn deinit(self: *Loop) void {
+        var it = self.conns.valueIterator();
+        while (it.next()) |conn| {
+            if (conn.*.job) |job| self.finish(job, error.Canceled);
+            conn.*.job = null;
+        }
+        var hit = self.hosts.valueIterator();
+        while (hit.next()) |host| {
+            while (host.*.popQueued()) |job| self.finish(job, error.Canceled);
+        }
+        // Conns close without touching the host lists (freed right after).
+        it = self.conns.valueIterator();
+        while (it.next()) |conn| conn.*.destroy(self);
+        self.conns.deinit(self.allocator);
+        hit = self.hosts.valueIterator();
+        while (hit.next()) |host| host.*.destroy(self.allocator);
+        self.hosts.deinit(self.allocator);
+        self.poller.deinit();
+    }
+
+    // Requests submitted and not yet completed.
+    pub fn pending(self: *const Loop) usize {
+        return self.in_flight;
+    }
+
+    pub fn stats(self: *const Loop) Stats {
+        return self.counters;
+    }
+
+    // Queues `request` (copied) and returns; `callback` runs from `poll`.
+    // Errors here mean the request was not queued and the callback will
+    // not run.
+    pub fn submit(self: *Loop, request: Request, callback: Callback) !void {
+        const uri = std.Uri.parse(request.url) catch return error.InvalidUrl;
+        if (!std.ascii.eqlIgnoreCase(uri.scheme, "http")) return error.UnsupportedUriScheme;
+        const host_name = component(uri.host orelse return error.InvalidUrl);
+        const port = uri.port orelse 80;
+        const host = try self.hostFor(host_name, port);
+
+        const job = try self.allocator.create(Job);
+        errdefer self.allocator.destroy(job);
+        job.* = .{
+            .host = host,
+            .wire = try buildRequest(self.allocator, request, uri, host_name, port),
+            .callback = callback,
+            .deadline_ns = nowNs() + @as(u64, self.options.timeout_ms) * std.time.ns_per_ms,
+            .start_ns = if (trace.isEnabled()) trace.now() else null,
+        };
+        self.counters.requests += 1;
+        self.in_flight += 1;
+        self.counters.max_in_flight = @max(self.counters.max_in_flight, self.in_flight);
+        host.pushQueued(job);
+        self.dispatch(host);
+    }
+
+    // Runs until every submitted request has completed.
+    pub fn run(self: *Loop) !void {
+        while (self.in_flight > 0) try self.poll(null);
+    }
+
+    // Waits up to `timeout_ms` (null: until the next event or deadline) and
+    // handles whatever became ready, running completed callbacks.
+    pub fn poll(self: *Loop, timeout_ms: ?u32) !void {
+        var events: [256]Poller.Event = undefined;
+        const wait_ms = self.waitTimeout(timeout_ms);
+        const n = try self.poller.wait(&events, wait_ms);
+        for (events[0..n]) |ev| {
+            const conn = self.conns.get(ev.id) orelse continue;
+            self.poller.fired(&conn.armed, ev.polled);
+            self.handle(conn, ev.mask);
+        }
+        self.expire();
+        try self.poller.flush();
+    }
+
+    fn waitTimeout(self: *const Loop, timeout_ms: ?u32) i32 {
+        var ms: u64 = timeout_ms orelse std.math.maxInt(i32);
+        if (self.in_flight == 0 and timeout_ms == null) return 0;
+        const t = nowNs();
+        var it = self.conns.valueIterator();
+        while (it.next()) |conn| {
+            const job = conn.*.job orelse continue;
+            const left = job.deadline_ns -| t;
+            ms = @min(ms, left / std.time.ns_per_ms + 1);
+        }
+        return @intCast(@min(ms, std.math.maxInt(i32)));
+    }
+
+    fn hostFor(self: *Loop, name: []const u8, port: u16) !*Host {
+        var key_buf: [300]u8 = undefined;
+        const key = std.fmt.bufPrint(&key_buf, "{s}:{d}", .{ name, port }) catch return error.InvalidUrl;
+        if (self.hosts.get(key)) |h| return h;
+        const host = try Host.create(self.allocator, name, port, key);
+        errdefer host.destroy(self.allocator);
+        try self.hosts.put(self.allocator, host.key, host);
+        return host;
+    }
+
+    // Hands queued requests of `host` to idle connections, then opens new
+    // ones up to the per-host limit.
+    fn dispatch(self: *Loop, host: *Host) void {
+        while (host.queue_head != null) {
+            if (host.idle.pop()) |conn| {
+                self.counters.connections_reused += 1;
+                conn.reused = true;
+                self.start(conn, host.popQueued().?);
+                continue;
+            }
+            if (host.open >= self.options.max_connections_per_host) return;
+            const job = host.popQueued().?;
+            const conn = self.connect(host) catch |e| {
+                self.finish(job, e);
+                continue;
+            };
+            self.start(conn, job);
+        }
+    }
+
+    fn connect(self: *Loop, host: *Host) !*Conn {
+        const addr = try host.address(self.allocator);
+        const fd = try posix.socket(addr.any.family, posix.SOCK.STREAM | posix.SOCK.NONBLOCK | posix.SOCK.CLOEXEC, posix.IPPROTO.TCP);
+        errdefer posix.close(fd);
+        // Requests are written in one go; do not wait for more.
+        posix.setsockopt(fd, posix.IPPROTO.TCP, posix.TCP.NODELAY, &std.mem.toBytes(@as(c_int, 1))) catch {};
+        var connecting = false;
+        posix.connect(fd, &addr.any, addr.getOsSockLen()) catch |e| switch (e) {
+            error.WouldBlock => connecting = true,
+            else => return e,
+        };
+
+        const conn = try self.allocator.create(Conn);
+        errdefer self.allocator.destroy(conn);
+        conn.* = .{ .id = self.next_id, .fd = fd, .host = host, .state = if (connecting) .connecting else .sending };
+        self.next_id += 1;
+        try self.conns.put(self.allocator, conn.id, conn);
+        errdefer _ = self.conns.remove(conn.id);
+        try self.poller.add(fd, conn.id);
+        host.open += 1;
+        self.counters.connections_new += 1;
+        return conn;
+    }
+
+    fn start(self: *Loop, conn: *Conn, job: *Job) void {
+        if (nowNs() >= job.deadline_ns) {
+            self.counters.timeouts += 1;
+            self.release(conn, conn.state != .idle);
+            self.finish(job, error.Timeout);
+            return;
+        }
+        conn.job = job;
+        conn.sent = 0;
+        conn.parser = Parser.init(self.options.max_response_bytes);
+        if (conn.state != .connecting) {
+            conn.state = .sending;
+            // Usually writable right away; saves a poll round trip.
+            self.handle(conn, 0);
+        } else {
+            self.want(conn, linux.POLL.OUT);
+        }
+    }
+
+    fn handle(self: *Loop, conn: *Conn, mask: u32) void {
+        self.step(conn, mask) catch |e| self.fail(conn, e);
+    }
+
+    fn step(self: *Loop, conn: *Conn, mask: u32) !void {
+        switch (conn.state) {
+            .idle => {
+                // The server closed (or wrote to) a connection we were not
+                // using; it cannot be reused.
+                if (mask != 0) self.release(conn, true);
+                return;
+            },
+            .connecting => {
+                if (mask == 0) return;
+                try posix.getsockoptError(conn.fd);
+                conn.state = .sending;
+            },
+            .sending, .receiving => {},
+        }
+        if (conn.state == .sending) {
+            const wire = conn.job.?.wire;
+            while (conn.sent < wire.len) {
+                const n = posix.send(conn.fd, wire[conn.sent..], posix.MSG.NOSIGNAL) catch |e| switch (e) {
+                    error.WouldBlock => return self.want(conn, linux.POLL.OUT),
+                    else => return e,
+                };
+                conn.sent += n;
+            }
+            conn.state = .receiving;
+        }
+        var buf: [16 * 1024]u8 = undefined;
+        while (true) {
+            const n = posix.recv(conn.fd, &buf, 0) catch |e| switch (e) {
+                error.WouldBlock => return self.want(conn, linux.POLL.IN),
+                else => return e,
+            };
+            if (n == 0) {
+                try conn.parser.finish();
+                break;
+            }
+            conn.got_bytes = true;
+            try conn.parser.feed(self.allocator, buf[0..n]);
+            if (conn.parser.done) break;
+        }
+        self.complete(conn);
+    }
+
+    fn want(self: *Loop, conn: *Conn, mask: u32) void {
+        self.poller.want(conn.fd, conn.id, &conn.armed, mask) catch |e| self.fail(conn, e);
+    }
+
+    fn complete(self: *Loop, conn: *Conn) void {
+        const job = conn.job.?;
+        conn.job = null;
+        var parser = conn.parser;
+        conn.parser = Parser.init(0);
+        defer parser.deinit(self.allocator);
+        const host = conn.host;
+        const reused = conn.reused;
+        // Back in the pool before the callback runs, so a request it
+        // submits can take the connection.
+        self.release(conn, !parser.keep_alive);
+        if (parser.body.toOwnedSlice(self.allocator)) |body| {
+            self.finish(job, Response{ .status = parser.status, .body = body, .reused_connection = reused });
+        } else |e| {
+            self.finish(job, e);
+        }
+        self.dispatch(host);
+    }
+
+    fn fail(self: *Loop, conn: *Conn, err: anyerror) void {
+        const host = conn.host;
+        const job = conn.job;
+        conn.job = null;
+        // A kept-alive connection the server dropped before answering:
+        // send again on a fresh one.
+        const retry = conn.reused and !conn.got_bytes and isStale(err);
+        self.release(conn, true);
+        if (job) |j| {
+            if (retry and !j.retried) {
+                j.retried = true;
+                self.counters.stale_retries += 1;
+                host.pushFront(j);
+            } else {
+                self.finish(j, err);
+            }
+        }
+        self.dispatch(host);
+    }
+
+    // Returns a connection to the idle list, or closes it.
+    fn release(self: *Loop, conn: *Conn, close: bool) void {
+        const host = conn.host;
+        if (conn.state == .idle) {
+            if (std.mem.indexOfScalar(*Conn, host.idle.items, conn)) |i| _ = host.idle.swapRemove(i);
+        }
+        if (!close and host.idle.items.len < self.options.max_idle_per_host) {
+            if (host.idle.append(self.allocator, conn)) |_| {
+                conn.state = .idle;
+                conn.reused = false;
+                conn.got_bytes = false;
+                self.want(conn, linux.POLL.IN);
+                return;
+            } else |_| {}
+        }
+        host.open -= 1;
+        _ = self.conns.remove(conn.id);
+        conn.destroy(self);
+    }
+
+    fn finish(self: *Loop, job: *Job, result: anyerror!Response) void {
+        if (job.start_ns) |t0| trace.record("evhttp/request", t0, trace.now() -| t0);
+        self.in_flight -= 1;
+        const callback = job.callback;
+        // The request head usually carries the API key.
+        std.crypto.secureZero(u8, job.wire);
+        self.allocator.free(job.wire);
+        self.allocator.destroy(job);
+        callback.onDone(callback.ctx, result);
+    }
+
+    // Fails requests past their deadline.
+    fn expire(self: *Loop) void {
+        const t = nowNs();
+        var late: std.ArrayListUnmanaged(u64) = .{};
+        defer late.deinit(self.allocator);
+        var it = self.conns.valueIterator();
+        while (it.next()) |conn| {
+            const job = conn.*.job orelse continue;
+            if (t >= job.deadline_ns) late.append(self.allocator, conn.*.id) catch break;
+        }
+        // Callbacks may open and close connections; look each one up again.
+        for (late.items) |id| {
+            const conn = self.conns.get(id) orelse continue;
+            if (conn.job == null) continue;
+            self.counters.timeouts += 1;
+            self.fail(conn, error.Timeout);
+        }
+    }
+
+    fn isStale(err: anyerror) bool {
+        return switch (err) {
+            error.ConnectionResetByPeer, error.BrokenPipe, error.EndOfStream => true,
+            else => false,
+        };
+    }
+};
+
+const Host = struct {
+    key: []u8,
+    name: []u8,
+    port: u16,
+    addr: ?std.net.Address = null,
+    open: u32 = 0,
+    idle: std.ArrayListUnmanaged(*Conn) = .{},
+    queue_head: ?*Job = null,
+    queue_tail: ?*Job = null,
+
+    fn create(allocator: std.mem.Allocator, name: []const u8, port: u16, key: []const u8) !*Host {
+        const host = try allocator.create(Host);
+        errdefer allocator.destroy(host);
+        const k = try allocator.dupe(u8, key);
+        errdefer allocator.free(k);
+        host.* = .{ .key = k, .name = try allocator.dupe(u8, name), .port = port };
+        return host;
+    }
+
+    fn destroy(self: *Host, allocator: std.mem.Allocator) void {
+        self.idle.deinit(allocator);
+        allocator.free(self.name);
+        allocator.free(self.key);
+        allocator.destroy(self);
+    }
+
+    fn address(self: *Host, allocator: std.mem.Allocator) !std.net.Address {
+        if (self.addr) |a| return a;
+        const list = try std.net.getAddressList(allocator, self.name, self.port);
+        defer list.deinit();
+        if (list.addrs.len == 0) return error.UnknownHostName;
+        self.addr = list.addrs[0];
+        return list.addrs[0];
+    }
+
+    fn pushQueued(self: *Host, job: *Job) void {
+        job.next = null;
+        if (self.queue_tail) |t| t.next = job else self.queue_head = job;
+        self.queue_tail = job;
+    }
+
+    fn pushFront(self: *Host, job: *Job) void {
+        job.next = self.queue_head;
+        self.queue_head = job;
+        if (self.queue_tail == null) self.queue_tail = job;
+    }
+
+    fn popQueued(self: *Host) ?*Job {
+        const job = self.queue_head orelse return null;
+        self.queue_head = job.next;
+        if (self.queue_head == null) self.queue_tail = null;
+        return job;
+    }
+};
+
+const Job = struct {
+    host: *Host,
+    // Serialized request (head + body).
+    wire: []u8,
+    callback: Callback,
+    deadline_ns: u64,
+    start_ns: ?u64,
+    retried: bool = false,
+    next: ?*Job = null,
+};
+
+const Conn = struct {
+    id: u64,
+    fd: posix.socket_t,
+    host: *Host,
+    state: State,
+    job: ?*Job = null,
+    sent: usize = 0,
+    parser: Parser = Parser.init(0),
+    reused: bool = false,
+    // Response bytes arrived for the current request.
+    got_bytes: bool = false,
+    // Poll events currently requested (io_uring: outstanding polls).
+    armed: u32 = 0,
+
+    const State = enum { connecting, sending, receiving, idle };
+
+    fn destroy(self: *Conn, loop: *Loop) void {
+        loop.poller.remove(self.fd);
+        // Completes any io_uring poll still holding the socket.
+        posix.shutdown(self.fd, .both) catch {};
+        posix.close(self.fd);
+        self.parser.deinit(loop.allocator);
+        loop.allocator.destroy(self);
+    }
+};
+
+fn buildRequest(allocator: std.mem.Allocator, request: Request, uri: std.Uri, host: []const u8, port: u16) ![]u8 {
+    var out: std.ArrayListUnmanaged(u8) = .{};
+    errdefer out.deinit(allocator);
+    const w = out.writer(allocator);
+    const path = if (uri.path.isEmpty()) "/" else component(uri.path);
+    try w.print("{s} {s}", .{ @tagName(request.method), path });
+    if (uri.query) |q| try w.print("?{s}", .{component(q)});
+    try w.print(" HTTP/1.1\r\nHost: {s}", .{host});
+    if (port != 80) try w.print(":{d}", .{port});
+    try w.print("\r\n{s}", .{request.headers});
+    if (request.method == .POST or request.body.len > 0) {
+        try w.print("Content-Type: {s}\r\nContent-Length: {d}\r\n", .{ request.content_type, request.body.len });
+    }
+    try out.appendSlice(allocator, "\r\n");
+    try out.appendSlice(allocator, request.body);
+    return out.toOwnedSlice(allocator);
+}
+
+fn component(c: std.Uri.Component) []const u8 {
+    return switch (c) {
+        inline else => |s| s,
+    };
+}
+
+fn nowNs() u64 {
+    const ts = posix.clock_gettime(.MONOTONIC) catch return 0;
+    return @as(u64, @intCast(ts.sec)) * std.time.ns_per_s + @as(u64, @intCast(ts.nsec));
+}
+
+// Incremental HTTP/1.1 response parser: head, then a Content-Length,
+// chunked or read-until-close body.
+pub const Parser = struct {
+    head: std.ArrayListUnmanaged(u8) = .{},
+    head_done: bool = false,
+    status: u16 = 0,
+    framing: Framing = .until_close,
+    remaining: u64 = 0,
+    keep_alive: bool = true,
+    body: std.ArrayListUnmanaged(u8) = .{},
+    chunk: ChunkState = .size,
+    // Hex digits of the current chunk size line / bytes of a trailer line.
+    line_len: usize = 0,
+    max_body: usize,
+    done: bool = false,
+
+    const max_head = 64 * 1024;
+
+    const Framing = enum { length, chunked, until_close };
+    const ChunkState = enum { size, size_ext, data, data_end, trailer };
+
+    pub fn init(max_body: usize) Parser {
+        return .{ .max_body = max_body };
+    }
+
+    pub fn deinit(self: *Parser, allocator: std.mem.Allocator) void {
+        self.head.deinit(allocator);
+        self.body.deinit(allocator);
+    }
+
+    // Bytes after the end of the response are ignored (no pipelining).
+    pub fn feed(self: *Parser, allocator: std.mem.Allocator, bytes: []const u8) !void {
+        if (self.done) return;
+        var rest = bytes;
+        if (!self.head_done) {
+            const from = self.head.items.len -| 3;
+            try self.head.appendSlice(allocator, bytes);
+            const end = std.mem.indexOfPos(u8, self.head.items, from, "\r\n\r\n") orelse {
+                if (self.head.items.len > max_head) return error.HttpHeadersOversize;
+                return;
+            };
+            try self.parseHead(self.head.items[0..end]);
+            rest = bytes[bytes.len - (self.head.items.len - end - 4) ..];
+            self.head.clearAndFree(allocator);
+            if (self.done) return;
+        }
+        switch (self.framing) {
+            .length => {
+                const n: usize = @intCast(@min(self.remaining, rest.len));
+                try self.appendBody(allocator, rest[0..n]);
+                self.remaining -= n;
+                if (self.remaining == 0) self.done = true;
+            },
+            .until_close => try self.appendBody(allocator, rest),
+            .chunked => try self.feedChunked(allocator, rest),
+        }
+    }
+
+    // The connection reached EOF.
+    pub fn finish(self: *Parser) !void {
+        if (self.done) return;
+        if (self.head_done and self.framing == .until_close) {
+            self.done = true;
+            self.keep_alive = false;
+            return;
+        }
+        return error.EndOfStream;
+    }
+
+    fn parseHead(self: *Parser, head: []const u8) !void {
+        self.head_done = true;
+        var lines = std.mem.splitSequence(u8, head, "\r\n");
+        const status_line = lines.first();
+        if (status_line.len < 12 or !std.mem.startsWith(u8, status_line, "HTTP/1.")) return error.HttpHeadersInvalid;
+        self.keep_alive = status_line[7] == '1';
+        self.status = std.fmt.parseInt(u16, status_line[9..12], 10) catch return error.HttpHeadersInvalid;
+        var length: ?u64 = null;
+        var chunked = false;
+        while (lines.next()) |line| {
+            const colon = std.mem.indexOfScalar(u8, line, ':') orelse continue;
+            const name = line[0..colon];
+            const value = std.mem.trim(u8, line[colon + 1 ..], " \t");
+            if (std.ascii.eqlIgnoreCase(name, "content-length")) {
+                length = std.fmt.parseInt(u64, value, 10) catch return error.HttpHeadersInvalid;
+            } else if (std.ascii.eqlIgnoreCase(name, "transfer-encoding")) {
+                chunked = std.ascii.endsWithIgnoreCase(value, "chunked");
+            } else if (std.ascii.eqlIgnoreCase(name, "connection")) {
+                if (std.ascii.eqlIgnoreCase(value, "close")) self.keep_alive = false;
+                if (std.ascii.eqlIgnoreCase(value, "keep-alive")) self.keep_alive = true;
+            }
+        }
+        if (self.status == 204 or self.status == 304 or self.status / 100 == 1) {
+            self.done = true;
+        } else if (chunked) {
+            self.framing = .chunked;
+        } else if (length) |n| {
+            if (n > self.max_body) return error.ResponseTooLarge;
+            self.framing = .length;
+            self.remaining = n;
+            self.done = n == 0;
+        } else {
+            self.framing = .until_close;
+            self.keep_alive = false;
+        }
+    }
+
+    fn feedChunked(self: *Parser, allocator: std.mem.Allocator, bytes: []const u8) !void {
+        var i: usize = 0;
+        while (i < bytes.len and !self.done) {
+            const ch = bytes[i];
+            switch (self.chunk) {
+                .size => {
+                    i += 1;
+                    if (std.fmt.charToDigit(ch, 16)) |d| {
+                        if (self.remaining > std.math.maxInt(u64) >> 4) return error.InvalidChunk;
+                        self.remaining = self.remaining * 16 + d;
+                        self.line_len += 1;
+                    } else |_| switch (ch) {
+                        ';', ' ', '\t', '\r' => self.chunk = .size_ext,
+                        '\n' => try self.endSizeLine(),
+                        else => return error.InvalidChunk,
+                    }
+                },
+                .size_ext => {
+                    i += 1;
+                    if (ch == '\n') try self.endSizeLine();
+                },
+                .data => {
+                    const n: usize = @intCast(@min(self.remaining, bytes.len - i));
+                    try self.appendBody(allocator, bytes[i..][0..n]);
+                    i += n;
+                    self.remaining -= n;
+                    if (self.remaining == 0) self.chunk = .data_end;
+                },
+                .data_end => {
+                    i += 1;
+                    if (ch == '\n') self.chunk = .size;
+                },
+                .trailer => {
+                    i += 1;
+                    if (ch == '\n') {
+                        if (self.line_len == 0) self.done = true;
+                        self.line_len = 0;
+                    } else if (ch != '\r') {
+                        self.line_len += 1;
+                    }
+                },
+            }
+        }
+    }
+
+    fn endSizeLine(self: *Parser) !void {
+        if (self.line_len == 0) return error.InvalidChunk;
+        self.line_len = 0;
+        self.chunk = if (self.remaining == 0) .trailer else .data;
+    }
+
+    fn appendBody(self: *Parser, allocator: std.mem.Allocator, bytes: []const u8) !void {
+        if (self.body.items.len + bytes.len > self.max_body) return error.ResponseTooLarge;
+        if (self.framing == .length and self.body.capacity == 0) {
+            try self.body.ensureTotalCapacityPrecise(allocator, @intCast(self.remaining));
+        }
+        try self.body.appendSlice(allocator, bytes);
+    }
+};
+
+// Readiness notification: epoll, or one-shot io_uring poll requests
+// re-armed after each completion.
+const Poller = union(Backend) {
+    epoll: posix.fd_t,
+    io_uring: IoUringPoller,
+
+    const Event = struct {
+        id: u64,
+        // Events that occurred.
+        mask: u32,
+        // Events of the io_uring poll that completed.
+        polled: u32 = 0,
+    };
+
+    const IoUringPoller = struct {
+        ring: linux.IoUring,
+        timeout: linux.kernel_timespec = .{ .sec = 0, .nsec = 0 },
+    };
+
+    // user_data of io_uring timeouts; connection ids never get this high.
+    const timeout_tag = std.math.maxInt(u64);
+    const mask_bits = 8;
+
+    fn init(backend: Backend) !Poller {
+        if (backend == .io_uring) {
+            if (linux.IoUring.init(256, 0)) |ring| {
+                return .{ .io_uring = .{ .ring = ring } };
+            } else |_| {}
+        }
+        return .{ .epoll = try posix.epoll_create1(linux.EPOLL.CLOEXEC) };
+    }
+
+    fn deinit(self: *Poller) void {
+        switch (self.*) {
+            .epoll => |fd| posix.close(fd),
+            .io_uring => |*u| u.ring.deinit(),
+        }
+    }
+
+    fn add(self: *Poller, fd: posix.fd_t, id: u64) !void {
+        switch (self.*) {
+            .epoll => |ep| {
+                var ev = linux.epoll_event{ .events = 0, .data = .{ .u64 = id } };
+                try posix.epoll_ctl(ep, linux.EPOLL.CTL_ADD, fd, &ev);
+            },
+            .io_uring => {},
+        }
+    }
+
+    fn remove(self: *Poller, fd: posix.fd_t) void {
+        switch (self.*) {
+            .epoll => |ep| posix.epoll_ctl(ep, linux.EPOLL.CTL_DEL, fd, null) catch {},
+            .io_uring => {},
+        }
+    }
+
+    // Requests `mask` events for the connection. Epoll interest is
+    // replaced; io_uring gets a new poll unless one is already pending for
+    // those events.
+    fn want(self: *Poller, fd: posix.fd_t, id: u64, armed: *u32, mask: u32) !void {
+        switch (self.*) {
+            .epoll => |ep| {
+                if (armed.* == mask) return;
+                var ev = linux.epoll_event{ .events = mask, .data = .{ .u64 = id } };
+                try posix.epoll_ctl(ep, linux.EPOLL.CTL_MOD, fd, &ev);
+                armed.* = mask;
+            },
+            .io_uring => |*u| {
+                if (armed.* & mask == mask) return;
+                const sqe = u.ring.poll_add((id << mask_bits) | mask, fd, mask) catch blk: {
+                    _ = try u.ring.submit();
+                    break :blk try u.ring.poll_add((id << mask_bits) | mask, fd, mask);
+                };
+                _ = sqe;
+                armed.* |= mask;
+            },
+        }
+    }
+
+    // A poll for `polled` completed (io_uring polls are one-shot).
+    fn fired(self: *Poller, armed: *u32, polled: u32) void {
+        switch (self.*) {
+            .epoll => {},
+            .io_uring => armed.* &= ~polled,
+        }
+    }
+
+    fn wait(self: *Poller, out: []Event, timeout_ms: i32) !usize {
+        switch (self.*) {
+            .epoll => |ep| {
+                var evs: [256]linux.epoll_event = undefined;
+                const n = posix.epoll_wait(ep, evs[0..@min(out.len, evs.len)], timeout_ms);
+                for (evs[0..n], out[0..n]) |e, *o| o.* = .{ .id = e.data.u64, .mask = e.events };
+                return n;
+            },
+            .io_uring => |*u| {
+                // Ends the wait after `timeout_ms` unless another
+                // completion arrives first (count = 1).
+                u.timeout = .{ .sec = @divTrunc(timeout_ms, 1000), .nsec = @as(i64, @rem(timeout_ms, 1000)) * std.time.ns_per_ms };
+                _ = u.ring.timeout(timeout_tag, &u.timeout, 1, 0) catch blk: {
+                    _ = try u.ring.submit();
+                    break :blk try u.ring.timeout(timeout_tag, &u.timeout, 1, 0);
+                };
+                _ = u.ring.submit_and_wait(1) catch |e| switch (e) {
+                    error.SignalInterrupt => 0,
+                    else => return e,
+                };
+                var cqes: [256]linux.io_uring_cqe = undefined;
+                const n = try u.ring.copy_cqes(cqes[0..@min(out.len, cqes.len)], 0);
+                var k: usize = 0;
+                for (cqes[0..n]) |cqe| {
+                    if (cqe.user_data == timeout_tag) continue;
+                    const mask: u32 = if (cqe.res < 0) linux.POLL.ERR else @intCast(cqe.res);
+                    const polled: u32 = @intCast(cqe.user_data & ((1 << mask_bits) - 1));
+                    out[k] = .{ .id = cqe.user_data >> mask_bits, .mask = mask, .polled = polled };
+                    k += 1;
+                }
+                return k;
+            },
+        }
+    }
+
+    // Submits polls queued while handling events.
+    fn flush(self: *Poller) !void {
+        switch (self.*) {
+            .epoll => {},
+            .io_uring => |*u| _ = try u.ring.submit(),
+        }
+    }
+};
+
+// Feeds `response` in pieces of `step` bytes (bytes after the end
+// included) and returns the parser.
+fn parseInSteps(response: []const u8, step: usize, max_body: usize) !Parser {
+    const allocator = std.testing.allocator;
+    var p = Parser.init(max_body);
+    errdefer p.deinit(allocator);
+    var i: usize = 0;
+    while (i < response.len) : (i += step) {
+        try p.feed(allocator, response[i..@min(i + step, response.len)]);
+    }
+    return p;
+}
+
+// Parses `response` byte by byte, in odd-sized pieces and at once, and
+// expects the same result each time.
+fn expectParsed(response: []const u8, status: u16, body: []const u8, keep_alive: bool, done: bool) !void {
+    for ([_]usize{ 1, 2, 7, response.len }) |step| {
+        var p = try parseInSteps(response, step, 1 << 20);
+        defer p.deinit(std.testing.allocator);
+        try std.testing.expect(p.head_done);
+        try std.testing.expectEqual(status, p.status);
+        try std.testing.expectEqualStrings(body, p.body.items);
+        try std.testing.expectEqual(keep_alive, p.keep_alive);
+        try std.testing.expectEqual(done, p.done);
+    }
+}
+
+test "parser: content-length body, head split across reads" {
+    try expectParsed("HTTP/1.1 200 OK\r\nContent-Type: application/json\r\ncontent-length:  7 \r\n\r\n{\"a\":1}", 200, "{\"a\":1}", true, true);
+    // Bytes of a next response are ignored.
+    try expectParsed("HTTP/1.1 200 OK\r\nContent-Length: 2\r\n\r\nokHTTP/1.1 500 x\r\n\r\n", 200, "ok", true, true);
+    try expectParsed("HTTP/1.1 201 Created\r\nContent-Length: 0\r\n\r\n", 201, "", true, true);
+    try expectParsed("HTTP/1.0 200 OK\r\nContent-Length: 2\r\n\r\nok", 200, "ok", false, true);
+    try expectParsed("HTTP/1.0 200 OK\r\nConnection: keep-alive\r\nContent-Length: 2\r\n\r\nok", 200, "ok", true, true);
+    try expectParsed("HTTP/1.1 200 OK\r\nConnection: close\r\nContent-Length: 2\r\n\r\nok", 200, "ok", false, true);
+}
+
+test "parser: chunked body with extensions and trailers" {
+    const response = "HTTP/1.1 200 OK\r\nTransfer-Encoding: gzip, chunked\r\n\r\n" ++
+        "5;name=value\r\nhello\r\n" ++
+        "7 ; x=\"y;z\"\r\n, world\r\n" ++
+        "a\r\n0123456789\r\n" ++
+        "0;last\r\nX-Checksum: abc\r\nX-Other: d\r\n\r\n" ++
+        "HTTP/1.1 200 OK\r\n";
+    try expectParsed(response, 200, "hello, world0123456789", true, true);
+    try expectParsed("HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n0\r\n\r\n", 200, "", true, true);
+    // Not done until the empty line after the trailers.
+    try expectParsed("HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n2\r\nab\r\n0\r\nX-T: 1\r\n", 200, "ab", true, false);
+}
+
+test "parser: read-until-close body" {
+    const response = "HTTP/1.1 200 OK\r\nContent-Type: text/plain\r\n\r\nno length,\r\n\r\nread to EOF";
+    try expectParsed(response, 200, "no length,\r\n\r\nread to EOF", false, false);
+    var p = try parseInSteps(response, 1, 1 << 20);
+    defer p.deinit(std.testing.allocator);
+    try p.finish();
+    try std.testing.expect(p.done);
+    try std.testing.expectEqualStrings("no length,\r\n\r\nread to EOF", p.body.items);
+}
+
+test "parser: 204 and 304 have no body" {
+    try expectParsed("HTTP/1.1 204 No Content\r\n\r\nHTTP/1.1 200 OK\r\n", 204, "", true, true);
+    try expectParsed("HTTP/1.1 304 Not Modified\r\nContent-Length: 10\r\nETag: \"x\"\r\n\r\n", 304, "", true, true);
+    try expectParsed("HTTP/1.1 204 No Content\r\nTransfer-Encoding: chunked\r\n\r\n0\r\n\r\n", 204, "", true, true);
+}
+
+test "parser: truncated, oversized and malformed responses fail" {
+    const allocator = std.testing.allocator;
+    {
+        // EOF inside the head, a content-length body and a chunked body.
+        for ([_][]const u8{
+            "HTTP/1.1 200 OK\r\nContent-Len",
+            "HTTP/1.1 200 OK\r\nContent-Length: 5\r\n\r\nabc",
+            "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n5\r\nab",
+        }) |response| {
+            var p = try parseInSteps(response, 1, 1 << 20);
+            defer p.deinit(allocator);
+            try std.testing.expect(!p.done);
+            try std.testing.expectError(error.EndOfStream, p.finish());
+        }
+    }
+    try std.testing.expectError(error.HttpHeadersInvalid, parseInSteps("HTTP/2 200\r\n\r\n", 1, 16));
+    try std.testing.expectError(error.HttpHeadersInvalid, parseInSteps("HTTP/1.1 abc OK\r\n\r\n", 3, 16));
+    try std.testing.expectError(error.HttpHeadersInvalid, parseInSteps("HTTP/1.1 200 OK\r\nContent-Length: x\r\n\r\n", 1, 16));
+    try std.testing.expectError(error.ResponseTooLarge, parseInSteps("HTTP/1.1 200 OK\r\nContent-Length: 17\r\n\r\n", 1, 16));
+    try std.testing.expectError(error.ResponseTooLarge, parseInSteps("HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n11\r\n0123456789abcdefg", 1, 16));
+    try std.testing.expectError(error.ResponseTooLarge, parseInSteps("HTTP/1.1 200 OK\r\n\r\n0123456789abcdefg", 4, 16));
+    try std.testing.expectError(error.InvalidChunk, parseInSteps("HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\nzz\r\n", 1, 16));
+    try std.testing.expectError(error.InvalidChunk, parseInSteps("HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n;x\r\n", 1, 16));
+}
+
+fn mockUrl(buf: []u8, server: anytype, path: []const u8) ![]const u8 {
+    return std.fmt.bufPrint(buf, "http://127.0.0.1:{d}{s}", .{ server.port(), path });
+}
+
+test "loop reuses a keep-alive connection" {
+    if (!supported) return error.SkipZigTest;
+    const mock = @import("mock_server");
+    const allocator = std.testing.allocator;
+    const server = try mock.Server.start(allocator, .{ .port = 0, .models = 3 });
+    defer server.stop();
+    var url_buf: [64]u8 = undefined;
+    const url = try mockUrl(&url_buf, server, "/v1/models");
+
+    var loop = try Loop.init(allocator, .{});
+    defer loop.deinit();
+    for (0..3) |i| {
+        var future = Future{};
+        try loop.submit(.{ .url = url }, future.callback());
+        var res = try future.wait(&loop);
+        defer res.deinit(allocator);
+        try std.testing.expectEqual(@as(u16, 200), res.status);
+        try std.testing.expect(std.mem.indexOf(u8, res.body, "mock-model-2") != null);
+        try std.testing.expectEqual(i > 0, res.reused_connection);
+    }
+    const s = loop.stats();
+    try std.testing.expectEqual(@as(u64, 3), s.requests);
+    try std.testing.expectEqual(@as(u64, 1), s.connections_new);
+    try std.testing.expectEqual(@as(u64, 2), s.connections_reused);
+    try std.testing.expectEqual(@as(u64, 0), s.stale_retries);
+    try std.testing.expectEqual(@as(usize, 0), loop.pending());
+    try std.testing.expectEqual(@as(u64, 1), server.connections.load(.monotonic));
+}
+
+test "loop resends once when the server closed the idle connection" {
+    if (!supported) return error.SkipZigTest;
+    const mock = @import("mock_server");
+    const allocator = std.testing.allocator;
+    const server = try mock.Server.start(allocator, .{ .port = 0, .idle_timeout_ms = 50 });
+    defer server.stop();
+    var url_buf: [64]u8 = undefined;
+    const url = try mockUrl(&url_buf, server, "/v1/models");
+
+    var loop = try Loop.init(allocator, .{});
+    defer loop.deinit();
+    {
+        var future = Future{};
+        try loop.submit(.{ .url = url }, future.callback());
+        var res = try future.wait(&loop);
+        res.deinit(allocator);
+    }
+    // Not polling meanwhile: the loop still holds the closed connection as
+    // idle and sends the next request on it.
+    std.Thread.sleep(300 * std.time.ns_per_ms);
+    var future = Future{};
+    try loop.submit(.{ .url = url }, future.callback());
+    var res = try future.wait(&loop);
+    defer res.deinit(allocator);
+    try std.testing.expectEqual(@as(u16, 200), res.status);
+    try std.testing.expect(!res.reused_connection);
+
+    const s = loop.stats();
+    try std.testing.expectEqual(@as(u64, 1), s.stale_retries);
+    try std.testing.expectEqual(@as(u64, 1), s.connections_reused);
+    try std.testing.expectEqual(@as(u64, 2), s.connections_new);
+    try std.testing.expectEqual(@as(u64, 2), server.connections.load(.monotonic));
+    try std.testing.expectEqual(@as(u64, 2), server.requests.load(.monotonic));
+}
+
+test "loop fails a request past its timeout" {
+    if (!supported) return error.SkipZigTest;
+    const mock = @import("mock_server");
+    const allocator = std.testing.allocator;
+    const server = try mock.Server.start(allocator, .{ .port = 0, .latency = .{ .fixed = 400 } });
+    defer server.stop();
+    var url_buf: [64]u8 = undefined;
+    const url = try mockUrl(&url_buf, server, "/v1/models");
+
+    var loop = try Loop.init(allocator, .{ .timeout_ms = 50 });
+    defer loop.deinit();
+    var timer = try std.time.Timer.start();
+    var future = Future{};
+    try loop.submit(.{ .url = url }, future.callback());
+    try std.testing.expectError(error.Timeout, future.wait(&loop));
+    try std.testing.expect(timer.read() < 300 * std.time.ns_per_ms);
+
+    const s = loop.stats();
+    try std.testing.expectEqual(@as(u64, 1), s.timeouts);
+    try std.testing.expectEqual(@as(usize, 0), loop.pending());
+    // The timed-out connection is closed, not kept for reuse.
+    try std.testing.expectEqual(@as(usize, 0), loop.conns.count());
+}
@@ -4,21 +4,551 @@ const c = @cImport({
     @cInclude("win_http.h");
 });
 const cstr = @import("../util/cstr.zig");
+const hedge = @import("../util/hedge.zig");
+const deadline = @import("deadline");
+const trace = @import("trace");
+
+pub const RequestInfo = struct {
+    // True when a pooled keep-alive connection served the request.
+    reused_connection: bool = false,
+    // HTTP status code, 0 if unknown.
+    status: u16 = 0,
+    // Cache validators from the response (empty when absent).
+    etag_buf: [128]u8 = undefined,
+    etag_len: usize = 0,
+    last_modified_buf: [64]u8 = undefined,
+    last_modified_len: usize = 0,
+    // Retry-After in seconds when the server sent one (429 / 503).
+    retry_after_s: ?u32 = null,
+
+    pub fn etag(self: *const RequestInfo) []const u8 {
+        return self.etag_buf[0..self.etag_len];
+    }
+
+    pub fn lastModified(self: *const RequestInfo) []const u8 {
+        return self.last_modified_buf[0..self.last_modified_len];
+    }
+};
+
+pub const Stats = struct {
+    requests: u64,
+    connections_new: u64,
+    connections_reused: u64,
+    // Response bodies as received and after decoding; the difference is
+    // what compression saved.
+    bytes_wire: u64,
+    bytes_body: u64,
+    // Responses that arrived with a Content-Encoding.
+    compressed_responses: u64,
+};
+
+// Destination for a response body. The read loop asks the sink for
+// writable memory and reads (or decodes) straight into it, so each body
+// byte is copied once, from the transport into the sink. There is no size ceiling beyond
+// what the sink itself imposes.
+pub const Sink = struct {
+    ctx: *anyopaque,
+    vtable: *const VTable,
+
+    pub const VTable = struct {
+        // Called once before the body; null when the server sent no
+        // Content-Length (chunked).
+        begin: *const fn (ctx: *anyopaque, content_length: ?u64) anyerror!void,
+        // Returns writable space for the next read, ideally at least
+        // `min_len` bytes (never empty).
+        reserve: *const fn (ctx: *anyopaque, min_len: usize) anyerror![]u8,
+        // Marks the first `n` bytes of the last reserved space as filled.
+        commit: *const fn (ctx: *anyopaque, n: usize) anyerror!void,
+    };
+};
+
+// Collects the body in one allocation presized from Content-Length, so a
+// response with a known length is never reallocated.
+pub const GrowableSink = struct {
+    allocator: std.mem.Allocator,
+    list: std.ArrayListUnmanaged(u8) = .{},
+
+    // Read size when the length is unknown or the server overshoots.
+    const chunk = 16 * 1024;
+
+    pub fn init(allocator: std.mem.Allocator) GrowableSink {
+        return .{ .allocator = allocator };
+    }
+
+    pub fn deinit(self: *GrowableSink) void {
+        self.list.deinit(self.allocator);
+    }
+
+    // Hands the body to the caller; the sink is empty afterwards.
+    pub fn toOwnedSlice(self: *GrowableSink) ![]u8 {
+        return self.list.toOwnedSlice(self.allocator);
+    }
+
+    pub fn sink(self: *GrowableSink) Sink {
+        return .{ .ctx = self, .vtable = &vtable };
+    }
+
+    const vtable = Sink.VTable{ .begin = begin, .reserve = reserve, .commit = commit };
+
+    fn begin(ctx: *anyopaque, content_length: ?u64) !void {
+        const self: *GrowableSink = @ptrCast(@alignCast(ctx));
+        const n = std.math.cast(usize, content_length orelse return) orelse return error.OutOfMemory;
+        try self.list.ensureTotalCapacityPrecise(self.allocator, self.list.items.len + n);
+    }
+
+    fn reserve(ctx: *anyopaque, min_len: usize) ![]u8 {
+        const self: *GrowableSink = @ptrCast(@alignCast(ctx));
+        if (self.list.unusedCapacitySlice().len < min_len) {
+            try self.list.ensureUnusedCapacity(self.allocator, @max(min_len, chunk));
+        }
+        return self.list.unusedCapacitySlice();
+    }
+
+    fn commit(ctx: *anyopaque, n: usize) !void {
+        const self: *GrowableSink = @ptrCast(@alignCast(ctx));
+        self.list.items.len += n;
+    }
+};
+
+// Reads into a caller-owned buffer; fails with error.BodyTooLarge when the
+// body does not fit.
+pub const FixedSink = struct {
+    buf: []u8,
+    len: usize = 0,
+
+    pub fn init(buf: []u8) FixedSink {
+        return .{ .buf = buf };
+    }
+
+    pub fn written(self: *const FixedSink) []u8 {
+        return self.buf[0..self.len];
+    }
+
+    pub fn sink(self: *FixedSink) Sink {
+        return .{ .ctx = self, .vtable = &vtable };
+    }
+
+    const vtable = Sink.VTable{ .begin = begin, .reserve = reserve, .commit = commit };
+
+    fn begin(ctx: *anyopaque, content_length: ?u64) !void {
+        const self: *FixedSink = @ptrCast(@alignCast(ctx));
+        const n = content_length orelse return;
+        if (n > self.buf.len - self.len) return error.BodyTooLarge;
+    }
+
+    fn reserve(ctx: *anyopaque, min_len: usize) ![]u8 {
+        _ = min_len;
+        const self: *FixedSink = @ptrCast(@alignCast(ctx));
+        if (self.len == self.buf.len) return error.BodyTooLarge;
+        return self.buf[self.len..];
+    }
+
+    fn commit(ctx: *anyopaque, n: usize) !void {
+        const self: *FixedSink = @ptrCast(@alignCast(ctx));
+        self.len += n;
+    }
+};
+
+// Hands each read to a callback as it arrives (streaming parsers, files).
+// `buf` is the staging area the body is read into; `bytes` passed to `onData`
+// is only valid during the call.
+pub const CallbackSink = struct {
+    buf: []u8,
+    ctx: ?*anyopaque = null,
+    onData: *const fn (ctx: ?*anyopaque, bytes: []const u8) anyerror!void,
+    // Total bytes delivered.
+    total: u64 = 0,
+
+    pub fn sink(self: *CallbackSink) Sink {
+        return .{ .ctx = self, .vtable = &vtable };
+    }
+
+    const vtable = Sink.VTable{ .begin = begin, .reserve = reserve, .commit = commit };
+
+    fn begin(ctx: *anyopaque, content_length: ?u64) !void {
+        _ = ctx;
+        _ = content_length;
+    }
+
+    fn reserve(ctx: *anyopaque, min_len: usize) ![]u8 {
+        _ = min_len;
+        const self: *CallbackSink = @ptrCast(@alignCast(ctx));
+        return self.buf;
+    }
+
+    fn commit(ctx: *anyopaque, n: usize) !void {
+        const self: *CallbackSink = @ptrCast(@alignCast(ctx));
+        try self.onData(self.ctx, self.buf[0..n]);
+        self.total += n;
+    }
+};
+
+// Streams the body into an open file through a staging buffer.
+pub const FileSink = struct {
+    file: std.fs.File,
+    callback: CallbackSink,
+
+    pub fn init(file: std.fs.File, buf: []u8) FileSink {
+        return .{ .file = file, .callback = .{ .buf = buf, .onData = onData } };
+    }
+
+    pub fn sink(self: *FileSink) Sink {
+        self.callback.ctx = self;
+        return self.callback.sink();
+    }
+
+    fn onData(ctx: ?*anyopaque, bytes: []const u8) !void {
+        const self: *FileSink = @ptrCast(@alignCast(ctx.?));
+        try self.file.writeAll(bytes);
+    }
+};
+
+// Passes reads through to another sink until `cancel` is set, then fails
+// the request with error.Canceled at its next read.
+pub const CancelSink = struct {
+    inner: Sink,
+    cancel: *const std.atomic.Value(bool),
+
+    pub fn sink(self: *CancelSink) Sink {
+        return .{ .ctx = self, .vtable = &vtable };
+    }
+
+    const vtable = Sink.VTable{ .begin = begin, .reserve = reserve, .commit = commit };
+
+    fn begin(ctx: *anyopaque, content_length: ?u64) !void {
+        const self: *CancelSink = @ptrCast(@alignCast(ctx));
+        if (self.cancel.load(.acquire)) return error.Canceled;
+        try self.inner.vtable.begin(self.inner.ctx, content_length);
+    }
+
+    fn reserve(ctx: *anyopaque, min_len: usize) ![]u8 {
+        const self: *CancelSink = @ptrCast(@alignCast(ctx));
+        if (self.cancel.load(.acquire)) return error.Canceled;
+        return self.inner.vtable.reserve(self.inner.ctx, min_len);
+    }
+
+    fn commit(ctx: *anyopaque, n: usize) !void {
+        const self: *CancelSink = @ptrCast(@alignCast(ctx));
+        try self.inner.vtable.commit(self.inner.ctx, n);
+    }
+};
 
 // Performs HTTP GET with an optional extra header block.
 // Returns a Zig-allocated body buffer the caller must free.
 pub fn get(allocator: std.mem.Allocator, url: []const u8, extra_header: []const u8) ![]u8 {
+    return getWithInfo(allocator, url, extra_header, null, .{});
+}
+
+// Same as `get`, additionally reporting status, validators and whether the
+// connection was reused. An empty body (e.g. 304 Not Modified) is returned
+// as an empty slice instead of an error; check `info.status`. `ctx` bounds
+// the request (see `getSink`); `.{}` for no limits.
+pub fn getWithInfo(allocator: std.mem.Allocator, url: []const u8, extra_header: []const u8, info: ?*RequestInfo, ctx: deadline.Context) ![]u8 {
+    var body = GrowableSink.init(allocator);
+    defer body.deinit();
+    var local_info: RequestInfo = .{};
+    try getSink(allocator, url, extra_header, body.sink(), &local_info, ctx);
+    if (info) |i| i.* = local_info;
+    // Plain `get` callers expect a body; conditional callers pass info.
+    if (body.list.items.len == 0 and info == null) return error.NetworkError;
+    return body.toOwnedSlice();
+}
+
+// `getWithInfo` with hedging (idempotent GETs only): when no answer came
+// within `hedger`'s delay a second identical request starts, and whichever
+// answers first is returned. The loser stops at its next body read; one
+// still waiting for its response head finishes in the background, bounded
+// by `ctx` like the winner.
+pub fn getHedged(allocator: std.mem.Allocator, url: []const u8, extra_header: []const u8, info: ?*RequestInfo, hedger: *hedge.Hedger, ctx: deadline.Context) ![]u8 {
+    // Attempts may outlive this call, so they work on their own copies.
+    const a = std.heap.smp_allocator;
+    const url_copy = try a.dupe(u8, url);
+    const header_copy = a.dupe(u8, extra_header) catch |e| {
+        a.free(url_copy);
+        return e;
+    };
+    var fetched = try hedger.race(HedgedGet.Fetched, HedgedGet, .{ .url = url_copy, .header = header_copy, .ctx = ctx });
+    defer fetched.body.deinit();
+    if (info) |i| i.* = fetched.info;
+    if (fetched.body.list.items.len == 0 and info == null) return error.NetworkError;
+    return allocator.dupe(u8, fetched.body.list.items);
+}
+
+const HedgedGet = struct {
+    url: []u8,
+    header: []u8,
+    // A copy: the context's token must outlive a background attempt too.
+    ctx: deadline.Context,
+
+    const Fetched = struct {
+        body: GrowableSink,
+        info: RequestInfo,
+    };
+
+    pub fn attempt(self: *const HedgedGet, cancel: *const hedge.Hedger.Cancel) anyerror!Fetched {
+        const a = std.heap.smp_allocator;
+        var body = GrowableSink.init(a);
+        errdefer body.deinit();
+        var cancellable = CancelSink{ .inner = body.sink(), .cancel = cancel };
+        var info: RequestInfo = .{};
+        try getSink(a, self.url, self.header, cancellable.sink(), &info, self.ctx);
+        return .{ .body = body, .info = info };
+    }
+
+    pub fn discard(_: *const HedgedGet, value: Fetched) void {
+        var body = value.body;
+        body.deinit();
+    }
+
+    pub fn deinit(self: *HedgedGet) void {
+        const a = std.heap.smp_allocator;
+        std.crypto.secureZero(u8, self.header);
+        a.free(self.header);
+        a.free(self.url);
+    }
+};
+
+// Content-Encoding values offered to servers by `getSink`. zstd is opt-in
+// (append ", zstd"): its decoder needs an 8 MiB window per response.
+// Empty disables compression. Set before the first request.
+pub var accept_encoding: []const u8 = "gzip, deflate";
+
+pub const Encoding = enum {
+    identity,
+    gzip,
+    deflate,
+    zstd,
+
+    // Null for anything `getSink` cannot decode (including stacked codings).
+    pub fn parse(value: []const u8) ?Encoding {
+        const v = std.mem.trim(u8, value, " \t");
+        if (v.len == 0 or std.ascii.eqlIgnoreCase(v, "identity")) return .identity;
+        if (std.ascii.eqlIgnoreCase(v, "gzip") or std.ascii.eqlIgnoreCase(v, "x-gzip")) return .gzip;
+        if (std.ascii.eqlIgnoreCase(v, "deflate")) return .deflate;
+        if (std.ascii.eqlIgnoreCase(v, "zstd")) return .zstd;
+        return null;
+    }
+};
+
+// Body bytes as received vs. after decoding, across all requests.
+var bytes_wire = std.atomic.Value(u64).init(0);
+var bytes_body = std.atomic.Value(u64).init(0);
+var compressed_responses = std.atomic.Value(u64).init(0);
+
+// Performs HTTP GET and streams the body into `sink`, advertising
+// `accept_encoding`. A compressed response is decoded on the fly straight
+// into the sink's memory, so the sink always receives the plain body.
+// `allocator` is used for the C strings of the URL and header block and,
+// for zstd, the decoder window. Errors returned by the sink abort the
+// request and are passed through unchanged.
+// `ctx` bounds the request. WinINet enforces the connect limit itself (and
+// the first-byte limit per wait for data); the watchdog closes the request
+// handle when the first-byte or total deadline passes or the token is
+// canceled, and the call then fails with error.DeadlineExceeded or
+// error.Canceled. The first-byte deadline counts from the send, so on a
+// new connection it includes the connect.
+pub fn getSink(allocator: std.mem.Allocator, url: []const u8, extra_header: []const u8, sink: Sink, info: ?*RequestInfo, ctx: deadline.Context) !void {
     const url_c = try cstr.toCString(allocator, url);
     defer allocator.free(url_c);
-    const hdr_c = try cstr.toCString(allocator, extra_header);
-    defer allocator.free(hdr_c);
+    const hdr_c = if (accept_encoding.len > 0)
+        try std.fmt.allocPrint(allocator, "{s}Accept-Encoding: {s}\r\n\x00", .{ extra_header, accept_encoding })
+    else
+        try cstr.toCString(allocator, extra_header);
+    // The header block usually carries the API key.
+    defer {
+        std.crypto.secureZero(u8, hdr_c);
+        allocator.free(hdr_c);
+    }
+
+    var guard: deadline.Guard = undefined;
+    try guard.start(ctx);
+    defer guard.finish();
+    const first_byte_ms = ctx.phaseMs(.first_byte) orelse 0;
+    const timeouts = c.HttpTimeouts{
+        .connect_ms = ctx.phaseMs(.connect) orelse 0,
+        .send_ms = first_byte_ms,
+        .receive_ms = first_byte_ms,
+    };
+
+    var c_info: c.HttpRequestInfo = std.mem.zeroes(c.HttpRequestInfo);
+    const span = trace.begin("http/get");
+    defer span.end();
+    const resp = c.http_begin(url_c.ptr, hdr_c.ptr, &c_info, &timeouts) orelse return error.NetworkError;
+    defer c.http_close(resp);
+    // Detached before http_close above (defers run in reverse order).
+    try guard.setTarget(.{ .ctx = resp, .abort = abortRequest });
+    defer guard.setTarget(null) catch {};
+    try guard.phase(.first_byte);
+    if (c.http_send(resp) == 0) return guard.failed(error.NetworkError);
+    try guard.phase(.body);
+    if (span.start_ns) |t0| recordPhases(t0, &c_info.times);
+
+    const body_start = trace.now();
+    var wire = WireReader{ .resp = resp, .guard = &guard };
+    const encoding = Encoding.parse(std.mem.sliceTo(&c_info.content_encoding, 0)) orelse
+        return error.UnsupportedContentEncoding;
+    const content_length: ?u64 = if (c_info.content_length >= 0) @intCast(c_info.content_length) else null;
+    const pumped = switch (encoding) {
+        .identity => pumpIdentity(&wire, sink, content_length),
+        .gzip, .deflate, .zstd => pumpDecoded(allocator, encoding, &wire, sink),
+    };
+    const body_len = pumped catch |e| return guard.failed(e);
+    if (span.start_ns != null) trace.record("http/body", body_start, trace.now() -| body_start);
+
+    _ = bytes_wire.fetchAdd(wire.bytes, .monotonic);
+    _ = bytes_body.fetchAdd(body_len, .monotonic);
+    if (encoding != .identity) _ = compressed_responses.fetchAdd(1, .monotonic);
+    if (info) |i| copyInfo(i, &c_info);
+}
 
-    var out_ptr: [*c]u8 = @as([*c]u8, @ptrFromInt(0));
-    var out_len: c_ulong = 0;
-    const ok = c.http_get_with_header(url_c.ptr, hdr_c.ptr, &out_ptr, &out_len);
-    if (ok == 0 or out_ptr == @as([*c]u8, @ptrFromInt(0)) or out_len == 0) return error.NetworkError;
-    defer c.http_free(out_ptr);
+// Abort target for `getSink`'s guard.
+fn abortRequest(ctx: *anyopaque) void {
+    c.http_abort(@ptrCast(ctx));
+}
+
+// Turns the phase boundaries measured by the WinINet status callback into
+// trace events. Phases that did not happen (DNS and connect on a reused
+// connection) are skipped.
+fn recordPhases(t0: u64, t: *const c.HttpPhaseTimes) void {
+    recordPhase("http/dns", t0, t.resolve_start, t.resolve_end);
+    recordPhase("http/connect", t0, t.connect_start, t.connect_end);
+    // TLS handshake (and request setup) on a fresh connection.
+    recordPhase("http/tls", t0, t.connect_end, t.send_start);
+    recordPhase("http/first_byte", t0, t.send_start, t.headers_end);
+}
+
+fn recordPhase(comptime name: []const u8, t0: u64, start: c_longlong, end: c_longlong) void {
+    if (start < 0 or end < start) return;
+    trace.record(name, t0 + @as(u64, @intCast(start)), @intCast(end - start));
+}
+
+// The response body as sent, counting the bytes that crossed the wire.
+// Each read re-arms the guard's body phase (its idle limit).
+const WireReader = struct {
+    resp: *c.HttpResponse,
+    guard: *deadline.Guard,
+    bytes: u64 = 0,
+
+    const Error = error{NetworkError} || deadline.Error;
+    const Reader = std.io.GenericReader(*WireReader, Error, read);
+
+    fn reader(self: *WireReader) Reader {
+        return .{ .context = self };
+    }
+
+    fn read(self: *WireReader, buf: []u8) Error!usize {
+        try self.guard.phase(.body);
+        // InternetReadFile takes a DWORD length.
+        const len: c_ulong = @intCast(@min(buf.len, std.math.maxInt(u32)));
+        var n: c_ulong = 0;
+        if (c.http_read(self.resp, buf.ptr, len, &n) == 0) return error.NetworkError;
+        self.bytes += n;
+        return n;
+    }
+};
+
+// Reads an uncompressed body straight into the sink. With a known length
+// each read is capped at what is left, so a presized sink is filled
+// exactly. EOF is then confirmed by a 1-byte probe into a scratch byte: a
+// sink filled to the last byte (FixedSink) is only asked for more room if
+// the server sends more than it announced. EOF before the announced
+// length fails with error.EndOfStream.
+fn pumpIdentity(wire: *WireReader, sink: Sink, content_length: ?u64) !u64 {
+    try sink.vtable.begin(sink.ctx, content_length);
+    var total: u64 = 0;
+    while (true) {
+        if (content_length) |len| if (total >= len) {
+            var probe: [1]u8 = undefined;
+            if (try wire.read(&probe) == 0) return total;
+            const space = try sink.vtable.reserve(sink.ctx, 1);
+            space[0] = probe[0];
+            try sink.vtable.commit(sink.ctx, 1);
+            total += 1;
+            continue;
+        };
+        const want: usize = if (content_length) |len|
+            std.math.cast(usize, len - total) orelse std.math.maxInt(usize)
+        else
+            GrowableSink.chunk;
+        const space = try sink.vtable.reserve(sink.ctx, want);
+        const dst = if (content_length != null) space[0..@min(space.len, want)] else space;
+        const n = try wire.read(dst);
+        if (n == 0) {
+            // The connection ended before the announced length: a
+            // truncated body is an error, not a short success.
+            if (content_length != null) return error.EndOfStream;
+            return total;
+        }
+        try sink.vtable.commit(sink.ctx, n);
+        total += n;
+    }
+}
+
+// Decodes a compressed body into the sink. The decoded length is unknown
+// up front, so the sink grows as it goes.
+fn pumpDecoded(allocator: std.mem.Allocator, encoding: Encoding, wire: *WireReader, sink: Sink) !u64 {
+    try sink.vtable.begin(sink.ctx, null);
+    // The decoders pull a few bytes at a time; batch the transport reads.
+    var buffered = std.io.bufferedReaderSize(16 * 1024, wire.reader());
+    const src = buffered.reader();
+    switch (encoding) {
+        .identity => unreachable,
+        .gzip => {
+            var dec = std.compress.gzip.decompressor(src);
+            return pumpReader(&dec, sink);
+        },
+        // HTTP "deflate" is the zlib format (RFC 9110).
+        .deflate => {
+            var dec = std.compress.zlib.decompressor(src);
+            return pumpReader(&dec, sink);
+        },
+        .zstd => {
+            const window = try allocator.alloc(u8, std.compress.zstd.DecompressorOptions.default_window_buffer_len);
+            defer allocator.free(window);
+            var dec = std.compress.zstd.decompressor(src, .{ .window_buffer = window });
+            return pumpReader(&dec, sink);
+        },
+    }
+}
+
+fn pumpReader(dec: anytype, sink: Sink) !u64 {
+    var total: u64 = 0;
+    while (true) {
+        const space = try sink.vtable.reserve(sink.ctx, GrowableSink.chunk);
+        const n = try dec.read(space);
+        if (n == 0) return total;
+        try sink.vtable.commit(sink.ctx, n);
+        total += n;
+    }
+}
+
+fn copyInfo(dst: *RequestInfo, src: *const c.HttpRequestInfo) void {
+    dst.reused_connection = (src.reused_connection != 0);
+    dst.status = std.math.cast(u16, src.status) orelse 0;
+    const etag = std.mem.sliceTo(&src.etag, 0);
+    @memcpy(dst.etag_buf[0..etag.len], etag);
+    dst.etag_len = etag.len;
+    const lm = std.mem.sliceTo(&src.last_modified, 0);
+    @memcpy(dst.last_modified_buf[0..lm.len], lm);
+    dst.last_modified_len = lm.len;
+    dst.retry_after_s = if (src.retry_after_s >= 0) @intCast(src.retry_after_s) else null;
+}
+
+// Cumulative connection counters for the shared session.
+pub fn stats() Stats {
+    var s: c.HttpStats = undefined;
+    c.http_get_stats(&s);
+    return .{
+        .requests = s.requests,
+        .connections_new = s.connections_new,
+        .connections_reused = s.connections_reused,
+        .bytes_wire = bytes_wire.load(.monotonic),
+        .bytes_body = bytes_body.load(.monotonic),
+        .compressed_responses = compressed_responses.load(.monotonic),
+    };
+}
 
-    const bytes = @as([*]u8, @ptrCast(out_ptr))[0..out_len];
-    return allocator.dupe(u8, bytes);
+// Releases pooled connections; call once when the app exits.
+pub fn shutdown() void {
+    c.http_shutdown();
 }
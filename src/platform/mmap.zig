@@ -0,0 +1,59 @@
+const std = @import("std");
+const builtin = @import("builtin");
+
+const c = if (builtin.os.tag == .windows) @cImport({
+    @cInclude("win_mmap.h");
+}) else struct {};
+const cstr = @import("../util/cstr.zig");
+
+// Read-only view of a whole file. Bytes stay valid until `close`, even if
+// another process replaces the file by rename in the meantime (POSIX keeps
+// the old inode; on Windows the replace waits until the view is closed).
+pub const MappedFile = struct {
+    bytes: []const u8,
+    // Exact mapping as returned by the OS, needed to unmap.
+    // Null for empty files, which are not mapped.
+    posix_mem: if (builtin.os.tag == .windows) void else ?[]align(std.heap.page_size_min) const u8,
+
+    // Returns null when the file does not exist.
+    pub fn openRead(allocator: std.mem.Allocator, path: []const u8) !?MappedFile {
+        if (builtin.os.tag == .windows) {
+            const path_c = try cstr.toCString(allocator, path);
+            defer allocator.free(path_c);
+            var base: ?*const anyopaque = null;
+            var len: c_ulonglong = 0;
+            if (c.mmap_open_read(path_c.ptr, &base, &len) == 0) {
+                std.fs.cwd().access(path, .{}) catch return null;
+                return error.MapFailed;
+            }
+            const bytes: []const u8 = if (base) |b| @as([*]const u8, @ptrCast(b))[0..@intCast(len)] else &.{};
+            return .{ .bytes = bytes, .posix_mem = {} };
+        }
+
+        const file = std.fs.cwd().openFile(path, .{ .mode = .read_only }) catch |e| switch (e) {
+            error.FileNotFound => return null,
+            else => return e,
+        };
+        defer file.close();
+        const size = (try file.stat()).size;
+        if (size == 0) return .{ .bytes = &.{}, .posix_mem = null };
+        const mem = try std.posix.mmap(
+            null,
+            @intCast(size),
+            std.posix.PROT.READ,
+            .{ .TYPE = .SHARED },
+            file.handle,
+            0,
+        );
+        return .{ .bytes = mem, .posix_mem = mem };
+    }
+
+    pub fn close(self: *MappedFile) void {
+        if (builtin.os.tag == .windows) {
+            if (self.bytes.len > 0) c.mmap_close(self.bytes.ptr);
+        } else {
+            if (self.posix_mem) |mem| std.posix.munmap(mem);
+        }
+        self.* = undefined;
+    }
+};
@@ -0,0 +1,31 @@
+const std = @import("std");
+const builtin = @import("builtin");
+
+// Per-user data directory for the app, created on demand:
+// - Windows: %APPDATA%\ohmyzig
+// - elsewhere: $XDG_DATA_HOME/ohmyzig, or ~/.local/share/ohmyzig
+// Caller frees the returned path.
+pub fn appDataDir(allocator: std.mem.Allocator) ![]u8 {
+    const dir = if (builtin.os.tag == .windows) blk: {
+        const appdata = try std.process.getEnvVarOwned(allocator, "APPDATA");
+        defer allocator.free(appdata);
+        break :blk try std.fs.path.join(allocator, &.{ appdata, "ohmyzig" });
+    } else if (std.process.getEnvVarOwned(allocator, "XDG_DATA_HOME") catch null) |xdg| blk: {
+        defer allocator.free(xdg);
+        break :blk try std.fs.path.join(allocator, &.{ xdg, "ohmyzig" });
+    } else blk: {
+        const home = try std.process.getEnvVarOwned(allocator, "HOME");
+        defer allocator.free(home);
+        break :blk try std.fs.path.join(allocator, &.{ home, ".local", "share", "ohmyzig" });
+    };
+    errdefer allocator.free(dir);
+    try std.fs.cwd().makePath(dir);
+    return dir;
+}
+
+// Path of `name` inside appDataDir(). Caller frees the returned path.
+pub fn appDataFile(allocator: std.mem.Allocator, name: []const u8) ![]u8 {
+    const dir = try appDataDir(allocator);
+    defer allocator.free(dir);
+    return std.fs.path.join(allocator, &.{ dir, name });
+}
@@ -1,38 +1,136 @@
 const std = @import("std");
+const builtin = @import("builtin");
 
-const c = @cImport({
+const c = if (builtin.os.tag == .windows) @cImport({
     @cInclude("win_secret.h");
-});
+}) else struct {};
 const cstr = @import("../util/cstr.zig");
+const paths = @import("paths.zig");
 
-fn appDataKeyPath(allocator: std.mem.Allocator) ![]u8 {
-    const appdata = try std.process.getEnvVarOwned(allocator, "APPDATA");
-    defer allocator.free(appdata);
-    const dir = try std.fs.path.join(allocator, &.{ appdata, "ohmyzig" });
-    defer allocator.free(dir);
-    try std.fs.cwd().makePath(dir);
-    return std.fs.path.join(allocator, &.{ dir, "openai.key" });
+// Per-user API key file in the app data directory:
+// - Windows: DPAPI-encrypted (CryptProtectData, current user scope).
+// - elsewhere: the plain key in a 0600 file, like other CLI credential
+//   stores; a key file readable by group or others is refused.
+pub const key_file_name = "openai.key";
+
+// Longest key file accepted on POSIX.
+const max_key_file = 4096;
+
+fn keyPath(allocator: std.mem.Allocator) ![]u8 {
+    return paths.appDataFile(allocator, key_file_name);
 }
 
 pub fn saveEncrypted(allocator: std.mem.Allocator, api_key: []const u8) !void {
-    const path = try appDataKeyPath(allocator);
+    const path = try keyPath(allocator);
     defer allocator.free(path);
-    const c_path = try cstr.toCString(allocator, path);
-    defer allocator.free(c_path);
-    const ok = c.dpapi_encrypt_and_save(c_path.ptr, api_key.ptr, @as(c_ulong, @intCast(api_key.len)));
-    if (ok == 0) return error.AccessDenied;
+    return saveEncryptedTo(allocator, path, api_key);
 }
 
+// Returns null when no key is stored. Caller frees (zero it first, e.g.
+// with `std.crypto.secureZero`).
 pub fn loadEncrypted(allocator: std.mem.Allocator) !?[]u8 {
-    const path = appDataKeyPath(allocator) catch return null;
+    const path = keyPath(allocator) catch return null;
     defer allocator.free(path);
-    const c_path = cstr.toCString(allocator, path) catch return null;
-    defer allocator.free(c_path);
-    var out_ptr: [*c]u8 = @as([*c]u8, @ptrFromInt(0));
-    var out_len: c_ulong = 0;
-    const ok = c.dpapi_load_and_decrypt(c_path.ptr, &out_ptr, &out_len);
-    if (ok == 0 or out_ptr == @as([*c]u8, @ptrFromInt(0)) or out_len == 0) return null;
-    defer c.secret_free(out_ptr);
-    const bytes = @as([*]u8, @ptrCast(out_ptr))[0..out_len];
-    return try allocator.dupe(u8, bytes);
+    return loadEncryptedFrom(allocator, path);
+}
+
+pub fn saveEncryptedTo(allocator: std.mem.Allocator, path: []const u8, api_key: []const u8) !void {
+    if (builtin.os.tag == .windows) {
+        const c_path = try cstr.toCString(allocator, path);
+        defer allocator.free(c_path);
+        const ok = c.dpapi_encrypt_and_save(c_path.ptr, api_key.ptr, @as(c_ulong, @intCast(api_key.len)));
+        if (ok == 0) return error.AccessDenied;
+        return;
+    }
+
+    // Created 0600 under a temp name, then renamed: the key is never
+    // readable by others, not even briefly.
+    var rand: [4]u8 = undefined;
+    std.crypto.random.bytes(&rand);
+    const tmp = try std.fmt.allocPrint(allocator, "{s}.{x}.tmp", .{ path, std.mem.readInt(u32, &rand, .little) });
+    defer allocator.free(tmp);
+    {
+        var file = try std.fs.cwd().createFile(tmp, .{ .exclusive = true, .mode = 0o600 });
+        defer file.close();
+        errdefer std.fs.cwd().deleteFile(tmp) catch {};
+        try file.writeAll(api_key);
+        try file.sync();
+    }
+    std.fs.cwd().rename(tmp, path) catch |e| {
+        std.fs.cwd().deleteFile(tmp) catch {};
+        return e;
+    };
+}
+
+pub fn loadEncryptedFrom(allocator: std.mem.Allocator, path: []const u8) !?[]u8 {
+    if (builtin.os.tag == .windows) {
+        const c_path = cstr.toCString(allocator, path) catch return null;
+        defer allocator.free(c_path);
+        var out_ptr: [*c]u8 = @as([*c]u8, @ptrFromInt(0));
+        var out_len: c_ulong = 0;
+        const ok = c.dpapi_load_and_decrypt(c_path.ptr, &out_ptr, &out_len);
+        if (ok == 0 or out_ptr == @as([*c]u8, @ptrFromInt(0)) or out_len == 0) return null;
+        const bytes = @as([*]u8, @ptrCast(out_ptr))[0..out_len];
+        defer {
+            std.crypto.secureZero(u8, bytes);
+            c.secret_free(out_ptr);
+        }
+        return try allocator.dupe(u8, bytes);
+    }
+
+    var file = std.fs.cwd().openFile(path, .{}) catch |e| switch (e) {
+        error.FileNotFound => return null,
+        else => return e,
+    };
+    defer file.close();
+    const st = try file.stat();
+    if (st.mode & 0o077 != 0) return error.InsecureKeyFile;
+    var buf: [max_key_file]u8 = undefined;
+    defer std.crypto.secureZero(u8, &buf);
+    const n = try file.readAll(&buf);
+    const key = std.mem.trim(u8, buf[0..n], " \t\r\n");
+    if (key.len == 0) return null;
+    return try allocator.dupe(u8, key);
 }
+
+// Memory for a secret that lives a while (the cached API key): its own
+// pages, locked in RAM where the OS allows it (VirtualLock / mlock) so it
+// is not written to the page file, and zeroed before it is freed.
+pub const SecretBuffer = struct {
+    mem: []u8,
+    len: usize,
+    locked: bool,
+
+    pub fn init(len: usize) !SecretBuffer {
+        const size = std.mem.alignForward(usize, @max(len, 1), std.heap.pageSize());
+        const mem = try std.heap.page_allocator.alloc(u8, size);
+        return .{ .mem = mem, .len = len, .locked = lock(mem) };
+    }
+
+    pub fn bytes(self: *const SecretBuffer) []u8 {
+        return self.mem[0..self.len];
+    }
+
+    pub fn deinit(self: *SecretBuffer) void {
+        std.crypto.secureZero(u8, self.mem);
+        if (self.locked) unlock(self.mem);
+        std.heap.page_allocator.free(self.mem);
+        self.* = undefined;
+    }
+
+    // Best effort: a failed lock (quota, RLIMIT_MEMLOCK) leaves the secret
+    // pageable but still zeroed on free.
+    fn lock(mem: []u8) bool {
+        if (builtin.os.tag == .windows) return c.secret_lock(mem.ptr, mem.len) != 0;
+        if (builtin.os.tag == .linux) return std.os.linux.E.init(std.os.linux.mlock(mem.ptr, mem.len)) == .SUCCESS;
+        return false;
+    }
+
+    fn unlock(mem: []u8) void {
+        if (builtin.os.tag == .windows) {
+            c.secret_unlock(mem.ptr, mem.len);
+        } else if (builtin.os.tag == .linux) {
+            _ = std.os.linux.munlock(mem.ptr, mem.len);
+        }
+    }
+};
@@ -4,6 +4,7 @@ const c = @cImport({
     @cInclude("win32_ui.h");
 });
 const cstr = @import("../util/cstr.zig");
+const text = @import("../util/text.zig");
 
 pub fn showInfoMessage(allocator: std.mem.Allocator, title: []const u8, body: []const u8) void {
     const t = cstr.toCString(allocator, title) catch return;
@@ -16,17 +17,28 @@ pub fn showInfoMessage(allocator: std.mem.Allocator, title: []const u8, body: []
 pub fn showScrollableText(allocator: std.mem.Allocator, title: []const u8, body: []const u8) void {
     const t = cstr.toCString(allocator, title) catch return;
     defer allocator.free(t);
-    const b = cstr.toCString(allocator, body) catch return;
+    const b = text.toValidUtf8CString(allocator, body) catch return;
     defer allocator.free(b);
     c.ShowScrollableText(t.ptr, b.ptr);
 }
 
 pub fn setMainText(allocator: std.mem.Allocator, body: []const u8) void {
-    const b = cstr.toCString(allocator, body) catch return;
+    const b = text.toValidUtf8CString(allocator, body) catch return;
     defer allocator.free(b);
     c.SetMainText(b.ptr);
 }
 
+// Replaces UTF-16 code units [start, end) of the main view with `body`
+// (UTF-8). Offsets are in the text as last set through the view; see
+// `text.controlEdit` for converting byte offsets.
+pub fn replaceMainRange(allocator: std.mem.Allocator, start: usize, end: usize, body: []const u8) void {
+    const b = text.toValidUtf8CString(allocator, body) catch return;
+    defer allocator.free(b);
+    const s = std.math.cast(c_ulong, start) orelse return;
+    const e = std.math.cast(c_ulong, end) orelse return;
+    c.ReplaceMainTextRange(s, e, b.ptr);
+}
+
 pub fn promptApiKey(allocator: std.mem.Allocator, out_save: *bool) ?[]u8 {
     var buf: [256]u8 = undefined;
     var save_flag: c_int = 0;
@@ -39,6 +51,12 @@ pub fn promptApiKey(allocator: std.mem.Allocator, out_save: *bool) ?[]u8 {
     return dup;
 }
 
+// Wakes the UI thread so it drains finished background jobs
+// (delivered to `OnJobsCompleted`). Safe to call from any thread.
+pub fn postJobsCompleted() void {
+    c.PostJobsCompleted();
+}
+
 pub fn createSimpleWindow() void {
     _ = c.CreateSimpleWindow();
 }
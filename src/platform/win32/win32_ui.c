@@ -4,6 +4,9 @@
 //  - Uses explicit ANSI versions of Win32 APIs (RegisterClassExA, TextOutA, ...)
 //    to avoid UNICODE macro surprises when building in different environments.
 //  - Shows simple MessageBoxA errors if class registration or window creation fails.
+//  - The text areas are Unicode (W) edit controls: the UTF-8 text from Zig is
+//    converted to UTF-16, so it shows correctly and EM_SETSEL positions are
+//    UTF-16 code units whatever the ANSI code page (DBCS included).
 #include "win32_ui.h"
 #include "app_callbacks.h"
 #include <windows.h>
@@ -18,10 +21,15 @@ static const char WINDOW_TITLE[] = "Zig + C Win32 Window";
 #define IDC_TEXTVIEW_EDIT   3001
 #define IDC_MAIN_EDIT       3002
 
+// Posted by worker threads when background jobs have finished
+#define WM_APP_JOBS_DONE    (WM_APP + 1)
+
+static HWND g_main_hwnd = NULL;
 static HWND g_main_edit = NULL;
 
 // Helper: format and show last-error details
 static void ShowLastErrorA(const char* title_prefix);
+static WCHAR* Utf8ToWide(const char* s);
 static void CenterWindow(HWND hwnd);
 static void ModalLoopUntilDestroyed(HWND hwnd);
 
@@ -30,27 +38,34 @@ static LRESULT CALLBACK WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lPara
     switch (msg) {
         case WM_CREATE: {
             HINSTANCE hi = ((LPCREATESTRUCTA)lParam)->hInstance;
+            g_main_hwnd = hwnd;
             CreateWindowExA(0, "BUTTON", "Update Model List",
                             WS_CHILD | WS_VISIBLE | BS_PUSHBUTTON,
                             10, 40, 180, 28,
                             hwnd, (HMENU)(INT_PTR)IDC_BTN_UPDATE,
                             hi, NULL);
             // Multiline read-only text area to show model list
-            g_main_edit = CreateWindowExA(WS_EX_CLIENTEDGE, "EDIT", "",
+            g_main_edit = CreateWindowExW(WS_EX_CLIENTEDGE, L"EDIT", L"",
                                           WS_CHILD | WS_VISIBLE | ES_MULTILINE | ES_AUTOVSCROLL | WS_VSCROLL | ES_READONLY,
                                           10, 80, 760, 460,
                                           hwnd, (HMENU)(INT_PTR)IDC_MAIN_EDIT, hi, NULL);
-            // Populate on startup (cached first, else online)
+            // Lift the default 32K limit; long transcripts grow by ranges.
+            SendMessageW(g_main_edit, EM_SETLIMITTEXT, 0, 0);
+            // Populate on startup (cached first, else fetched in background)
             OnShowModelsRequest();
             return 0;
         }
+        case WM_APP_JOBS_DONE:
+            OnJobsCompleted();
+            return 0;
         case WM_DESTROY:
+            g_main_hwnd = NULL;
             PostQuitMessage(0);
             return 0;
         case WM_COMMAND: {
             const int id = LOWORD(wParam);
             if (id == IDC_BTN_UPDATE) {
-                OnShowModelsRequest();
+                OnUpdateModelsRequest();
                 return 0;
             }
             break;
@@ -150,12 +165,38 @@ void ShowInfoMessage(const char* title, const char* body) {
 }
 
 void SetMainText(const char* body) {
+    WCHAR* wide = Utf8ToWide(body);
+    if (!wide) return;
     if (g_main_edit) {
-        SetWindowTextA(g_main_edit, body ? body : "");
+        SetWindowTextW(g_main_edit, wide);
     } else {
         // Fallback if not ready
-        MessageBoxA(NULL, body ? body : "", "Models", MB_OK | MB_ICONINFORMATION);
+        MessageBoxW(NULL, wide, L"Models", MB_OK | MB_ICONINFORMATION);
     }
+    HeapFree(GetProcessHeap(), 0, wide);
+}
+
+void ReplaceMainTextRange(unsigned long start, unsigned long end, const char* text) {
+    if (!g_main_edit) return;
+    WCHAR* wide = Utf8ToWide(text);
+    if (!wide) return;
+    // Select the old range and replace it in place; the control only
+    // re-lays out the affected lines. The caret is restored afterwards.
+    DWORD sel_start = 0, sel_end = 0;
+    SendMessageW(g_main_edit, EM_GETSEL, (WPARAM)&sel_start, (LPARAM)&sel_end);
+    SendMessageW(g_main_edit, WM_SETREDRAW, FALSE, 0);
+    SendMessageW(g_main_edit, EM_SETSEL, (WPARAM)start, (LPARAM)end);
+    SendMessageW(g_main_edit, EM_REPLACESEL, FALSE, (LPARAM)wide);
+    SendMessageW(g_main_edit, EM_SETSEL, (WPARAM)sel_start, (LPARAM)sel_end);
+    SendMessageW(g_main_edit, WM_SETREDRAW, TRUE, 0);
+    InvalidateRect(g_main_edit, NULL, FALSE);
+    HeapFree(GetProcessHeap(), 0, wide);
+}
+
+void PostJobsCompleted(void) {
+    // Several posts may coalesce into one drain; OnJobsCompleted handles all.
+    HWND hwnd = g_main_hwnd;
+    if (hwnd) PostMessageA(hwnd, WM_APP_JOBS_DONE, 0, 0);
 }
 
 // --- Scrollable text dialog ---
@@ -174,11 +215,17 @@ static LRESULT CALLBACK TextWndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM l
             SetWindowLongPtrA(hwnd, GWLP_USERDATA, (LONG_PTR)st);
 
             // Multiline, read-only edit with vertical scrollbar
-            st->hEdit = CreateWindowExA(WS_EX_CLIENTEDGE, "EDIT", "",
+            st->hEdit = CreateWindowExW(WS_EX_CLIENTEDGE, L"EDIT", L"",
                                         WS_CHILD | WS_VISIBLE | ES_MULTILINE | ES_AUTOVSCROLL | WS_VSCROLL | ES_READONLY,
                                         10, 10, 560, 320, hwnd, (HMENU)IDC_TEXTVIEW_EDIT, cs->hInstance, NULL);
             // Set text
-            if (st && st->body) SetWindowTextA(st->hEdit, st->body);
+            if (st && st->body) {
+                WCHAR* wide = Utf8ToWide(st->body);
+                if (wide) {
+                    SetWindowTextW(st->hEdit, wide);
+                    HeapFree(GetProcessHeap(), 0, wide);
+                }
+            }
 
             // OK button
             CreateWindowExA(0, "BUTTON", "OK", WS_CHILD | WS_VISIBLE | BS_DEFPUSHBUTTON,
@@ -354,6 +401,18 @@ int PromptForApiKey(char* out_buf, int out_buf_len, int* out_save) {
 }
 
 // --- Helpers ---
+// NUL-terminated UTF-16 copy of UTF-8 `s` (NULL reads as ""), for the W
+// text APIs. Free with HeapFree; NULL when out of memory.
+static WCHAR* Utf8ToWide(const char* s) {
+    if (!s) s = "";
+    int n = MultiByteToWideChar(CP_UTF8, 0, s, -1, NULL, 0);
+    if (n <= 0) return NULL;
+    WCHAR* wide = (WCHAR*)HeapAlloc(GetProcessHeap(), 0, (SIZE_T)n * sizeof(WCHAR));
+    if (!wide) return NULL;
+    MultiByteToWideChar(CP_UTF8, 0, s, -1, wide, n);
+    return wide;
+}
+
 static void CenterWindow(HWND hwnd) {
     RECT rc; GetWindowRect(hwnd, &rc);
     int w = rc.right - rc.left;
@@ -2,66 +2,393 @@
 #include <windows.h>
 #include <wininet.h>
 #include <stdlib.h>
+#include <string.h>
 
-int http_get_with_header(const char* url, const char* extra_header, char** out_buf, unsigned long* out_len) {
-    if (!out_buf || !out_len) return 0;
-    *out_buf = NULL;
-    *out_len = 0;
+// Process-lifetime WinINet session. WinINet pools keep-alive sockets (and
+// Schannel caches TLS sessions) per session, so keeping one open lets
+// repeat requests to the same host skip DNS, TCP and TLS setup.
+#define MAX_HOST_CONNECTIONS 4   // cached InternetConnect handles (one per host)
+#define MAX_CONNS_PER_SERVER 4   // keep-alive sockets WinINet may hold per host
 
-    HINTERNET hInternet = InternetOpenA("ohmyzig/1.0", INTERNET_OPEN_TYPE_PRECONFIG, NULL, NULL, 0);
-    if (!hInternet) return 0;
+typedef struct HostConn {
+    char host[INTERNET_MAX_HOST_NAME_LENGTH];
+    INTERNET_PORT port;
+    HINTERNET hConnect;
+    DWORD last_used;
+    int busy; // requests currently using hConnect
+} HostConn;
 
-    DWORD header_len = 0;
-    if (extra_header) {
-        header_len = (DWORD)lstrlenA(extra_header);
-    }
+// Per-request state passed to the status callback via dwContext.
+typedef struct RequestCtx {
+    int new_connection;
+    LARGE_INTEGER t0;
+    HttpPhaseTimes* times;
+} RequestCtx;
+
+static INIT_ONCE g_init_once = INIT_ONCE_STATIC_INIT;
+static CRITICAL_SECTION g_lock;
+static HINTERNET g_session = NULL;
+static HostConn g_hosts[MAX_HOST_CONNECTIONS];
+static HttpStats g_stats;
+
+static LARGE_INTEGER g_qpc_freq;
+
+// Nanoseconds since rc->t0 on the performance counter.
+static long long ElapsedNs(const RequestCtx* rc) {
+    LARGE_INTEGER t;
+    QueryPerformanceCounter(&t);
+    long long ticks = t.QuadPart - rc->t0.QuadPart;
+    return (long long)((double)ticks * 1e9 / (double)g_qpc_freq.QuadPart);
+}
+
+static void MarkEntered(RequestCtx* rc);
 
-    HINTERNET hUrl = InternetOpenUrlA(hInternet, url, extra_header, header_len, INTERNET_FLAG_RELOAD | INTERNET_FLAG_NO_CACHE_WRITE, 0);
-    if (!hUrl) {
-        InternetCloseHandle(hInternet);
-        return 0;
+// Synchronous handles get their callbacks on the requesting thread, in
+// order, while HttpSendRequest (or a read that waits on the socket) runs.
+static void CALLBACK HttpStatusCallback(HINTERNET h, DWORD_PTR context, DWORD status, LPVOID info, DWORD info_len) {
+    (void)h; (void)info; (void)info_len;
+    RequestCtx* rc = (RequestCtx*)context;
+    if (!rc) return;
+    if (status != INTERNET_STATUS_HANDLE_CREATED && status != INTERNET_STATUS_HANDLE_CLOSING) MarkEntered(rc);
+    HttpPhaseTimes* t = rc->times;
+    switch (status) {
+        case INTERNET_STATUS_RESOLVING_NAME: t->resolve_start = ElapsedNs(rc); break;
+        case INTERNET_STATUS_NAME_RESOLVED: t->resolve_end = ElapsedNs(rc); break;
+        // Only fired when WinINet has to open a fresh socket; a pooled
+        // keep-alive connection goes straight to SENDING_REQUEST.
+        case INTERNET_STATUS_CONNECTING_TO_SERVER:
+            rc->new_connection = 1;
+            t->connect_start = ElapsedNs(rc);
+            break;
+        case INTERNET_STATUS_CONNECTED_TO_SERVER: t->connect_end = ElapsedNs(rc); break;
+        case INTERNET_STATUS_SENDING_REQUEST:
+            if (t->send_start < 0) t->send_start = ElapsedNs(rc);
+            break;
+        default: break;
     }
+}
+
+static BOOL CALLBACK InitOnceHttp(PINIT_ONCE once, PVOID param, PVOID* ctx) {
+    (void)once; (void)param; (void)ctx;
+    InitializeCriticalSection(&g_lock);
+    QueryPerformanceFrequency(&g_qpc_freq);
+    return TRUE;
+}
+
+// Returns the shared session, creating it on first use. Caller holds g_lock.
+static HINTERNET SessionLocked(void) {
+    if (g_session) return g_session;
+    g_session = InternetOpenA("ohmyzig/1.0", INTERNET_OPEN_TYPE_PRECONFIG, NULL, NULL, 0);
+    if (!g_session) return NULL;
+    DWORD max_conns = MAX_CONNS_PER_SERVER;
+    InternetSetOptionA(g_session, INTERNET_OPTION_MAX_CONNS_PER_SERVER, &max_conns, sizeof(max_conns));
+    InternetSetOptionA(g_session, INTERNET_OPTION_MAX_CONNS_PER_1_0_SERVER, &max_conns, sizeof(max_conns));
+    InternetSetStatusCallbackA(g_session, HttpStatusCallback);
+    return g_session;
+}
+
+// Finds or opens the connect handle for host:port. Idle hosts are evicted
+// least-recently-used when the table is full; if every slot is busy the
+// caller gets an uncached handle (*out_slot == NULL) and must close it.
+// Caller holds g_lock.
+static HINTERNET ConnectLocked(const char* host, INTERNET_PORT port, HostConn** out_slot) {
+    *out_slot = NULL;
+    HINTERNET session = SessionLocked();
+    if (!session) return NULL;
 
-    const DWORD chunk = 16 * 1024;
-    DWORD total = 0;
-    char* buffer = NULL;
-
-    for (;;) {
-        // Grow buffer
-        char* newbuf = (char*)realloc(buffer, total + chunk);
-        if (!newbuf) {
-            free(buffer);
-            InternetCloseHandle(hUrl);
-            InternetCloseHandle(hInternet);
-            return 0;
+    HostConn* free_slot = NULL;
+    HostConn* lru = NULL;
+    for (int i = 0; i < MAX_HOST_CONNECTIONS; i++) {
+        HostConn* hc = &g_hosts[i];
+        if (!hc->hConnect) {
+            if (!free_slot) free_slot = hc;
+            continue;
         }
-        buffer = newbuf;
-
-        DWORD read = 0;
-        if (!InternetReadFile(hUrl, buffer + total, chunk, &read)) {
-            free(buffer);
-            InternetCloseHandle(hUrl);
-            InternetCloseHandle(hInternet);
-            return 0;
+        if (hc->port == port && lstrcmpiA(hc->host, host) == 0) {
+            hc->last_used = GetTickCount();
+            hc->busy++;
+            *out_slot = hc;
+            return hc->hConnect;
         }
-        total += read;
-        if (read == 0) break; // EOF
+        if (hc->busy == 0 && (!lru || hc->last_used < lru->last_used)) lru = hc;
+    }
+
+    HINTERNET hConnect = InternetConnectA(session, host, port, NULL, NULL, INTERNET_SERVICE_HTTP, 0, 0);
+    if (!hConnect) return NULL;
+
+    HostConn* hc = free_slot ? free_slot : lru;
+    if (!hc) return hConnect; // all slots busy: uncached
+    if (hc->hConnect) InternetCloseHandle(hc->hConnect);
+    lstrcpynA(hc->host, host, (int)sizeof(hc->host));
+    hc->port = port;
+    hc->hConnect = hConnect;
+    hc->last_used = GetTickCount();
+    hc->busy = 1;
+    *out_slot = hc;
+    return hConnect;
+}
+
+static void ReleaseConnect(HostConn* slot, HINTERNET hConnect) {
+    if (!slot) {
+        InternetCloseHandle(hConnect);
+        return;
     }
+    EnterCriticalSection(&g_lock);
+    slot->busy--;
+    LeaveCriticalSection(&g_lock);
+}
+
+// Copies a response header into out (NUL-terminated); leaves "" when the
+// header is missing or does not fit.
+static void QueryHeaderString(HINTERNET hReq, DWORD which, char* out, DWORD out_size) {
+    DWORD len = out_size;
+    DWORD index = 0;
+    out[0] = 0;
+    if (!HttpQueryInfoA(hReq, which, out, &len, &index)) out[0] = 0;
+}
+
+// Content-Length of the response, or -1 when absent (chunked) or invalid.
+static long long QueryContentLength(HINTERNET hReq) {
+    char buf[32];
+    DWORD len = sizeof(buf);
+    DWORD index = 0;
+    if (!HttpQueryInfoA(hReq, HTTP_QUERY_CONTENT_LENGTH, buf, &len, &index)) return -1;
+    char* end = NULL;
+    long long n = _strtoi64(buf, &end, 10);
+    return (end != buf && n >= 0) ? n : -1;
+}
+
+// An open request. Lives on the heap so the status callback context stays
+// valid while the body is read.
+struct HttpResponse {
+    HINTERNET hReq;
+    HINTERNET hConnect;
+    HostConn* slot;
+    RequestCtx rc;
+    HttpPhaseTimes local_times;
+    // Kept from http_begin for http_send.
+    const char* extra_header;
+    HttpRequestInfo* out_info;
+    // Abort state. http_abort may only close hReq while the owner is
+    // provably inside a WinINet call on it (the status callback fired from
+    // within the call); closing it any earlier would hand the owner's next
+    // call a closed handle, whose value WinINet may already have reused.
+    CRITICAL_SECTION abort_lock;
+    int in_call; // owner is in (or about to enter) a call on hReq
+    int entered; // WinINet reported progress from inside that call
+    int aborted;
+    int closed;  // hReq closed (by http_abort or http_close)
+};
 
-    // Optionally shrink to exact size
-    if (buffer) {
-        char* shrink = (char*)realloc(buffer, total);
-        if (shrink) buffer = shrink;
+static void MarkEntered(RequestCtx* rc) {
+    HttpResponse* resp = CONTAINING_RECORD(rc, HttpResponse, rc);
+    EnterCriticalSection(&resp->abort_lock);
+    if (resp->in_call) resp->entered = 1;
+    LeaveCriticalSection(&resp->abort_lock);
+}
+
+// Brackets each owner call on hReq. BeginCall fails once the request was
+// aborted; EndCall turns a call that returned during an abort into a
+// failure.
+static int BeginCall(HttpResponse* resp) {
+    EnterCriticalSection(&resp->abort_lock);
+    int ok = !resp->aborted;
+    if (ok) {
+        resp->in_call = 1;
+        resp->entered = 0;
     }
+    LeaveCriticalSection(&resp->abort_lock);
+    return ok;
+}
+
+static int EndCall(HttpResponse* resp, BOOL ok) {
+    EnterCriticalSection(&resp->abort_lock);
+    resp->in_call = 0;
+    resp->entered = 0;
+    int aborted = resp->aborted;
+    LeaveCriticalSection(&resp->abort_lock);
+    return ok && !aborted;
+}
 
-    InternetCloseHandle(hUrl);
-    InternetCloseHandle(hInternet);
+static void SetTimeout(HINTERNET h, DWORD option, unsigned long ms) {
+    if (ms == 0) return;
+    DWORD v = (DWORD)ms;
+    InternetSetOptionA(h, option, &v, sizeof(v));
+}
 
-    *out_buf = buffer;
-    *out_len = total;
+HttpResponse* http_open(const char* url, const char* extra_header, HttpRequestInfo* out_info) {
+    HttpResponse* resp = http_begin(url, extra_header, out_info, NULL);
+    if (!resp) return NULL;
+    if (!http_send(resp)) {
+        http_close(resp);
+        return NULL;
+    }
+    return resp;
+}
+
+HttpResponse* http_begin(const char* url, const char* extra_header, HttpRequestInfo* out_info, const HttpTimeouts* timeouts) {
+    if (out_info) memset(out_info, 0, sizeof(*out_info));
+
+    InitOnceExecuteOnce(&g_init_once, InitOnceHttp, NULL, NULL);
+
+    // Split URL into scheme/host/port/path
+    char host[INTERNET_MAX_HOST_NAME_LENGTH];
+    char path[INTERNET_MAX_PATH_LENGTH + INTERNET_MAX_URL_LENGTH];
+    char extra[INTERNET_MAX_URL_LENGTH];
+    URL_COMPONENTSA uc = {0};
+    uc.dwStructSize = sizeof(uc);
+    uc.lpszHostName = host;
+    uc.dwHostNameLength = sizeof(host);
+    uc.lpszUrlPath = path;
+    uc.dwUrlPathLength = INTERNET_MAX_PATH_LENGTH;
+    uc.lpszExtraInfo = extra;
+    uc.dwExtraInfoLength = sizeof(extra);
+    if (!InternetCrackUrlA(url, 0, 0, &uc)) return NULL;
+    if (uc.dwExtraInfoLength > 0) lstrcatA(path, extra); // keep ?query
+
+    const int secure = (uc.nScheme == INTERNET_SCHEME_HTTPS);
+
+    HttpResponse* resp = (HttpResponse*)calloc(1, sizeof(HttpResponse));
+    if (!resp) return NULL;
+    InitializeCriticalSection(&resp->abort_lock);
+    RequestCtx* rc = &resp->rc;
+    rc->times = out_info ? &out_info->times : &resp->local_times;
+    rc->times->resolve_start = rc->times->resolve_end = -1;
+    rc->times->connect_start = rc->times->connect_end = -1;
+    rc->times->send_start = rc->times->headers_end = -1;
+    QueryPerformanceCounter(&rc->t0);
+
+    EnterCriticalSection(&g_lock);
+    resp->hConnect = ConnectLocked(host, uc.nPort, &resp->slot);
+    g_stats.requests++;
+    LeaveCriticalSection(&g_lock);
+    if (!resp->hConnect) {
+        DeleteCriticalSection(&resp->abort_lock);
+        free(resp);
+        return NULL;
+    }
+
+    // No INTERNET_OPTION_HTTP_DECODING: compressed bodies are read as sent
+    // and decoded by the caller, which also gets the on-the-wire size.
+    DWORD flags = INTERNET_FLAG_RELOAD | INTERNET_FLAG_NO_CACHE_WRITE | INTERNET_FLAG_KEEP_CONNECTION;
+    if (secure) flags |= INTERNET_FLAG_SECURE;
+
+    resp->hReq = HttpOpenRequestA(resp->hConnect, "GET", path, NULL, NULL, NULL, flags, (DWORD_PTR)rc);
+    if (!resp->hReq) {
+        ReleaseConnect(resp->slot, resp->hConnect);
+        DeleteCriticalSection(&resp->abort_lock);
+        free(resp);
+        return NULL;
+    }
+    if (timeouts) {
+        SetTimeout(resp->hReq, INTERNET_OPTION_CONNECT_TIMEOUT, timeouts->connect_ms);
+        SetTimeout(resp->hReq, INTERNET_OPTION_SEND_TIMEOUT, timeouts->send_ms);
+        SetTimeout(resp->hReq, INTERNET_OPTION_RECEIVE_TIMEOUT, timeouts->receive_ms);
+    }
+    resp->extra_header = extra_header;
+    resp->out_info = out_info;
+    return resp;
+}
+
+int http_send(HttpResponse* resp) {
+    RequestCtx* rc = &resp->rc;
+    HttpRequestInfo* out_info = resp->out_info;
+    const char* extra_header = resp->extra_header;
+    HINTERNET hReq = resp->hReq;
+
+    DWORD header_len = 0;
+    if (extra_header) {
+        header_len = (DWORD)lstrlenA(extra_header);
+    }
+    if (!BeginCall(resp)) return 0;
+    BOOL sent = HttpSendRequestA(hReq, extra_header, header_len, NULL, 0);
+    // From here until the next call an abort only sets the flag, so the
+    // header queries below run on an open handle.
+    if (!EndCall(resp, sent)) return 0;
+    rc->times->headers_end = ElapsedNs(rc);
+
+    EnterCriticalSection(&g_lock);
+    if (rc->new_connection) g_stats.connections_new++;
+    else g_stats.connections_reused++;
+    LeaveCriticalSection(&g_lock);
+    if (out_info) {
+        out_info->reused_connection = rc->new_connection ? 0 : 1;
+        DWORD status = 0;
+        DWORD len = sizeof(status);
+        if (HttpQueryInfoA(hReq, HTTP_QUERY_STATUS_CODE | HTTP_QUERY_FLAG_NUMBER, &status, &len, NULL)) {
+            out_info->status = (int)status;
+        }
+        QueryHeaderString(hReq, HTTP_QUERY_ETAG, out_info->etag, sizeof(out_info->etag));
+        QueryHeaderString(hReq, HTTP_QUERY_LAST_MODIFIED, out_info->last_modified, sizeof(out_info->last_modified));
+        QueryHeaderString(hReq, HTTP_QUERY_CONTENT_ENCODING, out_info->content_encoding, sizeof(out_info->content_encoding));
+        out_info->content_length = QueryContentLength(hReq);
+        DWORD retry_after = 0;
+        len = sizeof(retry_after);
+        out_info->retry_after_s = -1;
+        if (HttpQueryInfoA(hReq, HTTP_QUERY_RETRY_AFTER | HTTP_QUERY_FLAG_NUMBER, &retry_after, &len, NULL)) {
+            out_info->retry_after_s = (int)retry_after;
+        }
+    }
+    return 1;
+}
+
+int http_read(HttpResponse* resp, char* buf, unsigned long len, unsigned long* out_read) {
+    *out_read = 0;
+    DWORD read = 0;
+    if (!BeginCall(resp)) return 0;
+    BOOL ok = InternetReadFile(resp->hReq, buf, len, &read);
+    if (!EndCall(resp, ok)) return 0;
+    *out_read = read;
     return 1;
 }
 
-void http_free(void* p) {
-    if (p) free(p);
+void http_abort(HttpResponse* resp) {
+    if (!resp) return;
+    EnterCriticalSection(&resp->abort_lock);
+    resp->aborted = 1;
+    int close_now = resp->in_call && resp->entered && !resp->closed;
+    if (close_now) resp->closed = 1;
+    LeaveCriticalSection(&resp->abort_lock);
+    // Closed outside the lock: the owner's callbacks and EndCall take it
+    // while the blocked call unwinds. Before the call has reported
+    // progress only the flag is set; it then fails at its end (bounded by
+    // the handle's timeouts) and no further call starts.
+    if (close_now) InternetCloseHandle(resp->hReq);
+}
+
+void http_close(HttpResponse* resp) {
+    if (!resp) return;
+    // A body read to EOF returns the socket to the keep-alive pool here;
+    // an aborted request's handle may already be closed.
+    EnterCriticalSection(&resp->abort_lock);
+    int close_now = !resp->closed;
+    resp->closed = 1;
+    LeaveCriticalSection(&resp->abort_lock);
+    if (close_now) InternetCloseHandle(resp->hReq);
+    ReleaseConnect(resp->slot, resp->hConnect);
+    DeleteCriticalSection(&resp->abort_lock);
+    free(resp);
+}
+
+void http_get_stats(HttpStats* out) {
+    if (!out) return;
+    InitOnceExecuteOnce(&g_init_once, InitOnceHttp, NULL, NULL);
+    EnterCriticalSection(&g_lock);
+    *out = g_stats;
+    LeaveCriticalSection(&g_lock);
+}
+
+void http_shutdown(void) {
+    InitOnceExecuteOnce(&g_init_once, InitOnceHttp, NULL, NULL);
+    EnterCriticalSection(&g_lock);
+    for (int i = 0; i < MAX_HOST_CONNECTIONS; i++) {
+        if (g_hosts[i].hConnect) InternetCloseHandle(g_hosts[i].hConnect);
+        g_hosts[i].hConnect = NULL;
+    }
+    if (g_session) {
+        InternetSetStatusCallbackA(g_session, NULL);
+        InternetCloseHandle(g_session);
+        g_session = NULL;
+    }
+    LeaveCriticalSection(&g_lock);
 }
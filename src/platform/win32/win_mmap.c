@@ -0,0 +1,40 @@
+#include "win_mmap.h"
+#include <windows.h>
+
+int mmap_open_read(const char* path, const void** out_base, unsigned long long* out_len) {
+    if (!path || !out_base || !out_len) return 0;
+    *out_base = NULL;
+    *out_len = 0;
+
+    HANDLE file = CreateFileA(path, GENERIC_READ,
+                              FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                              NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) return 0;
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size)) {
+        CloseHandle(file);
+        return 0;
+    }
+    if (size.QuadPart == 0) {
+        // Zero-length files cannot be mapped; report an empty view.
+        CloseHandle(file);
+        return 1;
+    }
+
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    // The view keeps the section (and file) alive; handles can go now.
+    CloseHandle(file);
+    if (!mapping) return 0;
+    const void* base = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping);
+    if (!base) return 0;
+
+    *out_base = base;
+    *out_len = (unsigned long long)size.QuadPart;
+    return 1;
+}
+
+void mmap_close(const void* base) {
+    if (base) UnmapViewOfFile(base);
+}
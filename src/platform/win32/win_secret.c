@@ -61,10 +61,11 @@ int dpapi_load_and_decrypt(const char* path, unsigned char** out_buf, unsigned l
     if (!ok) return 0;
 
     unsigned char* buf = (unsigned char*)malloc(out.cbData);
-    if (!buf) { LocalFree(out.pbData); return 0; }
+    if (!buf) { SecureZeroMemory(out.pbData, out.cbData); LocalFree(out.pbData); return 0; }
     memcpy(buf, out.pbData, out.cbData);
     *out_buf = buf;
     *out_len = out.cbData;
+    SecureZeroMemory(out.pbData, out.cbData);
     LocalFree(out.pbData);
     return 1;
 }
@@ -73,3 +74,11 @@ void secret_free(void* p) {
     if (p) free(p);
 }
 
+
+int secret_lock(void* p, unsigned long long len) {
+    return VirtualLock(p, (SIZE_T)len) ? 1 : 0;
+}
+
+void secret_unlock(void* p, unsigned long long len) {
+    VirtualUnlock(p, (SIZE_T)len);
+}
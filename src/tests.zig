@@ -0,0 +1,6 @@
+//! Test root for files under src/ that import across its subdirectories
+//! (a module cannot import above the directory of its root file, so they
+//! cannot be roots themselves). `zig build test` runs it with the others.
+test {
+    _ = @import("features/models_cache.zig");
+}
@@ -0,0 +1,75 @@
+const std = @import("std");
+
+// Allocator wrapper that counts calls and bytes going to `child`.
+// Used by the benchmarks for bytes/op and allocations/op. Not thread-safe;
+// wrap one per thread.
+pub const CountingAllocator = struct {
+    child: std.mem.Allocator,
+    // Successful alloc calls.
+    allocs: u64 = 0,
+    // Successful in-place resizes and remaps.
+    resizes: u64 = 0,
+    frees: u64 = 0,
+    // Bytes handed out (allocs plus growth from resizes).
+    bytes_allocated: u64 = 0,
+    live_bytes: u64 = 0,
+    peak_bytes: u64 = 0,
+
+    pub fn init(child: std.mem.Allocator) CountingAllocator {
+        return .{ .child = child };
+    }
+
+    pub fn allocator(self: *CountingAllocator) std.mem.Allocator {
+        return .{ .ptr = self, .vtable = &vtable };
+    }
+
+    // Zeroes the counters; live_bytes is kept so frees stay balanced.
+    pub fn reset(self: *CountingAllocator) void {
+        const live = self.live_bytes;
+        self.* = .{ .child = self.child, .live_bytes = live, .peak_bytes = live };
+    }
+
+    const vtable = std.mem.Allocator.VTable{
+        .alloc = alloc,
+        .resize = resize,
+        .remap = remap,
+        .free = free,
+    };
+
+    fn alloc(ctx: *anyopaque, len: usize, alignment: std.mem.Alignment, ret_addr: usize) ?[*]u8 {
+        const self: *CountingAllocator = @ptrCast(@alignCast(ctx));
+        const p = self.child.rawAlloc(len, alignment, ret_addr) orelse return null;
+        self.allocs += 1;
+        self.grow(0, len);
+        return p;
+    }
+
+    fn resize(ctx: *anyopaque, memory: []u8, alignment: std.mem.Alignment, new_len: usize, ret_addr: usize) bool {
+        const self: *CountingAllocator = @ptrCast(@alignCast(ctx));
+        if (!self.child.rawResize(memory, alignment, new_len, ret_addr)) return false;
+        self.resizes += 1;
+        self.grow(memory.len, new_len);
+        return true;
+    }
+
+    fn remap(ctx: *anyopaque, memory: []u8, alignment: std.mem.Alignment, new_len: usize, ret_addr: usize) ?[*]u8 {
+        const self: *CountingAllocator = @ptrCast(@alignCast(ctx));
+        const p = self.child.rawRemap(memory, alignment, new_len, ret_addr) orelse return null;
+        self.resizes += 1;
+        self.grow(memory.len, new_len);
+        return p;
+    }
+
+    fn free(ctx: *anyopaque, memory: []u8, alignment: std.mem.Alignment, ret_addr: usize) void {
+        const self: *CountingAllocator = @ptrCast(@alignCast(ctx));
+        self.child.rawFree(memory, alignment, ret_addr);
+        self.frees += 1;
+        self.live_bytes -|= memory.len;
+    }
+
+    fn grow(self: *CountingAllocator, old_len: usize, new_len: usize) void {
+        if (new_len > old_len) self.bytes_allocated += new_len - old_len;
+        self.live_bytes = self.live_bytes - @min(self.live_bytes, old_len) + new_len;
+        self.peak_bytes = @max(self.peak_bytes, self.live_bytes);
+    }
+};
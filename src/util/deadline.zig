@@ -0,0 +1,397 @@
+//! Deadlines and cooperative cancellation for outgoing requests.
+//! - A `Context` carries per-phase timeouts (connect, first byte, total)
+//!   and an optional `CancelToken`. It is a small value: pass it down the
+//!   call stack and copy it freely.
+//! - Each request runs under a `Guard`. The guard fires when the token is
+//!   canceled or the current phase runs out, and then calls the abort
+//!   target the transport registered (close the socket or handle), so a
+//!   call blocked in connect, send or read returns right away instead of
+//!   at its next check.
+//! - Phase deadlines are watched by one process-wide thread, started on
+//!   first use; checks between phases need no thread.
+//! - Waits outside the transport (rate-limit budget, retry backoff) use
+//!   `Guard.sleep` or a wake target, so they end on cancel and count
+//!   against the total budget too.
+//! - A fired guard turns whatever error the aborted transport produced
+//!   into error.Canceled or error.DeadlineExceeded (`failed`).
+//! Registered as the `deadline` module so the app, the `openai` module and
+//! the platform HTTP adapter share one watchdog.
+const std = @import("std");
+
+pub const Error = error{ Canceled, DeadlineExceeded };
+
+pub const Phase = enum {
+    // DNS, TCP and TLS for a new connection.
+    connect,
+    // Request sent until the response head arrives.
+    first_byte,
+    // Reading the body: `idle_ms` per wait for more bytes (re-armed per
+    // read), capped by the total deadline.
+    body,
+};
+
+pub const Timeouts = struct {
+    connect_ms: ?u32 = null,
+    first_byte_ms: ?u32 = null,
+    // Longest gap between body reads; catches streams that stall midway.
+    idle_ms: ?u32 = null,
+    // Whole call: scheduler waits, retries and the body included.
+    total_ms: ?u32 = null,
+};
+
+// Cancels every request whose context carries it. `cancel` may be called
+// from any thread; the token must outlive those requests.
+pub const CancelToken = struct {
+    canceled: std.atomic.Value(bool) = std.atomic.Value(bool).init(false),
+    mutex: std.Thread.Mutex = .{},
+    // Guards of requests in flight (intrusive list).
+    guards: ?*Guard = null,
+
+    pub fn cancel(self: *CancelToken) void {
+        self.mutex.lock();
+        defer self.mutex.unlock();
+        self.canceled.store(true, .release);
+        var g = self.guards;
+        while (g) |guard| : (g = guard.token_next) guard.fire(error.Canceled);
+    }
+
+    pub fn isCanceled(self: *const CancelToken) bool {
+        return self.canceled.load(.acquire);
+    }
+
+    // Makes the token usable again once no request holds it.
+    pub fn reset(self: *CancelToken) void {
+        self.canceled.store(false, .release);
+    }
+};
+
+pub const Context = struct {
+    timeouts: Timeouts = .{},
+    token: ?*CancelToken = null,
+    // End of the total budget on the module clock (`now`).
+    total_due_ns: ?u64 = null,
+
+    // Starts the total budget now.
+    pub fn init(timeouts: Timeouts, token: ?*CancelToken) Context {
+        return .{
+            .timeouts = timeouts,
+            .token = token,
+            .total_due_ns = if (timeouts.total_ms) |ms| now() + @as(u64, ms) * std.time.ns_per_ms else null,
+        };
+    }
+
+    pub fn check(self: Context) Error!void {
+        if (self.token) |t| if (t.isCanceled()) return error.Canceled;
+        if (self.total_due_ns) |due| if (now() >= due) return error.DeadlineExceeded;
+    }
+
+    // Deadline for `phase` if it started now: its own limit, capped by the
+    // total budget. Null when unbounded.
+    pub fn phaseDue(self: Context, phase: Phase) ?u64 {
+        const limit_ms: ?u32 = switch (phase) {
+            .connect => self.timeouts.connect_ms,
+            .first_byte => self.timeouts.first_byte_ms,
+            .body => self.timeouts.idle_ms,
+        };
+        const own = if (limit_ms) |ms| now() + @as(u64, ms) * std.time.ns_per_ms else null;
+        if (own) |o| if (self.total_due_ns) |t| return @min(o, t);
+        return own orelse self.total_due_ns;
+    }
+
+    // Milliseconds left for `phase` (at least 1), for transports with
+    // their own timeout settings. Null when unbounded.
+    pub fn phaseMs(self: Context, phase: Phase) ?u32 {
+        const due = self.phaseDue(phase) orelse return null;
+        const left = (due -| now()) / std.time.ns_per_ms;
+        return @intCast(std.math.clamp(left, 1, std.math.maxInt(u32)));
+    }
+};
+
+// What a guard calls to interrupt the transport. Runs on the canceling
+// thread or the watchdog, so it must only poke the transport (shutdown a
+// socket, close a handle), never free it.
+pub const Target = struct {
+    ctx: *anyopaque,
+    abort: *const fn (ctx: *anyopaque) void,
+};
+
+// One request's view of a `Context`. Pinned in memory between `start`
+// and `finish` (the token and watchdog link to it).
+pub const Guard = struct {
+    context: Context,
+    // 0 while live, else the reason it fired.
+    fired: std.atomic.Value(u8) = std.atomic.Value(u8).init(0),
+    // Protects `target` against a concurrent fire.
+    mutex: std.Thread.Mutex = .{},
+    target: ?Target = null,
+    // Token list links.
+    token_next: ?*Guard = null,
+    token_prev: ?*Guard = null,
+    // Set when the guard fires; ends `sleep` early.
+    wake: std.Thread.ResetEvent = .{},
+    // Watchdog list links and the armed deadline.
+    watch_next: ?*Guard = null,
+    watch_prev: ?*Guard = null,
+    watched: bool = false,
+    due_ns: u64 = 0,
+
+    const fired_canceled = 1;
+    const fired_deadline = 2;
+
+    // Registers with the context's token and arms the total budget; phase
+    // limits start with the first `phase` call, so time spent queued (e.g.
+    // for rate-limit budget) only counts against the total.
+    pub fn start(self: *Guard, context: Context) Error!void {
+        self.* = .{ .context = context };
+        try context.check();
+        if (context.token) |t| {
+            t.mutex.lock();
+            defer t.mutex.unlock();
+            if (t.isCanceled()) return error.Canceled;
+            self.token_next = t.guards;
+            if (t.guards) |head| head.token_prev = self;
+            t.guards = self;
+        }
+        if (context.total_due_ns) |due| watchdog.arm(self, due);
+    }
+
+    // Moves to `phase`: fails if the guard already fired, else re-arms
+    // the watchdog for the phase's deadline.
+    pub fn phase(self: *Guard, p: Phase) Error!void {
+        try self.check();
+        self.arm(p);
+    }
+
+    // Sleeps `ns`, waking early when the guard fires. Fails when it fired or
+    // the total budget ran out first.
+    pub fn sleep(self: *Guard, ns: u64) Error!void {
+        try self.check();
+        var wait = ns;
+        if (self.context.total_due_ns) |due| wait = @min(wait, due -| now());
+        self.wake.timedWait(wait) catch {};
+        try self.check();
+    }
+
+    pub fn check(self: *const Guard) Error!void {
+        if (self.reason()) |e| return e;
+        try self.context.check();
+    }
+
+    pub fn reason(self: *const Guard) ?Error {
+        return switch (self.fired.load(.acquire)) {
+            0 => null,
+            fired_canceled => error.Canceled,
+            else => error.DeadlineExceeded,
+        };
+    }
+
+    // The error to report for a transport failure: the guard's reason when
+    // it fired (the failure was the abort), else `err` unchanged.
+    pub fn failed(self: *const Guard, err: anyerror) anyerror {
+        return self.reason() orelse err;
+    }
+
+    // Sets (or with null, clears) what an abort interrupts. Clear it
+    // before the transport object goes away; after `setTarget(null)`
+    // returns no abort is running or will start on it. Fails when the
+    // guard already fired, so the caller aborts on its own.
+    pub fn setTarget(self: *Guard, target: ?Target) Error!void {
+        self.mutex.lock();
+        defer self.mutex.unlock();
+        self.target = target;
+        if (target != null) if (self.reason()) |e| return e;
+    }
+
+    // Unregisters from the token and the watchdog. Call exactly once after
+    // a successful `start`.
+    pub fn finish(self: *Guard) void {
+        watchdog.disarm(self);
+        if (self.context.token) |t| {
+            t.mutex.lock();
+            defer t.mutex.unlock();
+            if (self.token_prev) |p| p.token_next = self.token_next else t.guards = self.token_next;
+            if (self.token_next) |n| n.token_prev = self.token_prev;
+        }
+        self.setTarget(null) catch {};
+    }
+
+    fn arm(self: *Guard, p: Phase) void {
+        if (self.context.phaseDue(p)) |due| watchdog.arm(self, due) else watchdog.disarm(self);
+    }
+
+    fn fire(self: *Guard, why: Error) void {
+        const code: u8 = if (why == error.Canceled) fired_canceled else fired_deadline;
+        if (self.fired.cmpxchgStrong(0, code, .acq_rel, .acquire) != null) return;
+        self.wake.set();
+        self.mutex.lock();
+        defer self.mutex.unlock();
+        if (self.target) |t| t.abort(t.ctx);
+    }
+};
+
+// Nanoseconds on the monotonic clock since the module was first used.
+pub fn now() u64 {
+    clock_once.call();
+    const b = clock_base orelse return 0;
+    const t = std.time.Instant.now() catch return 0;
+    return t.since(b);
+}
+
+var clock_base: ?std.time.Instant = null;
+var clock_once = std.once(initClock);
+
+fn initClock() void {
+    clock_base = std.time.Instant.now() catch null;
+}
+
+// Fires guards whose phase deadline passed. Armed guards sit in an
+// unsorted list: requests in flight number in the tens, so a scan per
+// wakeup is cheaper than keeping a heap.
+const Watchdog = struct {
+    mutex: std.Thread.Mutex = .{},
+    cond: std.Thread.Condition = .{},
+    head: ?*Guard = null,
+    started: bool = false,
+
+    fn arm(self: *Watchdog, g: *Guard, due: u64) void {
+        self.mutex.lock();
+        defer self.mutex.unlock();
+        // A later deadline (the usual re-arm per body read) needs no wakeup:
+        // the thread rescans when the old one comes due.
+        const earlier = !g.watched or due < g.due_ns;
+        g.due_ns = due;
+        if (!g.watched) {
+            g.watch_prev = null;
+            g.watch_next = self.head;
+            if (self.head) |h| h.watch_prev = g;
+            self.head = g;
+            g.watched = true;
+        }
+        if (!self.started) {
+            // Without the thread deadlines are still checked between phases.
+            const t = std.Thread.spawn(.{ .stack_size = 64 * 1024 }, loop, .{self}) catch return;
+            t.detach();
+            self.started = true;
+        }
+        if (earlier) self.cond.signal();
+    }
+
+    fn disarm(self: *Watchdog, g: *Guard) void {
+        self.mutex.lock();
+        defer self.mutex.unlock();
+        self.unlinkLocked(g);
+    }
+
+    fn unlinkLocked(self: *Watchdog, g: *Guard) void {
+        if (!g.watched) return;
+        if (g.watch_prev) |p| p.watch_next = g.watch_next else self.head = g.watch_next;
+        if (g.watch_next) |n| n.watch_prev = g.watch_prev;
+        g.watch_next = null;
+        g.watch_prev = null;
+        g.watched = false;
+    }
+
+    fn loop(self: *Watchdog) void {
+        self.mutex.lock();
+        defer self.mutex.unlock();
+        while (true) {
+            const t = now();
+            var earliest: ?u64 = null;
+            var it = self.head;
+            while (it) |g| {
+                it = g.watch_next;
+                if (g.due_ns <= t) {
+                    self.unlinkLocked(g);
+                    g.fire(error.DeadlineExceeded);
+                } else {
+                    earliest = @min(earliest orelse g.due_ns, g.due_ns);
+                }
+            }
+            if (earliest) |e| {
+                self.cond.timedWait(&self.mutex, e - t) catch {};
+            } else {
+                self.cond.wait(&self.mutex);
+            }
+        }
+    }
+};
+
+var watchdog: Watchdog = .{};
+
+// Abort target for tests: counts calls.
+fn countAbort(ctx: *anyopaque) void {
+    const n: *std.atomic.Value(u32) = @ptrCast(@alignCast(ctx));
+    _ = n.fetchAdd(1, .acq_rel);
+}
+
+fn cancelAfter(token: *CancelToken, ms: u64) void {
+    std.Thread.sleep(ms * std.time.ns_per_ms);
+    token.cancel();
+}
+
+test "a canceled token fails checks and new guards" {
+    var token: CancelToken = .{};
+    const ctx = Context.init(.{}, &token);
+    try ctx.check();
+    token.cancel();
+    try std.testing.expectError(error.Canceled, ctx.check());
+    var guard: Guard = undefined;
+    try std.testing.expectError(error.Canceled, guard.start(ctx));
+
+    token.reset();
+    try guard.start(ctx);
+    guard.finish();
+    try std.testing.expect(token.guards == null);
+}
+
+test "cancel wakes a sleeping guard and aborts its target" {
+    var token: CancelToken = .{};
+    var guard: Guard = undefined;
+    try guard.start(Context.init(.{}, &token));
+    defer guard.finish();
+    var aborts = std.atomic.Value(u32).init(0);
+    try guard.setTarget(.{ .ctx = &aborts, .abort = countAbort });
+
+    const canceler = try std.Thread.spawn(.{}, cancelAfter, .{ &token, 50 });
+    defer canceler.join();
+    var timer = try std.time.Timer.start();
+    try std.testing.expectError(error.Canceled, guard.sleep(5 * std.time.ns_per_s));
+    try std.testing.expect(timer.read() < std.time.ns_per_s);
+    try std.testing.expectEqual(@as(u32, 1), aborts.load(.acquire));
+    try std.testing.expectEqual(@as(?Error, error.Canceled), guard.reason());
+    // A fired guard refuses a new target, so the caller aborts on its own.
+    try std.testing.expectError(error.Canceled, guard.setTarget(.{ .ctx = &aborts, .abort = countAbort }));
+    try std.testing.expectEqual(@as(anyerror, error.Canceled), guard.failed(error.ConnectionResetByPeer));
+}
+
+test "the watchdog fires a phase deadline once" {
+    var guard: Guard = undefined;
+    try guard.start(Context.init(.{ .first_byte_ms = 30 }, null));
+    defer guard.finish();
+    var aborts = std.atomic.Value(u32).init(0);
+    try guard.setTarget(.{ .ctx = &aborts, .abort = countAbort });
+    try guard.phase(.first_byte);
+
+    // The connect phase has no limit and the total is unbounded; only the
+    // first-byte limit can end this sleep.
+    try std.testing.expectError(error.DeadlineExceeded, guard.sleep(5 * std.time.ns_per_s));
+    try std.testing.expectEqual(@as(u32, 1), aborts.load(.acquire));
+    try std.testing.expectError(error.DeadlineExceeded, guard.phase(.body));
+    // With the guard fired, a transport error reads as the deadline.
+    try std.testing.expectEqual(@as(anyerror, error.DeadlineExceeded), guard.failed(error.EndOfStream));
+}
+
+test "the total budget caps sleeps and phases" {
+    const ctx = Context.init(.{ .total_ms = 40, .idle_ms = 10_000 }, null);
+    // The phase limit is capped by the total budget.
+    try std.testing.expect(ctx.phaseDue(.body).? <= ctx.total_due_ns.?);
+    try std.testing.expect(ctx.phaseMs(.body).? <= 40);
+    try std.testing.expectEqual(@as(?u64, null), Context.init(.{}, null).phaseDue(.connect));
+
+    var guard: Guard = undefined;
+    try guard.start(ctx);
+    defer guard.finish();
+    var timer = try std.time.Timer.start();
+    try std.testing.expectError(error.DeadlineExceeded, guard.sleep(5 * std.time.ns_per_s));
+    try std.testing.expect(timer.read() < std.time.ns_per_s);
+}
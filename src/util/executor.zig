@@ -0,0 +1,331 @@
+//! Small portable job executor.
+//! - A fixed pool of worker threads runs `Job.run` off the UI thread.
+//! - Finished jobs land on a completion queue; the owner thread drains it
+//!   (e.g. from the Win32 message loop) and `Job.complete` runs there.
+//! - No Win32 dependency: waking the owner thread is delegated to `notify`.
+const std = @import("std");
+
+// Intrusive job node. Embed it in a larger struct and recover the parent
+// with `@fieldParentPtr` inside the callbacks.
+pub const Job = struct {
+    // Runs on a worker thread.
+    run: *const fn (job: *Job) void,
+    // Runs on the thread that calls `Executor.drainCompletions`.
+    complete: *const fn (job: *Job) void,
+
+    // Filled in by the executor.
+    id: u64 = 0,
+    next: ?*Job = null,
+};
+
+pub const Handle = struct {
+    id: u64,
+};
+
+pub const Stats = struct {
+    // Jobs waiting for a worker.
+    queued: usize,
+    // Highest `queued` value observed since init.
+    max_queued: usize,
+    // Jobs currently executing on a worker.
+    running: usize,
+    // Jobs finished but not yet drained by the owner thread.
+    awaiting_completion: usize,
+    submitted: u64,
+    completed: u64,
+    // Time from `init` to the first `markFirstPaint`, if it happened.
+    first_paint_ns: ?u64,
+};
+
+// Simple FIFO over the intrusive `next` link.
+const Queue = struct {
+    head: ?*Job = null,
+    tail: ?*Job = null,
+    len: usize = 0,
+
+    fn push(q: *Queue, job: *Job) void {
+        job.next = null;
+        if (q.tail) |t| t.next = job else q.head = job;
+        q.tail = job;
+        q.len += 1;
+    }
+
+    fn pop(q: *Queue) ?*Job {
+        const job = q.head orelse return null;
+        q.head = job.next;
+        if (q.head == null) q.tail = null;
+        job.next = null;
+        q.len -= 1;
+        return job;
+    }
+};
+
+pub const Executor = struct {
+    allocator: std.mem.Allocator,
+    threads: []std.Thread = &.{},
+
+    mutex: std.Thread.Mutex = .{},
+    work_cond: std.Thread.Condition = .{},
+    pending: Queue = .{},
+    done: Queue = .{},
+    running: usize = 0,
+    shutting_down: bool = false,
+
+    next_id: u64 = 1,
+    submitted: u64 = 0,
+    completed: u64 = 0,
+    max_queued: usize = 0,
+
+    started: ?std.time.Instant = null,
+    first_paint_ns: ?u64 = null,
+
+    notify: ?*const fn (ctx: ?*anyopaque) void = null,
+    notify_ctx: ?*anyopaque = null,
+
+    pub const Options = struct {
+        threads: usize = 2,
+        // Called from a worker thread after a job was pushed onto the
+        // completion queue. Typically posts a message to the UI thread.
+        notify: ?*const fn (ctx: ?*anyopaque) void = null,
+        notify_ctx: ?*anyopaque = null,
+    };
+
+    // Initializes in place: worker threads keep a pointer to `self`.
+    pub fn init(self: *Executor, allocator: std.mem.Allocator, options: Options) !void {
+        self.* = .{
+            .allocator = allocator,
+            .notify = options.notify,
+            .notify_ctx = options.notify_ctx,
+            .started = std.time.Instant.now() catch null,
+        };
+
+        const n = @max(options.threads, 1);
+        const threads = try allocator.alloc(std.Thread, n);
+        errdefer allocator.free(threads);
+
+        var spawned: usize = 0;
+        errdefer {
+            self.mutex.lock();
+            self.shutting_down = true;
+            self.mutex.unlock();
+            self.work_cond.broadcast();
+            for (threads[0..spawned]) |t| t.join();
+        }
+        while (spawned < n) : (spawned += 1) {
+            threads[spawned] = try std.Thread.spawn(.{}, workerMain, .{self});
+        }
+        self.threads = threads;
+    }
+
+    // Stops the workers after their current job. Jobs still queued and
+    // completions not yet drained are dropped without callbacks.
+    pub fn deinit(self: *Executor) void {
+        self.mutex.lock();
+        self.shutting_down = true;
+        self.mutex.unlock();
+        self.work_cond.broadcast();
+
+        for (self.threads) |t| t.join();
+        self.allocator.free(self.threads);
+        self.threads = &.{};
+    }
+
+    pub fn submit(self: *Executor, job: *Job) Handle {
+        self.mutex.lock();
+        defer self.mutex.unlock();
+
+        job.id = self.next_id;
+        self.next_id += 1;
+        self.submitted += 1;
+        self.pending.push(job);
+        self.max_queued = @max(self.max_queued, self.pending.len);
+        self.work_cond.signal();
+        return .{ .id = job.id };
+    }
+
+    // Runs `complete` for every finished job. Call from the owner thread.
+    // Returns the number of completions applied.
+    pub fn drainCompletions(self: *Executor) usize {
+        // Detach the whole list under the lock, then run callbacks unlocked
+        // so they are free to submit follow-up jobs.
+        self.mutex.lock();
+        var list = self.done;
+        self.done = .{};
+        self.mutex.unlock();
+
+        var n: usize = 0;
+        while (list.pop()) |job| {
+            job.complete(job);
+            n += 1;
+        }
+        return n;
+    }
+
+    // Records time-to-first-paint; only the first call has an effect.
+    pub fn markFirstPaint(self: *Executor) void {
+        self.mutex.lock();
+        defer self.mutex.unlock();
+        if (self.first_paint_ns != null) return;
+        const start = self.started orelse return;
+        const now = std.time.Instant.now() catch return;
+        self.first_paint_ns = now.since(start);
+    }
+
+    pub fn stats(self: *Executor) Stats {
+        self.mutex.lock();
+        defer self.mutex.unlock();
+        return .{
+            .queued = self.pending.len,
+            .max_queued = self.max_queued,
+            .running = self.running,
+            .awaiting_completion = self.done.len,
+            .submitted = self.submitted,
+            .completed = self.completed,
+            .first_paint_ns = self.first_paint_ns,
+        };
+    }
+
+    fn workerMain(self: *Executor) void {
+        while (true) {
+            self.mutex.lock();
+            while (self.pending.len == 0 and !self.shutting_down) {
+                self.work_cond.wait(&self.mutex);
+            }
+            if (self.shutting_down) {
+                self.mutex.unlock();
+                return;
+            }
+            const job = self.pending.pop().?;
+            self.running += 1;
+            self.mutex.unlock();
+
+            job.run(job);
+
+            self.mutex.lock();
+            self.running -= 1;
+            self.completed += 1;
+            self.done.push(job);
+            self.mutex.unlock();
+
+            if (self.notify) |f| f(self.notify_ctx);
+        }
+    }
+};
+
+const TestJob = struct {
+    job: Job = .{ .run = run, .complete = complete },
+    ran_on: ?std.Thread.Id = null,
+    completed_on: ?std.Thread.Id = null,
+    // Set by `run` when it starts; `run` then waits for `gate`.
+    started: ?*std.Thread.ResetEvent = null,
+    gate: ?*std.Thread.ResetEvent = null,
+    // Submitted from `complete`.
+    follow_up: ?*TestJob = null,
+    executor: ?*Executor = null,
+
+    fn run(job: *Job) void {
+        const self: *TestJob = @fieldParentPtr("job", job);
+        self.ran_on = std.Thread.getCurrentId();
+        if (self.started) |e| e.set();
+        if (self.gate) |g| g.wait();
+    }
+
+    fn complete(job: *Job) void {
+        const self: *TestJob = @fieldParentPtr("job", job);
+        self.completed_on = std.Thread.getCurrentId();
+        if (self.follow_up) |f| _ = self.executor.?.submit(&f.job);
+    }
+
+    // `notify` callback: one post per finished job.
+    fn notify(ctx: ?*anyopaque) void {
+        const finished: *std.Thread.Semaphore = @ptrCast(@alignCast(ctx.?));
+        finished.post();
+    }
+};
+
+test "jobs run on workers and complete on the draining thread" {
+    var finished = std.Thread.Semaphore{};
+    var ex: Executor = undefined;
+    try ex.init(std.testing.allocator, .{ .threads = 2, .notify = TestJob.notify, .notify_ctx = &finished });
+    defer ex.deinit();
+
+    var jobs: [8]TestJob = undefined;
+    var last_id: u64 = 0;
+    for (&jobs) |*j| {
+        j.* = .{};
+        const handle = ex.submit(&j.job);
+        try std.testing.expect(handle.id > last_id);
+        last_id = handle.id;
+    }
+    for (jobs) |_| finished.wait();
+    try std.testing.expectEqual(@as(usize, jobs.len), ex.drainCompletions());
+
+    const me = std.Thread.getCurrentId();
+    for (jobs) |j| {
+        try std.testing.expect(j.ran_on.? != me);
+        try std.testing.expectEqual(me, j.completed_on.?);
+    }
+    const s = ex.stats();
+    try std.testing.expectEqual(@as(u64, jobs.len), s.submitted);
+    try std.testing.expectEqual(@as(u64, jobs.len), s.completed);
+    try std.testing.expectEqual(@as(usize, 0), s.queued);
+    try std.testing.expectEqual(@as(usize, 0), s.running);
+    try std.testing.expectEqual(@as(usize, 0), s.awaiting_completion);
+}
+
+test "queue depth is reported while the worker is busy" {
+    var finished = std.Thread.Semaphore{};
+    var ex: Executor = undefined;
+    try ex.init(std.testing.allocator, .{ .threads = 1, .notify = TestJob.notify, .notify_ctx = &finished });
+    defer ex.deinit();
+
+    var started = std.Thread.ResetEvent{};
+    var gate = std.Thread.ResetEvent{};
+    var blocker = TestJob{ .started = &started, .gate = &gate };
+    _ = ex.submit(&blocker.job);
+    started.wait();
+
+    var queued: [3]TestJob = .{ .{}, .{}, .{} };
+    for (&queued) |*j| _ = ex.submit(&j.job);
+    var s = ex.stats();
+    try std.testing.expectEqual(@as(usize, 3), s.queued);
+    try std.testing.expectEqual(@as(usize, 3), s.max_queued);
+    try std.testing.expectEqual(@as(usize, 1), s.running);
+
+    gate.set();
+    for (0..4) |_| finished.wait();
+    try std.testing.expectEqual(@as(usize, 4), ex.drainCompletions());
+    s = ex.stats();
+    try std.testing.expectEqual(@as(usize, 0), s.queued);
+    try std.testing.expectEqual(@as(usize, 3), s.max_queued);
+}
+
+test "completion callbacks can submit follow-up jobs" {
+    var finished = std.Thread.Semaphore{};
+    var ex: Executor = undefined;
+    try ex.init(std.testing.allocator, .{ .threads = 2, .notify = TestJob.notify, .notify_ctx = &finished });
+    defer ex.deinit();
+
+    var second = TestJob{};
+    var first = TestJob{ .follow_up = &second, .executor = &ex };
+    _ = ex.submit(&first.job);
+    finished.wait();
+    try std.testing.expectEqual(@as(usize, 1), ex.drainCompletions());
+    finished.wait();
+    try std.testing.expectEqual(@as(usize, 1), ex.drainCompletions());
+    try std.testing.expect(second.completed_on != null);
+    try std.testing.expectEqual(@as(u64, 2), ex.stats().completed);
+}
+
+test "only the first paint is recorded" {
+    var ex: Executor = undefined;
+    try ex.init(std.testing.allocator, .{ .threads = 1 });
+    defer ex.deinit();
+
+    try std.testing.expectEqual(@as(?u64, null), ex.stats().first_paint_ns);
+    ex.markFirstPaint();
+    const first = ex.stats().first_paint_ns orelse return error.TestUnexpectedResult;
+    std.Thread.sleep(std.time.ns_per_ms);
+    ex.markFirstPaint();
+    try std.testing.expectEqual(first, ex.stats().first_paint_ns.?);
+}
@@ -0,0 +1,317 @@
+const std = @import("std");
+
+// Hedged requests for idempotent calls: when the first attempt has not
+// answered within an adaptive delay, an identical second attempt starts;
+// the first success wins and the other attempt is asked to stop.
+// - The delay is the `percentile` of recently observed latencies (clamped),
+//   so only requests slower than usual get a hedge.
+// - A token bucket caps the extra load: every request earns `budget_ratio`
+//   of a hedge, up to `budget_burst`; a hedge spends one.
+// - Cancellation is cooperative: the losing attempt sees its flag set and
+//   should give up at its next check (e.g. the next body read).
+// - An attempt that fails while no other one runs fails the call; hedging
+//   cuts latency, it does not retry errors.
+// Thread-safe. Attempts run on their own threads; a losing attempt may
+// outlive `race` (see `drain`).
+pub const Hedger = struct {
+    options: Options,
+    mutex: std.Thread.Mutex = .{},
+    // Ring of the latest latencies (ns) of successful calls.
+    samples: [window]u64 = undefined,
+    sample_count: usize = 0,
+    sample_head: usize = 0,
+    budget: f64,
+    counters: Stats = .{},
+    // Attempt threads still running (winners and losers).
+    running: std.atomic.Value(usize) = std.atomic.Value(usize).init(0),
+
+    pub const window = 128;
+
+    pub const Options = struct {
+        percentile: f64 = 0.95,
+        // Delay used until `min_samples` latencies were seen.
+        initial_delay_ms: u64 = 1000,
+        min_samples: usize = 16,
+        min_delay_ms: u64 = 20,
+        max_delay_ms: u64 = 5000,
+        // Hedges earned per request (0.1: at most ~10% extra requests).
+        budget_ratio: f64 = 0.1,
+        budget_burst: f64 = 2,
+    };
+
+    pub const Stats = struct {
+        requests: u64 = 0,
+        hedges_issued: u64 = 0,
+        // Hedges that answered before the first attempt.
+        hedges_won: u64 = 0,
+        // Hedges skipped because the budget was spent.
+        hedges_denied: u64 = 0,
+    };
+
+    // Set when the other attempt won; check it between steps.
+    pub const Cancel = std.atomic.Value(bool);
+
+    pub fn init(options: Options) Hedger {
+        return .{ .options = options, .budget = options.budget_burst };
+    }
+
+    // Current hedge delay.
+    pub fn delayNs(self: *Hedger) u64 {
+        self.mutex.lock();
+        defer self.mutex.unlock();
+        return self.delayLocked();
+    }
+
+    pub fn observe(self: *Hedger, latency_ns: u64) void {
+        self.mutex.lock();
+        defer self.mutex.unlock();
+        self.samples[self.sample_head] = latency_ns;
+        self.sample_head = (self.sample_head + 1) % window;
+        self.sample_count = @min(self.sample_count + 1, window);
+    }
+
+    pub fn stats(self: *Hedger) Stats {
+        self.mutex.lock();
+        defer self.mutex.unlock();
+        return self.counters;
+    }
+
+    // Waits until no attempt thread is left; call before freeing what the
+    // attempts use.
+    pub fn drain(self: *Hedger) void {
+        while (self.running.load(.acquire) != 0) std.Thread.sleep(std.time.ns_per_ms);
+    }
+
+    // Runs `ctx.attempt` with hedging and returns the first successful
+    // result. Takes ownership of `ctx`, which must own what the attempts
+    // need, since a losing attempt can outlive the call:
+    //   fn attempt(ctx: *const Ctx, cancel: *const Cancel) anyerror!T
+    //   fn discard(ctx: *const Ctx, value: T) void   // frees a loser's result
+    //   fn deinit(ctx: *Ctx) void                    // after the last attempt
+    pub fn race(self: *Hedger, comptime T: type, comptime Ctx: type, ctx: Ctx) anyerror!T {
+        const R = Race(T, Ctx);
+        const r = std.heap.smp_allocator.create(R) catch |e| {
+            var owned = ctx;
+            owned.deinit();
+            return e;
+        };
+        r.* = .{ .hedger = self, .ctx = ctx };
+        const start = std.time.Instant.now() catch null;
+
+        self.mutex.lock();
+        self.counters.requests += 1;
+        self.budget = @min(self.budget + self.options.budget_ratio, self.options.budget_burst);
+        const delay = self.delayLocked();
+        self.mutex.unlock();
+
+        r.mutex.lock();
+        if (!r.startLocked(0)) {
+            // No thread for the attempt: run it here, unhedged.
+            r.mutex.unlock();
+            defer r.release();
+            return r.ctx.attempt(&r.cancel[0]);
+        }
+        waitUntil(r, delay);
+        if (r.result == null) {
+            if (self.takeBudget()) {
+                if (r.startLocked(1)) {
+                    self.mutex.lock();
+                    self.counters.hedges_issued += 1;
+                    self.mutex.unlock();
+                }
+            }
+        }
+        while (r.result == null) r.cond.wait(&r.mutex);
+        const result = r.result.?;
+        const hedge_won = r.winner == 1;
+        r.mutex.unlock();
+        r.release();
+
+        if (hedge_won) {
+            self.mutex.lock();
+            self.counters.hedges_won += 1;
+            self.mutex.unlock();
+        }
+        if (result) |_| {
+            if (start) |s| if (std.time.Instant.now()) |now| self.observe(now.since(s)) else |_| {};
+        } else |_| {}
+        return result;
+    }
+
+    fn delayLocked(self: *const Hedger) u64 {
+        const o = self.options;
+        if (self.sample_count < o.min_samples) return o.initial_delay_ms * std.time.ns_per_ms;
+        var sorted: [window]u64 = undefined;
+        const s = sorted[0..self.sample_count];
+        @memcpy(s, self.samples[0..self.sample_count]);
+        std.mem.sort(u64, s, {}, std.sort.asc(u64));
+        const rank: usize = @intFromFloat(@ceil(o.percentile * @as(f64, @floatFromInt(s.len))));
+        const p = s[@min(s.len - 1, rank -| 1)];
+        return std.math.clamp(p, o.min_delay_ms * std.time.ns_per_ms, o.max_delay_ms * std.time.ns_per_ms);
+    }
+
+    fn takeBudget(self: *Hedger) bool {
+        self.mutex.lock();
+        defer self.mutex.unlock();
+        if (self.budget < 1) {
+            self.counters.hedges_denied += 1;
+            return false;
+        }
+        self.budget -= 1;
+        return true;
+    }
+
+    fn waitUntil(r: anytype, delay_ns: u64) void {
+        var timer = std.time.Timer.start() catch return;
+        while (r.result == null) {
+            const elapsed = timer.read();
+            if (elapsed >= delay_ns) return;
+            r.cond.timedWait(&r.mutex, delay_ns - elapsed) catch return;
+        }
+    }
+};
+
+// Shared state of one hedged call; freed by the last participant (the
+// caller or a still-running attempt).
+fn Race(comptime T: type, comptime Ctx: type) type {
+    return struct {
+        const Self = @This();
+
+        hedger: *Hedger,
+        ctx: Ctx,
+        mutex: std.Thread.Mutex = .{},
+        cond: std.Thread.Condition = .{},
+        cancel: [2]Hedger.Cancel = .{ Hedger.Cancel.init(false), Hedger.Cancel.init(false) },
+        // Caller plus started attempts.
+        refs: usize = 1,
+        // Attempts started and not finished.
+        active: usize = 0,
+        result: ?(anyerror!T) = null,
+        winner: ?usize = null,
+
+        fn startLocked(self: *Self, index: usize) bool {
+            self.refs += 1;
+            self.active += 1;
+            _ = self.hedger.running.fetchAdd(1, .acq_rel);
+            const t = std.Thread.spawn(.{}, runAttempt, .{ self, index }) catch {
+                self.refs -= 1;
+                self.active -= 1;
+                _ = self.hedger.running.fetchSub(1, .acq_rel);
+                return false;
+            };
+            t.detach();
+            return true;
+        }
+
+        fn runAttempt(self: *Self, index: usize) void {
+            const hedger = self.hedger;
+            defer _ = hedger.running.fetchSub(1, .acq_rel);
+            const value = self.ctx.attempt(&self.cancel[index]);
+
+            self.mutex.lock();
+            self.active -= 1;
+            const ok = if (value) |_| true else |_| false;
+            if (self.result == null and (ok or self.active == 0)) {
+                // First success wins; an error only ends the call when no
+                // other attempt can still succeed.
+                self.result = value;
+                if (ok) self.winner = index;
+                for (&self.cancel, 0..) |*c, i| if (i != index) c.store(true, .release);
+                self.cond.broadcast();
+            } else if (value) |v| {
+                self.ctx.discard(v);
+            } else |_| {}
+            self.mutex.unlock();
+            self.release();
+        }
+
+        fn release(self: *Self) void {
+            self.mutex.lock();
+            self.refs -= 1;
+            const last = self.refs == 0;
+            self.mutex.unlock();
+            if (!last) return;
+            self.ctx.deinit();
+            std.heap.smp_allocator.destroy(self);
+        }
+    };
+}
+
+// Test attempt with injected latency: the call's first attempt takes
+// `first_ms`, any later one `hedge_ms`. Sleeps in 1 ms steps so a losing
+// attempt stops soon after it is canceled. Returns the attempt's number.
+const SpikeCtx = struct {
+    started: *std.atomic.Value(u32),
+    first_ms: usize,
+    hedge_ms: usize,
+
+    fn attempt(self: *const SpikeCtx, cancel: *const Hedger.Cancel) anyerror!u32 {
+        const n = self.started.fetchAdd(1, .acq_rel);
+        for (0..if (n == 0) self.first_ms else self.hedge_ms) |_| {
+            if (cancel.load(.acquire)) return error.Canceled;
+            std.Thread.sleep(std.time.ns_per_ms);
+        }
+        return n;
+    }
+
+    fn discard(_: *const SpikeCtx, _: u32) void {}
+    fn deinit(_: *SpikeCtx) void {}
+};
+
+test "hedges answer the calls whose first attempt hits a spike" {
+    var hedger = Hedger.init(.{ .initial_delay_ms = 15, .min_samples = 4, .min_delay_ms = 15, .budget_ratio = 1 });
+    defer hedger.drain();
+    const calls = 40;
+    var started: [calls]std.atomic.Value(u32) = undefined;
+    for (&started) |*s| s.* = std.atomic.Value(u32).init(0);
+
+    var spikes: u64 = 0;
+    for (0..calls) |i| {
+        // Every fifth call's first attempt stalls for 400 ms.
+        const spike = i % 5 == 4;
+        spikes += @intFromBool(spike);
+        var timer = try std.time.Timer.start();
+        const winner = try hedger.race(u32, SpikeCtx, .{ .started = &started[i], .first_ms = if (spike) 400 else 2, .hedge_ms = 2 });
+        if (spike) {
+            try std.testing.expectEqual(@as(u32, 1), winner);
+            try std.testing.expect(timer.read() < 200 * std.time.ns_per_ms);
+        }
+    }
+    const s = hedger.stats();
+    try std.testing.expectEqual(@as(u64, calls), s.requests);
+    try std.testing.expect(s.hedges_won >= spikes);
+    try std.testing.expect(s.hedges_issued >= s.hedges_won);
+    // Fast calls answer before the delay; only a stalled scheduler hedges them.
+    try std.testing.expect(s.hedges_issued < calls);
+    try std.testing.expectEqual(@as(u64, 0), s.hedges_denied);
+}
+
+test "the budget caps hedges when every call is slow" {
+    var hedger = Hedger.init(.{ .initial_delay_ms = 5, .min_delay_ms = 5, .max_delay_ms = 5 });
+    defer hedger.drain();
+    const calls = 20;
+    var started: [calls]std.atomic.Value(u32) = undefined;
+    for (&started) |*s| s.* = std.atomic.Value(u32).init(0);
+
+    for (0..calls) |i| {
+        _ = try hedger.race(u32, SpikeCtx, .{ .started = &started[i], .first_ms = 20, .hedge_ms = 20 });
+    }
+    const s = hedger.stats();
+    // Burst of 2, then 0.1 per call.
+    try std.testing.expect(s.hedges_issued >= 2 and s.hedges_issued <= 2 + calls / 10);
+    try std.testing.expectEqual(@as(u64, calls), s.hedges_issued + s.hedges_denied);
+}
+
+test "an attempt that fails alone fails the call without a hedge" {
+    const FailCtx = struct {
+        fn attempt(_: *const @This(), _: *const Hedger.Cancel) anyerror!u32 {
+            return error.ConnectionRefused;
+        }
+        fn discard(_: *const @This(), _: u32) void {}
+        fn deinit(_: *@This()) void {}
+    };
+    var hedger = Hedger.init(.{ .initial_delay_ms = 50 });
+    defer hedger.drain();
+    try std.testing.expectError(error.ConnectionRefused, hedger.race(u32, FailCtx, .{}));
+    try std.testing.expectEqual(@as(u64, 0), hedger.stats().hedges_issued);
+}
@@ -0,0 +1,318 @@
+const std = @import("std");
+
+// Text document as a piece table: the text is a list of pieces, each a
+// span of an append-only byte buffer. Edits append the new bytes to the
+// buffer and split or drop pieces, so their cost depends on the edit and
+// the number of pieces, never on the document length. Appending at the end
+// (streamed output, transcripts) extends the last piece in place.
+// Every edit returns the `Change` it made, which is all a view needs to
+// update itself. Not thread-safe; owned by one thread (the UI thread).
+pub const PieceTable = struct {
+    allocator: std.mem.Allocator,
+    // Append-only storage all pieces point into.
+    buf: std.ArrayListUnmanaged(u8) = .{},
+    pieces: std.ArrayListUnmanaged(Piece) = .{},
+    len: usize = 0,
+
+    pub const Piece = struct {
+        start: usize,
+        len: usize,
+    };
+
+    // Bytes [start, end) of the old text were replaced by `text`.
+    // `text` is the slice passed to the edit.
+    pub const Change = struct {
+        start: usize,
+        end: usize,
+        text: []const u8,
+    };
+
+    // Bytes of replaced text `buf` may hold before edits compact it (at
+    // least the live length, so compaction stays amortized O(edit)).
+    const min_garbage = 64 * 1024;
+
+    pub fn init(allocator: std.mem.Allocator) PieceTable {
+        return .{ .allocator = allocator };
+    }
+
+    pub fn deinit(self: *PieceTable) void {
+        self.buf.deinit(self.allocator);
+        self.pieces.deinit(self.allocator);
+        self.* = undefined;
+    }
+
+    pub fn append(self: *PieceTable, text: []const u8) !Change {
+        return self.replace(self.len, self.len, text);
+    }
+
+    pub fn insert(self: *PieceTable, pos: usize, text: []const u8) !Change {
+        return self.replace(pos, pos, text);
+    }
+
+    // Replaces bytes [start, end) with `text`.
+    pub fn replace(self: *PieceTable, start: usize, end: usize, text: []const u8) !Change {
+        std.debug.assert(start <= end and end <= self.len);
+        const change = Change{ .start = start, .end = end, .text = text };
+        if (start == end and text.len == 0) return change;
+
+        const added = Piece{ .start = self.buf.items.len, .len = text.len };
+        try self.buf.appendSlice(self.allocator, text);
+
+        // Fast path: append right after the last piece's bytes.
+        if (start == self.len and end == self.len and self.pieces.items.len > 0) {
+            const last = &self.pieces.items[self.pieces.items.len - 1];
+            if (last.start + last.len == added.start) {
+                last.len += added.len;
+                self.len += added.len;
+                return change;
+            }
+        }
+
+        // Pieces [first, last) overlap the edit; they are replaced by the
+        // kept head of `first`, the new piece and the kept tail of `last-1`.
+        const first = self.locate(start);
+        var last = first.index;
+        var pos = start - first.offset;
+        while (last < self.pieces.items.len and pos + self.pieces.items[last].len <= end) {
+            pos += self.pieces.items[last].len;
+            last += 1;
+        }
+        var repl: [3]Piece = undefined;
+        var n: usize = 0;
+        if (first.offset > 0) {
+            repl[n] = .{ .start = self.pieces.items[first.index].start, .len = first.offset };
+            n += 1;
+        }
+        if (added.len > 0) {
+            repl[n] = added;
+            n += 1;
+        }
+        if (last < self.pieces.items.len) {
+            const tail_cut = end - pos;
+            const p = self.pieces.items[last];
+            if (tail_cut < p.len) {
+                repl[n] = .{ .start = p.start + tail_cut, .len = p.len - tail_cut };
+                n += 1;
+            }
+            last += 1;
+        }
+        try self.pieces.replaceRange(self.allocator, first.index, last - first.index, repl[0..n]);
+        self.len = self.len - (end - start) + text.len;
+
+        // Best effort: a failed compaction leaves a valid, larger buffer.
+        self.maybeCompact() catch {};
+        return change;
+    }
+
+    // Replaces the whole text with `text`, editing only the range between
+    // the common prefix and suffix of old and new text. Returns null when
+    // nothing changed.
+    pub fn setText(self: *PieceTable, text: []const u8) !?Change {
+        const prefix = self.commonPrefix(text);
+        const max_suffix = @min(self.len, text.len) - prefix;
+        const suffix = self.commonSuffix(text, max_suffix);
+        if (prefix == self.len and prefix == text.len) return null;
+        return try self.replace(prefix, self.len - suffix, text[prefix .. text.len - suffix]);
+    }
+
+    // Copies the text into `out` (out.len == len).
+    pub fn copyTo(self: *const PieceTable, out: []u8) void {
+        std.debug.assert(out.len == self.len);
+        var w: usize = 0;
+        for (self.pieces.items) |p| {
+            @memcpy(out[w..][0..p.len], self.bytes(p));
+            w += p.len;
+        }
+    }
+
+    // Caller frees.
+    pub fn toOwnedText(self: *const PieceTable, allocator: std.mem.Allocator) ![]u8 {
+        const out = try allocator.alloc(u8, self.len);
+        self.copyTo(out);
+        return out;
+    }
+
+    pub fn pieceCount(self: *const PieceTable) usize {
+        return self.pieces.items.len;
+    }
+
+    fn bytes(self: *const PieceTable, p: Piece) []const u8 {
+        return self.buf.items[p.start..][0..p.len];
+    }
+
+    const Location = struct {
+        index: usize,
+        offset: usize,
+    };
+
+    // Piece containing byte `pos` (or one past the last piece at the end).
+    // Searches from the back, where edits to a growing document land.
+    fn locate(self: *const PieceTable, pos: usize) Location {
+        var start = self.len;
+        var i = self.pieces.items.len;
+        while (i > 0) {
+            i -= 1;
+            start -= self.pieces.items[i].len;
+            if (start <= pos) {
+                if (pos - start == self.pieces.items[i].len) return .{ .index = i + 1, .offset = 0 };
+                return .{ .index = i, .offset = pos - start };
+            }
+        }
+        return .{ .index = 0, .offset = 0 };
+    }
+
+    fn commonPrefix(self: *const PieceTable, text: []const u8) usize {
+        var n: usize = 0;
+        for (self.pieces.items) |p| {
+            const b = self.bytes(p);
+            const m = @min(b.len, text.len - n);
+            const same = std.mem.indexOfDiff(u8, b[0..m], text[n..][0..m]) orelse m;
+            n += same;
+            if (same < b.len) break;
+        }
+        return n;
+    }
+
+    fn commonSuffix(self: *const PieceTable, text: []const u8, max: usize) usize {
+        var n: usize = 0;
+        var i = self.pieces.items.len;
+        while (i > 0 and n < max) {
+            i -= 1;
+            const b = self.bytes(self.pieces.items[i]);
+            var k: usize = 0;
+            while (k < b.len and n < max and b[b.len - 1 - k] == text[text.len - 1 - n]) : ({
+                k += 1;
+                n += 1;
+            }) {}
+            if (k < b.len) break;
+        }
+        return n;
+    }
+
+    // Rewrites the live text into a fresh buffer once replaced bytes
+    // outweigh it, which also collapses the piece list to one piece.
+    fn maybeCompact(self: *PieceTable) !void {
+        const garbage = self.buf.items.len - self.len;
+        if (garbage <= @max(self.len, min_garbage)) return;
+        var fresh = try std.ArrayListUnmanaged(u8).initCapacity(self.allocator, self.len);
+        for (self.pieces.items) |p| fresh.appendSliceAssumeCapacity(self.bytes(p));
+        self.buf.deinit(self.allocator);
+        self.buf = fresh;
+        self.pieces.clearRetainingCapacity();
+        if (self.len > 0) self.pieces.appendAssumeCapacity(.{ .start = 0, .len = self.len });
+    }
+};
+
+const CountingAllocator = @import("counting_allocator.zig").CountingAllocator;
+
+// Applies `change` to a plain copy of the text, as a view would.
+fn applyChange(model: *std.ArrayList(u8), change: PieceTable.Change) !void {
+    try model.replaceRange(change.start, change.end - change.start, change.text);
+}
+
+fn expectText(doc: *const PieceTable, want: []const u8) !void {
+    const got = try doc.toOwnedText(std.testing.allocator);
+    defer std.testing.allocator.free(got);
+    try std.testing.expectEqualStrings(want, got);
+}
+
+test "random edits match a plain string" {
+    var doc = PieceTable.init(std.testing.allocator);
+    defer doc.deinit();
+    var model = std.ArrayList(u8).init(std.testing.allocator);
+    defer model.deinit();
+    var prng = std.Random.DefaultPrng.init(0x7ab1e);
+    const rng = prng.random();
+
+    var text: [96]u8 = undefined;
+    for (0..4000) |_| {
+        const n = rng.uintAtMost(usize, text.len);
+        for (text[0..n]) |*b| b.* = "abc\n"[rng.uintLessThan(usize, 4)];
+        const change = switch (rng.uintLessThan(u8, 4)) {
+            0 => try doc.append(text[0..n]),
+            1 => blk: {
+                const start = rng.uintAtMost(usize, doc.len);
+                const end = start + rng.uintAtMost(usize, @min(doc.len - start, 64));
+                break :blk try doc.replace(start, end, text[0..n]);
+            },
+            2 => try doc.insert(rng.uintAtMost(usize, doc.len), text[0..n]),
+            else => blk: {
+                // New text sharing a prefix and suffix with the old one.
+                const old = try doc.toOwnedText(std.testing.allocator);
+                defer std.testing.allocator.free(old);
+                const cut = rng.uintAtMost(usize, old.len);
+                const keep = cut + rng.uintAtMost(usize, @min(old.len - cut, 32));
+                var new = std.ArrayList(u8).init(std.testing.allocator);
+                defer new.deinit();
+                try new.appendSlice(old[0..cut]);
+                try new.appendSlice(text[0..n]);
+                try new.appendSlice(old[keep..]);
+                const edit = (try doc.setText(new.items)) orelse {
+                    try std.testing.expectEqualStrings(old, new.items);
+                    continue;
+                };
+                try applyChange(&model, edit);
+                try std.testing.expectEqualStrings(new.items, model.items);
+                continue;
+            },
+        };
+        try applyChange(&model, change);
+        try std.testing.expectEqual(model.items.len, doc.len);
+    }
+    try expectText(&doc, model.items);
+}
+
+test "replaced bytes are compacted away" {
+    var doc = PieceTable.init(std.testing.allocator);
+    defer doc.deinit();
+    _ = try doc.setText("x" ** 1000);
+    const filler = "y" ** 512;
+    for (0..1000) |_| _ = try doc.replace(100, 100 + filler.len, filler);
+    // Garbage never outgrows the compaction threshold by more than one edit.
+    try std.testing.expect(doc.buf.items.len <= doc.len + @max(doc.len, PieceTable.min_garbage) + filler.len);
+    try expectText(&doc, "x" ** 100 ++ filler ++ "x" ** 388);
+}
+
+test "edit cost follows the delta, not the document" {
+    // Same edits on a 4 KiB and a 4 MiB document. Buffer capacity for the
+    // deltas is reserved up front: its geometric growth is amortized O(1)
+    // per byte and would otherwise show up as a one-off copy of the text.
+    var allocated: [2]u64 = undefined;
+    for ([_]usize{ 4 << 10, 4 << 20 }, 0..) |size, i| {
+        var counting = CountingAllocator.init(std.testing.allocator);
+        var doc = PieceTable.init(counting.allocator());
+        defer doc.deinit();
+
+        const initial = try std.testing.allocator.alloc(u8, size);
+        defer std.testing.allocator.free(initial);
+        @memset(initial, 'a');
+        _ = try doc.setText(initial);
+        const delta = "streamed delta, forty bytes in length.\n";
+        try doc.buf.ensureUnusedCapacity(doc.allocator, 512 * delta.len);
+        try doc.pieces.ensureUnusedCapacity(doc.allocator, 8);
+        counting.reset();
+
+        for (0..256) |_| {
+            const change = try doc.append(delta);
+            try std.testing.expectEqual(doc.len - delta.len, change.start);
+        }
+        // Appends extend the last piece; no piece is added.
+        try std.testing.expectEqual(@as(usize, 1), doc.pieceCount());
+
+        // A small edit in the middle touches only the piece it lands in.
+        _ = try doc.replace(size / 2, size / 2 + 5, "hello");
+        try std.testing.expectEqual(@as(usize, 3), doc.pieceCount());
+        // setText scans for the common prefix and suffix but edits only the
+        // differing range.
+        const new = try doc.toOwnedText(std.testing.allocator);
+        defer std.testing.allocator.free(new);
+        new[size / 4] = 'b';
+        const change = (try doc.setText(new)).?;
+        try std.testing.expectEqual(size / 4, change.start);
+        try std.testing.expectEqual(@as(usize, 1), change.text.len);
+
+        allocated[i] = counting.bytes_allocated;
+        try std.testing.expectEqual(@as(u64, 0), counting.allocs);
+    }
+    try std.testing.expectEqual(allocated[0], allocated[1]);
+}
@@ -0,0 +1,148 @@
+const std = @import("std");
+const CountingAllocator = @import("counting_allocator.zig").CountingAllocator;
+
+// Per-request arena with allocation accounting.
+// Everything a request allocates (headers, C strings, response body, decoded
+// ids, display text) goes into one arena and is released at once when the
+// request ends; the arena keeps its first chunk for the next request.
+// A CountingAllocator sits on top, so each request reports its allocation
+// count, bytes and peak live bytes. Used by one thread at a time.
+pub const RequestArena = struct {
+    arena: std.heap.ArenaAllocator,
+    counting: CountingAllocator,
+    // Flow the arena is currently serving (e.g. "models/fetch").
+    flow: []const u8 = "",
+    next: ?*RequestArena = null,
+
+    pub fn allocator(self: *RequestArena) std.mem.Allocator {
+        return self.counting.allocator();
+    }
+
+    pub fn stats(self: *const RequestArena) Usage {
+        return .{
+            .allocs = self.counting.allocs,
+            .bytes = self.counting.bytes_allocated,
+            .peak_bytes = self.counting.peak_bytes,
+            .capacity = self.arena.queryCapacity(),
+        };
+    }
+};
+
+// Allocation usage of one request.
+pub const Usage = struct {
+    allocs: u64 = 0,
+    bytes: u64 = 0,
+    peak_bytes: u64 = 0,
+    // Arena memory actually reserved for the request.
+    capacity: usize = 0,
+};
+
+// Totals for one flow across its requests.
+pub const FlowStats = struct {
+    name: []const u8 = "",
+    requests: u64 = 0,
+    allocs: u64 = 0,
+    bytes: u64 = 0,
+    // Largest per-request peak seen.
+    max_peak_bytes: u64 = 0,
+    last: Usage = .{},
+};
+
+// Thread-safe pool of reusable request arenas.
+pub const ArenaPool = struct {
+    backing: std.mem.Allocator,
+    options: Options,
+    mutex: std.Thread.Mutex = .{},
+    free: ?*RequestArena = null,
+    free_count: usize = 0,
+    flows: [max_flows]FlowStats = [_]FlowStats{.{}} ** max_flows,
+    flow_count: usize = 0,
+
+    const max_flows = 16;
+
+    pub const Options = struct {
+        // Idle arenas kept for reuse.
+        max_pooled: usize = 4,
+        // Bytes an arena keeps across a reset; larger chunks are released.
+        retain_bytes: usize = 256 * 1024,
+    };
+
+    pub fn init(backing: std.mem.Allocator, options: Options) ArenaPool {
+        return .{ .backing = backing, .options = options };
+    }
+
+    pub fn deinit(self: *ArenaPool) void {
+        while (self.free) |ra| {
+            self.free = ra.next;
+            ra.arena.deinit();
+            self.backing.destroy(ra);
+        }
+        self.free_count = 0;
+    }
+
+    // Hands out a fresh (reset) arena for one request of `flow`. `flow`
+    // must outlive the pool (string literals in practice).
+    pub fn acquire(self: *ArenaPool, flow: []const u8) !*RequestArena {
+        self.mutex.lock();
+        const pooled = self.free;
+        if (pooled) |ra| {
+            self.free = ra.next;
+            self.free_count -= 1;
+        }
+        self.mutex.unlock();
+
+        const ra = pooled orelse blk: {
+            const ra = try self.backing.create(RequestArena);
+            ra.arena = std.heap.ArenaAllocator.init(self.backing);
+            break :blk ra;
+        };
+        ra.counting = CountingAllocator.init(ra.arena.allocator());
+        ra.flow = flow;
+        ra.next = null;
+        return ra;
+    }
+
+    // Records the request's usage under its flow, frees everything it
+    // allocated and pools the arena (or destroys it when the pool is full).
+    pub fn release(self: *ArenaPool, ra: *RequestArena) void {
+        const usage = ra.stats();
+        _ = ra.arena.reset(.{ .retain_with_limit = self.options.retain_bytes });
+
+        self.mutex.lock();
+        defer self.mutex.unlock();
+        if (self.flowLocked(ra.flow)) |f| {
+            f.requests += 1;
+            f.allocs += usage.allocs;
+            f.bytes += usage.bytes;
+            f.max_peak_bytes = @max(f.max_peak_bytes, usage.peak_bytes);
+            f.last = usage;
+        }
+        if (self.free_count < self.options.max_pooled) {
+            ra.next = self.free;
+            self.free = ra;
+            self.free_count += 1;
+            return;
+        }
+        ra.arena.deinit();
+        self.backing.destroy(ra);
+    }
+
+    pub fn flowStats(self: *ArenaPool, name: []const u8) ?FlowStats {
+        self.mutex.lock();
+        defer self.mutex.unlock();
+        for (self.flows[0..self.flow_count]) |f| {
+            if (std.mem.eql(u8, f.name, name)) return f;
+        }
+        return null;
+    }
+
+    fn flowLocked(self: *ArenaPool, name: []const u8) ?*FlowStats {
+        for (self.flows[0..self.flow_count]) |*f| {
+            if (std.mem.eql(u8, f.name, name)) return f;
+        }
+        if (self.flow_count == max_flows) return null;
+        self.flows[self.flow_count] = .{ .name = name };
+        self.flow_count += 1;
+        return &self.flows[self.flow_count - 1];
+    }
+};
@@ -0,0 +1,125 @@
+const std = @import("std");
+
+// Single-flight coalescing of duplicate in-flight work.
+// Callers derive a key from what identifies the request (see `requestKey`)
+// and `join` it. The first caller becomes the leader and does the work;
+// callers arriving while it runs become followers and block in `wait`
+// until the leader publishes its result, which they all share. Once
+// published, the key is free again, so the next caller starts fresh work.
+// Each participant calls `release` when done with the value; the last one
+// frees it through `Options.free`.
+// Thread-safe.
+pub fn SingleFlight(comptime T: type) type {
+    return struct {
+        const Self = @This();
+
+        allocator: std.mem.Allocator,
+        options: Options,
+        mutex: std.Thread.Mutex = .{},
+        in_flight: std.AutoHashMapUnmanaged(u64, *Call) = .{},
+        counters: Stats = .{},
+
+        pub const Options = struct {
+            // Frees a published value once every participant released it.
+            free: ?*const fn (allocator: std.mem.Allocator, value: *T) void = null,
+        };
+
+        pub const Stats = struct {
+            // Calls that did the work.
+            leaders: u64 = 0,
+            // Calls that waited for a leader instead.
+            coalesced: u64 = 0,
+            // Most participants seen on one call.
+            max_participants: usize = 0,
+        };
+
+        pub const Call = struct {
+            key: u64,
+            done: std.Thread.ResetEvent = .{},
+            // Valid once `done` is set; null if the leader gave up.
+            value: ?T = null,
+            // Participants that have not released yet (guarded by mutex).
+            refs: usize = 1,
+        };
+
+        pub const Joined = struct {
+            call: *Call,
+            // True for the caller that must do the work and `publish`.
+            leader: bool,
+        };
+
+        pub fn init(allocator: std.mem.Allocator, options: Options) Self {
+            return .{ .allocator = allocator, .options = options };
+        }
+
+        // Only call once no call is in flight.
+        pub fn deinit(self: *Self) void {
+            self.in_flight.deinit(self.allocator);
+        }
+
+        pub fn join(self: *Self, key: u64) !Joined {
+            self.mutex.lock();
+            defer self.mutex.unlock();
+            if (self.in_flight.get(key)) |call| {
+                call.refs += 1;
+                self.counters.coalesced += 1;
+                self.counters.max_participants = @max(self.counters.max_participants, call.refs);
+                return .{ .call = call, .leader = false };
+            }
+            const call = try self.allocator.create(Call);
+            errdefer self.allocator.destroy(call);
+            call.* = .{ .key = key };
+            try self.in_flight.put(self.allocator, key, call);
+            self.counters.leaders += 1;
+            self.counters.max_participants = @max(self.counters.max_participants, 1);
+            return .{ .call = call, .leader = true };
+        }
+
+        // Leader only: shares `value` (or null on failure, in which case each
+        // follower should do its own work) and wakes the followers. The
+        // value must stay valid until the last `release`.
+        pub fn publish(self: *Self, call: *Call, value: ?T) void {
+            self.mutex.lock();
+            call.value = value;
+            _ = self.in_flight.remove(call.key);
+            self.mutex.unlock();
+            call.done.set();
+        }
+
+        // Followers only: blocks until the leader publishes.
+        pub fn wait(self: *Self, call: *Call) ?*const T {
+            _ = self;
+            call.done.wait();
+            return if (call.value) |*v| v else null;
+        }
+
+        pub fn release(self: *Self, call: *Call) void {
+            self.mutex.lock();
+            call.refs -= 1;
+            const last = call.refs == 0;
+            self.mutex.unlock();
+            if (!last) return;
+            if (call.value) |*v| if (self.options.free) |free| free(self.allocator, v);
+            self.allocator.destroy(call);
+        }
+
+        pub fn stats(self: *Self) Stats {
+            self.mutex.lock();
+            defer self.mutex.unlock();
+            return self.counters;
+        }
+    };
+}
+
+// Key for an HTTP request: method, URL and the header lines that change
+// the response (pass only those; e.g. Authorization and validators, not
+// tracing ids).
+pub fn requestKey(method: []const u8, url: []const u8, headers: []const u8) u64 {
+    var h = std.hash.Wyhash.init(0);
+    h.update(method);
+    h.update(" ");
+    h.update(url);
+    h.update("\n");
+    h.update(headers);
+    return h.final();
+}
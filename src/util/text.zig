@@ -0,0 +1,150 @@
+const std = @import("std");
+const kernels = @import("text_kernels");
+
+// Converts LF line endings to CRLF (the Win32 EDIT control needs CRLF).
+// Sized exactly: one vectorized pass to count newlines, one to copy the
+// runs between them. Caller frees.
+pub fn toCRLF(allocator: std.mem.Allocator, s: []const u8) ![]u8 {
+    const out = try allocator.alloc(u8, kernels.crlfLen(s));
+    kernels.toCRLFInto(out, s);
+    return out;
+}
+
+// Like cstr.toCString (NUL included in the returned slice), but replaces
+// each byte that starts a malformed UTF-8 sequence with '?' before the text
+// reaches the Win32 text APIs. Valid input (the common case) is validated
+// in bulk and copied once. Caller frees.
+pub fn toValidUtf8CString(allocator: std.mem.Allocator, s: []const u8) ![]u8 {
+    const out = try allocator.alloc(u8, s.len + 1);
+    out[s.len] = 0;
+    replaceInvalidInto(out[0..s.len], s);
+    return out;
+}
+
+// `s` with the same replacement as `toValidUtf8CString`, without the NUL:
+// `s` itself when it is valid, else a copy from `allocator`.
+pub fn validUtf8(allocator: std.mem.Allocator, s: []const u8) ![]const u8 {
+    if (kernels.utf8Validate(s)) return s;
+    const out = try allocator.alloc(u8, s.len);
+    replaceInvalidInto(out, s);
+    return out;
+}
+
+fn replaceInvalidInto(out: []u8, s: []const u8) void {
+    var r: usize = 0;
+    while (r < s.len) {
+        const valid = kernels.utf8ValidPrefix(s[r..]);
+        @memcpy(out[r..][0..valid], s[r..][0..valid]);
+        r += valid;
+        if (r < s.len) {
+            out[r] = '?';
+            r += 1;
+        }
+    }
+}
+
+// UTF-16 code units of valid UTF-8 `s`, i.e. its length in a Unicode edit
+// control: one per character, two for characters above U+FFFF.
+pub fn utf16Len(s: []const u8) usize {
+    var n: usize = 0;
+    for (s) |b| n += @intFromBool(b & 0xC0 != 0x80) + @intFromBool(b >= 0xF0);
+    return n;
+}
+
+// An edit to the text of a Unicode edit control.
+pub const ControlEdit = struct {
+    // Replaced range of the old text, in UTF-16 code units.
+    start: usize,
+    end: usize,
+    // Replacement: whole characters.
+    text: []const u8,
+    // UTF-16 length of the new text.
+    new_len: usize,
+};
+
+// Converts a byte-level change, old text -> `new` with `new[start..new_end]`
+// replacing what lay between the bytes the two share before and after it,
+// into control positions. `old_len` is the old text's UTF-16 length. Both
+// texts must be valid UTF-8; a change whose ends fall inside a character
+// (a common prefix can end between two bytes of one) is widened to whole
+// characters.
+pub fn controlEdit(new: []const u8, old_len: usize, start: usize, new_end: usize) ControlEdit {
+    var s = start;
+    while (s > 0 and s < new.len and isContinuation(new[s])) s -= 1;
+    var e = new_end;
+    while (e < new.len and isContinuation(new[e])) e += 1;
+    const prefix = utf16Len(new[0..s]);
+    const suffix = utf16Len(new[e..]);
+    return .{
+        .start = prefix,
+        .end = old_len - suffix,
+        .text = new[s..e],
+        .new_len = prefix + utf16Len(new[s..e]) + suffix,
+    };
+}
+
+inline fn isContinuation(b: u8) bool {
+    return b & 0xC0 == 0x80;
+}
+
+// Applies `controlEdit` of old -> new to old's UTF-16 form and checks the
+// result against new's.
+fn expectControlEdit(old: []const u8, new: []const u8) !void {
+    const allocator = std.testing.allocator;
+    var prefix: usize = 0;
+    while (prefix < @min(old.len, new.len) and old[prefix] == new[prefix]) prefix += 1;
+    var suffix: usize = 0;
+    while (suffix < @min(old.len, new.len) - prefix and old[old.len - 1 - suffix] == new[new.len - 1 - suffix]) suffix += 1;
+
+    const old16 = try std.unicode.utf8ToUtf16LeAlloc(allocator, old);
+    defer allocator.free(old16);
+    const new16 = try std.unicode.utf8ToUtf16LeAlloc(allocator, new);
+    defer allocator.free(new16);
+    try std.testing.expectEqual(old16.len, utf16Len(old));
+
+    const edit = controlEdit(new, old16.len, prefix, new.len - suffix);
+    const mid16 = try std.unicode.utf8ToUtf16LeAlloc(allocator, edit.text);
+    defer allocator.free(mid16);
+    const result = try std.mem.concat(allocator, u16, &.{ old16[0..edit.start], mid16, old16[edit.end..] });
+    defer allocator.free(result);
+    try std.testing.expectEqualSlices(u16, new16, result);
+    try std.testing.expectEqual(new16.len, edit.new_len);
+}
+
+test "control edits land on whole characters" {
+    // The common prefix ends inside the last character (C3 A9 -> C3 A8).
+    try expectControlEdit("na\u{ef}ve caf\u{e9}", "na\u{ef}ve caf\u{e8}");
+    // Characters above U+FFFF count two units; the suffix starts mid-character.
+    try expectControlEdit("\u{1F600} x \u{1F601}", "\u{1F600} yy \u{1F601}");
+    try expectControlEdit("\u{65e5}\u{672c}", "\u{65e5}\u{8a9e}\u{672c}");
+    try expectControlEdit("abc", "");
+    try expectControlEdit("", "\u{20ac}1");
+}
+
+test "control edits match UTF-16 on random text" {
+    const pool = [_][]const u8{ "a", " ", "\n", "\u{e9}", "\u{e8}", "\u{20ac}", "\u{65e5}", "\u{1F600}", "\u{1F601}" };
+    var prng = std.Random.DefaultPrng.init(0x14);
+    const rng = prng.random();
+    var old_buf: [256]u8 = undefined;
+    var new_buf: [256]u8 = undefined;
+    for (0..500) |_| {
+        var n: usize = 0;
+        for (0..rng.uintLessThan(usize, 40)) |_| {
+            const piece = pool[rng.uintLessThan(usize, pool.len)];
+            @memcpy(old_buf[n..][0..piece.len], piece);
+            n += piece.len;
+        }
+        const old = old_buf[0..n];
+        // Same text with a few characters swapped or dropped.
+        var m: usize = 0;
+        var it = (std.unicode.Utf8View.init(old) catch unreachable).iterator();
+        while (it.nextCodepointSlice()) |cp| {
+            const roll = rng.uintLessThan(u8, 10);
+            if (roll == 0) continue;
+            const piece = if (roll == 1) pool[rng.uintLessThan(usize, pool.len)] else cp;
+            @memcpy(new_buf[m..][0..piece.len], piece);
+            m += piece.len;
+        }
+        try expectControlEdit(old, new_buf[0..m]);
+    }
+}
@@ -0,0 +1,357 @@
+//! Vectorized text kernels: byte counting/search (CRLF conversion), JSON
+//! string escaping and UTF-8 validation.
+//! - Each kernel scans `lanes` bytes (16–64, whatever the target's vector
+//!   unit suggests) per step and turns a compare into a bitmask, so runs
+//!   without anything of interest are skipped at vector speed.
+//! - Outputs are sized exactly up front (count pass, then copy pass).
+//! - `scalar` holds byte-at-a-time reference versions. They are used on
+//!   targets without a useful vector unit, for the tails and as the
+//!   reference the bench and the tests below check the vector paths
+//!   against.
+//! Registered as the `text_kernels` module so both the app and the `openai`
+//! module can use it.
+const std = @import("std");
+
+pub const lanes: usize = std.simd.suggestVectorLength(u8) orelse 0;
+const use_simd = lanes >= 16;
+const L = if (use_simd) lanes else 16;
+const V = @Vector(L, u8);
+const Mask = std.meta.Int(.unsigned, L);
+
+inline fn load(s: []const u8, i: usize) V {
+    return s[i..][0..L].*;
+}
+
+inline fn eqMask(v: V, byte: u8) Mask {
+    return @bitCast(v == @as(V, @splat(byte)));
+}
+
+// Bytes JSON strings must escape: '"', '\\' and control characters.
+inline fn escapeMask(v: V) Mask {
+    const ctrl: Mask = @bitCast(v < @as(V, @splat(0x20)));
+    return ctrl | eqMask(v, '"') | eqMask(v, '\\');
+}
+
+// ---------------------------------------------------------------------------
+// Byte search
+
+// Number of occurrences of `byte` in `s`.
+pub fn countByte(s: []const u8, byte: u8) usize {
+    if (!use_simd) return scalar.countByte(s, byte);
+    var n: usize = 0;
+    var i: usize = 0;
+    while (i + L <= s.len) : (i += L) n += @popCount(eqMask(load(s, i), byte));
+    return n + scalar.countByte(s[i..], byte);
+}
+
+// Index of the first `byte` at or after `start`, or null.
+pub fn indexOfBytePos(s: []const u8, start: usize, byte: u8) ?usize {
+    if (!use_simd) return scalar.indexOfBytePos(s, start, byte);
+    var i = start;
+    while (i + L <= s.len) : (i += L) {
+        const m = eqMask(load(s, i), byte);
+        if (m != 0) return i + @ctz(m);
+    }
+    return scalar.indexOfBytePos(s, i, byte);
+}
+
+// Output length of `toCRLFInto` for `s`.
+pub fn crlfLen(s: []const u8) usize {
+    return s.len + countByte(s, '\n');
+}
+
+// Writes `s` with every LF turned into CRLF. `out.len` must equal
+// `crlfLen(s)`.
+pub fn toCRLFInto(out: []u8, s: []const u8) void {
+    std.debug.assert(out.len == crlfLen(s));
+    var r: usize = 0;
+    var w: usize = 0;
+    while (indexOfBytePos(s, r, '\n')) |nl| {
+        const run = nl - r;
+        @memcpy(out[w..][0..run], s[r..nl]);
+        out[w + run] = '\r';
+        out[w + run + 1] = '\n';
+        w += run + 2;
+        r = nl + 1;
+    }
+    @memcpy(out[w..], s[r..]);
+}
+
+// ---------------------------------------------------------------------------
+// JSON string escaping (same output as std.json for valid UTF-8 input)
+
+// Length of `s` once escaped, without the surrounding quotes.
+pub fn jsonEscapedLen(s: []const u8) usize {
+    var n = s.len;
+    var i: usize = 0;
+    if (use_simd) {
+        while (i + L <= s.len) : (i += L) {
+            var m = escapeMask(load(s, i));
+            while (m != 0) : (m &= m - 1) n += escapeExtra(s[i + @ctz(m)]);
+        }
+    }
+    for (s[i..]) |c| n += escapeExtra(c);
+    return n;
+}
+
+// Writes `s` as a quoted JSON string. `out.len` must equal
+// `jsonEscapedLen(s) + 2`.
+pub fn jsonEscapeInto(out: []u8, s: []const u8) void {
+    std.debug.assert(out.len == jsonEscapedLen(s) + 2);
+    out[0] = '"';
+    _ = jsonEscapeContentInto(out[1 .. out.len - 1], s);
+    out[out.len - 1] = '"';
+}
+
+// Writes `s` escaped, without quotes, to the front of `out` and returns the
+// bytes written. `out` must hold `jsonEscapedLen(s)` bytes; `6 * s.len`
+// always does. Escapes are per byte, so a string may be escaped in pieces
+// split anywhere (streamed bodies do).
+pub fn jsonEscapeContentInto(out: []u8, s: []const u8) usize {
+    var w: usize = 0;
+    var r: usize = 0;
+    while (nextEscape(s, r)) |e| {
+        const run = e - r;
+        @memcpy(out[w..][0..run], s[r..e]);
+        w += run;
+        w += writeEscape(out[w..], s[e]);
+        r = e + 1;
+    }
+    @memcpy(out[w..][0 .. s.len - r], s[r..]);
+    return w + s.len - r;
+}
+
+// Quoted, escaped copy of `s`, allocated at its exact size. Caller frees.
+pub fn jsonEscapeAlloc(allocator: std.mem.Allocator, s: []const u8) ![]u8 {
+    const out = try allocator.alloc(u8, jsonEscapedLen(s) + 2);
+    jsonEscapeInto(out, s);
+    return out;
+}
+
+fn nextEscape(s: []const u8, start: usize) ?usize {
+    var i = start;
+    if (use_simd) {
+        while (i + L <= s.len) : (i += L) {
+            const m = escapeMask(load(s, i));
+            if (m != 0) return i + @ctz(m);
+        }
+    }
+    while (i < s.len) : (i += 1) {
+        if (escapeExtra(s[i]) != 0) return i;
+    }
+    return null;
+}
+
+// Extra output bytes for `c` beyond the byte itself.
+inline fn escapeExtra(c: u8) usize {
+    return switch (c) {
+        '"', '\\', '\n', '\r', '\t', 0x08, 0x0C => 1,
+        0x00...0x07, 0x0B, 0x0E...0x1F => 5,
+        else => 0,
+    };
+}
+
+fn writeEscape(out: []u8, c: u8) usize {
+    const short: ?u8 = switch (c) {
+        '"' => '"',
+        '\\' => '\\',
+        '\n' => 'n',
+        '\r' => 'r',
+        '\t' => 't',
+        0x08 => 'b',
+        0x0C => 'f',
+        else => null,
+    };
+    out[0] = '\\';
+    if (short) |ch| {
+        out[1] = ch;
+        return 2;
+    }
+    const hex = "0123456789abcdef";
+    out[1..6].* = .{ 'u', '0', '0', hex[c >> 4], hex[c & 0xF] };
+    return 6;
+}
+
+// ---------------------------------------------------------------------------
+// UTF-8 validation
+
+// Length of the longest valid UTF-8 prefix of `s` (== s.len when valid).
+// All-ASCII blocks are skipped a vector at a time; multi-byte sequences go
+// through the scalar decoder.
+pub fn utf8ValidPrefix(s: []const u8) usize {
+    var i: usize = 0;
+    while (i < s.len) {
+        if (use_simd and i + L <= s.len) {
+            const high: Mask = @bitCast(load(s, i) >= @as(V, @splat(0x80)));
+            if (high == 0) {
+                i += L;
+                continue;
+            }
+            i += @ctz(high);
+        }
+        const n = scalar.sequenceLen(s[i..]) orelse return i;
+        i += n;
+    }
+    return i;
+}
+
+pub fn utf8Validate(s: []const u8) bool {
+    return utf8ValidPrefix(s) == s.len;
+}
+
+// ---------------------------------------------------------------------------
+// Scalar reference versions
+
+pub const scalar = struct {
+    pub fn countByte(s: []const u8, byte: u8) usize {
+        var n: usize = 0;
+        for (s) |c| n += @intFromBool(c == byte);
+        return n;
+    }
+
+    pub fn indexOfBytePos(s: []const u8, start: usize, byte: u8) ?usize {
+        var i = start;
+        while (i < s.len) : (i += 1) {
+            if (s[i] == byte) return i;
+        }
+        return null;
+    }
+
+    pub fn utf8ValidPrefix(s: []const u8) usize {
+        var i: usize = 0;
+        while (i < s.len) i += sequenceLen(s[i..]) orelse return i;
+        return i;
+    }
+
+    // Length of the valid UTF-8 sequence starting at s[0], or null when it
+    // is malformed, overlong, a surrogate, above U+10FFFF or truncated.
+    pub fn sequenceLen(s: []const u8) ?usize {
+        const b0 = s[0];
+        if (b0 < 0x80) return 1;
+        const n: usize = switch (b0) {
+            0xC2...0xDF => 2,
+            0xE0...0xEF => 3,
+            0xF0...0xF4 => 4,
+            else => return null,
+        };
+        if (s.len < n) return null;
+        // Second-byte ranges exclude overlongs, surrogates and > U+10FFFF.
+        const lo: u8, const hi: u8 = switch (b0) {
+            0xE0 => .{ 0xA0, 0xBF },
+            0xED => .{ 0x80, 0x9F },
+            0xF0 => .{ 0x90, 0xBF },
+            0xF4 => .{ 0x80, 0x8F },
+            else => .{ 0x80, 0xBF },
+        };
+        if (s[1] < lo or s[1] > hi) return null;
+        for (s[2..n]) |b| {
+            if (b & 0xC0 != 0x80) return null;
+        }
+        return n;
+    }
+};
+
+// ---------------------------------------------------------------------------
+// Tests: vector paths against the scalar versions and std, on random input
+// biased towards the bytes each kernel looks for.
+
+// Random text of `len` bytes: ASCII with newlines, quotes, backslashes,
+// control bytes and valid multi-byte sequences mixed in, plus (when
+// `invalid`) stray high bytes.
+fn fuzzText(rng: std.Random, buf: []u8, invalid: bool) []u8 {
+    var i: usize = 0;
+    var one: [1]u8 = undefined;
+    while (i < buf.len) {
+        const pick = rng.uintLessThan(u8, 20);
+        one[0] = switch (pick) {
+            3 => rng.uintLessThan(u8, 0x20),
+            7 => if (invalid) 0x80 | rng.int(u8) else 'x',
+            else => 0x20 + rng.uintLessThan(u8, 0x5F),
+        };
+        const seq: []const u8 = switch (pick) {
+            0 => "\n",
+            1 => "\"",
+            2 => "\\",
+            4 => "\xc3\xa9",
+            5 => "\xe2\x82\xac",
+            6 => "\xf0\x9f\x98\x80",
+            else => &one,
+        };
+        if (i + seq.len > buf.len) break;
+        @memcpy(buf[i..][0..seq.len], seq);
+        i += seq.len;
+    }
+    return buf[0..i];
+}
+
+test "byte search matches the scalar versions" {
+    var prng = std.Random.DefaultPrng.init(0x13);
+    const rng = prng.random();
+    var buf: [300]u8 = undefined;
+    for (0..2000) |_| {
+        const s = fuzzText(rng, buf[0..rng.uintAtMost(usize, buf.len)], true);
+        for ([_]u8{ '\n', '"', 0xC3 }) |b| {
+            try std.testing.expectEqual(scalar.countByte(s, b), countByte(s, b));
+            const start = rng.uintAtMost(usize, s.len);
+            try std.testing.expectEqual(scalar.indexOfBytePos(s, start, b), indexOfBytePos(s, start, b));
+        }
+    }
+}
+
+test "CRLF conversion matches a bytewise copy" {
+    const allocator = std.testing.allocator;
+    var prng = std.Random.DefaultPrng.init(0x0d0a);
+    const rng = prng.random();
+    var buf: [300]u8 = undefined;
+    for (0..1000) |_| {
+        const s = fuzzText(rng, buf[0..rng.uintAtMost(usize, buf.len)], true);
+        var expected: std.ArrayListUnmanaged(u8) = .{};
+        defer expected.deinit(allocator);
+        for (s) |c| {
+            if (c == '\n') try expected.append(allocator, '\r');
+            try expected.append(allocator, c);
+        }
+        const out = try allocator.alloc(u8, crlfLen(s));
+        defer allocator.free(out);
+        toCRLFInto(out, s);
+        try std.testing.expectEqualSlices(u8, expected.items, out);
+    }
+}
+
+test "JSON escaping matches std.json, whole and in pieces" {
+    const allocator = std.testing.allocator;
+    var prng = std.Random.DefaultPrng.init(0x22);
+    const rng = prng.random();
+    var buf: [300]u8 = undefined;
+    for (0..1000) |_| {
+        const s = fuzzText(rng, buf[0..rng.uintAtMost(usize, buf.len)], false);
+        const expected = try std.json.stringifyAlloc(allocator, s, .{});
+        defer allocator.free(expected);
+        const out = try jsonEscapeAlloc(allocator, s);
+        defer allocator.free(out);
+        try std.testing.expectEqualStrings(expected, out);
+
+        // Escapes are per byte, so any split gives the same content.
+        var pieces: [6 * buf.len]u8 = undefined;
+        const cut = rng.uintAtMost(usize, s.len);
+        const w = jsonEscapeContentInto(&pieces, s[0..cut]);
+        const n = w + jsonEscapeContentInto(pieces[w..], s[cut..]);
+        try std.testing.expectEqualStrings(expected[1 .. expected.len - 1], pieces[0..n]);
+    }
+}
+
+test "UTF-8 validation matches the scalar decoder and std.unicode" {
+    var prng = std.Random.DefaultPrng.init(0x8);
+    const rng = prng.random();
+    var buf: [300]u8 = undefined;
+    for (0..2000) |_| {
+        const s = fuzzText(rng, buf[0..rng.uintAtMost(usize, buf.len)], rng.boolean());
+        try std.testing.expectEqual(scalar.utf8ValidPrefix(s), utf8ValidPrefix(s));
+        try std.testing.expectEqual(std.unicode.utf8ValidateSlice(s), utf8Validate(s));
+    }
+    // Overlong, surrogate, above U+10FFFF and truncated sequences.
+    for ([_][]const u8{ "\xc0\xaf", "\xed\xa0\x80", "\xf4\x90\x80\x80", "\xe2\x82" }) |bad| {
+        try std.testing.expect(!utf8Validate(bad));
+        try std.testing.expect(!std.unicode.utf8ValidateSlice(bad));
+    }
+}
@@ -0,0 +1,265 @@
+//! Lightweight span tracing for request timing.
+//! - `begin("http/get")` ... `span.end()` records one complete event with a
+//!   monotonic start time and duration. Span names are string literals;
+//!   the part before '/' is the category.
+//! - Each thread writes into its own fixed-size ring (single producer, no
+//!   locks on the hot path); once full, the oldest events are overwritten.
+//!   A thread takes the registry lock once, on its first event.
+//! - Disabled (the default), `begin` costs one relaxed atomic load and
+//!   `end` a branch; nothing is allocated.
+//! - `writeChromeTrace` exports a Chrome `trace_event` JSON file
+//!   (chrome://tracing, Perfetto); `writeSummary` writes one JSON line per
+//!   span name with count and latency percentiles. Export when the traced
+//!   work is idle: a ring that is written during export may hand back a
+//!   torn copy of its oldest events.
+//! Registered as the `trace` module so the app, the `openai` module and
+//! the batch runner share one registry.
+const std = @import("std");
+
+pub const ring_capacity = 4096;
+
+pub const Event = struct {
+    name: []const u8,
+    start_ns: u64,
+    dur_ns: u64,
+    tid: u32,
+};
+
+const Ring = struct {
+    events: [ring_capacity]Event = undefined,
+    // Events ever written; the next slot is head % ring_capacity. Only the
+    // owning thread stores it (release), exporters load it (acquire).
+    head: std.atomic.Value(u64) = .init(0),
+    tid: u32,
+    next: ?*Ring = null,
+};
+
+var enabled = std.atomic.Value(bool).init(false);
+var base: ?std.time.Instant = null;
+var registry_mutex: std.Thread.Mutex = .{};
+var rings: ?*Ring = null;
+threadlocal var local_ring: ?*Ring = null;
+
+// Rings live until `reset`, so events of finished threads stay exportable.
+const ring_allocator = std.heap.smp_allocator;
+
+// Starts recording. Timestamps count from the first `enable`.
+pub fn enable() void {
+    registry_mutex.lock();
+    if (base == null) base = std.time.Instant.now() catch null;
+    registry_mutex.unlock();
+    enabled.store(true, .release);
+}
+
+pub fn disable() void {
+    enabled.store(false, .release);
+}
+
+pub inline fn isEnabled() bool {
+    return enabled.load(.monotonic);
+}
+
+// Nanoseconds since `enable` on the monotonic clock.
+pub fn now() u64 {
+    const b = base orelse return 0;
+    const t = std.time.Instant.now() catch return 0;
+    return t.since(b);
+}
+
+pub const Span = struct {
+    name: []const u8,
+    // Null when tracing was off at `begin`.
+    start_ns: ?u64,
+
+    pub inline fn end(self: Span) void {
+        const start = self.start_ns orelse return;
+        record(self.name, start, now() -| start);
+    }
+};
+
+pub inline fn begin(comptime name: []const u8) Span {
+    if (!isEnabled()) return .{ .name = name, .start_ns = null };
+    return .{ .name = name, .start_ns = now() };
+}
+
+// Records an event measured elsewhere (e.g. phase times reported by the
+// WinINet adapter). `name` must outlive the registry (a string literal).
+pub fn record(name: []const u8, start_ns: u64, dur_ns: u64) void {
+    if (!isEnabled()) return;
+    const ring = local_ring orelse registerThread() orelse return;
+    const h = ring.head.raw;
+    ring.events[h % ring_capacity] = .{ .name = name, .start_ns = start_ns, .dur_ns = dur_ns, .tid = ring.tid };
+    ring.head.store(h + 1, .release);
+}
+
+fn registerThread() ?*Ring {
+    const ring = ring_allocator.create(Ring) catch return null;
+    ring.* = .{ .tid = @truncate(std.Thread.getCurrentId()) };
+    registry_mutex.lock();
+    ring.next = rings;
+    rings = ring;
+    registry_mutex.unlock();
+    local_ring = ring;
+    return ring;
+}
+
+// Frees every ring. Only call when no traced thread is running (at exit).
+pub fn reset() void {
+    disable();
+    registry_mutex.lock();
+    defer registry_mutex.unlock();
+    while (rings) |r| {
+        rings = r.next;
+        ring_allocator.destroy(r);
+    }
+    local_ring = null;
+}
+
+pub const Snapshot = struct {
+    // Sorted by start time.
+    events: []Event,
+    // Events lost because a ring wrapped.
+    dropped: u64,
+
+    pub fn deinit(self: *Snapshot, allocator: std.mem.Allocator) void {
+        allocator.free(self.events);
+    }
+};
+
+// Copies the events currently held by all rings.
+pub fn snapshot(allocator: std.mem.Allocator) !Snapshot {
+    registry_mutex.lock();
+    defer registry_mutex.unlock();
+
+    var total: usize = 0;
+    var r = rings;
+    while (r) |ring| : (r = ring.next) total += @min(ring.head.load(.acquire), ring_capacity);
+
+    var out = try std.ArrayListUnmanaged(Event).initCapacity(allocator, total);
+    errdefer out.deinit(allocator);
+    var dropped: u64 = 0;
+    r = rings;
+    while (r) |ring| : (r = ring.next) {
+        const h = ring.head.load(.acquire);
+        const n = @min(h, ring_capacity);
+        dropped += h - n;
+        var i = h - n;
+        while (i < h and out.items.len < total) : (i += 1) {
+            out.appendAssumeCapacity(ring.events[i % ring_capacity]);
+        }
+    }
+    std.mem.sort(Event, out.items, {}, struct {
+        fn lessThan(_: void, a: Event, b: Event) bool {
+            return a.start_ns < b.start_ns;
+        }
+    }.lessThan);
+    return .{ .events = try out.toOwnedSlice(allocator), .dropped = dropped };
+}
+
+// Writes a Chrome trace_event file ("X" complete events, microseconds).
+pub fn writeChromeTrace(allocator: std.mem.Allocator, path: []const u8) !void {
+    var snap = try snapshot(allocator);
+    defer snap.deinit(allocator);
+
+    var out: std.ArrayListUnmanaged(u8) = .{};
+    defer out.deinit(allocator);
+    try out.appendSlice(allocator, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    var buf: [256]u8 = undefined;
+    for (snap.events, 0..) |e, i| {
+        const line = try std.fmt.bufPrint(&buf,
+            \\{{"name":"{s}","cat":"{s}","ph":"X","pid":1,"tid":{d},"ts":{d}.{d:0>3},"dur":{d}.{d:0>3}}}{s}
+            \\
+        , .{
+            e.name,              category(e.name),
+            e.tid,               e.start_ns / 1000,
+            e.start_ns % 1000,   e.dur_ns / 1000,
+            e.dur_ns % 1000,     if (i + 1 < snap.events.len) "," else "",
+        });
+        try out.appendSlice(allocator, line);
+    }
+    try out.appendSlice(allocator, "]}\n");
+    try std.fs.cwd().writeFile(.{ .sub_path = path, .data = out.items });
+}
+
+// Writes one JSON line per span name:
+// {"name","cat","count","total_us","mean_us","p50_us","p99_us","max_us"}
+// plus a final {"dropped":N} line.
+pub fn writeSummary(allocator: std.mem.Allocator, path: []const u8) !void {
+    var snap = try snapshot(allocator);
+    defer snap.deinit(allocator);
+
+    // Group by name (names are literals, but compare by content anyway).
+    std.mem.sort(Event, snap.events, {}, struct {
+        fn lessThan(_: void, a: Event, b: Event) bool {
+            return switch (std.mem.order(u8, a.name, b.name)) {
+                .lt => true,
+                .gt => false,
+                .eq => a.dur_ns < b.dur_ns,
+            };
+        }
+    }.lessThan);
+
+    var out: std.ArrayListUnmanaged(u8) = .{};
+    defer out.deinit(allocator);
+    var buf: [320]u8 = undefined;
+    var i: usize = 0;
+    while (i < snap.events.len) {
+        var j = i;
+        var total: u64 = 0;
+        while (j < snap.events.len and std.mem.eql(u8, snap.events[j].name, snap.events[i].name)) : (j += 1) {
+            total += snap.events[j].dur_ns;
+        }
+        const group = snap.events[i..j];
+        const line = try std.fmt.bufPrint(&buf,
+            \\{{"name":"{s}","cat":"{s}","count":{d},"total_us":{d},"mean_us":{d},"p50_us":{d},"p99_us":{d},"max_us":{d}}}
+            \\
+        , .{
+            group[0].name,
+            category(group[0].name),
+            group.len,
+            total / 1000,
+            total / group.len / 1000,
+            percentile(group, 50) / 1000,
+            percentile(group, 99) / 1000,
+            group[group.len - 1].dur_ns / 1000,
+        });
+        try out.appendSlice(allocator, line);
+        i = j;
+    }
+    const tail = try std.fmt.bufPrint(&buf, "{{\"dropped\":{d}}}\n", .{snap.dropped});
+    try out.appendSlice(allocator, tail);
+    try std.fs.cwd().writeFile(.{ .sub_path = path, .data = out.items });
+}
+
+// `group` is sorted by duration.
+fn percentile(group: []const Event, p: usize) u64 {
+    const idx = (group.len - 1) * p / 100;
+    return group[idx].dur_ns;
+}
+
+fn category(name: []const u8) []const u8 {
+    const slash = std.mem.indexOfScalar(u8, name, '/') orelse return name;
+    return name[0..slash];
+}
+
+// Convenience for entry points: when `env_var` (e.g. OHMYZIG_TRACE) holds a
+// path prefix, enables tracing and returns the prefix (caller frees).
+pub fn enableFromEnv(allocator: std.mem.Allocator, env_var: []const u8) ?[]u8 {
+    const prefix = std.process.getEnvVarOwned(allocator, env_var) catch return null;
+    if (prefix.len == 0) {
+        allocator.free(prefix);
+        return null;
+    }
+    enable();
+    return prefix;
+}
+
+// Writes `<prefix>.trace.json` and `<prefix>.jsonl`.
+pub fn exportFiles(allocator: std.mem.Allocator, prefix: []const u8) !void {
+    const trace_path = try std.fmt.allocPrint(allocator, "{s}.trace.json", .{prefix});
+    defer allocator.free(trace_path);
+    const summary_path = try std.fmt.allocPrint(allocator, "{s}.jsonl", .{prefix});
+    defer allocator.free(summary_path);
+    try writeChromeTrace(allocator, trace_path);
+    try writeSummary(allocator, summary_path);
+}
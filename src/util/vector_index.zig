@@ -0,0 +1,336 @@
+const std = @import("std");
+
+// Nearest-neighbour search over unit-length f32 vectors stored row-major
+// (`vectors[i * dims ..][0..dims]`). With unit vectors cosine similarity
+// is the dot product, so every search is a stream of SIMD dot products.
+// - `searchFlat`: exact brute-force top-k.
+// - `Ivf`: coarse inverted-file index for larger sets. Rows are clustered
+//   around `nlist` centroids (spherical k-means); a query scans only the
+//   rows of its `nprobe` nearest clusters. Approximate: recall rises with
+//   nprobe, and nprobe == nlist is exact.
+// No I/O and no global state; the vectors may live in a mapped file.
+
+pub const lanes: usize = std.simd.suggestVectorLength(f32) orelse 4;
+const Vec = @Vector(lanes, f32);
+
+pub fn dot(a: []const f32, b: []const f32) f32 {
+    std.debug.assert(a.len == b.len);
+    // Two accumulators keep two multiply-adds in flight.
+    var acc0: Vec = @splat(0);
+    var acc1: Vec = @splat(0);
+    var i: usize = 0;
+    while (i + 2 * lanes <= a.len) : (i += 2 * lanes) {
+        acc0 = @mulAdd(Vec, a[i..][0..lanes].*, b[i..][0..lanes].*, acc0);
+        acc1 = @mulAdd(Vec, a[i + lanes ..][0..lanes].*, b[i + lanes ..][0..lanes].*, acc1);
+    }
+    if (i + lanes <= a.len) {
+        acc0 = @mulAdd(Vec, a[i..][0..lanes].*, b[i..][0..lanes].*, acc0);
+        i += lanes;
+    }
+    var sum = @reduce(.Add, acc0 + acc1);
+    while (i < a.len) : (i += 1) sum += a[i] * b[i];
+    return sum;
+}
+
+// Scales `v` to unit length (left as is when all zero).
+pub fn normalize(v: []f32) void {
+    const len = @sqrt(dot(v, v));
+    if (len == 0) return;
+    for (v) |*x| x.* /= len;
+}
+
+pub const Hit = struct {
+    index: u32,
+    score: f32,
+};
+
+// Best `hits.len` results seen so far, highest score first. Insertion into
+// a sorted array: k is small, and most candidates are rejected by one
+// comparison against the current minimum.
+pub const TopK = struct {
+    hits: []Hit,
+    len: usize = 0,
+
+    pub fn init(buf: []Hit) TopK {
+        return .{ .hits = buf };
+    }
+
+    pub fn push(self: *TopK, index: u32, score: f32) void {
+        if (self.hits.len == 0) return;
+        if (self.len == self.hits.len) {
+            if (score <= self.hits[self.len - 1].score) return;
+            self.len -= 1;
+        }
+        var i = self.len;
+        while (i > 0 and self.hits[i - 1].score < score) : (i -= 1) self.hits[i] = self.hits[i - 1];
+        self.hits[i] = .{ .index = index, .score = score };
+        self.len += 1;
+    }
+
+    pub fn items(self: *const TopK) []Hit {
+        return self.hits[0..self.len];
+    }
+};
+
+// Exact top-k by cosine similarity. `query` must be unit length. Returns
+// the filled prefix of `out` (k = out.len).
+pub fn searchFlat(vectors: []const f32, dims: usize, query: []const f32, out: []Hit) []Hit {
+    std.debug.assert(query.len == dims);
+    var top = TopK.init(out);
+    const count = vectors.len / dims;
+    for (0..count) |i| top.push(@intCast(i), dot(vectors[i * dims ..][0..dims], query));
+    return top.items();
+}
+
+pub const Ivf = struct {
+    allocator: std.mem.Allocator,
+    dims: usize,
+    // nlist x dims, unit length.
+    centroids: []f32,
+    // Rows of list i: members[offsets[i]..offsets[i + 1]].
+    offsets: []u32,
+    members: []u32,
+
+    // Upper bound on `nprobe` (the probe list lives on the stack).
+    pub const max_probe = 256;
+
+    pub const Options = struct {
+        // Clusters; 0 picks sqrt(count), the usual balance between
+        // centroid scoring and list scanning.
+        nlist: usize = 0,
+        iterations: u32 = 8,
+        // k-means trains on at most this many rows per cluster (sampled),
+        // then assigns every row once.
+        train_rows_per_list: usize = 64,
+        // Seeds centroid selection, so a build is reproducible.
+        seed: u64 = 0x5eed,
+    };
+
+    pub fn build(allocator: std.mem.Allocator, vectors: []const f32, dims: usize, options: Options) !Ivf {
+        const count = vectors.len / dims;
+        if (count == 0) return error.EmptyIndex;
+        var nlist = if (options.nlist > 0) options.nlist else std.math.sqrt(count);
+        nlist = std.math.clamp(nlist, 1, count);
+
+        const centroids = try allocator.alloc(f32, nlist * dims);
+        errdefer allocator.free(centroids);
+        var prng = std.Random.DefaultPrng.init(options.seed);
+        const random = prng.random();
+
+        // Training sample: a random subset of distinct rows (partial
+        // Fisher-Yates), all rows when the set is small.
+        const order = try allocator.alloc(u32, count);
+        defer allocator.free(order);
+        for (order, 0..) |*r, i| r.* = @intCast(i);
+        const sample_len = @max(nlist, @min(count, nlist * options.train_rows_per_list));
+        for (0..sample_len) |i| {
+            const j = random.intRangeLessThan(usize, i, count);
+            std.mem.swap(u32, &order[i], &order[j]);
+        }
+        const sample = order[0..sample_len];
+
+        // Seed centroids with the first nlist sampled rows.
+        for (0..nlist) |c| {
+            @memcpy(centroids[c * dims ..][0..dims], vectors[@as(usize, sample[c]) * dims ..][0..dims]);
+        }
+
+        const sums = try allocator.alloc(f32, nlist * dims);
+        defer allocator.free(sums);
+        const sizes = try allocator.alloc(u32, nlist);
+        defer allocator.free(sizes);
+        for (0..options.iterations) |_| {
+            @memset(sums, 0);
+            @memset(sizes, 0);
+            for (sample) |r| {
+                const row = vectors[@as(usize, r) * dims ..][0..dims];
+                const c = nearest(centroids, dims, row);
+                const sum = sums[c * dims ..][0..dims];
+                for (sum, row) |*s, x| s.* += x;
+                sizes[c] += 1;
+            }
+            for (0..nlist) |c| {
+                const centroid = centroids[c * dims ..][0..dims];
+                if (sizes[c] == 0) {
+                    // Empty cluster: restart it on a random row.
+                    const r = random.uintLessThan(usize, count);
+                    @memcpy(centroid, vectors[r * dims ..][0..dims]);
+                    continue;
+                }
+                @memcpy(centroid, sums[c * dims ..][0..dims]);
+                normalize(centroid);
+            }
+        }
+
+        // Final assignment of every row, then group rows by list.
+        const assign = try allocator.alloc(u32, count);
+        defer allocator.free(assign);
+        const offsets = try allocator.alloc(u32, nlist + 1);
+        errdefer allocator.free(offsets);
+        @memset(offsets, 0);
+        for (0..count) |i| {
+            const c = nearest(centroids, dims, vectors[i * dims ..][0..dims]);
+            assign[i] = @intCast(c);
+            offsets[c + 1] += 1;
+        }
+        for (1..nlist + 1) |c| offsets[c] += offsets[c - 1];
+        const members = try allocator.alloc(u32, count);
+        errdefer allocator.free(members);
+        @memset(sizes, 0);
+        for (assign, 0..) |c, i| {
+            members[offsets[c] + sizes[c]] = @intCast(i);
+            sizes[c] += 1;
+        }
+
+        return .{ .allocator = allocator, .dims = dims, .centroids = centroids, .offsets = offsets, .members = members };
+    }
+
+    pub fn deinit(self: *Ivf) void {
+        self.allocator.free(self.centroids);
+        self.allocator.free(self.offsets);
+        self.allocator.free(self.members);
+    }
+
+    pub fn listCount(self: *const Ivf) usize {
+        return self.offsets.len - 1;
+    }
+
+    // Approximate top-k: scans the rows of the `nprobe` clusters nearest to
+    // `query` (unit length). `vectors` must be the rows the index was built
+    // from. Returns the filled prefix of `out`.
+    pub fn search(self: *const Ivf, vectors: []const f32, query: []const f32, nprobe: usize, out: []Hit) []Hit {
+        const dims = self.dims;
+        var probe_buf: [max_probe]Hit = undefined;
+        var probes = TopK.init(probe_buf[0..@min(@max(nprobe, 1), max_probe, self.listCount())]);
+        for (0..self.listCount()) |c| probes.push(@intCast(c), dot(self.centroids[c * dims ..][0..dims], query));
+
+        var top = TopK.init(out);
+        for (probes.items()) |p| {
+            for (self.members[self.offsets[p.index]..self.offsets[p.index + 1]]) |r| {
+                top.push(r, dot(vectors[@as(usize, r) * dims ..][0..dims], query));
+            }
+        }
+        return top.items();
+    }
+
+    fn nearest(centroids: []const f32, dims: usize, row: []const f32) usize {
+        var best: usize = 0;
+        var best_score = -std.math.inf(f32);
+        for (0..centroids.len / dims) |c| {
+            const s = dot(centroids[c * dims ..][0..dims], row);
+            if (s > best_score) {
+                best_score = s;
+                best = c;
+            }
+        }
+        return best;
+    }
+};
+
+// Reference implementations for the bench equivalence check.
+pub const scalar = struct {
+    pub fn dot(a: []const f32, b: []const f32) f32 {
+        var sum: f32 = 0;
+        for (a, b) |x, y| sum += x * y;
+        return sum;
+    }
+};
+
+// `count` unit rows of `dims` values around `clusters` seeded centres, so
+// IVF lists are meaningful. Same seed, same rows.
+fn fixtureVectors(allocator: std.mem.Allocator, count: usize, dims: usize, clusters: usize, seed: u64) ![]f32 {
+    var prng = std.Random.DefaultPrng.init(seed);
+    const rng = prng.random();
+    const centres = try allocator.alloc(f32, clusters * dims);
+    defer allocator.free(centres);
+    for (centres) |*x| x.* = rng.floatNorm(f32);
+    const out = try allocator.alloc(f32, count * dims);
+    for (0..count) |i| {
+        const row = out[i * dims ..][0..dims];
+        const centre = centres[(i % clusters) * dims ..][0..dims];
+        for (row, centre) |*x, c| x.* = c + 0.3 * rng.floatNorm(f32);
+        normalize(row);
+    }
+    return out;
+}
+
+test "SIMD dot matches the scalar reference at every tail length" {
+    var prng = std.Random.DefaultPrng.init(18);
+    const rng = prng.random();
+    var a: [4 * lanes + 3]f32 = undefined;
+    var b: [4 * lanes + 3]f32 = undefined;
+    for (&a, &b) |*x, *y| {
+        x.* = rng.float(f32) * 2 - 1;
+        y.* = rng.float(f32) * 2 - 1;
+    }
+    for (0..a.len + 1) |n| {
+        const want = scalar.dot(a[0..n], b[0..n]);
+        try std.testing.expectApproxEqAbs(want, dot(a[0..n], b[0..n]), 1e-4);
+    }
+}
+
+test "flat search ranks a hand-checked fixture" {
+    // Four unit rows in 3-D; the query lies between rows 0 and 2, nearer 0.
+    const s = std.math.sqrt1_2;
+    const vectors = [_]f32{
+        1, 0,  0,
+        0, 1,  0,
+        s, 0,  s,
+        0, 0,  -1,
+    };
+    var query = [_]f32{ 0.9, 0, 0.3 };
+    normalize(&query);
+    var out: [3]Hit = undefined;
+    const hits = searchFlat(&vectors, 3, &query, &out);
+    try std.testing.expectEqual(@as(usize, 3), hits.len);
+    try std.testing.expectEqual(@as(u32, 0), hits[0].index);
+    try std.testing.expectEqual(@as(u32, 2), hits[1].index);
+    try std.testing.expectEqual(@as(u32, 1), hits[2].index);
+    try std.testing.expectApproxEqAbs(@sqrt(@as(f32, 0.9)), hits[0].score, 1e-5);
+    try std.testing.expectApproxEqAbs(@as(f32, 0), hits[2].score, 1e-6);
+
+    // k above the row count returns every row.
+    var all: [8]Hit = undefined;
+    try std.testing.expectEqual(@as(usize, 4), searchFlat(&vectors, 3, &query, &all).len);
+}
+
+test "IVF probing every list is exact" {
+    const allocator = std.testing.allocator;
+    const dims = 24;
+    const vectors = try fixtureVectors(allocator, 600, dims, 12, 0xf1a7);
+    defer allocator.free(vectors);
+    var ivf = try Ivf.build(allocator, vectors, dims, .{ .nlist = 12 });
+    defer ivf.deinit();
+    try std.testing.expectEqual(@as(usize, 12), ivf.listCount());
+    try std.testing.expectEqual(@as(u32, 600), ivf.offsets[ivf.listCount()]);
+
+    const queries = try fixtureVectors(allocator, 20, dims, 12, 0x9e7);
+    defer allocator.free(queries);
+    for (0..20) |q| {
+        const query = queries[q * dims ..][0..dims];
+        var exact_buf: [10]Hit = undefined;
+        var ivf_buf: [10]Hit = undefined;
+        const exact = searchFlat(vectors, dims, query, &exact_buf);
+        const approx = ivf.search(vectors, query, ivf.listCount(), &ivf_buf);
+        try std.testing.expectEqual(exact.len, approx.len);
+        for (exact, approx) |e, a| {
+            try std.testing.expectEqual(e.index, a.index);
+            try std.testing.expectEqual(e.score, a.score);
+        }
+    }
+}
+
+test "IVF build is reproducible for a seed" {
+    const allocator = std.testing.allocator;
+    const dims = 16;
+    const vectors = try fixtureVectors(allocator, 300, dims, 6, 0xabc);
+    defer allocator.free(vectors);
+    var first = try Ivf.build(allocator, vectors, dims, .{});
+    defer first.deinit();
+    var second = try Ivf.build(allocator, vectors, dims, .{});
+    defer second.deinit();
+    // nlist 0 picks sqrt(count).
+    try std.testing.expectEqual(@as(usize, 17), first.listCount());
+    try std.testing.expectEqualSlices(f32, first.centroids, second.centroids);
+    try std.testing.expectEqualSlices(u32, first.offsets, second.offsets);
+    try std.testing.expectEqualSlices(u32, first.members, second.members);
+}